@@ -0,0 +1,102 @@
+/**
+ * @file admission.h
+ * @brief Header for Work Queue Admission Control
+ *
+ * This header file provides the interface for deciding what happens to a
+ * request that arrives while the work queue is at its admission limit
+ * ('--max-queue-depth'). Bounding the queue keeps queueing delay, and so
+ * tail latency, bounded when clients send faster than the pool can compute,
+ * and keeps memory flat instead of growing with the backlog.
+ *
+ */
+#ifndef _ADMISSION_H
+#define _ADMISSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @enum overload_policy
+ * @brief What to do with new work once the queue is at its limit.
+ */
+typedef enum overload_policy
+{
+    OVERLOAD_POLICY_REJECT = 0,   // Answer the new request "busy" at once
+    OVERLOAD_POLICY_SHED_OLDEST,  // Answer the oldest queued request "busy"
+    OVERLOAD_POLICY_BLOCK_ACCEPT, // Stop reading sockets until it drains
+} overload_policy_t;
+
+/**
+ * @enum admission_decision
+ * @brief The action the I/O path should take for one arriving request.
+ */
+typedef enum admission_decision
+{
+    ADMISSION_ACCEPT = 0,  // Enqueue the request
+    ADMISSION_REJECT,      // Reply busy, do not enqueue
+    ADMISSION_SHED_OLDEST, // Dequeue the oldest request and reply busy to
+                           // it, then enqueue the new one
+} admission_decision_t;
+
+/**
+ * @struct admission
+ * @brief Opaque admission controller handle.
+ */
+typedef struct admission admission_t;
+
+/**
+ * @brief Creates an admission controller.
+ *
+ * @param max_depth The queue depth at which the policy fires (>= 1).
+ * @param policy The overload policy.
+ * @return admission_t * - The controller, or NULL on failure.
+ */
+admission_t * admission_create(size_t max_depth, overload_policy_t policy);
+
+/**
+ * @brief Frees an admission controller.
+ *
+ * @param admission_pp Pointer to the controller pointer, set to NULL.
+ */
+void admission_destroy(admission_t ** admission_pp);
+
+/**
+ * @brief Changes the admission limit, for example on a config reload.
+ *
+ * @param admission_p The controller.
+ * @param max_depth The new limit (>= 1).
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int admission_set_max_depth(admission_t * admission_p, size_t max_depth);
+
+/**
+ * @brief Decides what to do with a request that has just been read.
+ *
+ * Under OVERLOAD_POLICY_BLOCK_ACCEPT the request is always accepted, since
+ * it has already been read; the policy acts through
+ * admission_reading_paused() instead. If the enqueue still fails because
+ * the queue itself is full, the caller should reply busy.
+ *
+ * @param admission_p The controller.
+ * @param depth The current queue depth (e.g. from mpmc_queue_size()).
+ * @return admission_decision_t - The action to take.
+ */
+admission_decision_t admission_check(admission_t * admission_p, size_t depth);
+
+/**
+ * @brief Reports whether the I/O path should stop reading from sockets.
+ *
+ * Only OVERLOAD_POLICY_BLOCK_ACCEPT ever pauses. Reading pauses when the
+ * depth reaches the limit and resumes once it has drained to three quarters
+ * of the limit, so the I/O path does not flap on every request. While
+ * paused, unread requests stay in the kernel's socket buffers and TCP flow
+ * control pushes back on the clients.
+ *
+ * @param admission_p The controller.
+ * @param depth The current queue depth.
+ * @return bool - true if reading (and accepting) should be paused.
+ */
+bool admission_reading_paused(admission_t * admission_p, size_t depth);
+
+#endif /* _ADMISSION_H */
+/*** end of file ***/
@@ -0,0 +1,158 @@
+/**
+ * @file admission.c
+ * @brief Work Queue Admission Control
+ *
+ * This file implements the overload policies. The controller holds no
+ * per-request state: the queue depth is read from the queue itself by the
+ * caller, so admitting a request adds no shared writes. The only shared
+ * write is the paused flag, which changes when the queue crosses its
+ * watermarks rather than on every request.
+ */
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "admission.h"
+#include "utilities.h"
+
+/**
+ * @struct admission
+ * @brief Limit, policy and pause state.
+ */
+struct admission
+{
+    atomic_size_t     max_depth; // Depth at which the policy fires
+    overload_policy_t policy;    // What to do at the limit
+    atomic_bool       paused;    // Reading paused (block-accept only)
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Returns the depth at which paused reading resumes.
+ *
+ * @param max_depth The admission limit.
+ * @return The resume watermark, three quarters of the limit, computed
+ * without overflowing for any size_t limit.
+ */
+static size_t resume_depth(size_t max_depth);
+
+// +---------------------------------------------------------------------------+
+// |                              ADMISSION API                                |
+// +---------------------------------------------------------------------------+
+
+admission_t * admission_create(size_t max_depth, overload_policy_t policy)
+{
+    admission_t * admission_p = NULL;
+
+    if ((0 == max_depth) || (OVERLOAD_POLICY_BLOCK_ACCEPT < policy))
+    {
+        print_error("admission_create(): Invalid argument passed.");
+        goto END;
+    }
+
+    admission_p = calloc(1, sizeof(admission_t));
+    if (NULL == admission_p)
+    {
+        print_error("admission_create(): calloc() failed.");
+        goto END;
+    }
+
+    atomic_init(&admission_p->max_depth, max_depth);
+    atomic_init(&admission_p->paused, false);
+    admission_p->policy = policy;
+
+END:
+    return admission_p;
+}
+
+void admission_destroy(admission_t ** admission_pp)
+{
+    if ((NULL == admission_pp) || (NULL == *admission_pp))
+    {
+        return;
+    }
+
+    free(*admission_pp);
+    *admission_pp = NULL;
+}
+
+int admission_set_max_depth(admission_t * admission_p, size_t max_depth)
+{
+    if ((NULL == admission_p) || (0 == max_depth))
+    {
+        print_error("admission_set_max_depth(): Invalid argument passed.");
+        return E_FAILURE;
+    }
+
+    atomic_store_explicit(
+        &admission_p->max_depth, max_depth, memory_order_relaxed);
+    return E_SUCCESS;
+}
+
+admission_decision_t admission_check(admission_t * admission_p, size_t depth)
+{
+    if ((NULL == admission_p) ||
+        (depth < atomic_load_explicit(&admission_p->max_depth,
+                                      memory_order_relaxed)))
+    {
+        return ADMISSION_ACCEPT;
+    }
+
+    switch (admission_p->policy)
+    {
+        case OVERLOAD_POLICY_REJECT:
+            return ADMISSION_REJECT;
+
+        case OVERLOAD_POLICY_SHED_OLDEST:
+            return ADMISSION_SHED_OLDEST;
+
+        case OVERLOAD_POLICY_BLOCK_ACCEPT:
+        default:
+            return ADMISSION_ACCEPT;
+    }
+}
+
+bool admission_reading_paused(admission_t * admission_p, size_t depth)
+{
+    size_t max_depth = 0;
+    bool   paused    = false;
+
+    if ((NULL == admission_p) ||
+        (OVERLOAD_POLICY_BLOCK_ACCEPT != admission_p->policy))
+    {
+        return false;
+    }
+
+    max_depth = atomic_load_explicit(&admission_p->max_depth,
+                                     memory_order_relaxed);
+    paused = atomic_load_explicit(&admission_p->paused, memory_order_relaxed);
+
+    // Only store on a transition so that the common case stays read-only
+    if ((false == paused) && (depth >= max_depth))
+    {
+        paused = true;
+        atomic_store_explicit(&admission_p->paused, true, memory_order_relaxed);
+    }
+    else if ((true == paused) && (depth <= resume_depth(max_depth)))
+    {
+        paused = false;
+        atomic_store_explicit(
+            &admission_p->paused, false, memory_order_relaxed);
+    }
+
+    return paused;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static size_t resume_depth(size_t max_depth)
+{
+    // Rounded down, so a limit of 1 resumes only once the queue is empty
+    return (max_depth / 4) * 3 + ((max_depth % 4) * 3) / 4;
+}
+
+/*** end of file ***/
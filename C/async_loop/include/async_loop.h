@@ -0,0 +1,153 @@
+/**
+ * @file async_loop.h
+ * @brief Header for the Asynchronous Connection Loop
+ *
+ * This header file provides the interface for '--exec-mode async'. One loop
+ * thread owns many non-blocking connections. It reads and decodes request
+ * frames, hands each request to the caller (typically by enqueueing it on
+ * the thread pool) and writes the replies as workers complete them. No
+ * worker ever touches a socket, so a client that reads its replies slowly
+ * stalls only its own connection: its replies wait in that connection's
+ * output buffer and, once the pipeline limit is reached, the loop simply
+ * stops reading from it until it catches up.
+ *
+ * Each connection is a small state machine that is resumed whenever its
+ * socket becomes ready or one of its requests completes:
+ *
+ *   READING --(pipeline or output full)--> PAUSED --(drained)--> READING
+ *      |                                     |
+ *      +----(peer closed / bad frame)--------+--> DRAINING --> closed
+ *
+ * A DRAINING connection is closed once every request it submitted has
+ * completed and its replies have been written.
+ *
+ */
+#ifndef _ASYNC_LOOP_H
+#define _ASYNC_LOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wire_protocol.h"
+
+#define ASYNC_MAX_PIPELINE 16 // Requests in flight per connection
+#define ASYNC_MAX_PAYLOAD  16 // Largest reply payload, in bytes
+
+/**
+ * @struct async_loop
+ * @brief Opaque loop handle.
+ */
+typedef struct async_loop async_loop_t;
+
+/**
+ * Identifies one request in flight: the connection it arrived on and the
+ * reply slot reserved for it. A token is valid from the submit call until
+ * its async_loop_complete(); a connection is not closed while any of its
+ * tokens are outstanding.
+ */
+typedef uint64_t async_token_t;
+
+/**
+ * @brief Hands one decoded request to the caller.
+ *
+ * Called on the loop thread, so it must not block. The frame, including its
+ * payload, is only valid for the duration of the call.
+ *
+ * @param context_p The context given to async_loop_create().
+ * @param token The request's token, to be passed to async_loop_complete().
+ * @param frame_p The request.
+ * @return int - E_SUCCESS if the request was accepted, in which case exactly
+ * one async_loop_complete() must follow, otherwise E_FAILURE and the loop
+ * replies WIRE_REPLY_BUSY itself.
+ */
+typedef int (*async_submit_t)(void *               context_p,
+                              async_token_t        token,
+                              const wire_frame_t * frame_p);
+
+/**
+ * @brief Creates a loop for up to 'max_connections' connections.
+ *
+ * All memory is allocated here: each connection gets an input and an output
+ * buffer of 'buffer_size' bytes and ASYNC_MAX_PIPELINE reply slots. A
+ * request is only read once its reply is sure to fit, so completing it
+ * never allocates and never fails for lack of space.
+ *
+ * @param max_connections The most connections open at once.
+ * @param buffer_size The size of each connection buffer; a request frame
+ * larger than this closes its connection. Must be at least
+ * ASYNC_MAX_PIPELINE replies of ASYNC_MAX_PAYLOAD bytes.
+ * @param submit The function requests are handed to.
+ * @param context_p Passed to 'submit'.
+ * @return async_loop_t * - The new loop, or NULL on failure.
+ */
+async_loop_t * async_loop_create(size_t         max_connections,
+                                 size_t         buffer_size,
+                                 async_submit_t submit,
+                                 void *         context_p);
+
+/**
+ * @brief Closes every connection, destroys a loop and sets the caller's
+ * pointer to NULL.
+ *
+ * The loop must not be running, and no thread may still complete requests.
+ *
+ * @param loop_pp The address of the loop pointer.
+ */
+void async_loop_destroy(async_loop_t ** loop_pp);
+
+/**
+ * @brief Gives a connected socket to the loop.
+ *
+ * May be called from any thread (typically an acceptor). The loop takes
+ * ownership of the descriptor, makes it non-blocking and closes it when the
+ * connection ends, or at once if the loop is already full.
+ *
+ * @param loop_p The loop.
+ * @param fd The connected socket.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE (the
+ * descriptor is closed).
+ */
+int async_loop_add(async_loop_t * loop_p, int fd);
+
+/**
+ * @brief Completes a request previously accepted by the submit function.
+ *
+ * May be called from any thread (typically a pool worker). The reply is
+ * copied into the request's reply slot and queued to the loop thread, which
+ * writes it, so the caller never waits for the client.
+ *
+ * @param loop_p The loop.
+ * @param token The token the request was submitted with.
+ * @param request_id The request id of the request.
+ * @param status The reply status (see wire_reply_status_t).
+ * @param payload_p The reply payload.
+ * @param length The payload size, at most ASYNC_MAX_PAYLOAD.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int async_loop_complete(async_loop_t * loop_p,
+                        async_token_t  token,
+                        uint32_t       request_id,
+                        uint8_t        status,
+                        const void *   payload_p,
+                        uint32_t       length);
+
+/**
+ * @brief Runs the loop on the calling thread until async_loop_stop().
+ *
+ * @param loop_p The loop.
+ * @return int - Returns E_SUCCESS once stopped, otherwise E_FAILURE.
+ */
+int async_loop_run(async_loop_t * loop_p);
+
+/**
+ * @brief Asks a running loop to return from async_loop_run().
+ *
+ * May be called from any thread. Connections are left open until
+ * async_loop_destroy().
+ *
+ * @param loop_p The loop.
+ */
+void async_loop_stop(async_loop_t * loop_p);
+
+#endif /* _ASYNC_LOOP_H */
+/*** end of file ***/
@@ -0,0 +1,866 @@
+/**
+ * @file async_loop.c
+ * @brief Asynchronous Connection Loop
+ *
+ * This file implements the connection state machines and the epoll loop
+ * that drives them. Everything about a connection is owned by the loop
+ * thread; pool workers only fill in the reply slot they were given and push
+ * it onto a lock-free queue, then poke an eventfd (once per batch, not once
+ * per reply) to wake the loop. The loop drains every completion before it
+ * writes, so replies that finish together leave in a single send().
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "async_loop.h"
+#include "mpmc_queue.h"
+#include "utilities.h"
+
+#define CACHE_LINE_SIZE 64         // Assumed size of a CPU cache line
+#define MAX_EVENTS      256        // epoll events handled per wakeup
+#define WAKE_EVENT      UINT64_MAX // epoll data of the wakeup eventfd
+#define NO_SLOT         UINT32_MAX // End of the free connection list
+#define REPLY_SIZE      (WIRE_HEADER_SIZE + ASYNC_MAX_PAYLOAD)
+#define PIPELINE_FULL   ((1u << ASYNC_MAX_PIPELINE) - 1) // Every slot busy
+
+/**
+ * @enum conn_state
+ * @brief Where a connection's state machine is waiting.
+ */
+typedef enum conn_state
+{
+    CONN_FREE = 0, // Slot unused
+    CONN_READING,  // Waiting for request bytes
+    CONN_PAUSED,   // Waiting for replies to drain before reading more
+    CONN_DRAINING, // No more requests; waiting to finish and close
+} conn_state_t;
+
+/**
+ * @struct async_reply
+ * @brief The reply slot of one request, written by the completing worker.
+ *
+ * Aligned so that workers completing neighbouring requests never share a
+ * cache line.
+ */
+typedef struct async_reply
+{
+    alignas(CACHE_LINE_SIZE) uint32_t request_id; // Echoed in the reply
+    uint32_t length;                              // Payload bytes
+    uint8_t  status;                              // wire_reply_status_t
+    uint8_t  payload[ASYNC_MAX_PAYLOAD];          // Result
+} async_reply_t;
+
+/**
+ * @struct async_conn
+ * @brief One connection; touched only by the loop thread.
+ */
+typedef struct async_conn
+{
+    int          fd;         // Connected socket
+    conn_state_t state;      // Current state
+    uint32_t     busy_mask;  // Reply slots of requests in flight
+    uint32_t     events;     // epoll events registered, 0 if not watched
+    uint32_t     next;       // Next free slot, or next dirty connection
+    bool         dirty;      // Has new replies to write this wakeup
+    bool         failed;     // Socket error; replies are discarded
+    size_t       in_len;     // Received bytes not yet decoded
+    size_t       out_head;   // Offset of the first unsent byte
+    size_t       out_len;    // Bytes waiting to be sent
+    uint8_t *    in_p;       // Input buffer
+    uint8_t *    out_p;      // Output buffer
+} async_conn_t;
+
+/**
+ * @struct async_loop
+ * @brief Connections, reply slots and the queues feeding the loop thread.
+ */
+struct async_loop
+{
+    int             epoll_fd;        // Readiness of sockets and wake_fd
+    int             wake_fd;         // eventfd poked by other threads
+    atomic_bool     wake_pending;    // wake_fd already poked, not yet read
+    atomic_bool     stop;            // async_loop_stop() was called
+    mpmc_queue_t *  adds_p;          // New sockets, as fd + 1
+    mpmc_queue_t *  completions_p;   // Completed async_reply_t pointers
+    async_submit_t  submit;          // Where requests are handed off
+    void *          context_p;       // Passed to 'submit'
+    size_t          max_connections; // Size of 'conns_p'
+    size_t          buffer_size;     // Size of each connection buffer
+    uint32_t        free_head;       // First free connection slot
+    uint32_t        dirty_head;      // First connection with new replies
+    async_conn_t *  conns_p;         // Every connection slot
+    async_reply_t * replies_p;       // ASYNC_MAX_PIPELINE per connection
+    uint8_t *       buffers_p;       // Two buffers per connection
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Wakes the loop thread unless a wakeup is already pending.
+ *
+ * @param loop_p The loop.
+ */
+static void wake_loop(async_loop_t * loop_p);
+
+/**
+ * @brief Handles a wakeup: opens new connections and queues replies.
+ *
+ * @param loop_p The loop.
+ */
+static void handle_wakeup(async_loop_t * loop_p);
+
+/**
+ * @brief Starts the state machine of a new connection.
+ *
+ * @param loop_p The loop.
+ * @param fd The connected socket; closed if no slot is free.
+ */
+static void conn_open(async_loop_t * loop_p, int fd);
+
+/**
+ * @brief Closes a connection and returns its slot to the free list.
+ *
+ * @param loop_p The loop.
+ * @param conn_p The connection.
+ */
+static void conn_close(async_loop_t * loop_p, async_conn_t * conn_p);
+
+/**
+ * @brief Resumes a connection's state machine after anything happened to it.
+ *
+ * Writes what can be written, moves between states and registers the epoll
+ * events the new state waits for.
+ *
+ * @param loop_p The loop.
+ * @param conn_p The connection.
+ */
+static void conn_step(async_loop_t * loop_p, async_conn_t * conn_p);
+
+/**
+ * @brief Reads what the socket has and hands off the requests it holds.
+ *
+ * @param loop_p The loop.
+ * @param conn_p The connection.
+ */
+static void conn_read(async_loop_t * loop_p, async_conn_t * conn_p);
+
+/**
+ * @brief Decodes and submits buffered requests while the connection may.
+ *
+ * @param loop_p The loop.
+ * @param conn_p The connection.
+ */
+static void conn_decode(async_loop_t * loop_p, async_conn_t * conn_p);
+
+/**
+ * @brief Sends buffered replies, as far as the socket accepts them.
+ *
+ * @param conn_p The connection.
+ */
+static void conn_flush(async_conn_t * conn_p);
+
+/**
+ * @brief Checks whether one more request may be read.
+ *
+ * @param loop_p The loop.
+ * @param conn_p The connection.
+ * @return true if a reply slot is free and the output buffer can hold a
+ * reply to every request in flight plus this one, false otherwise.
+ */
+static bool conn_has_credit(async_loop_t * loop_p, async_conn_t * conn_p);
+
+/**
+ * @brief Appends one reply to the output buffer.
+ *
+ * @param loop_p The loop.
+ * @param conn_p The connection.
+ * @param status The reply status.
+ * @param request_id The request being answered.
+ * @param payload_p The payload, or NULL if 'length' is 0.
+ * @param length The payload size.
+ */
+static void conn_append(async_loop_t *  loop_p,
+                        async_conn_t *  conn_p,
+                        uint8_t         status,
+                        uint32_t        request_id,
+                        const uint8_t * payload_p,
+                        uint32_t        length);
+
+/**
+ * @brief Abandons a connection after a socket error.
+ *
+ * @param conn_p The connection.
+ */
+static void conn_fail(async_conn_t * conn_p);
+
+// +---------------------------------------------------------------------------+
+// |                              ASYNC LOOP API                               |
+// +---------------------------------------------------------------------------+
+
+async_loop_t * async_loop_create(size_t         max_connections,
+                                 size_t         buffer_size,
+                                 async_submit_t submit,
+                                 void *         context_p)
+{
+    async_loop_t *     loop_p = NULL;
+    struct epoll_event event  = { 0 };
+
+    if ((0 == max_connections) ||
+        ((NO_SLOT / ASYNC_MAX_PIPELINE) <= max_connections) ||
+        ((ASYNC_MAX_PIPELINE * REPLY_SIZE) > buffer_size) || (NULL == submit))
+    {
+        print_error("async_loop_create(): Invalid argument passed.");
+        goto END;
+    }
+
+    loop_p = calloc(1, sizeof(async_loop_t));
+    if (NULL == loop_p)
+    {
+        print_error("async_loop_create(): calloc() failed.");
+        goto END;
+    }
+
+    loop_p->epoll_fd        = -1;
+    loop_p->wake_fd         = -1;
+    loop_p->submit          = submit;
+    loop_p->context_p       = context_p;
+    loop_p->max_connections = max_connections;
+    loop_p->buffer_size     = buffer_size;
+    loop_p->dirty_head      = NO_SLOT;
+    atomic_init(&loop_p->wake_pending, false);
+    atomic_init(&loop_p->stop, false);
+
+    loop_p->conns_p = calloc(max_connections, sizeof(async_conn_t));
+    loop_p->replies_p =
+        aligned_alloc(CACHE_LINE_SIZE,
+                      max_connections * ASYNC_MAX_PIPELINE *
+                          sizeof(async_reply_t));
+    loop_p->buffers_p = malloc(max_connections * 2 * buffer_size);
+    if ((NULL == loop_p->conns_p) || (NULL == loop_p->replies_p) ||
+        (NULL == loop_p->buffers_p))
+    {
+        print_error("async_loop_create(): Unable to allocate connections.");
+        goto FAIL;
+    }
+
+    // Every reply slot can be queued at once, so completing never fails
+    loop_p->adds_p = mpmc_queue_create(max_connections + 1);
+    loop_p->completions_p =
+        mpmc_queue_create((max_connections * ASYNC_MAX_PIPELINE) + 1);
+    if ((NULL == loop_p->adds_p) || (NULL == loop_p->completions_p))
+    {
+        print_error("async_loop_create(): Unable to create queues.");
+        goto FAIL;
+    }
+
+    for (size_t slot = 0; slot < max_connections; slot++)
+    {
+        loop_p->conns_p[slot].fd    = -1;
+        loop_p->conns_p[slot].in_p  = loop_p->buffers_p + (slot * 2 *
+                                                           buffer_size);
+        loop_p->conns_p[slot].out_p = loop_p->conns_p[slot].in_p + buffer_size;
+        loop_p->conns_p[slot].next  = (uint32_t)(slot + 1);
+    }
+    loop_p->conns_p[max_connections - 1].next = NO_SLOT;
+    loop_p->free_head                         = 0;
+
+    loop_p->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop_p->wake_fd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((-1 == loop_p->epoll_fd) || (-1 == loop_p->wake_fd))
+    {
+        perror("async_loop_create(): epoll_create1()/eventfd()");
+        goto FAIL;
+    }
+
+    event.events   = EPOLLIN;
+    event.data.u64 = WAKE_EVENT;
+    if (-1 == epoll_ctl(loop_p->epoll_fd, EPOLL_CTL_ADD, loop_p->wake_fd,
+                        &event))
+    {
+        perror("async_loop_create(): epoll_ctl()");
+        goto FAIL;
+    }
+
+    goto END;
+
+FAIL:
+    async_loop_destroy(&loop_p);
+END:
+    return loop_p;
+}
+
+void async_loop_destroy(async_loop_t ** loop_pp)
+{
+    async_loop_t * loop_p = NULL;
+    void *         item_p = NULL;
+
+    if ((NULL == loop_pp) || (NULL == *loop_pp))
+    {
+        return;
+    }
+
+    loop_p = *loop_pp;
+
+    for (size_t slot = 0;
+         (NULL != loop_p->conns_p) && (slot < loop_p->max_connections);
+         slot++)
+    {
+        if (CONN_FREE != loop_p->conns_p[slot].state)
+        {
+            close(loop_p->conns_p[slot].fd);
+        }
+    }
+
+    while ((NULL != loop_p->adds_p) &&
+           (E_SUCCESS == mpmc_queue_dequeue(loop_p->adds_p, &item_p)))
+    {
+        close((int)((intptr_t)item_p - 1));
+    }
+
+    if (-1 != loop_p->wake_fd)
+    {
+        close(loop_p->wake_fd);
+    }
+    if (-1 != loop_p->epoll_fd)
+    {
+        close(loop_p->epoll_fd);
+    }
+
+    mpmc_queue_destroy(&loop_p->adds_p);
+    mpmc_queue_destroy(&loop_p->completions_p);
+    free(loop_p->buffers_p);
+    free(loop_p->replies_p);
+    free(loop_p->conns_p);
+    free(loop_p);
+    *loop_pp = NULL;
+}
+
+int async_loop_add(async_loop_t * loop_p, int fd)
+{
+    int exit_code = E_FAILURE;
+
+    if ((NULL == loop_p) || (0 > fd))
+    {
+        print_error("async_loop_add(): Invalid argument passed.");
+        goto END;
+    }
+
+    // fd + 1 so that descriptor 0 is not mistaken for an empty item
+    exit_code = mpmc_queue_enqueue(loop_p->adds_p, (void *)(intptr_t)(fd + 1));
+    if (E_SUCCESS != exit_code)
+    {
+        print_error("async_loop_add(): Too many pending connections.");
+        close(fd);
+        goto END;
+    }
+
+    wake_loop(loop_p);
+END:
+    return exit_code;
+}
+
+int async_loop_complete(async_loop_t * loop_p,
+                        async_token_t  token,
+                        uint32_t       request_id,
+                        uint8_t        status,
+                        const void *   payload_p,
+                        uint32_t       length)
+{
+    int             exit_code = E_FAILURE;
+    async_reply_t * reply_p   = NULL;
+
+    if ((NULL == loop_p) ||
+        ((loop_p->max_connections * ASYNC_MAX_PIPELINE) <= token) ||
+        (ASYNC_MAX_PAYLOAD < length) || ((0 < length) && (NULL == payload_p)))
+    {
+        print_error("async_loop_complete(): Invalid argument passed.");
+        goto END;
+    }
+
+    reply_p             = &loop_p->replies_p[token];
+    reply_p->request_id = request_id;
+    reply_p->status     = status;
+    reply_p->length     = length;
+    if (0 < length)
+    {
+        memcpy(reply_p->payload, payload_p, length);
+    }
+
+    // The queue has room for every reply slot, so this cannot fail for a
+    // token that is really outstanding
+    exit_code = mpmc_queue_enqueue(loop_p->completions_p, reply_p);
+    if (E_SUCCESS != exit_code)
+    {
+        print_error("async_loop_complete(): Completion queue full.");
+        goto END;
+    }
+
+    wake_loop(loop_p);
+END:
+    return exit_code;
+}
+
+int async_loop_run(async_loop_t * loop_p)
+{
+    int                exit_code          = E_FAILURE;
+    int                count              = 0;
+    async_conn_t *     conn_p             = NULL;
+    struct epoll_event events[MAX_EVENTS] = { { 0 } };
+
+    if (NULL == loop_p)
+    {
+        print_error("async_loop_run(): NULL argument passed.");
+        goto END;
+    }
+
+    while (false == atomic_load_explicit(&loop_p->stop, memory_order_acquire))
+    {
+        count = epoll_wait(loop_p->epoll_fd, events, MAX_EVENTS, -1);
+        if (-1 == count)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            perror("async_loop_run(): epoll_wait()");
+            goto END;
+        }
+
+        for (int idx = 0; idx < count; idx++)
+        {
+            if (WAKE_EVENT == events[idx].data.u64)
+            {
+                handle_wakeup(loop_p);
+                continue;
+            }
+
+            // A slot closed earlier in this batch may already be reused;
+            // a spurious readiness event is harmless on a non-blocking fd
+            conn_p = &loop_p->conns_p[events[idx].data.u64];
+            if (CONN_FREE == conn_p->state)
+            {
+                continue;
+            }
+
+            if (0 != (events[idx].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+            {
+                conn_read(loop_p, conn_p);
+            }
+            conn_step(loop_p, conn_p);
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+void async_loop_stop(async_loop_t * loop_p)
+{
+    if (NULL == loop_p)
+    {
+        return;
+    }
+
+    atomic_store_explicit(&loop_p->stop, true, memory_order_release);
+    wake_loop(loop_p);
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static void wake_loop(async_loop_t * loop_p)
+{
+    uint64_t one = 1;
+
+    // Only the first of a burst of completions pays for the write()
+    if (false == atomic_exchange_explicit(
+                     &loop_p->wake_pending, true, memory_order_acq_rel))
+    {
+        if (-1 == write(loop_p->wake_fd, &one, sizeof(one)))
+        {
+            perror("async_loop: write()");
+        }
+    }
+}
+
+static void handle_wakeup(async_loop_t * loop_p)
+{
+    uint64_t        value   = 0;
+    void *          item_p  = NULL;
+    async_reply_t * reply_p = NULL;
+    async_conn_t *  conn_p  = NULL;
+    size_t          index   = 0;
+    uint32_t        slot    = 0;
+
+    if (-1 == read(loop_p->wake_fd, &value, sizeof(value)))
+    {
+        if (EAGAIN != errno)
+        {
+            perror("async_loop: read()");
+        }
+    }
+
+    // Cleared before draining, so anything queued from here on wakes the
+    // loop again rather than waiting for the next unrelated event
+    atomic_store_explicit(&loop_p->wake_pending, false, memory_order_release);
+
+    while (E_SUCCESS == mpmc_queue_dequeue(loop_p->adds_p, &item_p))
+    {
+        conn_open(loop_p, (int)((intptr_t)item_p - 1));
+    }
+
+    while (E_SUCCESS == mpmc_queue_dequeue(loop_p->completions_p, &item_p))
+    {
+        reply_p = item_p;
+        index   = (size_t)(reply_p - loop_p->replies_p);
+        conn_p  = &loop_p->conns_p[index / ASYNC_MAX_PIPELINE];
+
+        conn_p->busy_mask &= ~(1u << (index % ASYNC_MAX_PIPELINE));
+        if (false == conn_p->failed)
+        {
+            conn_append(loop_p,
+                        conn_p,
+                        reply_p->status,
+                        reply_p->request_id,
+                        reply_p->payload,
+                        reply_p->length);
+        }
+
+        if (false == conn_p->dirty)
+        {
+            conn_p->dirty      = true;
+            conn_p->next       = loop_p->dirty_head;
+            loop_p->dirty_head = (uint32_t)(conn_p - loop_p->conns_p);
+        }
+    }
+
+    // Each connection is written once, however many replies it received
+    while (NO_SLOT != loop_p->dirty_head)
+    {
+        slot               = loop_p->dirty_head;
+        conn_p             = &loop_p->conns_p[slot];
+        loop_p->dirty_head = conn_p->next;
+        conn_p->dirty      = false;
+        conn_step(loop_p, conn_p);
+    }
+}
+
+static void conn_open(async_loop_t * loop_p, int fd)
+{
+    async_conn_t *     conn_p = NULL;
+    uint32_t           slot   = loop_p->free_head;
+    int                flags  = 0;
+    struct epoll_event event  = { 0 };
+
+    if (NO_SLOT == slot)
+    {
+        print_error("async_loop: Connection limit reached.");
+        close(fd);
+        return;
+    }
+
+    flags = fcntl(fd, F_GETFL);
+    event.events   = EPOLLIN;
+    event.data.u64 = slot;
+    if ((-1 == flags) || (-1 == fcntl(fd, F_SETFL, flags | O_NONBLOCK)) ||
+        (-1 == epoll_ctl(loop_p->epoll_fd, EPOLL_CTL_ADD, fd, &event)))
+    {
+        perror("async_loop: fcntl()/epoll_ctl()");
+        close(fd);
+        return;
+    }
+
+    conn_p            = &loop_p->conns_p[slot];
+    loop_p->free_head = conn_p->next;
+
+    conn_p->fd        = fd;
+    conn_p->state     = CONN_READING;
+    conn_p->busy_mask = 0;
+    conn_p->events    = EPOLLIN;
+    conn_p->dirty     = false;
+    conn_p->failed    = false;
+    conn_p->in_len    = 0;
+    conn_p->out_head  = 0;
+    conn_p->out_len   = 0;
+}
+
+static void conn_close(async_loop_t * loop_p, async_conn_t * conn_p)
+{
+    if (0 != conn_p->events)
+    {
+        epoll_ctl(loop_p->epoll_fd, EPOLL_CTL_DEL, conn_p->fd, NULL);
+    }
+    close(conn_p->fd);
+
+    conn_p->fd        = -1;
+    conn_p->state     = CONN_FREE;
+    conn_p->next      = loop_p->free_head;
+    loop_p->free_head = (uint32_t)(conn_p - loop_p->conns_p);
+}
+
+static void conn_step(async_loop_t * loop_p, async_conn_t * conn_p)
+{
+    conn_state_t       state  = CONN_FREE;
+    uint32_t           events = 0;
+    int                op     = EPOLL_CTL_MOD;
+    struct epoll_event event  = { 0 };
+
+    if (0 < conn_p->out_len)
+    {
+        conn_flush(conn_p);
+    }
+
+    // Run the state machine until it has to wait for something
+    do
+    {
+        state = conn_p->state;
+        switch (state)
+        {
+            case CONN_READING:
+                if (false == conn_has_credit(loop_p, conn_p))
+                {
+                    conn_p->state = CONN_PAUSED;
+                }
+                break;
+
+            case CONN_PAUSED:
+                // Requests read before pausing may already be waiting
+                if (true == conn_has_credit(loop_p, conn_p))
+                {
+                    conn_p->state = CONN_READING;
+                    conn_decode(loop_p, conn_p);
+                }
+                break;
+
+            case CONN_DRAINING:
+                if ((0 == conn_p->busy_mask) && (0 == conn_p->out_len))
+                {
+                    conn_close(loop_p, conn_p);
+                    return;
+                }
+                break;
+
+            case CONN_FREE:
+            default:
+                return;
+        }
+    } while (state != conn_p->state);
+
+    if (CONN_READING == conn_p->state)
+    {
+        events |= EPOLLIN;
+    }
+    if (0 < conn_p->out_len)
+    {
+        events |= EPOLLOUT;
+    }
+
+    if (events == conn_p->events)
+    {
+        return;
+    }
+
+    // A connection waiting only for completions is taken out of the epoll
+    // set entirely, since EPOLLHUP and EPOLLERR cannot be masked and would
+    // otherwise be reported on every wakeup until it closes
+    if (0 == events)
+    {
+        op = EPOLL_CTL_DEL;
+    }
+    else if (0 == conn_p->events)
+    {
+        op = EPOLL_CTL_ADD;
+    }
+
+    event.events   = events;
+    event.data.u64 = (uint64_t)(conn_p - loop_p->conns_p);
+    if (-1 == epoll_ctl(loop_p->epoll_fd, op, conn_p->fd, &event))
+    {
+        perror("async_loop: epoll_ctl()");
+        conn_fail(conn_p);
+        events = conn_p->events;
+    }
+    conn_p->events = events;
+}
+
+static void conn_read(async_loop_t * loop_p, async_conn_t * conn_p)
+{
+    ssize_t received = 0;
+
+    if (CONN_READING != conn_p->state)
+    {
+        return;
+    }
+
+    received = recv(conn_p->fd,
+                    conn_p->in_p + conn_p->in_len,
+                    loop_p->buffer_size - conn_p->in_len,
+                    0);
+    if (0 < received)
+    {
+        conn_p->in_len += (size_t)received;
+        conn_decode(loop_p, conn_p);
+    }
+    else if (0 == received)
+    {
+        // The client is done sending; answer what it already sent
+        conn_p->state = CONN_DRAINING;
+    }
+    else if ((EAGAIN != errno) && (EWOULDBLOCK != errno) && (EINTR != errno))
+    {
+        conn_fail(conn_p);
+    }
+}
+
+static void conn_decode(async_loop_t * loop_p, async_conn_t * conn_p)
+{
+    size_t        offset   = 0;
+    size_t        consumed = 0;
+    uint32_t      reply    = 0;
+    async_token_t token    = 0;
+    wire_frame_t  frame    = { 0 };
+    wire_status_t status   = WIRE_FRAME_OK;
+
+    while (CONN_READING == conn_p->state)
+    {
+        if (false == conn_has_credit(loop_p, conn_p))
+        {
+            conn_p->state = CONN_PAUSED;
+            break;
+        }
+
+        status = wire_decode_frame(conn_p->in_p + offset,
+                                   conn_p->in_len - offset,
+                                   &frame,
+                                   &consumed);
+        if (WIRE_FRAME_INCOMPLETE == status)
+        {
+            // A frame that fills the whole buffer and is still incomplete
+            // can never be read
+            if ((0 == offset) && (loop_p->buffer_size == conn_p->in_len))
+            {
+                conn_p->state = CONN_DRAINING;
+            }
+            break;
+        }
+
+        if (WIRE_FRAME_INVALID == status)
+        {
+            conn_p->state = CONN_DRAINING;
+            break;
+        }
+
+        offset += consumed;
+
+        // The token names the connection's first free reply slot
+        reply = (uint32_t)__builtin_ctz(~conn_p->busy_mask);
+        token = ((async_token_t)(conn_p - loop_p->conns_p) *
+                 ASYNC_MAX_PIPELINE) +
+                reply;
+        if (E_SUCCESS == loop_p->submit(loop_p->context_p, token, &frame))
+        {
+            conn_p->busy_mask |= (1u << reply);
+        }
+        else
+        {
+            conn_append(loop_p,
+                        conn_p,
+                        WIRE_REPLY_BUSY,
+                        frame.request_id,
+                        NULL,
+                        0);
+        }
+    }
+
+    if (0 < offset)
+    {
+        memmove(conn_p->in_p, conn_p->in_p + offset, conn_p->in_len - offset);
+        conn_p->in_len -= offset;
+    }
+}
+
+static void conn_flush(async_conn_t * conn_p)
+{
+    ssize_t sent = 0;
+
+    sent = send(conn_p->fd,
+                conn_p->out_p + conn_p->out_head,
+                conn_p->out_len,
+                MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (0 <= sent)
+    {
+        conn_p->out_head += (size_t)sent;
+        conn_p->out_len -= (size_t)sent;
+        if (0 == conn_p->out_len)
+        {
+            conn_p->out_head = 0;
+        }
+    }
+    else if ((EAGAIN != errno) && (EWOULDBLOCK != errno) && (EINTR != errno))
+    {
+        conn_fail(conn_p);
+    }
+}
+
+static bool conn_has_credit(async_loop_t * loop_p, async_conn_t * conn_p)
+{
+    size_t in_flight = (size_t)__builtin_popcount(conn_p->busy_mask);
+
+    return ((PIPELINE_FULL != conn_p->busy_mask) &&
+            ((conn_p->out_len + ((in_flight + 1) * REPLY_SIZE)) <=
+             loop_p->buffer_size));
+}
+
+static void conn_append(async_loop_t *  loop_p,
+                        async_conn_t *  conn_p,
+                        uint8_t         status,
+                        uint32_t        request_id,
+                        const uint8_t * payload_p,
+                        uint32_t        length)
+{
+    uint8_t * tail_p = NULL;
+
+    // Credit was checked before the request was read, so the reply fits
+    // once the unsent bytes are moved to the front
+    if ((conn_p->out_head + conn_p->out_len + WIRE_HEADER_SIZE + length) >
+        loop_p->buffer_size)
+    {
+        memmove(conn_p->out_p,
+                conn_p->out_p + conn_p->out_head,
+                conn_p->out_len);
+        conn_p->out_head = 0;
+    }
+
+    tail_p = conn_p->out_p + conn_p->out_head + conn_p->out_len;
+    wire_encode_header(tail_p, status, request_id, length);
+    if (0 < length)
+    {
+        memcpy(tail_p + WIRE_HEADER_SIZE, payload_p, length);
+    }
+    conn_p->out_len += WIRE_HEADER_SIZE + length;
+}
+
+static void conn_fail(async_conn_t * conn_p)
+{
+    conn_p->failed   = true;
+    conn_p->state    = CONN_DRAINING;
+    conn_p->out_head = 0;
+    conn_p->out_len  = 0;
+}
+
+/*** end of file ***/
@@ -0,0 +1,612 @@
+/**
+ * @file test_async_loop.c
+ * @brief Tests for the Asynchronous Connection Loop
+ *
+ * Drives a running loop over UNIX stream socket pairs. A worker thread
+ * completes requests newest first, so replies leave the loop in a different
+ * order from the requests. The tests check that every pipelined request gets
+ * exactly one reply carrying its request id and payload, including when the
+ * client sends far more than ASYNC_MAX_PIPELINE requests before reading any
+ * reply and when several connections are served at once; that a rejected
+ * submit is answered WIRE_REPLY_BUSY; and that a bad frame closes the
+ * connection. Build with -fsanitize=thread to check the hand-off between the
+ * worker and the loop thread as well.
+ *
+ * Usage: test-async-loop
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h> // ntohl
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "async_loop.h"
+#include "utilities.h"
+#include "wire_protocol.h"
+
+#define TEST_CONNECTIONS 8    // Connections the loop is created for
+#define TEST_BUFFER_SIZE 4096 // Bytes per connection buffer
+#define TEST_PAYLOAD     4    // Request payload: the request id again
+#define TEST_REQUESTS    2000 // Requests pipelined by the slow reader
+#define TEST_TIMEOUT_S   5    // Longest wait for a reply
+#define TEST_MAX_PENDING (TEST_CONNECTIONS * ASYNC_MAX_PIPELINE)
+#define TYPE_ECHO        1    // Request the worker echoes
+#define TYPE_REFUSE      2    // Request the submit function refuses
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr,                                                    \
+                    "%s:%d: CHECK(%s) failed\n",                               \
+                    __FILE__,                                                  \
+                    __LINE__,                                                  \
+                    #condition);                                               \
+            goto END;                                                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @struct pending
+ * @brief A submitted request waiting for the worker.
+ */
+typedef struct pending
+{
+    async_token_t token;                 // From the submit call
+    uint32_t      request_id;            // Echoed in the reply
+    uint32_t      length;                // Payload bytes
+    uint8_t       payload[TEST_PAYLOAD]; // Echoed in the reply
+} pending_t;
+
+/**
+ * @struct harness
+ * @brief A running loop, its thread and the worker completing its requests.
+ */
+typedef struct harness
+{
+    async_loop_t *  loop_p;      // The loop under test
+    pthread_t       loop_thread; // Runs async_loop_run()
+    pthread_t       worker;      // Completes requests
+    pthread_mutex_t lock;        // Guards the fields below
+    pthread_cond_t  ready;       // Signalled when 'count' grows or on stop
+    bool            stop;        // The worker should return
+    size_t          count;       // Requests in 'pending'
+    pending_t       pending[TEST_MAX_PENDING];
+} harness_t;
+
+/**
+ * @struct test_case
+ * @brief One named test.
+ */
+typedef struct test_case
+{
+    const char * name_p;               // Printed with the result
+    int (*run)(harness_t * harness_p); // Returns E_SUCCESS if it passed
+} test_case_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Pipelines a few requests and checks their out-of-order replies.
+ */
+static int test_pipeline(harness_t * harness_p);
+
+/**
+ * @brief Sends TEST_REQUESTS requests before reading a single reply.
+ */
+static int test_slow_reader(harness_t * harness_p);
+
+/**
+ * @brief Interleaves requests on every connection the loop allows.
+ */
+static int test_many_connections(harness_t * harness_p);
+
+/**
+ * @brief Checks that a refused request is answered WIRE_REPLY_BUSY.
+ */
+static int test_busy(harness_t * harness_p);
+
+/**
+ * @brief Checks that a frame with a bad magic closes its connection.
+ */
+static int test_bad_frame(harness_t * harness_p);
+
+/**
+ * @brief Creates the loop and starts its thread and the worker.
+ *
+ * @param harness_p The harness to start.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int harness_start(harness_t * harness_p);
+
+/**
+ * @brief Stops and joins both threads and destroys the loop.
+ *
+ * @param harness_p The harness to stop.
+ */
+static void harness_stop(harness_t * harness_p);
+
+/**
+ * @brief Opens a connection to the loop.
+ *
+ * @param harness_p The harness.
+ * @return The client's end of the connection, or -1 on failure.
+ */
+static int harness_connect(harness_t * harness_p);
+
+/**
+ * @brief Submit function: queues echo requests for the worker.
+ */
+static int submit_request(void *               context_p,
+                          async_token_t        token,
+                          const wire_frame_t * frame_p);
+
+/**
+ * @brief Completes queued requests, newest first.
+ *
+ * @param arg_p The harness.
+ * @return NULL.
+ */
+static void * run_worker(void * arg_p);
+
+/**
+ * @brief Runs the loop.
+ *
+ * @param arg_p The harness.
+ * @return NULL.
+ */
+static void * run_loop(void * arg_p);
+
+/**
+ * @brief Sends requests 'first' to 'first + count - 1' on a connection.
+ *
+ * @param fd The client's end.
+ * @param type The request type.
+ * @param first The first request id.
+ * @param count The number of requests.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int send_requests(int fd, uint8_t type, uint32_t first, size_t count);
+
+/**
+ * @brief Reads replies until 'count' have arrived and checks each of them.
+ *
+ * Every request id from 'first' to 'first + count - 1' must be answered
+ * exactly once, with 'status' and, for WIRE_REPLY_OK, its id as payload.
+ *
+ * @param fd The client's end.
+ * @param status The status every reply must carry.
+ * @param first The first request id.
+ * @param count The number of replies.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int read_replies(int fd, uint8_t status, uint32_t first, size_t count);
+
+/**
+ * @brief Reads exactly 'length' bytes.
+ *
+ * @return E_SUCCESS on success, E_FAILURE on end of file or error.
+ */
+static int read_full(int fd, void * buffer_p, size_t length);
+
+int main(void)
+{
+    static const test_case_t tests[] = {
+        { "pipeline", test_pipeline },
+        { "slow-reader", test_slow_reader },
+        { "many-connections", test_many_connections },
+        { "busy", test_busy },
+        { "bad-frame", test_bad_frame },
+    };
+    int         exit_code = E_SUCCESS;
+    harness_t * harness_p = NULL;
+
+    for (size_t idx = 0; idx < sizeof(tests) / sizeof(tests[0]); idx++)
+    {
+        // A fresh loop per test, so a failure cannot leak into the next
+        harness_p = calloc(1, sizeof(*harness_p));
+        if ((NULL != harness_p) && (E_SUCCESS == harness_start(harness_p)) &&
+            (E_SUCCESS == tests[idx].run(harness_p)))
+        {
+            printf("PASS %s\n", tests[idx].name_p);
+        }
+        else
+        {
+            printf("FAIL %s\n", tests[idx].name_p);
+            exit_code = E_FAILURE;
+        }
+
+        if (NULL != harness_p)
+        {
+            harness_stop(harness_p);
+            free(harness_p);
+        }
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int test_pipeline(harness_t * harness_p)
+{
+    int exit_code = E_FAILURE;
+    int fd        = -1;
+
+    fd = harness_connect(harness_p);
+    CHECK(0 <= fd);
+
+    for (uint32_t round = 0; round < 10; round++)
+    {
+        CHECK(E_SUCCESS == send_requests(fd, TYPE_ECHO, round * 12, 12));
+        CHECK(E_SUCCESS == read_replies(fd, WIRE_REPLY_OK, round * 12, 12));
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    if (0 <= fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+static int test_slow_reader(harness_t * harness_p)
+{
+    int exit_code = E_FAILURE;
+    int fd        = -1;
+
+    fd = harness_connect(harness_p);
+    CHECK(0 <= fd);
+
+    // Far beyond the pipeline limit: the loop must pause reading, not drop
+    CHECK(E_SUCCESS == send_requests(fd, TYPE_ECHO, 0, TEST_REQUESTS));
+    CHECK(E_SUCCESS == read_replies(fd, WIRE_REPLY_OK, 0, TEST_REQUESTS));
+
+    exit_code = E_SUCCESS;
+END:
+    if (0 <= fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+static int test_many_connections(harness_t * harness_p)
+{
+    int    exit_code = E_FAILURE;
+    size_t opened    = 0;
+    int    fds[TEST_CONNECTIONS];
+
+    for (; opened < TEST_CONNECTIONS; opened++)
+    {
+        fds[opened] = harness_connect(harness_p);
+        CHECK(0 <= fds[opened]);
+    }
+
+    for (uint32_t round = 0; round < 20; round++)
+    {
+        for (size_t idx = 0; idx < TEST_CONNECTIONS; idx++)
+        {
+            CHECK(E_SUCCESS ==
+                  send_requests(fds[idx], TYPE_ECHO, round * 100, 40));
+        }
+
+        for (size_t idx = 0; idx < TEST_CONNECTIONS; idx++)
+        {
+            CHECK(E_SUCCESS ==
+                  read_replies(fds[idx], WIRE_REPLY_OK, round * 100, 40));
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    for (size_t idx = 0; idx < opened; idx++)
+    {
+        close(fds[idx]);
+    }
+    return exit_code;
+}
+
+static int test_busy(harness_t * harness_p)
+{
+    int exit_code = E_FAILURE;
+    int fd        = -1;
+
+    fd = harness_connect(harness_p);
+    CHECK(0 <= fd);
+
+    CHECK(E_SUCCESS == send_requests(fd, TYPE_REFUSE, 0, 5));
+    CHECK(E_SUCCESS == read_replies(fd, WIRE_REPLY_BUSY, 0, 5));
+
+    // The connection stays usable after refusals
+    CHECK(E_SUCCESS == send_requests(fd, TYPE_ECHO, 5, 5));
+    CHECK(E_SUCCESS == read_replies(fd, WIRE_REPLY_OK, 5, 5));
+
+    exit_code = E_SUCCESS;
+END:
+    if (0 <= fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+static int test_bad_frame(harness_t * harness_p)
+{
+    int     exit_code               = E_FAILURE;
+    int     fd                      = -1;
+    uint8_t byte                    = 0;
+    uint8_t frame[WIRE_HEADER_SIZE] = { 0 };
+
+    fd = harness_connect(harness_p);
+    CHECK(0 <= fd);
+
+    CHECK(E_SUCCESS == send_requests(fd, TYPE_ECHO, 0, 3));
+    CHECK(E_SUCCESS == read_replies(fd, WIRE_REPLY_OK, 0, 3));
+
+    // Not "NC": the loop closes the connection
+    memset(frame, 0xFF, sizeof(frame));
+    CHECK((ssize_t)sizeof(frame) == write(fd, frame, sizeof(frame)));
+    CHECK(0 == read(fd, &byte, 1));
+
+    exit_code = E_SUCCESS;
+END:
+    if (0 <= fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+static int harness_start(harness_t * harness_p)
+{
+    int exit_code = E_FAILURE;
+
+    pthread_mutex_init(&harness_p->lock, NULL);
+    pthread_cond_init(&harness_p->ready, NULL);
+
+    harness_p->loop_p = async_loop_create(
+        TEST_CONNECTIONS, TEST_BUFFER_SIZE, submit_request, harness_p);
+    CHECK(NULL != harness_p->loop_p);
+
+    CHECK(0 == pthread_create(&harness_p->worker, NULL, run_worker, harness_p));
+    if (0 != pthread_create(&harness_p->loop_thread, NULL, run_loop, harness_p))
+    {
+        pthread_mutex_lock(&harness_p->lock);
+        harness_p->stop = true;
+        pthread_cond_signal(&harness_p->ready);
+        pthread_mutex_unlock(&harness_p->lock);
+        pthread_join(harness_p->worker, NULL);
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    if (E_SUCCESS != exit_code)
+    {
+        async_loop_destroy(&harness_p->loop_p);
+    }
+    return exit_code;
+}
+
+static void harness_stop(harness_t * harness_p)
+{
+    if (NULL == harness_p->loop_p)
+    {
+        return;
+    }
+
+    async_loop_stop(harness_p->loop_p);
+    pthread_join(harness_p->loop_thread, NULL);
+
+    pthread_mutex_lock(&harness_p->lock);
+    harness_p->stop = true;
+    pthread_cond_signal(&harness_p->ready);
+    pthread_mutex_unlock(&harness_p->lock);
+    pthread_join(harness_p->worker, NULL);
+
+    async_loop_destroy(&harness_p->loop_p);
+    pthread_cond_destroy(&harness_p->ready);
+    pthread_mutex_destroy(&harness_p->lock);
+}
+
+static int harness_connect(harness_t * harness_p)
+{
+    struct timeval timeout = { .tv_sec = TEST_TIMEOUT_S };
+    int            fds[2]  = { -1, -1 };
+
+    if (0 != socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds))
+    {
+        perror("harness_connect(): socketpair()");
+        return -1;
+    }
+
+    // A reply that never comes fails the test instead of hanging it
+    setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (E_SUCCESS != async_loop_add(harness_p->loop_p, fds[1]))
+    {
+        close(fds[0]);
+        return -1;
+    }
+
+    return fds[0];
+}
+
+static int submit_request(void *               context_p,
+                          async_token_t        token,
+                          const wire_frame_t * frame_p)
+{
+    int         exit_code = E_FAILURE;
+    harness_t * harness_p = context_p;
+    pending_t * pending_p = NULL;
+
+    if ((TYPE_ECHO != frame_p->type) || (TEST_PAYLOAD < frame_p->length))
+    {
+        return E_FAILURE;
+    }
+
+    pthread_mutex_lock(&harness_p->lock);
+    if (TEST_MAX_PENDING > harness_p->count)
+    {
+        pending_p             = &harness_p->pending[harness_p->count++];
+        pending_p->token      = token;
+        pending_p->request_id = frame_p->request_id;
+        pending_p->length     = frame_p->length;
+        memcpy(pending_p->payload, frame_p->payload_p, frame_p->length);
+        pthread_cond_signal(&harness_p->ready);
+        exit_code = E_SUCCESS;
+    }
+    pthread_mutex_unlock(&harness_p->lock);
+
+    return exit_code;
+}
+
+static void * run_worker(void * arg_p)
+{
+    harness_t * harness_p = arg_p;
+    pending_t   pending   = { 0 };
+
+    pthread_mutex_lock(&harness_p->lock);
+    for (;;)
+    {
+        while ((false == harness_p->stop) && (0 == harness_p->count))
+        {
+            pthread_cond_wait(&harness_p->ready, &harness_p->lock);
+        }
+
+        if (true == harness_p->stop)
+        {
+            break;
+        }
+
+        // Newest first, so replies are reordered
+        pending = harness_p->pending[--harness_p->count];
+        pthread_mutex_unlock(&harness_p->lock);
+
+        async_loop_complete(harness_p->loop_p,
+                            pending.token,
+                            pending.request_id,
+                            WIRE_REPLY_OK,
+                            pending.payload,
+                            pending.length);
+
+        pthread_mutex_lock(&harness_p->lock);
+    }
+    pthread_mutex_unlock(&harness_p->lock);
+
+    return NULL;
+}
+
+static void * run_loop(void * arg_p)
+{
+    harness_t * harness_p = arg_p;
+
+    async_loop_run(harness_p->loop_p);
+    return NULL;
+}
+
+static int send_requests(int fd, uint8_t type, uint32_t first, size_t count)
+{
+    uint32_t id                                     = 0;
+    uint8_t  frame[WIRE_HEADER_SIZE + TEST_PAYLOAD] = { 0 };
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        id = first + (uint32_t)idx;
+        wire_encode_header(frame, type, id, TEST_PAYLOAD);
+        memcpy(frame + WIRE_HEADER_SIZE, &id, sizeof(id));
+
+        if ((ssize_t)sizeof(frame) != write(fd, frame, sizeof(frame)))
+        {
+            perror("send_requests(): write()");
+            return E_FAILURE;
+        }
+    }
+
+    return E_SUCCESS;
+}
+
+static int read_replies(int fd, uint8_t status, uint32_t first, size_t count)
+{
+    int          exit_code                               = E_FAILURE;
+    bool *       seen_p                                  = NULL;
+    size_t       consumed                                = 0;
+    uint32_t     echoed                                  = 0;
+    uint32_t     length                                  = 0;
+    wire_frame_t frame                                   = { 0 };
+    uint8_t      buffer[WIRE_HEADER_SIZE + TEST_PAYLOAD] = { 0 };
+
+    seen_p = calloc(count, sizeof(*seen_p));
+    CHECK(NULL != seen_p);
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        // The length is the last header field, in network byte order
+        CHECK(E_SUCCESS == read_full(fd, buffer, WIRE_HEADER_SIZE));
+        memcpy(&length,
+               buffer + WIRE_HEADER_SIZE - sizeof(length),
+               sizeof(length));
+        length = ntohl(length);
+        CHECK(TEST_PAYLOAD >= length);
+        CHECK(E_SUCCESS == read_full(fd, buffer + WIRE_HEADER_SIZE, length));
+        CHECK(WIRE_FRAME_OK ==
+              wire_decode_frame(
+                  buffer, WIRE_HEADER_SIZE + length, &frame, &consumed));
+
+        CHECK(status == frame.type);
+        CHECK((frame.request_id >= first) &&
+              (frame.request_id - first < count));
+        CHECK(false == seen_p[frame.request_id - first]);
+        seen_p[frame.request_id - first] = true;
+
+        if (WIRE_REPLY_OK == status)
+        {
+            CHECK(TEST_PAYLOAD == frame.length);
+            memcpy(&echoed, frame.payload_p, sizeof(echoed));
+            CHECK(frame.request_id == echoed);
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    free(seen_p);
+    return exit_code;
+}
+
+static int read_full(int fd, void * buffer_p, size_t length)
+{
+    size_t  done   = 0;
+    ssize_t result = 0;
+
+    while (done < length)
+    {
+        result = read(fd, (uint8_t *)buffer_p + done, length - done);
+        if ((-1 == result) && (EINTR == errno))
+        {
+            continue;
+        }
+        if (0 >= result)
+        {
+            return E_FAILURE;
+        }
+        done += (size_t)result;
+    }
+
+    return E_SUCCESS;
+}
+
+/*** end of file ***/
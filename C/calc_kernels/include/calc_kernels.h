@@ -0,0 +1,106 @@
+/**
+ * @file calc_kernels.h
+ * @brief Header for the Batched Calculation Kernels
+ *
+ * This header file provides the interface for running one arithmetic
+ * operator over a batch of operand pairs stored as a structure of arrays.
+ * Kernels are vectorized (AVX2/AVX-512 on x86-64, NEON on AArch64) and the
+ * implementation is installed once at server start by calc_kernels_select().
+ *
+ */
+#ifndef _CALC_KERNELS_H
+#define _CALC_KERNELS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @enum simd_level
+ * @brief Instruction set used by the calculation kernels.
+ */
+typedef enum simd_level
+{
+    SIMD_LEVEL_AUTO = 0, // Best level supported by the running CPU
+    SIMD_LEVEL_OFF,      // Portable scalar loops
+    SIMD_LEVEL_AVX2,     // x86-64 AVX2, 8 lanes
+    SIMD_LEVEL_AVX512,   // x86-64 AVX-512F, 16 lanes
+    SIMD_LEVEL_NEON,     // AArch64 Advanced SIMD, 4 lanes
+} simd_level_t;
+
+/**
+ * @enum calc_op
+ * @brief Operators with a batched kernel.
+ */
+typedef enum calc_op
+{
+    CALC_OP_ADD = 0,
+    CALC_OP_SUB,
+    CALC_OP_MUL,
+    CALC_OP_COUNT, // Number of operators, not an operator
+} calc_op_t;
+
+/**
+ * @struct calc_batch
+ * @brief A batch of requests for one operator, as a structure of arrays.
+ *
+ * Results wrap on overflow (two's complement), matching the behaviour of the
+ * SIMD instructions.
+ */
+typedef struct calc_batch
+{
+    const int32_t * lhs_p;    // Left operands
+    const int32_t * rhs_p;    // Right operands
+    int32_t *       result_p; // Results, may alias lhs_p or rhs_p
+    size_t          count;    // Number of operand pairs
+} calc_batch_t;
+
+/**
+ * @brief Converts a SIMD level name ("auto", "off", "avx2", "avx512").
+ *
+ * Nothing is printed for an unknown name, so the caller decides how the
+ * failure is reported.
+ *
+ * @param name_p The level name.
+ * @param level_p Pointer to where the level will be stored.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int calc_kernels_level_from_string(const char * name_p, simd_level_t * level_p);
+
+/**
+ * @brief Checks whether the running CPU supports a SIMD level.
+ *
+ * Unlike calc_kernels_select() this installs nothing, so option parsing can
+ * reject a level up front. SIMD_LEVEL_AUTO is always supported.
+ *
+ * @param level The level.
+ * @return bool - true if calc_kernels_select() would accept the level.
+ */
+bool calc_kernels_level_supported(simd_level_t level);
+
+/**
+ * @brief Selects the kernel implementation used by calc_kernels_run().
+ *
+ * Called once at server start, before any worker runs, with the level the
+ * options ask for; that is SIMD_LEVEL_AUTO when '--simd' was not given, so
+ * the widest level the CPU supports is installed either way. Until then
+ * calc_kernels_run() uses the scalar loops. Requesting a specific level the
+ * CPU does not support fails.
+ *
+ * @param requested The requested level.
+ * @param selected_p Optional pointer to where the chosen level is stored.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int calc_kernels_select(simd_level_t requested, simd_level_t * selected_p);
+
+/**
+ * @brief Runs an operator over every operand pair in a batch.
+ *
+ * @param op The operator to apply.
+ * @param batch_p The batch.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int calc_kernels_run(calc_op_t op, const calc_batch_t * batch_p);
+
+#endif /* _CALC_KERNELS_H */
+/*** end of file ***/
@@ -0,0 +1,367 @@
+/**
+ * @file calc_kernels.c
+ * @brief Batched Calculation Kernels
+ *
+ * This file contains the scalar and SIMD implementations of the batched
+ * operator kernels and the runtime dispatch between them. The x86-64 kernels
+ * are compiled with per-function target attributes so the rest of the
+ * program does not need to be built with -mavx2/-mavx512f, and they are only
+ * selected after __builtin_cpu_supports() confirms the CPU has them. Each
+ * level has one kernel per operator, looked up through a per-level table, so
+ * no vector loop branches on the operator.
+ *
+ * Arithmetic is performed on unsigned values so that overflow wraps instead
+ * of being undefined behaviour, matching what the vector instructions do.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "calc_kernels.h"
+#include "utilities.h"
+
+/**
+ * @brief Signature shared by every kernel implementation. Each kernel applies
+ * one operator, so its loop does not branch on the operator.
+ */
+typedef void (*kernel_fn_t)(const calc_batch_t * batch_p);
+
+/**
+ * @brief Declares the kernels of one SIMD level: '<level>_add',
+ * '<level>_sub' and '<level>_mul'.
+ */
+#define DECLARE_KERNELS(level)                                                 \
+    static void level##_add(const calc_batch_t * batch_p);                     \
+    static void level##_sub(const calc_batch_t * batch_p);                     \
+    static void level##_mul(const calc_batch_t * batch_p)
+
+/**
+ * @brief Lists the kernels of one SIMD level, indexed by calc_op_t.
+ */
+#define KERNEL_TABLE(level)                                                    \
+    {                                                                          \
+        [CALC_OP_ADD] = level##_add, [CALC_OP_SUB] = level##_sub,              \
+        [CALC_OP_MUL] = level##_mul,                                           \
+    }
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Scalar kernels for the whole batch.
+ *
+ * Used when SIMD is off. Each has a '<name>_from' helper, taking the index of
+ * the first element to process, that the vector kernels use for the tail that
+ * does not fill a vector.
+ */
+DECLARE_KERNELS(scalar);
+
+#if defined(__x86_64__)
+/**
+ * @brief AVX2 kernels, 8 x int32 per vector.
+ */
+DECLARE_KERNELS(avx2);
+
+/**
+ * @brief AVX-512F kernels, 16 x int32 per vector.
+ */
+DECLARE_KERNELS(avx512);
+#elif defined(__aarch64__)
+/**
+ * @brief NEON kernels, 4 x int32 per vector.
+ */
+DECLARE_KERNELS(neon);
+#endif
+
+/**
+ * @brief Checks whether the running CPU supports a SIMD level.
+ *
+ * @param level The level to check. SIMD_LEVEL_AUTO is not accepted.
+ * @return Non-zero if supported, 0 otherwise.
+ */
+static int level_supported(simd_level_t level);
+
+static const kernel_fn_t g_scalar_kernels[CALC_OP_COUNT] =
+    KERNEL_TABLE(scalar);
+#if defined(__x86_64__)
+static const kernel_fn_t g_avx2_kernels[CALC_OP_COUNT]   = KERNEL_TABLE(avx2);
+static const kernel_fn_t g_avx512_kernels[CALC_OP_COUNT] =
+    KERNEL_TABLE(avx512);
+#elif defined(__aarch64__)
+static const kernel_fn_t g_neon_kernels[CALC_OP_COUNT] = KERNEL_TABLE(neon);
+#endif
+
+// The kernels of the selected level; written once by calc_kernels_select()
+// before the workers start and only read afterwards.
+static const kernel_fn_t * g_kernels_p = g_scalar_kernels;
+
+// +---------------------------------------------------------------------------+
+// |                             CALC KERNELS API                              |
+// +---------------------------------------------------------------------------+
+
+int calc_kernels_level_from_string(const char * name_p, simd_level_t * level_p)
+{
+    int exit_code = E_FAILURE;
+
+    if ((NULL == name_p) || (NULL == level_p))
+    {
+        print_error("calc_kernels_level_from_string(): NULL argument passed.");
+        goto END;
+    }
+
+    if (0 == strcmp(name_p, "auto"))
+    {
+        *level_p = SIMD_LEVEL_AUTO;
+    }
+    else if (0 == strcmp(name_p, "off"))
+    {
+        *level_p = SIMD_LEVEL_OFF;
+    }
+    else if (0 == strcmp(name_p, "avx2"))
+    {
+        *level_p = SIMD_LEVEL_AVX2;
+    }
+    else if (0 == strcmp(name_p, "avx512"))
+    {
+        *level_p = SIMD_LEVEL_AVX512;
+    }
+    else
+    {
+        // Unknown names are the caller's to report
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+bool calc_kernels_level_supported(simd_level_t level)
+{
+    return ((SIMD_LEVEL_AUTO == level) || (0 != level_supported(level)));
+}
+
+int calc_kernels_select(simd_level_t requested, simd_level_t * selected_p)
+{
+    int          exit_code = E_FAILURE;
+    simd_level_t level     = requested;
+
+    if (SIMD_LEVEL_AUTO == level)
+    {
+        if (level_supported(SIMD_LEVEL_AVX512))
+        {
+            level = SIMD_LEVEL_AVX512;
+        }
+        else if (level_supported(SIMD_LEVEL_AVX2))
+        {
+            level = SIMD_LEVEL_AVX2;
+        }
+        else if (level_supported(SIMD_LEVEL_NEON))
+        {
+            level = SIMD_LEVEL_NEON;
+        }
+        else
+        {
+            level = SIMD_LEVEL_OFF;
+        }
+    }
+
+    if (!level_supported(level))
+    {
+        print_error("calc_kernels_select(): SIMD level not supported by CPU.");
+        goto END;
+    }
+
+    switch (level)
+    {
+#if defined(__x86_64__)
+        case SIMD_LEVEL_AVX2:
+            g_kernels_p = g_avx2_kernels;
+            break;
+        case SIMD_LEVEL_AVX512:
+            g_kernels_p = g_avx512_kernels;
+            break;
+#elif defined(__aarch64__)
+        case SIMD_LEVEL_NEON:
+            g_kernels_p = g_neon_kernels;
+            break;
+#endif
+        default:
+            g_kernels_p = g_scalar_kernels;
+            break;
+    }
+
+    if (NULL != selected_p)
+    {
+        *selected_p = level;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+int calc_kernels_run(calc_op_t op, const calc_batch_t * batch_p)
+{
+    int exit_code = E_FAILURE;
+
+    if ((NULL == batch_p) || (NULL == batch_p->lhs_p) ||
+        (NULL == batch_p->rhs_p) || (NULL == batch_p->result_p))
+    {
+        print_error("calc_kernels_run(): NULL argument passed.");
+        goto END;
+    }
+
+    if ((0 > (int)op) || (CALC_OP_COUNT <= op))
+    {
+        print_error("calc_kernels_run(): Unknown operator.");
+        goto END;
+    }
+
+    g_kernels_p[op](batch_p);
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+/**
+ * @brief Defines the scalar kernel 'scalar_<name>' and its tail helper
+ * 'scalar_<name>_from' for a C operator.
+ */
+#define DEFINE_SCALAR_KERNEL(name, operator)                                   \
+    static void scalar_##name##_from(const calc_batch_t * batch_p,             \
+                                     size_t               start)               \
+    {                                                                          \
+        const uint32_t * lhs_p    = (const uint32_t *)batch_p->lhs_p;          \
+        const uint32_t * rhs_p    = (const uint32_t *)batch_p->rhs_p;          \
+        uint32_t *       result_p = (uint32_t *)batch_p->result_p;             \
+                                                                               \
+        for (size_t idx = start; idx < batch_p->count; idx++)                  \
+        {                                                                      \
+            result_p[idx] = lhs_p[idx] operator rhs_p[idx];                    \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static void scalar_##name(const calc_batch_t * batch_p)                    \
+    {                                                                          \
+        scalar_##name##_from(batch_p, 0);                                      \
+    }
+
+DEFINE_SCALAR_KERNEL(add, +)
+DEFINE_SCALAR_KERNEL(sub, -)
+DEFINE_SCALAR_KERNEL(mul, *)
+
+#if defined(__x86_64__)
+/**
+ * @brief Defines the AVX2 kernel 'avx2_<name>' around one intrinsic.
+ */
+#define DEFINE_AVX2_KERNEL(name, intrinsic)                                    \
+    __attribute__((target("avx2"))) static void avx2_##name(                   \
+        const calc_batch_t * batch_p)                                          \
+    {                                                                          \
+        size_t  idx = 0;                                                       \
+        __m256i lhs;                                                           \
+        __m256i rhs;                                                           \
+                                                                               \
+        for (; (idx + 8) <= batch_p->count; idx += 8)                          \
+        {                                                                      \
+            lhs = _mm256_loadu_si256((const __m256i *)(batch_p->lhs_p + idx)); \
+            rhs = _mm256_loadu_si256((const __m256i *)(batch_p->rhs_p + idx)); \
+            _mm256_storeu_si256((__m256i *)(batch_p->result_p + idx),          \
+                                intrinsic(lhs, rhs));                          \
+        }                                                                      \
+                                                                               \
+        scalar_##name##_from(batch_p, idx);                                    \
+    }
+
+/**
+ * @brief Defines the AVX-512F kernel 'avx512_<name>' around one intrinsic.
+ *
+ * Masked loads and stores handle the tail without a scalar loop.
+ */
+#define DEFINE_AVX512_KERNEL(name, intrinsic)                                  \
+    __attribute__((target("avx512f"))) static void avx512_##name(              \
+        const calc_batch_t * batch_p)                                          \
+    {                                                                          \
+        size_t    idx  = 0;                                                    \
+        __mmask16 mask = 0;                                                    \
+        __m512i   lhs;                                                         \
+        __m512i   rhs;                                                         \
+                                                                               \
+        while (idx < batch_p->count)                                           \
+        {                                                                      \
+            mask = ((batch_p->count - idx) >= 16)                              \
+                       ? (__mmask16)0xFFFF                                     \
+                       : (__mmask16)((1U << (batch_p->count - idx)) - 1);      \
+                                                                               \
+            lhs = _mm512_maskz_loadu_epi32(mask, batch_p->lhs_p + idx);        \
+            rhs = _mm512_maskz_loadu_epi32(mask, batch_p->rhs_p + idx);        \
+            _mm512_mask_storeu_epi32(                                          \
+                batch_p->result_p + idx, mask, intrinsic(lhs, rhs));           \
+            idx += 16;                                                         \
+        }                                                                      \
+    }
+
+DEFINE_AVX2_KERNEL(add, _mm256_add_epi32)
+DEFINE_AVX2_KERNEL(sub, _mm256_sub_epi32)
+DEFINE_AVX2_KERNEL(mul, _mm256_mullo_epi32)
+
+DEFINE_AVX512_KERNEL(add, _mm512_add_epi32)
+DEFINE_AVX512_KERNEL(sub, _mm512_sub_epi32)
+DEFINE_AVX512_KERNEL(mul, _mm512_mullo_epi32)
+#elif defined(__aarch64__)
+/**
+ * @brief Defines the NEON kernel 'neon_<name>' around one intrinsic.
+ */
+#define DEFINE_NEON_KERNEL(name, intrinsic)                                    \
+    static void neon_##name(const calc_batch_t * batch_p)                      \
+    {                                                                          \
+        size_t idx = 0;                                                        \
+                                                                               \
+        for (; (idx + 4) <= batch_p->count; idx += 4)                          \
+        {                                                                      \
+            vst1q_s32(batch_p->result_p + idx,                                 \
+                      intrinsic(vld1q_s32(batch_p->lhs_p + idx),               \
+                                vld1q_s32(batch_p->rhs_p + idx)));             \
+        }                                                                      \
+                                                                               \
+        scalar_##name##_from(batch_p, idx);                                    \
+    }
+
+DEFINE_NEON_KERNEL(add, vaddq_s32)
+DEFINE_NEON_KERNEL(sub, vsubq_s32)
+DEFINE_NEON_KERNEL(mul, vmulq_s32)
+#endif
+
+static int level_supported(simd_level_t level)
+{
+    switch (level)
+    {
+        case SIMD_LEVEL_OFF:
+            return 1;
+#if defined(__x86_64__)
+        case SIMD_LEVEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+        case SIMD_LEVEL_AVX512:
+            return __builtin_cpu_supports("avx512f");
+#elif defined(__aarch64__)
+        case SIMD_LEVEL_NEON:
+            return 1; // Advanced SIMD is mandatory on AArch64
+#endif
+        default:
+            return 0;
+    }
+}
+
+/*** end of file ***/
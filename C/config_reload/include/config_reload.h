@@ -0,0 +1,62 @@
+/**
+ * @file config_reload.h
+ * @brief Header for Live Configuration Reload
+ *
+ * This header file provides the interface for reloading the runtime-tunable
+ * part of the NetCalc configuration from a config file on SIGHUP, without
+ * restarting the server.
+ *
+ */
+#ifndef _CONFIG_RELOAD_H
+#define _CONFIG_RELOAD_H
+
+#include <stdbool.h>
+
+#include "option_handler.h"
+
+/**
+ * @brief Installs a SIGHUP handler that marks a reload as pending.
+ *
+ * The handler only sets a flag; the reload itself runs on the thread that
+ * polls config_reload_pending(), never in signal context.
+ *
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int config_reload_install_handler();
+
+/**
+ * @brief Reports and clears a pending reload request.
+ *
+ * @return bool - true if SIGHUP was received since the last call.
+ */
+bool config_reload_pending();
+
+/**
+ * @brief Builds an updated configuration from a config file.
+ *
+ * The file is parsed with options_load_file(), so each value is held to the
+ * same validation as on the command line. Only the runtime-tunable settings
+ * are taken from it:
+ *  - 'n' (thread count, the pool grows or shrinks to it), unless every
+ *    worker owns a socket ('--shared-nothing' or '--transport udp'),
+ *  - 'max-queue-depth' (the admission limit),
+ *  - 'batch-size' and 'batch-timeout-us'.
+ * Any other option needs a restart, 'queue-depth' included since the work
+ * queue cannot be resized; if the file changes one from its current value
+ * that is reported and ignored. Settings not present in the file keep their
+ * current values, as do those given on the command line or in the
+ * environment at start, which outrank the file there too. The merged result
+ * must pass options_check(), or nothing is reloaded.
+ *
+ * @param path_p The path of the config file.
+ * @param current_p The configuration currently in use.
+ * @param updated_p Pointer to where the updated configuration is written.
+ * It is untouched if the file is invalid.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int config_reload_apply(const char *      path_p,
+                        const options_t * current_p,
+                        options_t *       updated_p);
+
+#endif /* _CONFIG_RELOAD_H */
+/*** end of file ***/
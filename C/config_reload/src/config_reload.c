@@ -0,0 +1,199 @@
+/**
+ * @file config_reload.c
+ * @brief Live Configuration Reload
+ *
+ * This file contains the SIGHUP driven reload path. The new values go through
+ * the same parser and validation as the command line, and are merged into a
+ * copy of the running configuration so that a bad file never disturbs the
+ * configuration in use.
+ */
+#define _GNU_SOURCE // for sigaction()
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config_reload.h"
+#include "utilities.h"
+
+#define MAX_RELOAD_REPORT 128 // Longest message built by this file
+
+static volatile sig_atomic_t g_reload_requested = 0; // Set by SIGHUP
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Records a reload request. Async-signal-safe.
+ *
+ * @param signal_number The signal received (SIGHUP).
+ */
+static void handle_sighup(int signal_number);
+
+/**
+ * @brief Clears the runtime-tunable settings of an options_t.
+ *
+ * What remains set afterwards is exactly the set of options that cannot be
+ * changed without a restart.
+ *
+ * @param options_p The options to clear.
+ * @param workers_fixed true if the worker count ('-n') is fixed at start.
+ */
+static void clear_reloadable(options_t * options_p, bool workers_fixed);
+
+// +---------------------------------------------------------------------------+
+// |                            CONFIG RELOAD API                              |
+// +---------------------------------------------------------------------------+
+
+int config_reload_install_handler()
+{
+    int              exit_code = E_FAILURE;
+    struct sigaction action    = { 0 };
+
+    action.sa_handler = handle_sighup;
+    action.sa_flags   = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if (0 != sigaction(SIGHUP, &action, NULL))
+    {
+        perror("config_reload_install_handler(): sigaction()");
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+bool config_reload_pending()
+{
+    bool pending = (0 != g_reload_requested);
+
+    // Only clear a request that was seen. A SIGHUP arriving after the test
+    // is then either kept for the next call or covered by this reload, which
+    // reads the file afterwards.
+    if (true == pending)
+    {
+        g_reload_requested = 0;
+    }
+    return pending;
+}
+
+int config_reload_apply(const char *      path_p,
+                        const options_t * current_p,
+                        options_t *       updated_p)
+{
+    int       exit_code                  = E_FAILURE;
+    bool      workers_fixed              = false;
+    options_t loaded                     = { 0 };
+    options_t fixed                      = { 0 };
+    options_t merged                     = { 0 };
+    char      name[MAX_OPTION_NAME]      = { 0 };
+    char      message[MAX_RELOAD_REPORT] = { 0 };
+
+    if ((NULL == path_p) || (NULL == current_p) || (NULL == updated_p))
+    {
+        print_error("config_reload_apply(): NULL argument passed.");
+        goto END;
+    }
+
+    // Zero the padding too, so options_find_difference() only sees real
+    // settings
+    memset(&loaded, 0, sizeof(loaded));
+
+    // Options given on the command line or in the environment outrank the
+    // file, so they are neither reloaded nor reported as changed
+    loaded.pinned_set = current_p->pinned_set;
+
+    exit_code = options_load_file(path_p, &loaded);
+    if (E_SUCCESS != exit_code)
+    {
+        print_error("config_reload_apply(): Invalid config; not reloaded.");
+        goto END;
+    }
+
+    // With a socket per worker the pool cannot grow or shrink, so the
+    // worker count is fixed at start
+    workers_fixed = ((true == current_p->shared_nothing_flag) ||
+                     (TRANSPORT_UDP == current_p->transport));
+
+    // Restart-only options are only worth a word if the file changed them
+    memcpy(&fixed, &loaded, sizeof(fixed));
+    clear_reloadable(&fixed, workers_fixed);
+    if (true == options_find_difference(&fixed, current_p, name, sizeof(name)))
+    {
+        snprintf(message,
+                 sizeof(message),
+                 "config_reload_apply(): Ignoring '%s' and any other changed "
+                 "option that needs a restart.",
+                 name);
+        print_error(message);
+    }
+
+    memcpy(&merged, current_p, sizeof(merged));
+
+    if ((true == loaded.n_flag) && (false == workers_fixed))
+    {
+        merged.n_flag  = true;
+        merged.n_value = loaded.n_value;
+    }
+    if (true == loaded.max_queue_depth_flag)
+    {
+        merged.max_queue_depth_flag = true;
+        merged.max_queue_depth      = loaded.max_queue_depth;
+    }
+    if (true == loaded.batch_size_flag)
+    {
+        merged.batch_size_flag = true;
+        merged.batch_size      = loaded.batch_size;
+    }
+    if (true == loaded.batch_timeout_flag)
+    {
+        merged.batch_timeout_flag = true;
+        merged.batch_timeout_us   = loaded.batch_timeout_us;
+    }
+
+    // Each value was range checked alone; together with the rest of the
+    // running configuration they must still pass the startup checks, e.g.
+    // '-n' under '--max-threads' and the limit within the queue depth.
+    exit_code = options_check(&merged);
+    if (E_SUCCESS != exit_code)
+    {
+        print_error("config_reload_apply(): Invalid config; not reloaded.");
+        goto END;
+    }
+
+    memcpy(updated_p, &merged, sizeof(*updated_p));
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static void handle_sighup(int signal_number)
+{
+    (void)signal_number;
+    g_reload_requested = 1;
+}
+
+static void clear_reloadable(options_t * options_p, bool workers_fixed)
+{
+    if (false == workers_fixed)
+    {
+        options_p->n_flag  = false;
+        options_p->n_value = 0;
+    }
+    options_p->max_queue_depth_flag = false;
+    options_p->max_queue_depth      = 0;
+    options_p->batch_size_flag      = false;
+    options_p->batch_size           = 0;
+    options_p->batch_timeout_flag   = false;
+    options_p->batch_timeout_us     = 0;
+}
+
+/*** end of file ***/
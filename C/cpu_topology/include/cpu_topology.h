@@ -0,0 +1,84 @@
+/**
+ * @file cpu_topology.h
+ * @brief Header for CPU Topology Functions
+ *
+ * This header file provides the interface for discovering how many CPUs the
+ * running process is actually allowed to use, so that NetCalc can size its
+ * thread pool to the machine it is deployed on, and for placing pool workers
+ * and their memory on specific CPUs and NUMA nodes.
+ *
+ */
+#ifndef _CPU_TOPOLOGY_H
+#define _CPU_TOPOLOGY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_CPU_LIST_SIZE 1024 // Maximum number of CPUs in a CPU list
+
+/**
+ * @enum numa_policy
+ * @brief Memory placement policy applied to each pool worker.
+ */
+typedef enum numa_policy
+{
+    NUMA_POLICY_NONE = 0,   // Leave the kernel default policy untouched
+    NUMA_POLICY_LOCAL,      // Allocate on the node of the CPU a worker runs on
+    NUMA_POLICY_INTERLEAVE, // Interleave pages across all online nodes
+} numa_policy_t;
+
+/**
+ * @brief Determines the number of CPUs available to the calling process.
+ *
+ * The result is the smallest of the following limits, ignoring any that
+ * cannot be determined on the current system:
+ *  - the number of online CPUs,
+ *  - the number of CPUs in the scheduler affinity mask,
+ *  - the cgroup CPU quota (v2 'cpu.max' or v1 'cpu.cfs_quota_us'), rounded
+ *    up to a whole CPU. The smallest quota of the process's own cgroup, as
+ *    listed in /proc/self/cgroup, and its ancestors is used.
+ *
+ * @param cpu_count_p Pointer to where the CPU count will be stored.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int cpu_topology_available_cpus(int32_t * cpu_count_p);
+
+/**
+ * @brief Parses a kernel style CPU list such as "0-3,8,10-11".
+ *
+ * CPUs are stored in the order they appear in the list. Duplicates are
+ * rejected, as are ranges whose end is lower than their start.
+ *
+ * Nothing is printed for a malformed list, so the caller decides how the
+ * failure is reported.
+ *
+ * @param list_p The CPU list string.
+ * @param cpus_p Array where the parsed CPU numbers will be stored.
+ * @param max_cpus The capacity of cpus_p.
+ * @param cpu_count_p Pointer to where the number of parsed CPUs is stored.
+ * @param reason_pp Optional pointer to where a static description of what
+ * is wrong with the list (e.g. "duplicate CPU") is stored on failure.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int cpu_topology_parse_cpu_list(const char *  list_p,
+                                uint16_t *    cpus_p,
+                                size_t        max_cpus,
+                                size_t *      cpu_count_p,
+                                const char ** reason_pp);
+
+/**
+ * @brief Pins the calling thread to a CPU and applies a NUMA memory policy.
+ *
+ * Intended to be called by each pool worker as its first action, before it
+ * allocates its queue and buffers, so that those allocations are placed
+ * according to the policy (first touch on the local node for
+ * NUMA_POLICY_LOCAL).
+ *
+ * @param cpu The CPU the calling thread should run on.
+ * @param policy The memory placement policy for the calling thread.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int cpu_topology_bind_worker(uint16_t cpu, numa_policy_t policy);
+
+#endif /* _CPU_TOPOLOGY_H */
+/*** end of file ***/
@@ -0,0 +1,734 @@
+/**
+ * @file cpu_topology.c
+ * @brief CPU Topology Discovery
+ *
+ * This file contains functions for discovering the CPU resources available to
+ * the server process. It combines the online CPU count, the scheduler affinity
+ * mask and the cgroup CPU quota, since any one of them on its own over-reports
+ * the usable CPUs inside containers or under taskset/cpuset restrictions.
+ *
+ * It also provides worker placement: CPU list parsing, thread pinning and NUMA
+ * memory policies. The memory policy is set through the raw set_mempolicy()
+ * system call so that no libnuma dependency is required.
+ */
+#define _GNU_SOURCE // for sched_getaffinity() and the CPU_* macros
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/mempolicy.h> // MPOL_*
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h> // SYS_set_mempolicy
+#include <unistd.h>      // sysconf, syscall
+
+#include "cpu_topology.h"
+#include "utilities.h"
+
+#define PROC_SELF_CGROUP       "/proc/self/cgroup"
+#define CGROUP_V2_ROOT         "/sys/fs/cgroup"
+#define CGROUP_V1_CPU_ROOT     "/sys/fs/cgroup/cpu"
+#define CGROUP_V2_CPU_MAX      "cpu.max"
+#define CGROUP_V1_CFS_QUOTA    "cpu.cfs_quota_us"
+#define CGROUP_V1_CFS_PERIOD   "cpu.cfs_period_us"
+#define CGROUP_CPU_CONTROLLER  "cpu"
+#define CGROUP_QUOTA_UNLIMITED -1 // Quota value meaning "no CPU limit"
+#define MAX_CGROUP_LINE_LEN    (PATH_MAX + 64) // One /proc/self/cgroup line
+#define NODE_ONLINE_LIST       "/sys/devices/system/node/online"
+#define MAX_NODE_LIST_LEN      256 // Maximum length of the online node list
+#define MAX_CPU_NUMBER         (CPU_SETSIZE - 1) // Highest CPU in a list
+#define BITS_PER_ULONG         (sizeof(unsigned long) * CHAR_BIT)
+#define NODE_MASK_WORDS        ((MAX_CPU_NUMBER + 1) / BITS_PER_ULONG)
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Counts the CPUs in the scheduler affinity mask of this process.
+ *
+ * @param cpu_count_p Pointer to where the CPU count will be stored.
+ * @return E_SUCCESS on success, E_FAILURE if the mask could not be read.
+ */
+static int get_affinity_cpus(int32_t * cpu_count_p);
+
+/**
+ * @brief Reads the cgroup CPU quota and converts it to a whole CPU count.
+ *
+ * The cgroup of this process is taken from /proc/self/cgroup, and the
+ * smallest quota of that cgroup and each of its ancestors is used: outside a
+ * cgroup namespace the mount root is the host's root cgroup, which is
+ * unlimited even when the process's own cgroup (a systemd slice, a container)
+ * is throttled. The cgroup v2 interface is tried first, followed by cgroup
+ * v1. A quota of "max" (v2) or -1 (v1) at every level is reported as
+ * CGROUP_QUOTA_UNLIMITED.
+ *
+ * @param cpu_count_p Pointer to where the CPU count will be stored.
+ * @return E_SUCCESS if a quota (or the lack of one) was determined, E_FAILURE
+ * if no cgroup CPU controller could be read.
+ */
+static int get_cgroup_quota_cpus(int32_t * cpu_count_p);
+
+/**
+ * @brief Finds the cgroup of this process in one hierarchy.
+ *
+ * @param controller_p The controller of a v1 hierarchy, or NULL for the
+ * unified (v2) hierarchy.
+ * @param path_p Buffer of MAX_CGROUP_LINE_LEN bytes receiving the cgroup path,
+ * relative to the hierarchy's root and starting with '/'.
+ * @return E_SUCCESS if the hierarchy is listed, E_FAILURE otherwise.
+ */
+static int get_self_cgroup(const char * controller_p, char * path_p);
+
+/**
+ * @brief Takes the smallest CPU quota from a cgroup and all its ancestors.
+ *
+ * Levels whose files cannot be read are skipped; a cgroup path that is not
+ * visible under 'root_p' (a container's cgroup seen from inside it) thus
+ * falls back to the levels that are.
+ *
+ * @param root_p Mount point of the hierarchy.
+ * @param cgroup_p The cgroup path from get_self_cgroup().
+ * @param read_fn Reads the quota of one cgroup directory as a CPU count.
+ * @param cpu_count_p Pointer to where the smallest CPU count, or
+ * CGROUP_QUOTA_UNLIMITED, is stored.
+ * @return E_SUCCESS if at least one level could be read, E_FAILURE otherwise.
+ */
+static int walk_cgroup_quota(const char * root_p,
+                             const char * cgroup_p,
+                             int (*read_fn)(const char *, int32_t *),
+                             int32_t *    cpu_count_p);
+
+/**
+ * @brief Reads the cgroup v2 'cpu.max' of one cgroup as a CPU count.
+ *
+ * @param dir_p The cgroup directory.
+ * @param cpu_count_p Pointer to where the CPU count, or
+ * CGROUP_QUOTA_UNLIMITED, is stored.
+ * @return E_SUCCESS if the file was read, E_FAILURE otherwise.
+ */
+static int read_cpu_max(const char * dir_p, int32_t * cpu_count_p);
+
+/**
+ * @brief Reads the cgroup v1 CFS quota and period of one cgroup as a CPU
+ * count.
+ *
+ * @param dir_p The cgroup directory.
+ * @param cpu_count_p Pointer to where the CPU count, or
+ * CGROUP_QUOTA_UNLIMITED, is stored.
+ * @return E_SUCCESS if both files were read, E_FAILURE otherwise.
+ */
+static int read_cfs_quota(const char * dir_p, int32_t * cpu_count_p);
+
+/**
+ * @brief Reads a single signed integer from a file.
+ *
+ * @param path_p Path of the file to read.
+ * @param value_p Pointer to where the value will be stored.
+ * @return E_SUCCESS if a value was read, E_FAILURE otherwise.
+ */
+static int read_long_from_file(const char * path_p, long * value_p);
+
+/**
+ * @brief Converts a CFS quota/period pair into a whole number of CPUs.
+ *
+ * @param quota The CPU time allowed per period, in microseconds.
+ * @param period The length of a period, in microseconds.
+ * @return The quota rounded up to a whole CPU.
+ */
+static int32_t quota_to_cpus(long quota, long period);
+
+/**
+ * @brief Parses one CPU number from a CPU list.
+ *
+ * @param str_p The string to parse from.
+ * @param end_pp Pointer to where the position after the number is stored.
+ * @param cpu_p Pointer to where the CPU number will be stored.
+ * @return E_SUCCESS if a valid CPU number was parsed, E_FAILURE otherwise.
+ */
+static int parse_cpu_number(const char * str_p, char ** end_pp, long * cpu_p);
+
+/**
+ * @brief Applies a NUMA memory policy to the calling thread.
+ *
+ * @param policy The memory placement policy to apply.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int apply_numa_policy(numa_policy_t policy);
+
+// +---------------------------------------------------------------------------+
+// |                             CPU TOPOLOGY API                              |
+// +---------------------------------------------------------------------------+
+
+int cpu_topology_available_cpus(int32_t * cpu_count_p)
+{
+    int     exit_code   = E_FAILURE;
+    long    online_cpus = 0;
+    int32_t limit       = 0;
+    int32_t cpu_count   = 0;
+
+    if (NULL == cpu_count_p)
+    {
+        print_error("cpu_topology_available_cpus(): NULL argument passed.");
+        goto END;
+    }
+
+    online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (1 > online_cpus)
+    {
+        print_error("cpu_topology_available_cpus(): Unable to count CPUs.");
+        goto END;
+    }
+    cpu_count = (int32_t)online_cpus;
+
+    if ((E_SUCCESS == get_affinity_cpus(&limit)) && (limit < cpu_count))
+    {
+        cpu_count = limit;
+    }
+
+    if ((E_SUCCESS == get_cgroup_quota_cpus(&limit)) &&
+        (CGROUP_QUOTA_UNLIMITED != limit) && (limit < cpu_count))
+    {
+        cpu_count = limit;
+    }
+
+    *cpu_count_p = cpu_count;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+int cpu_topology_parse_cpu_list(const char *  list_p,
+                                uint16_t *    cpus_p,
+                                size_t        max_cpus,
+                                size_t *      cpu_count_p,
+                                const char ** reason_pp)
+{
+    int          exit_code                = E_FAILURE;
+    const char * reason_p                 = NULL;
+    const char * cursor_p                 = list_p;
+    char *       end_p                    = NULL;
+    long         first                    = 0;
+    long         last                     = 0;
+    size_t       count                    = 0;
+    bool         seen[MAX_CPU_NUMBER + 1] = { false };
+
+    if ((NULL == list_p) || (NULL == cpus_p) || (NULL == cpu_count_p))
+    {
+        print_error("cpu_topology_parse_cpu_list(): NULL argument passed.");
+        goto END;
+    }
+
+    while ('\0' != *cursor_p)
+    {
+        if (E_SUCCESS != parse_cpu_number(cursor_p, &end_p, &first))
+        {
+            reason_p = "invalid CPU number";
+            goto END;
+        }
+        last = first;
+
+        if ('-' == *end_p)
+        {
+            if ((E_SUCCESS != parse_cpu_number(end_p + 1, &end_p, &last)) ||
+                (last < first))
+            {
+                reason_p = "invalid range";
+                goto END;
+            }
+        }
+
+        if ((',' != *end_p) && ('\0' != *end_p))
+        {
+            reason_p = "unexpected character";
+            goto END;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            if (true == seen[cpu])
+            {
+                reason_p = "duplicate CPU";
+                goto END;
+            }
+            if (max_cpus <= count)
+            {
+                reason_p = "too many CPUs";
+                goto END;
+            }
+            seen[cpu]       = true;
+            cpus_p[count++] = (uint16_t)cpu;
+        }
+
+        cursor_p = (',' == *end_p) ? (end_p + 1) : end_p;
+        if ((',' == *end_p) && ('\0' == *cursor_p))
+        {
+            reason_p = "trailing ','";
+            goto END;
+        }
+    }
+
+    if (0 == count)
+    {
+        reason_p = "empty CPU list";
+        goto END;
+    }
+
+    *cpu_count_p = count;
+
+    exit_code = E_SUCCESS;
+END:
+    if ((NULL != reason_p) && (NULL != reason_pp))
+    {
+        *reason_pp = reason_p;
+    }
+    return exit_code;
+}
+
+int cpu_topology_bind_worker(uint16_t cpu, numa_policy_t policy)
+{
+    int       exit_code = E_FAILURE;
+    int       error     = 0;
+    cpu_set_t set       = { 0 };
+
+    if (CPU_SETSIZE <= cpu)
+    {
+        print_error("cpu_topology_bind_worker(): CPU number too large.");
+        goto END;
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (0 != error)
+    {
+        print_error("cpu_topology_bind_worker(): Unable to pin thread.");
+        goto END;
+    }
+
+    exit_code = apply_numa_policy(policy);
+    if (E_SUCCESS != exit_code)
+    {
+        print_error("cpu_topology_bind_worker(): Unable to set NUMA policy.");
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int get_affinity_cpus(int32_t * cpu_count_p)
+{
+    int         exit_code = E_FAILURE;
+    long        conf_cpus = 0;
+    cpu_set_t * set_p     = NULL;
+    size_t      set_size  = 0;
+
+    conf_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (1 > conf_cpus)
+    {
+        goto END;
+    }
+
+    // A dynamically sized set is used so that machines with more than
+    // CPU_SETSIZE (1024) CPUs are still counted correctly.
+    set_p = CPU_ALLOC(conf_cpus);
+    if (NULL == set_p)
+    {
+        print_error("get_affinity_cpus(): CPU_ALLOC() failed.");
+        goto END;
+    }
+    set_size = CPU_ALLOC_SIZE(conf_cpus);
+    CPU_ZERO_S(set_size, set_p);
+
+    if (0 != sched_getaffinity(0, set_size, set_p))
+    {
+        goto END;
+    }
+
+    *cpu_count_p = (int32_t)CPU_COUNT_S(set_size, set_p);
+    if (1 > *cpu_count_p)
+    {
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    CPU_FREE(set_p);
+    return exit_code;
+}
+
+static int get_cgroup_quota_cpus(int32_t * cpu_count_p)
+{
+    int  exit_code                   = E_FAILURE;
+    char cgroup[MAX_CGROUP_LINE_LEN] = { 0 };
+
+    if ((E_SUCCESS == get_self_cgroup(NULL, cgroup)) &&
+        (E_SUCCESS ==
+         walk_cgroup_quota(CGROUP_V2_ROOT, cgroup, read_cpu_max, cpu_count_p)))
+    {
+        exit_code = E_SUCCESS;
+        goto END;
+    }
+
+    if ((E_SUCCESS == get_self_cgroup(CGROUP_CPU_CONTROLLER, cgroup)) &&
+        (E_SUCCESS == walk_cgroup_quota(CGROUP_V1_CPU_ROOT,
+                                        cgroup,
+                                        read_cfs_quota,
+                                        cpu_count_p)))
+    {
+        exit_code = E_SUCCESS;
+        goto END;
+    }
+
+    // No /proc/self/cgroup: the root files are all that can be read
+    if ((E_SUCCESS == read_cpu_max(CGROUP_V2_ROOT, cpu_count_p)) ||
+        (E_SUCCESS == read_cfs_quota(CGROUP_V1_CPU_ROOT, cpu_count_p)))
+    {
+        exit_code = E_SUCCESS;
+    }
+
+END:
+    return exit_code;
+}
+
+static int get_self_cgroup(const char * controller_p, char * path_p)
+{
+    int    exit_code                 = E_FAILURE;
+    FILE * file_p                    = NULL;
+    char   line[MAX_CGROUP_LINE_LEN] = { 0 };
+    char * controllers_p             = NULL;
+    char * cgroup_p                  = NULL;
+    char * token_p                   = NULL;
+    char * save_p                    = NULL;
+    bool   match                     = false;
+
+    file_p = fopen(PROC_SELF_CGROUP, "r");
+    if (NULL == file_p)
+    {
+        goto END;
+    }
+
+    // Each line is "<hierarchy-id>:<controller,...>:<path>"; v2 lists none
+    while ((false == match) && (NULL != fgets(line, sizeof(line), file_p)))
+    {
+        controllers_p = strchr(line, ':');
+        if (NULL == controllers_p)
+        {
+            continue;
+        }
+        controllers_p++;
+
+        cgroup_p = strchr(controllers_p, ':');
+        if ((NULL == cgroup_p) || ('/' != cgroup_p[1]))
+        {
+            continue;
+        }
+        *cgroup_p++ = '\0';
+        cgroup_p[strcspn(cgroup_p, "\n")] = '\0';
+
+        if (NULL == controller_p)
+        {
+            match = ('\0' == *controllers_p);
+            continue;
+        }
+
+        for (token_p = strtok_r(controllers_p, ",", &save_p);
+             (false == match) && (NULL != token_p);
+             token_p = strtok_r(NULL, ",", &save_p))
+        {
+            match = (0 == strcmp(token_p, controller_p));
+        }
+    }
+
+    if (false == match)
+    {
+        goto END;
+    }
+
+    snprintf(path_p, MAX_CGROUP_LINE_LEN, "%s", cgroup_p);
+
+    exit_code = E_SUCCESS;
+END:
+    if (NULL != file_p)
+    {
+        fclose(file_p);
+    }
+    return exit_code;
+}
+
+static int walk_cgroup_quota(const char * root_p,
+                             const char * cgroup_p,
+                             int (*read_fn)(const char *, int32_t *),
+                             int32_t *    cpu_count_p)
+{
+    int     exit_code     = E_FAILURE;
+    char    dir[PATH_MAX] = { 0 };
+    size_t  root_len      = strlen(root_p);
+    size_t  dir_len       = 0;
+    char *  slash_p       = NULL;
+    int32_t limit         = 0;
+    int32_t cpu_count     = CGROUP_QUOTA_UNLIMITED;
+
+    dir_len = (size_t)snprintf(dir, sizeof(dir), "%s%s", root_p, cgroup_p);
+    if (sizeof(dir) <= dir_len)
+    {
+        goto END;
+    }
+
+    // The root cgroup is "/", which would otherwise be read twice
+    if ((root_len < dir_len) && ('/' == dir[dir_len - 1]))
+    {
+        dir[dir_len - 1] = '\0';
+    }
+
+    for (;;)
+    {
+        if (E_SUCCESS == read_fn(dir, &limit))
+        {
+            exit_code = E_SUCCESS;
+            if ((CGROUP_QUOTA_UNLIMITED != limit) &&
+                ((CGROUP_QUOTA_UNLIMITED == cpu_count) || (limit < cpu_count)))
+            {
+                cpu_count = limit;
+            }
+        }
+
+        // Up one level, stopping once the mount root has been read
+        slash_p = strrchr(dir, '/');
+        if ((strlen(dir) <= root_len) || (NULL == slash_p) ||
+            (slash_p < dir + root_len))
+        {
+            break;
+        }
+        *slash_p = '\0';
+    }
+
+    if (E_SUCCESS == exit_code)
+    {
+        *cpu_count_p = cpu_count;
+    }
+
+END:
+    return exit_code;
+}
+
+static int read_cpu_max(const char * dir_p, int32_t * cpu_count_p)
+{
+    int    exit_code      = E_FAILURE;
+    FILE * file_p         = NULL;
+    char   path[PATH_MAX] = { 0 };
+    char   quota[32]      = { 0 };
+    long   period         = 0;
+    long   quota_us       = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", dir_p, CGROUP_V2_CPU_MAX);
+    file_p = fopen(path, "r");
+    if (NULL == file_p)
+    {
+        goto END;
+    }
+
+    // "<quota> <period>" or "max <period>"
+    if (2 != fscanf(file_p, "%31s %ld", quota, &period))
+    {
+        goto END;
+    }
+
+    if (('m' == quota[0]) || (0 >= period))
+    {
+        *cpu_count_p = CGROUP_QUOTA_UNLIMITED;
+        exit_code    = E_SUCCESS;
+        goto END;
+    }
+
+    quota_us = strtol(quota, NULL, 10);
+    if (0 >= quota_us)
+    {
+        goto END;
+    }
+
+    *cpu_count_p = quota_to_cpus(quota_us, period);
+
+    exit_code = E_SUCCESS;
+END:
+    if (NULL != file_p)
+    {
+        fclose(file_p);
+    }
+    return exit_code;
+}
+
+static int read_cfs_quota(const char * dir_p, int32_t * cpu_count_p)
+{
+    int  exit_code      = E_FAILURE;
+    char path[PATH_MAX] = { 0 };
+    long period         = 0;
+    long quota_us       = 0;
+
+    // Separate quota and period files, a quota of -1 is unlimited
+    snprintf(path, sizeof(path), "%s/%s", dir_p, CGROUP_V1_CFS_QUOTA);
+    if (E_SUCCESS != read_long_from_file(path, &quota_us))
+    {
+        goto END;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", dir_p, CGROUP_V1_CFS_PERIOD);
+    if (E_SUCCESS != read_long_from_file(path, &period))
+    {
+        goto END;
+    }
+
+    if ((0 >= quota_us) || (0 >= period))
+    {
+        *cpu_count_p = CGROUP_QUOTA_UNLIMITED;
+    }
+    else
+    {
+        *cpu_count_p = quota_to_cpus(quota_us, period);
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int read_long_from_file(const char * path_p, long * value_p)
+{
+    int    exit_code = E_FAILURE;
+    FILE * file_p    = NULL;
+
+    file_p = fopen(path_p, "r");
+    if (NULL == file_p)
+    {
+        goto END;
+    }
+
+    if (1 != fscanf(file_p, "%ld", value_p))
+    {
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    if (NULL != file_p)
+    {
+        fclose(file_p);
+    }
+    return exit_code;
+}
+
+static int32_t quota_to_cpus(long quota, long period)
+{
+    long cpus = (quota + period - 1) / period;
+
+    return (cpus < 1) ? 1 : (int32_t)cpus;
+}
+
+static int parse_cpu_number(const char * str_p, char ** end_pp, long * cpu_p)
+{
+    int exit_code = E_FAILURE;
+
+    // strtol() would accept leading whitespace and signs, a CPU list does not
+    if (('0' > *str_p) || ('9' < *str_p))
+    {
+        goto END;
+    }
+
+    errno  = 0;
+    *cpu_p = strtol(str_p, end_pp, 10);
+    if ((0 != errno) || (MAX_CPU_NUMBER < *cpu_p))
+    {
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int apply_numa_policy(numa_policy_t policy)
+{
+    int           exit_code                    = E_FAILURE;
+    FILE *        file_p                       = NULL;
+    char          node_list[MAX_NODE_LIST_LEN] = { 0 };
+    uint16_t      nodes[MAX_CPU_LIST_SIZE]     = { 0 };
+    size_t        node_count                   = 0;
+    unsigned long node_mask[NODE_MASK_WORDS]   = { 0 };
+
+    switch (policy)
+    {
+        case NUMA_POLICY_NONE:
+            exit_code = E_SUCCESS;
+            break;
+
+        case NUMA_POLICY_LOCAL:
+            if (0 != syscall(SYS_set_mempolicy, MPOL_LOCAL, NULL, 0))
+            {
+                print_error("apply_numa_policy(): set_mempolicy() failed.");
+                goto END;
+            }
+            exit_code = E_SUCCESS;
+            break;
+
+        case NUMA_POLICY_INTERLEAVE:
+            file_p = fopen(NODE_ONLINE_LIST, "r");
+            if ((NULL == file_p) ||
+                (NULL == fgets(node_list, sizeof(node_list), file_p)))
+            {
+                print_error("apply_numa_policy(): Unable to read NUMA nodes.");
+                goto END;
+            }
+            node_list[strcspn(node_list, "\n")] = '\0';
+
+            if (E_SUCCESS != cpu_topology_parse_cpu_list(node_list,
+                                                         nodes,
+                                                         MAX_CPU_LIST_SIZE,
+                                                         &node_count,
+                                                         NULL))
+            {
+                print_error("apply_numa_policy(): Unable to parse NUMA nodes.");
+                goto END;
+            }
+
+            for (size_t idx = 0; idx < node_count; idx++)
+            {
+                node_mask[nodes[idx] / BITS_PER_ULONG] |=
+                    (1UL << (nodes[idx] % BITS_PER_ULONG));
+            }
+
+            if (0 != syscall(SYS_set_mempolicy,
+                             MPOL_INTERLEAVE,
+                             node_mask,
+                             (unsigned long)(MAX_CPU_NUMBER + 1)))
+            {
+                print_error("apply_numa_policy(): set_mempolicy() failed.");
+                goto END;
+            }
+            exit_code = E_SUCCESS;
+            break;
+
+        default:
+            print_error("apply_numa_policy(): Unknown NUMA policy.");
+            break;
+    }
+
+END:
+    if (NULL != file_p)
+    {
+        fclose(file_p);
+    }
+    return exit_code;
+}
+
+/*** end of file ***/
@@ -0,0 +1,98 @@
+/**
+ * @file datagram.h
+ * @brief Header for the Batched UDP Request Worker
+ *
+ * This header file provides the interface for '--transport udp'. A request
+ * that fits in one datagram needs no connection, so instead of accepting
+ * and reading connections each worker owns one socket of a SO_REUSEPORT
+ * group (see listener_open_datagram_group()) and answers the datagrams the
+ * kernel hashes to it. Datagrams are read with one recvmmsg() and the
+ * replies written with one sendmmsg() per batch of DATAGRAM_BATCH.
+ *
+ * Where the kernel supports it, UDP GRO lets one read return a run of
+ * datagrams from the same client merged into a single buffer; they are
+ * split and answered one by one, and when the replies to such a run are of
+ * one size they are sent back as a single UDP GSO message.
+ *
+ */
+#ifndef _DATAGRAM_H
+#define _DATAGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DATAGRAM_BATCH        32   // Datagrams per recvmmsg()/sendmmsg()
+#define DATAGRAM_MAX_SIZE     2048 // Largest request datagram without GRO
+#define DATAGRAM_MAX_REPLY    512  // Largest reply to one request
+#define DATAGRAM_MAX_SEGMENTS 64   // Most datagrams GRO merges into one read
+
+/**
+ * @struct datagram_worker
+ * @brief Opaque worker handle.
+ */
+typedef struct datagram_worker datagram_worker_t;
+
+/**
+ * @brief Answers one request datagram.
+ *
+ * Called on the worker's thread, once per request, with both buffers valid
+ * only for the duration of the call.
+ *
+ * @param context_p The context given to datagram_worker_create().
+ * @param request_p The request.
+ * @param length The request size in bytes.
+ * @param reply_p Where the reply is written.
+ * @param reply_size The capacity of reply_p, DATAGRAM_MAX_REPLY.
+ * @return size_t - The reply size, or 0 to send no reply.
+ */
+typedef size_t (*datagram_handler_t)(void *          context_p,
+                                     const uint8_t * request_p,
+                                     size_t          length,
+                                     uint8_t *       reply_p,
+                                     size_t          reply_size);
+
+/**
+ * @brief Creates a worker for one bound UDP socket.
+ *
+ * Every buffer is allocated here, so answering never allocates. UDP GRO is
+ * enabled on the socket if the kernel supports it, which raises the buffer
+ * for each datagram of a batch to 64 KiB.
+ *
+ * @param fd The bound socket. The worker does not take ownership of it.
+ * @param handler The function each request is handed to.
+ * @param context_p Passed to 'handler'.
+ * @return datagram_worker_t * - The new worker, or NULL on failure.
+ */
+datagram_worker_t * datagram_worker_create(int                fd,
+                                           datagram_handler_t handler,
+                                           void *             context_p);
+
+/**
+ * @brief Destroys a worker and sets the caller's pointer to NULL.
+ *
+ * The worker must not be running. Its socket is left open.
+ *
+ * @param worker_pp The address of the worker pointer.
+ */
+void datagram_worker_destroy(datagram_worker_t ** worker_pp);
+
+/**
+ * @brief Answers datagrams on the calling thread until
+ * datagram_worker_stop().
+ *
+ * @param worker_p The worker.
+ * @return int - Returns E_SUCCESS once stopped, otherwise E_FAILURE.
+ */
+int datagram_worker_run(datagram_worker_t * worker_p);
+
+/**
+ * @brief Asks a running worker to return from datagram_worker_run().
+ *
+ * May be called from any thread; the worker notices within 100 ms.
+ *
+ * @param worker_p The worker.
+ */
+void datagram_worker_stop(datagram_worker_t * worker_p);
+
+#endif /* _DATAGRAM_H */
+/*** end of file ***/
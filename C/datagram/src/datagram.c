@@ -0,0 +1,473 @@
+/**
+ * @file datagram.c
+ * @brief Batched UDP Request Worker
+ *
+ * This file implements the receive, answer, send cycle of a UDP worker. One
+ * recvmmsg() fills up to DATAGRAM_BATCH preallocated buffers, each request
+ * is answered into a reply buffer reserved for its slot, and one sendmmsg()
+ * writes every reply of the batch, so a full batch costs two system calls
+ * instead of one pair per request. The worker shares nothing with other
+ * workers; the kernel's SO_REUSEPORT hash is the only load balancer.
+ */
+#define _GNU_SOURCE // for recvmmsg() and sendmmsg()
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h> // UDP_GRO, UDP_SEGMENT
+#include <poll.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "datagram.h"
+#include "utilities.h"
+
+#define POLL_INTERVAL_MS 100   // How often the worker checks for stop
+#define GRO_BUFFER_SIZE  65536 // A read with GRO may return 64 KiB
+#define TX_MESSAGES      (DATAGRAM_BATCH * DATAGRAM_MAX_SEGMENTS)
+
+/**
+ * Room for the UDP_GRO control message of one read, aligned for cmsghdr.
+ */
+typedef struct rx_control
+{
+    alignas(struct cmsghdr) char buffer[CMSG_SPACE(sizeof(int))];
+} rx_control_t;
+
+/**
+ * Room for the UDP_SEGMENT control message of one send, aligned likewise.
+ */
+typedef struct tx_control
+{
+    alignas(struct cmsghdr) char buffer[CMSG_SPACE(sizeof(uint16_t))];
+} tx_control_t;
+
+/**
+ * @struct datagram_worker
+ * @brief One socket, its batch of buffers and the messages describing them.
+ */
+struct datagram_worker
+{
+    int                     fd;           // Bound UDP socket, not owned
+    datagram_handler_t      handler;      // Answers each request
+    void *                  context_p;    // Passed to 'handler'
+    atomic_bool             stop;         // datagram_worker_stop() was called
+    bool                    gro;          // Reads may merge datagrams
+    bool                    gso;          // Replies may leave as one message
+    size_t                  rx_size;      // Size of each receive buffer
+    size_t                  segments;     // Requests per receive buffer
+    uint8_t *               rx_buffers_p; // One buffer per slot
+    uint8_t *               tx_buffers_p; // 'segments' replies per slot
+
+    struct mmsghdr          rx_msgs[DATAGRAM_BATCH];    // recvmmsg() vector
+    struct iovec            rx_iovs[DATAGRAM_BATCH];    // Receive buffers
+    struct sockaddr_storage peers[DATAGRAM_BATCH];      // Senders
+    rx_control_t            rx_control[DATAGRAM_BATCH]; // GRO segment size
+    struct mmsghdr          tx_msgs[TX_MESSAGES];       // sendmmsg() vector
+    struct iovec            tx_iovs[TX_MESSAGES];       // Reply bytes
+    tx_control_t            tx_control[DATAGRAM_BATCH]; // GSO segment size
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Resets the receive messages before a recvmmsg().
+ *
+ * @param worker_p The worker.
+ */
+static void prepare_receive(datagram_worker_t * worker_p);
+
+/**
+ * @brief Answers every datagram of a batch and sends the replies.
+ *
+ * @param worker_p The worker.
+ * @param count The number of datagrams read.
+ */
+static void answer_batch(datagram_worker_t * worker_p, size_t count);
+
+/**
+ * @brief Answers the requests in one receive buffer.
+ *
+ * @param worker_p The worker.
+ * @param slot The receive slot.
+ * @param out The number of reply messages already queued.
+ * @return size_t - The number of reply messages queued afterwards.
+ */
+static size_t answer_slot(datagram_worker_t * worker_p,
+                          size_t              slot,
+                          size_t              out);
+
+/**
+ * @brief Returns the size of the datagrams GRO merged into a read.
+ *
+ * @param msg_p The message read.
+ * @param length The bytes read.
+ * @return size_t - The segment size, or 'length' if nothing was merged.
+ */
+static size_t segment_size(struct msghdr * msg_p, size_t length);
+
+/**
+ * @brief Queues one reply message.
+ *
+ * @param worker_p The worker.
+ * @param slot The receive slot the reply answers.
+ * @param out The index of the message.
+ * @param reply_p The reply bytes.
+ * @param length The reply size.
+ */
+static void queue_reply(datagram_worker_t * worker_p,
+                        size_t              slot,
+                        size_t              out,
+                        uint8_t *           reply_p,
+                        size_t              length);
+
+/**
+ * @brief Sends the queued reply messages.
+ *
+ * UDP makes no delivery promise, so a reply the kernel refuses is dropped
+ * rather than retried.
+ *
+ * @param worker_p The worker.
+ * @param count The number of queued messages.
+ */
+static void send_replies(datagram_worker_t * worker_p, size_t count);
+
+// +---------------------------------------------------------------------------+
+// |                               DATAGRAM API                                |
+// +---------------------------------------------------------------------------+
+
+datagram_worker_t * datagram_worker_create(int                fd,
+                                           datagram_handler_t handler,
+                                           void *             context_p)
+{
+    datagram_worker_t * worker_p = NULL;
+    int                 enable   = 1;
+    int                 value    = 0;
+    socklen_t           size     = sizeof(value);
+
+    if ((0 > fd) || (NULL == handler))
+    {
+        print_error("datagram_worker_create(): Invalid argument passed.");
+        goto END;
+    }
+
+    worker_p = calloc(1, sizeof(datagram_worker_t));
+    if (NULL == worker_p)
+    {
+        print_error("datagram_worker_create(): calloc() failed.");
+        goto END;
+    }
+
+    worker_p->fd        = fd;
+    worker_p->handler   = handler;
+    worker_p->context_p = context_p;
+    atomic_init(&worker_p->stop, false);
+
+    // Both are optional: on older kernels every read is one datagram and
+    // every reply its own message.
+    worker_p->gro =
+        (0 == setsockopt(fd, SOL_UDP, UDP_GRO, &enable, sizeof(enable)));
+    worker_p->gso =
+        ((true == worker_p->gro) &&
+         (0 == getsockopt(fd, SOL_UDP, UDP_SEGMENT, &value, &size)));
+
+    worker_p->rx_size  = (true == worker_p->gro) ? GRO_BUFFER_SIZE
+                                                 : DATAGRAM_MAX_SIZE;
+    worker_p->segments = (true == worker_p->gro) ? DATAGRAM_MAX_SEGMENTS : 1;
+
+    worker_p->rx_buffers_p = malloc(DATAGRAM_BATCH * worker_p->rx_size);
+    worker_p->tx_buffers_p = malloc(DATAGRAM_BATCH * worker_p->segments *
+                                    DATAGRAM_MAX_REPLY);
+    if ((NULL == worker_p->rx_buffers_p) || (NULL == worker_p->tx_buffers_p))
+    {
+        print_error("datagram_worker_create(): Unable to allocate buffers.");
+        datagram_worker_destroy(&worker_p);
+        goto END;
+    }
+
+    for (size_t slot = 0; slot < DATAGRAM_BATCH; slot++)
+    {
+        worker_p->rx_iovs[slot].iov_base =
+            worker_p->rx_buffers_p + (slot * worker_p->rx_size);
+        worker_p->rx_iovs[slot].iov_len          = worker_p->rx_size;
+        worker_p->rx_msgs[slot].msg_hdr.msg_name = &worker_p->peers[slot];
+        worker_p->rx_msgs[slot].msg_hdr.msg_iov  = &worker_p->rx_iovs[slot];
+        worker_p->rx_msgs[slot].msg_hdr.msg_iovlen = 1;
+    }
+
+END:
+    return worker_p;
+}
+
+void datagram_worker_destroy(datagram_worker_t ** worker_pp)
+{
+    if ((NULL == worker_pp) || (NULL == *worker_pp))
+    {
+        return;
+    }
+
+    free((*worker_pp)->rx_buffers_p);
+    free((*worker_pp)->tx_buffers_p);
+    free(*worker_pp);
+    *worker_pp = NULL;
+}
+
+int datagram_worker_run(datagram_worker_t * worker_p)
+{
+    int           exit_code = E_FAILURE;
+    int           ready     = 0;
+    int           count     = 0;
+    struct pollfd poll_fd   = { 0 };
+
+    if (NULL == worker_p)
+    {
+        print_error("datagram_worker_run(): NULL argument passed.");
+        goto END;
+    }
+
+    poll_fd.fd     = worker_p->fd;
+    poll_fd.events = POLLIN;
+
+    // Poll with a timeout rather than block in recvmmsg() so that
+    // datagram_worker_stop() is noticed without signalling this thread.
+    while (false ==
+           atomic_load_explicit(&worker_p->stop, memory_order_acquire))
+    {
+        ready = poll(&poll_fd, 1, POLL_INTERVAL_MS);
+        if (-1 == ready)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            perror("datagram_worker_run(): poll()");
+            goto END;
+        }
+
+        // Drain the socket before sleeping in poll() again
+        count = (0 < ready) ? DATAGRAM_BATCH : 0;
+        while (DATAGRAM_BATCH == count)
+        {
+            prepare_receive(worker_p);
+            count = recvmmsg(worker_p->fd,
+                             worker_p->rx_msgs,
+                             DATAGRAM_BATCH,
+                             MSG_DONTWAIT,
+                             NULL);
+            if (-1 == count)
+            {
+                if ((EAGAIN == errno) || (EWOULDBLOCK == errno) ||
+                    (EINTR == errno))
+                {
+                    break;
+                }
+                perror("datagram_worker_run(): recvmmsg()");
+                goto END;
+            }
+
+            answer_batch(worker_p, (size_t)count);
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+void datagram_worker_stop(datagram_worker_t * worker_p)
+{
+    if (NULL == worker_p)
+    {
+        return;
+    }
+
+    atomic_store_explicit(&worker_p->stop, true, memory_order_release);
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static void prepare_receive(datagram_worker_t * worker_p)
+{
+    struct msghdr * msg_p = NULL;
+
+    for (size_t slot = 0; slot < DATAGRAM_BATCH; slot++)
+    {
+        msg_p              = &worker_p->rx_msgs[slot].msg_hdr;
+        msg_p->msg_namelen = sizeof(worker_p->peers[slot]);
+        msg_p->msg_flags   = 0;
+        if (true == worker_p->gro)
+        {
+            msg_p->msg_control    = worker_p->rx_control[slot].buffer;
+            msg_p->msg_controllen = sizeof(worker_p->rx_control[slot]);
+        }
+    }
+}
+
+static void answer_batch(datagram_worker_t * worker_p, size_t count)
+{
+    size_t out = 0;
+
+    for (size_t slot = 0; slot < count; slot++)
+    {
+        // Without GRO a request larger than its buffer is cut short
+        if (0 != (worker_p->rx_msgs[slot].msg_hdr.msg_flags & MSG_TRUNC))
+        {
+            continue;
+        }
+
+        out = answer_slot(worker_p, slot, out);
+    }
+
+    send_replies(worker_p, out);
+}
+
+static size_t answer_slot(datagram_worker_t * worker_p,
+                          size_t              slot,
+                          size_t              out)
+{
+    size_t           length    = worker_p->rx_msgs[slot].msg_len;
+    size_t           segment   = 0;
+    size_t           part      = 0;
+    size_t           reply_len = 0;
+    size_t           first_len = 0;
+    size_t           used      = 0;
+    size_t           replies   = 0;
+    size_t           first_out = out;
+    bool             uniform   = true;
+    uint16_t         gso       = 0;
+    struct msghdr *  msg_p     = NULL;
+    struct cmsghdr * cmsg_p    = NULL;
+    uint8_t *        request_p = worker_p->rx_iovs[slot].iov_base;
+    uint8_t *        reply_p   = worker_p->tx_buffers_p +
+                            (slot * worker_p->segments * DATAGRAM_MAX_REPLY);
+
+    segment = segment_size(&worker_p->rx_msgs[slot].msg_hdr, length);
+
+    // The replies are packed one after another, ready to be sent as one
+    // GSO message if they turn out to be segments of one size.
+    for (size_t offset = 0, requests = 0;
+         (offset < length) && (requests < worker_p->segments);
+         offset += segment, requests++)
+    {
+        part      = ((length - offset) < segment) ? (length - offset) : segment;
+        reply_len = worker_p->handler(worker_p->context_p,
+                                      request_p + offset,
+                                      part,
+                                      reply_p + used,
+                                      DATAGRAM_MAX_REPLY);
+        if ((0 == reply_len) || (DATAGRAM_MAX_REPLY < reply_len))
+        {
+            continue;
+        }
+
+        // GSO cuts a message into equal segments and a shorter last one
+        if (0 == replies)
+        {
+            first_len = reply_len;
+        }
+        else if ((reply_len > first_len) ||
+                 (worker_p->tx_iovs[out - 1].iov_len != first_len))
+        {
+            uniform = false;
+        }
+
+        queue_reply(worker_p, slot, out, reply_p + used, reply_len);
+        used += reply_len;
+        replies++;
+        out++;
+    }
+
+    if ((true == worker_p->gso) && (1 < replies) && (true == uniform))
+    {
+        queue_reply(worker_p, slot, first_out, reply_p, used);
+        msg_p                 = &worker_p->tx_msgs[first_out].msg_hdr;
+        msg_p->msg_control    = worker_p->tx_control[slot].buffer;
+        msg_p->msg_controllen = sizeof(worker_p->tx_control[slot]);
+        cmsg_p                = CMSG_FIRSTHDR(msg_p);
+        cmsg_p->cmsg_level    = SOL_UDP;
+        cmsg_p->cmsg_type     = UDP_SEGMENT;
+        cmsg_p->cmsg_len      = CMSG_LEN(sizeof(gso));
+        gso                   = (uint16_t)first_len;
+        memcpy(CMSG_DATA(cmsg_p), &gso, sizeof(gso));
+        out = first_out + 1;
+    }
+
+    return out;
+}
+
+static size_t segment_size(struct msghdr * msg_p, size_t length)
+{
+    int gso_size = 0;
+
+    for (struct cmsghdr * cmsg_p = CMSG_FIRSTHDR(msg_p); NULL != cmsg_p;
+         cmsg_p                  = CMSG_NXTHDR(msg_p, cmsg_p))
+    {
+        if ((SOL_UDP == cmsg_p->cmsg_level) &&
+            (UDP_GRO == cmsg_p->cmsg_type))
+        {
+            memcpy(&gso_size, CMSG_DATA(cmsg_p), sizeof(gso_size));
+            break;
+        }
+    }
+
+    return (0 < gso_size) ? (size_t)gso_size : length;
+}
+
+static void queue_reply(datagram_worker_t * worker_p,
+                        size_t              slot,
+                        size_t              out,
+                        uint8_t *           reply_p,
+                        size_t              length)
+{
+    struct msghdr * msg_p = &worker_p->tx_msgs[out].msg_hdr;
+
+    worker_p->tx_iovs[out].iov_base = reply_p;
+    worker_p->tx_iovs[out].iov_len  = length;
+
+    msg_p->msg_name       = &worker_p->peers[slot];
+    msg_p->msg_namelen    = worker_p->rx_msgs[slot].msg_hdr.msg_namelen;
+    msg_p->msg_iov        = &worker_p->tx_iovs[out];
+    msg_p->msg_iovlen     = 1;
+    msg_p->msg_control    = NULL;
+    msg_p->msg_controllen = 0;
+    msg_p->msg_flags      = 0;
+}
+
+static void send_replies(datagram_worker_t * worker_p, size_t count)
+{
+    size_t sent   = 0;
+    int    result = 0;
+
+    while (sent < count)
+    {
+        result = sendmmsg(
+            worker_p->fd, &worker_p->tx_msgs[sent], count - sent, 0);
+        if (0 < result)
+        {
+            sent += (size_t)result;
+            continue;
+        }
+
+        if ((-1 == result) && (EINTR == errno))
+        {
+            continue;
+        }
+
+        // A device that cannot segment a GSO message fails it with EIO;
+        // from then on replies leave as separate datagrams.
+        if ((-1 == result) && (EIO == errno))
+        {
+            worker_p->gso = false;
+        }
+        sent++;
+    }
+}
+
+/*** end of file ***/
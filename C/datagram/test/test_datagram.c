@@ -0,0 +1,549 @@
+/**
+ * @file test_datagram.c
+ * @brief Tests for the Batched UDP Request Worker
+ *
+ * Runs a worker on its own thread behind a loopback UDP socket and talks to
+ * it from a client socket. The tests check that every request is answered
+ * exactly once with its own reply, including when several batches' worth
+ * arrive before the worker reads any; that a handler returning 0 or more
+ * than DATAGRAM_MAX_REPLY sends nothing; and, where the kernel supports UDP
+ * GSO, that a client's GSO send reaches the worker as one merged read whose
+ * requests are split and answered in order, both when the replies are of
+ * one size and when they are not. Build with -fsanitize=thread to check
+ * datagram_worker_stop() from another thread as well.
+ *
+ * Usage: test-datagram
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h> // htonl
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h> // UDP_SEGMENT
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "datagram.h"
+#include "utilities.h"
+
+#define TEST_REQUEST_SIZE 64        // Bytes per request datagram
+#define TEST_ROUNDS       20        // Bursts in the burst test
+#define TEST_SEGMENTS     10        // Requests in one GSO send
+#define TEST_TIMEOUT_S    2         // Longest wait for a reply
+#define TEST_RCVBUF       (1 << 20) // Receive buffer of both sockets
+#define TEST_BURST        (3 * DATAGRAM_BATCH) // Sent before reading
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr,                                                    \
+                    "%s:%d: CHECK(%s) failed\n",                               \
+                    __FILE__,                                                  \
+                    __LINE__,                                                  \
+                    #condition);                                               \
+            goto END;                                                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @struct harness
+ * @brief A running worker, its socket and a client connected to it.
+ */
+typedef struct harness
+{
+    int                 server_fd; // Bound socket the worker answers on
+    int                 client_fd; // Connected to 'server_fd'
+    datagram_worker_t * worker_p;  // The worker under test
+    pthread_t           thread;    // Runs datagram_worker_run()
+    bool                running;   // 'thread' was started
+} harness_t;
+
+/**
+ * @struct test_case
+ * @brief One named test.
+ */
+typedef struct test_case
+{
+    const char * name_p;               // Printed with the result
+    int (*run)(harness_t * harness_p); // Returns E_SUCCESS if it passed
+} test_case_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Sends one request at a time and checks its reply.
+ */
+static int test_echo(harness_t * harness_p);
+
+/**
+ * @brief Sends TEST_BURST requests before reading any reply, repeatedly.
+ */
+static int test_burst(harness_t * harness_p);
+
+/**
+ * @brief Checks that empty and oversized replies are not sent.
+ */
+static int test_no_reply(harness_t * harness_p);
+
+/**
+ * @brief Sends one GSO message whose replies are all of one size.
+ */
+static int test_gso_uniform(harness_t * harness_p);
+
+/**
+ * @brief Sends one GSO message whose replies differ in size.
+ */
+static int test_gso_mixed(harness_t * harness_p);
+
+/**
+ * @brief Opens both sockets, creates the worker and starts its thread.
+ *
+ * @param harness_p The harness to start.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int harness_start(harness_t * harness_p);
+
+/**
+ * @brief Stops and joins the worker, destroys it and closes both sockets.
+ *
+ * @param harness_p The harness to stop.
+ */
+static void harness_stop(harness_t * harness_p);
+
+/**
+ * @brief Handler: answers request 'id' with 'reply_len' bytes.
+ *
+ * A request holds its id and the reply size it asks for; the reply repeats
+ * the id and is padded with its low byte.
+ */
+static size_t handle_request(void *          context_p,
+                             const uint8_t * request_p,
+                             size_t          length,
+                             uint8_t *       reply_p,
+                             size_t          reply_size);
+
+/**
+ * @brief Runs the worker.
+ *
+ * @param arg_p The harness.
+ * @return NULL.
+ */
+static void * run_worker(void * arg_p);
+
+/**
+ * @brief Builds one request.
+ *
+ * @param request_p Where TEST_REQUEST_SIZE bytes are written.
+ * @param id The request id.
+ * @param reply_len The reply size to ask for.
+ */
+static void build_request(uint8_t * request_p, uint32_t id, uint16_t reply_len);
+
+/**
+ * @brief Sends one request asking for a 'reply_len' byte reply.
+ *
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int send_request(int fd, uint32_t id, uint16_t reply_len);
+
+/**
+ * @brief Reads one reply and checks that it answers 'id' with 'reply_len'
+ * bytes.
+ *
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int read_reply(int fd, uint32_t id, uint16_t reply_len);
+
+/**
+ * @brief Sends 'count' requests as one UDP GSO message.
+ *
+ * @param fd The client socket.
+ * @param first The first request id.
+ * @param reply_lens_p The reply size each request asks for.
+ * @param count The number of requests, at most TEST_SEGMENTS.
+ * @return E_SUCCESS on success, E_FAILURE if the kernel refused it.
+ */
+static int send_gso(int              fd,
+                    uint32_t         first,
+                    const uint16_t * reply_lens_p,
+                    size_t           count);
+
+int main(void)
+{
+    static const test_case_t tests[] = {
+        { "echo", test_echo },
+        { "burst", test_burst },
+        { "no-reply", test_no_reply },
+        { "gso-uniform", test_gso_uniform },
+        { "gso-mixed", test_gso_mixed },
+    };
+    int         exit_code = E_SUCCESS;
+    harness_t * harness_p = NULL;
+
+    for (size_t idx = 0; idx < sizeof(tests) / sizeof(tests[0]); idx++)
+    {
+        // A fresh worker per test, so a failure cannot leak into the next
+        harness_p = calloc(1, sizeof(*harness_p));
+        if ((NULL != harness_p) && (E_SUCCESS == harness_start(harness_p)) &&
+            (E_SUCCESS == tests[idx].run(harness_p)))
+        {
+            printf("PASS %s\n", tests[idx].name_p);
+        }
+        else
+        {
+            printf("FAIL %s\n", tests[idx].name_p);
+            exit_code = E_FAILURE;
+        }
+
+        if (NULL != harness_p)
+        {
+            harness_stop(harness_p);
+            free(harness_p);
+        }
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int test_echo(harness_t * harness_p)
+{
+    int exit_code = E_FAILURE;
+
+    for (uint32_t id = 0; id < 100; id++)
+    {
+        CHECK(E_SUCCESS == send_request(harness_p->client_fd, id, 8 + id));
+        CHECK(E_SUCCESS == read_reply(harness_p->client_fd, id, 8 + id));
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int test_burst(harness_t * harness_p)
+{
+    int      exit_code = E_FAILURE;
+    uint32_t id        = 0;
+
+    // One worker answers in arrival order, so the replies come back in
+    // the order the requests were sent
+    for (uint32_t round = 0; round < TEST_ROUNDS; round++)
+    {
+        for (size_t idx = 0; idx < TEST_BURST; idx++)
+        {
+            id = (round * TEST_BURST) + (uint32_t)idx;
+            CHECK(E_SUCCESS == send_request(harness_p->client_fd, id, 16));
+        }
+
+        for (size_t idx = 0; idx < TEST_BURST; idx++)
+        {
+            id = (round * TEST_BURST) + (uint32_t)idx;
+            CHECK(E_SUCCESS == read_reply(harness_p->client_fd, id, 16));
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int test_no_reply(harness_t * harness_p)
+{
+    int exit_code = E_FAILURE;
+    int fd        = harness_p->client_fd;
+
+    CHECK(E_SUCCESS == send_request(fd, 0, 0));
+    CHECK(E_SUCCESS == send_request(fd, 1, DATAGRAM_MAX_REPLY + 1));
+    CHECK(E_SUCCESS == send_request(fd, 2, DATAGRAM_MAX_REPLY));
+
+    // Only the last request is answered
+    CHECK(E_SUCCESS == read_reply(fd, 2, DATAGRAM_MAX_REPLY));
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int test_gso_uniform(harness_t * harness_p)
+{
+    int      exit_code                 = E_FAILURE;
+    uint16_t reply_lens[TEST_SEGMENTS] = { 0 };
+
+    // Equal replies and a shorter last one: one GSO message back
+    for (size_t idx = 0; idx < TEST_SEGMENTS; idx++)
+    {
+        reply_lens[idx] = 100;
+    }
+    reply_lens[TEST_SEGMENTS - 1] = 40;
+
+    if (E_SUCCESS !=
+        send_gso(harness_p->client_fd, 0, reply_lens, TEST_SEGMENTS))
+    {
+        printf("SKIP UDP GSO is not supported\n");
+        exit_code = E_SUCCESS;
+        goto END;
+    }
+
+    for (uint32_t idx = 0; idx < TEST_SEGMENTS; idx++)
+    {
+        CHECK(E_SUCCESS ==
+              read_reply(harness_p->client_fd, idx, reply_lens[idx]));
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int test_gso_mixed(harness_t * harness_p)
+{
+    int      exit_code                 = E_FAILURE;
+    uint16_t reply_lens[TEST_SEGMENTS] = { 0 };
+
+    // A longer reply after a shorter one cannot be a GSO segment, and an
+    // empty one is skipped; each reply must leave as its own datagram.
+    for (size_t idx = 0; idx < TEST_SEGMENTS; idx++)
+    {
+        reply_lens[idx] = (uint16_t)(8 + (24 * (idx % 3)));
+    }
+    reply_lens[4] = 0;
+
+    if (E_SUCCESS !=
+        send_gso(harness_p->client_fd, 0, reply_lens, TEST_SEGMENTS))
+    {
+        printf("SKIP UDP GSO is not supported\n");
+        exit_code = E_SUCCESS;
+        goto END;
+    }
+
+    for (uint32_t idx = 0; idx < TEST_SEGMENTS; idx++)
+    {
+        if (0 != reply_lens[idx])
+        {
+            CHECK(E_SUCCESS ==
+                  read_reply(harness_p->client_fd, idx, reply_lens[idx]));
+        }
+    }
+
+    // Nothing was sent twice
+    CHECK(E_SUCCESS == send_request(harness_p->client_fd, 99, 8));
+    CHECK(E_SUCCESS == read_reply(harness_p->client_fd, 99, 8));
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int harness_start(harness_t * harness_p)
+{
+    int                exit_code = E_FAILURE;
+    int                rcvbuf    = TEST_RCVBUF;
+    socklen_t          length    = sizeof(struct sockaddr_in);
+    struct timeval     timeout   = { .tv_sec = TEST_TIMEOUT_S };
+    struct sockaddr_in address   = { 0 };
+
+    harness_p->server_fd = -1;
+    harness_p->client_fd = -1;
+    harness_p->server_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    harness_p->client_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    CHECK((0 <= harness_p->server_fd) && (0 <= harness_p->client_fd));
+
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // Bursts must not overflow either receive buffer
+    setsockopt(harness_p->server_fd,
+               SOL_SOCKET,
+               SO_RCVBUF,
+               &rcvbuf,
+               sizeof(rcvbuf));
+    setsockopt(harness_p->client_fd,
+               SOL_SOCKET,
+               SO_RCVBUF,
+               &rcvbuf,
+               sizeof(rcvbuf));
+
+    // A reply that never comes fails the test instead of hanging it
+    setsockopt(harness_p->client_fd,
+               SOL_SOCKET,
+               SO_RCVTIMEO,
+               &timeout,
+               sizeof(timeout));
+
+    CHECK(0 == bind(harness_p->server_fd,
+                    (struct sockaddr *)&address,
+                    sizeof(address)));
+    CHECK(0 == getsockname(harness_p->server_fd,
+                           (struct sockaddr *)&address,
+                           &length));
+    CHECK(0 == connect(harness_p->client_fd,
+                       (struct sockaddr *)&address,
+                       sizeof(address)));
+
+    harness_p->worker_p =
+        datagram_worker_create(harness_p->server_fd, handle_request, NULL);
+    CHECK(NULL != harness_p->worker_p);
+
+    CHECK(0 ==
+          pthread_create(&harness_p->thread, NULL, run_worker, harness_p));
+    harness_p->running = true;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static void harness_stop(harness_t * harness_p)
+{
+    if (true == harness_p->running)
+    {
+        datagram_worker_stop(harness_p->worker_p);
+        pthread_join(harness_p->thread, NULL);
+    }
+
+    // The worker leaves its socket open
+    datagram_worker_destroy(&harness_p->worker_p);
+    if (0 <= harness_p->server_fd)
+    {
+        close(harness_p->server_fd);
+    }
+    if (0 <= harness_p->client_fd)
+    {
+        close(harness_p->client_fd);
+    }
+}
+
+static size_t handle_request(void *          context_p,
+                             const uint8_t * request_p,
+                             size_t          length,
+                             uint8_t *       reply_p,
+                             size_t          reply_size)
+{
+    uint32_t id        = 0;
+    uint16_t reply_len = 0;
+
+    (void)context_p;
+
+    if (TEST_REQUEST_SIZE != length)
+    {
+        return 0;
+    }
+
+    memcpy(&id, request_p, sizeof(id));
+    memcpy(&reply_len, request_p + sizeof(id), sizeof(reply_len));
+
+    // Never write past the buffer, even when asked to overfill it
+    memset(reply_p, (uint8_t)id, (reply_len < reply_size) ? reply_len
+                                                           : reply_size);
+    if (sizeof(id) <= reply_size)
+    {
+        memcpy(reply_p, &id, sizeof(id));
+    }
+
+    return reply_len;
+}
+
+static void * run_worker(void * arg_p)
+{
+    harness_t * harness_p = arg_p;
+
+    datagram_worker_run(harness_p->worker_p);
+    return NULL;
+}
+
+static void build_request(uint8_t * request_p, uint32_t id, uint16_t reply_len)
+{
+    memset(request_p, 0, TEST_REQUEST_SIZE);
+    memcpy(request_p, &id, sizeof(id));
+    memcpy(request_p + sizeof(id), &reply_len, sizeof(reply_len));
+}
+
+static int send_request(int fd, uint32_t id, uint16_t reply_len)
+{
+    uint8_t request[TEST_REQUEST_SIZE] = { 0 };
+
+    build_request(request, id, reply_len);
+    if ((ssize_t)sizeof(request) != send(fd, request, sizeof(request), 0))
+    {
+        perror("send_request(): send()");
+        return E_FAILURE;
+    }
+
+    return E_SUCCESS;
+}
+
+static int read_reply(int fd, uint32_t id, uint16_t reply_len)
+{
+    int      exit_code                     = E_FAILURE;
+    ssize_t  received                      = 0;
+    uint32_t echoed                        = 0;
+    uint8_t  reply[DATAGRAM_MAX_REPLY + 1] = { 0 };
+
+    do
+    {
+        received = recv(fd, reply, sizeof(reply), 0);
+    } while ((-1 == received) && (EINTR == errno));
+
+    CHECK(reply_len == received);
+    CHECK(sizeof(echoed) <= (size_t)received);
+    memcpy(&echoed, reply, sizeof(echoed));
+    CHECK(id == echoed);
+
+    for (size_t idx = sizeof(echoed); idx < (size_t)received; idx++)
+    {
+        CHECK((uint8_t)id == reply[idx]);
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int send_gso(int              fd,
+                    uint32_t         first,
+                    const uint16_t * reply_lens_p,
+                    size_t           count)
+{
+    int     segment                                     = TEST_REQUEST_SIZE;
+    ssize_t length                                      = 0;
+    uint8_t requests[TEST_SEGMENTS * TEST_REQUEST_SIZE] = { 0 };
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        build_request(requests + (idx * TEST_REQUEST_SIZE),
+                      first + (uint32_t)idx,
+                      reply_lens_p[idx]);
+    }
+
+    // Sent as one message; a worker with UDP_GRO reads it in one go
+    if (0 != setsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)))
+    {
+        return E_FAILURE;
+    }
+
+    length = (ssize_t)(count * TEST_REQUEST_SIZE);
+    if (length != send(fd, requests, (size_t)length, 0))
+    {
+        return E_FAILURE;
+    }
+
+    segment = 0;
+    setsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment));
+    return E_SUCCESS;
+}
+
+/*** end of file ***/
@@ -0,0 +1,131 @@
+/**
+ * @file expr_engine.h
+ * @brief Header for the Expression Compiler and Evaluator
+ *
+ * This header file provides the interface for evaluating whole arithmetic
+ * expressions such as "(3 + 4) * 2 - 7 % 3" in one request, rather than one
+ * operation per request. An expression is compiled into a flat postfix
+ * program and run by a single loop over a small value stack.
+ *
+ * Compilation works on the expression's shape: its operators and
+ * parentheses with every number replaced by a placeholder, so "1 + 2 * 3"
+ * and "40 + 5 * 60" share the shape "n+n*n" and therefore one program. The
+ * numbers become the program's arguments, consumed in the order they appear.
+ * An expr_cache_t remembers the programs of recently seen shapes, so a
+ * client that sends the same template with different numbers pays only for
+ * a lexing pass before the program runs.
+ *
+ * Arithmetic is on int32_t and wraps on overflow (two's complement), as in
+ * calc_kernels.h. Division or remainder by zero fails the evaluation.
+ *
+ */
+#ifndef _EXPR_ENGINE_H
+#define _EXPR_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EXPR_MAX_LENGTH 256 // Longest expression text, in bytes
+#define EXPR_MAX_SHAPE  64  // Most numbers, operators and parentheses
+#define EXPR_MAX_CODE   64  // Most instructions in a program
+#define EXPR_MAX_ARGS   32  // Most numbers in an expression
+#define EXPR_MAX_STACK  32  // Deepest value stack a program may need
+
+/**
+ * @struct expr_program
+ * @brief A compiled expression shape.
+ *
+ * Self-contained, so it may be copied and cached by value.
+ */
+typedef struct expr_program
+{
+    uint8_t code[EXPR_MAX_CODE]; // Postfix instructions
+    uint8_t length;              // Instructions in 'code'
+    uint8_t arg_count;           // Numbers the program consumes
+    uint8_t stack_depth;         // Largest stack the program builds
+} expr_program_t;
+
+/**
+ * @struct expr_cache
+ * @brief Opaque cache of compiled programs, keyed by shape.
+ *
+ * A cache is not thread-safe; give each connection or worker its own, which
+ * also keeps one client's templates from evicting another's.
+ */
+typedef struct expr_cache expr_cache_t;
+
+/**
+ * @brief Compiles an expression.
+ *
+ * Numbers are decimal integers within the int32_t range; '+' and '-' may
+ * also be used as unary operators. Operators are '+', '-', '*', '/' and
+ * '%', with the usual precedence and left associativity. Spaces and tabs
+ * are ignored.
+ *
+ * @param text_p The expression. Need not be NUL terminated.
+ * @param length The size of the expression, at most EXPR_MAX_LENGTH.
+ * @param program_p Pointer to where the program is stored.
+ * @param args_p Array of EXPR_MAX_ARGS entries receiving the numbers.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int expr_compile(const char *     text_p,
+                 size_t           length,
+                 expr_program_t * program_p,
+                 int32_t *        args_p);
+
+/**
+ * @brief Runs a program on the numbers of one expression.
+ *
+ * @param program_p The program.
+ * @param args_p The numbers, program_p->arg_count of them.
+ * @param result_p Pointer to where the value is stored on success.
+ * @return int - Returns E_SUCCESS on success, E_FAILURE on division by zero.
+ */
+int expr_evaluate(const expr_program_t * program_p,
+                  const int32_t *        args_p,
+                  int32_t *              result_p);
+
+/**
+ * @brief Creates a cache of about 'entries' compiled shapes.
+ *
+ * The capacity is rounded up to a power of two.
+ *
+ * @param entries The requested number of entries.
+ * @return expr_cache_t * - The new cache, or NULL on failure.
+ */
+expr_cache_t * expr_cache_create(size_t entries);
+
+/**
+ * @brief Destroys a cache and sets the caller's pointer to NULL.
+ *
+ * @param cache_pp The address of the cache pointer.
+ */
+void expr_cache_destroy(expr_cache_t ** cache_pp);
+
+/**
+ * @brief Evaluates an expression, compiling its shape only on a cache miss.
+ *
+ * @param cache_p The cache.
+ * @param text_p The expression, as for expr_compile().
+ * @param length The size of the expression.
+ * @param result_p Pointer to where the value is stored on success.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int expr_cache_evaluate(expr_cache_t * cache_p,
+                        const char *   text_p,
+                        size_t         length,
+                        int32_t *      result_p);
+
+/**
+ * @brief Reads how often expr_cache_evaluate() found a compiled shape.
+ *
+ * @param cache_p The cache.
+ * @param hits_p Pointer to where the number of hits is stored.
+ * @param misses_p Pointer to where the number of misses is stored.
+ */
+void expr_cache_stats(const expr_cache_t * cache_p,
+                      uint64_t *           hits_p,
+                      uint64_t *           misses_p);
+
+#endif /* _EXPR_ENGINE_H */
+/*** end of file ***/
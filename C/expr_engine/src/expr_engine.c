@@ -0,0 +1,641 @@
+/**
+ * @file expr_engine.c
+ * @brief Expression Compiler and Evaluator
+ *
+ * This file implements the three stages of evaluating an expression. The
+ * lexer makes one pass over the text, parsing the numbers into the argument
+ * array and writing every other token into the shape. The compiler is a
+ * recursive descent parser over the shape that emits postfix code, one byte
+ * per instruction; since the numbers are consumed in the order they appear,
+ * an argument instruction needs no operand. The evaluator is a single
+ * switch over the code.
+ *
+ * The cache is direct-mapped on a hash of the shape, and an entry holds the
+ * shape itself so that a hit is confirmed with one memcmp().
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "expr_engine.h"
+#include "number_parser.h"
+#include "utilities.h"
+
+#define SHAPE_NUMBER      'n'     // Placeholder for a number in a shape
+#define MAX_CACHE_ENTRIES 1048576 // Largest cache accepted (2^20)
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ULL // 64-bit FNV-1a start value
+#define FNV_PRIME        0x00000100000001B3ULL // 64-bit FNV-1a multiplier
+
+/**
+ * @enum expr_op
+ * @brief Program instructions.
+ */
+typedef enum expr_op
+{
+    EXPR_OP_ARG = 0, // Push the next number
+    EXPR_OP_ADD,     // Pop b, pop a, push a + b
+    EXPR_OP_SUB,     // Pop b, pop a, push a - b
+    EXPR_OP_MUL,     // Pop b, pop a, push a * b
+    EXPR_OP_DIV,     // Pop b, pop a, push a / b
+    EXPR_OP_MOD,     // Pop b, pop a, push a % b
+    EXPR_OP_NEG,     // Pop a, push -a
+} expr_op_t;
+
+/**
+ * @struct expr_parser
+ * @brief State of the compiler while it walks one shape.
+ */
+typedef struct expr_parser
+{
+    const char *     shape_p;   // The shape being compiled
+    size_t           length;    // Tokens in the shape
+    size_t           position;  // Next token
+    size_t           depth;     // Stack depth after the code so far
+    expr_program_t * program_p; // Where the code is emitted
+} expr_parser_t;
+
+/**
+ * @struct expr_entry
+ * @brief One cached shape and its program.
+ */
+typedef struct expr_entry
+{
+    uint64_t       hash;                  // Hash of the shape
+    bool           valid;                 // Whether the entry is in use
+    uint8_t        shape_length;          // Tokens in 'shape'
+    char           shape[EXPR_MAX_SHAPE]; // The shape
+    expr_program_t program;               // Its compiled program
+} expr_entry_t;
+
+struct expr_cache
+{
+    expr_entry_t * entries_p; // The entries
+    size_t         mask;      // Number of entries - 1
+    uint64_t       hits;      // Shapes found compiled
+    uint64_t       misses;    // Shapes compiled
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Splits an expression into its shape and its numbers.
+ *
+ * @param text_p The expression.
+ * @param length The size of the expression.
+ * @param shape_p Array of EXPR_MAX_SHAPE entries receiving the shape.
+ * @param shape_length_p Pointer to where the shape's length is stored.
+ * @param args_p Array of EXPR_MAX_ARGS entries receiving the numbers.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int lex_expression(const char * text_p,
+                          size_t       length,
+                          char *       shape_p,
+                          size_t *     shape_length_p,
+                          int32_t *    args_p);
+
+/**
+ * @brief Compiles a shape into a program.
+ *
+ * @param shape_p The shape.
+ * @param length The shape's length.
+ * @param program_p Pointer to where the program is stored.
+ * @return E_SUCCESS on success, E_FAILURE if the shape is not an expression.
+ */
+static int compile_shape(const char *     shape_p,
+                         size_t           length,
+                         expr_program_t * program_p);
+
+/**
+ * @brief Parses "term { ('+' | '-') term }".
+ *
+ * @param parser_p The parser.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int parse_sum(expr_parser_t * parser_p);
+
+/**
+ * @brief Parses "unary { ('*' | '/' | '%') unary }".
+ *
+ * @param parser_p The parser.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int parse_term(expr_parser_t * parser_p);
+
+/**
+ * @brief Parses "{ '+' | '-' } primary".
+ *
+ * @param parser_p The parser.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int parse_unary(expr_parser_t * parser_p);
+
+/**
+ * @brief Parses "number | '(' sum ')'".
+ *
+ * @param parser_p The parser.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int parse_primary(expr_parser_t * parser_p);
+
+/**
+ * @brief Appends one instruction, tracking the stack depth it leaves.
+ *
+ * @param parser_p The parser.
+ * @param op The instruction.
+ * @return E_SUCCESS on success, E_FAILURE if a limit is exceeded.
+ */
+static int emit(expr_parser_t * parser_p, expr_op_t op);
+
+/**
+ * @brief Hashes a shape with 64-bit FNV-1a.
+ *
+ * @param shape_p The shape.
+ * @param length The shape's length.
+ * @return The hash.
+ */
+static uint64_t hash_shape(const char * shape_p, size_t length);
+
+// +---------------------------------------------------------------------------+
+// |                             EXPRESSION API                                |
+// +---------------------------------------------------------------------------+
+
+int expr_compile(const char *     text_p,
+                 size_t           length,
+                 expr_program_t * program_p,
+                 int32_t *        args_p)
+{
+    int    exit_code    = E_FAILURE;
+    size_t shape_length = 0;
+    char   shape[EXPR_MAX_SHAPE];
+
+    if ((NULL == text_p) || (NULL == program_p) || (NULL == args_p))
+    {
+        print_error("expr_compile(): NULL argument passed.");
+        goto END;
+    }
+
+    exit_code =
+        lex_expression(text_p, length, shape, &shape_length, args_p);
+    if (E_SUCCESS != exit_code)
+    {
+        goto END;
+    }
+
+    exit_code = compile_shape(shape, shape_length, program_p);
+END:
+    return exit_code;
+}
+
+int expr_evaluate(const expr_program_t * program_p,
+                  const int32_t *        args_p,
+                  int32_t *              result_p)
+{
+    int32_t  stack[EXPR_MAX_STACK];
+    size_t   top  = 0;
+    size_t   next = 0;
+    uint32_t lhs  = 0;
+    uint32_t rhs  = 0;
+
+    if ((NULL == program_p) || (NULL == args_p) || (NULL == result_p) ||
+        (EXPR_MAX_STACK < program_p->stack_depth))
+    {
+        print_error("expr_evaluate(): Invalid argument passed.");
+        return E_FAILURE;
+    }
+
+    // The compiler proved the stack never underflows or exceeds
+    // stack_depth, so the loop does no bounds checks of its own.
+    for (size_t pc = 0; pc < program_p->length; pc++)
+    {
+        if (EXPR_OP_ARG == program_p->code[pc])
+        {
+            stack[top++] = args_p[next++];
+            continue;
+        }
+
+        if (EXPR_OP_NEG == program_p->code[pc])
+        {
+            stack[top - 1] = (int32_t)(0u - (uint32_t)stack[top - 1]);
+            continue;
+        }
+
+        // Unsigned arithmetic wraps instead of overflowing
+        top--;
+        lhs = (uint32_t)stack[top - 1];
+        rhs = (uint32_t)stack[top];
+
+        switch (program_p->code[pc])
+        {
+            case EXPR_OP_ADD:
+                stack[top - 1] = (int32_t)(lhs + rhs);
+                break;
+
+            case EXPR_OP_SUB:
+                stack[top - 1] = (int32_t)(lhs - rhs);
+                break;
+
+            case EXPR_OP_MUL:
+                stack[top - 1] = (int32_t)(lhs * rhs);
+                break;
+
+            case EXPR_OP_DIV:
+            case EXPR_OP_MOD:
+                if (0 == stack[top])
+                {
+                    return E_FAILURE;
+                }
+
+                // INT32_MIN / -1 wraps back to INT32_MIN
+                if ((-1 == stack[top]) && (INT32_MIN == stack[top - 1]))
+                {
+                    stack[top - 1] = (EXPR_OP_DIV == program_p->code[pc])
+                                         ? INT32_MIN
+                                         : 0;
+                    break;
+                }
+
+                stack[top - 1] = (EXPR_OP_DIV == program_p->code[pc])
+                                     ? (stack[top - 1] / stack[top])
+                                     : (stack[top - 1] % stack[top]);
+                break;
+
+            default:
+                print_error("expr_evaluate(): Unknown instruction.");
+                return E_FAILURE;
+        }
+    }
+
+    *result_p = stack[0];
+    return E_SUCCESS;
+}
+
+expr_cache_t * expr_cache_create(size_t entries)
+{
+    expr_cache_t * cache_p  = NULL;
+    size_t         capacity = 1;
+
+    if ((0 == entries) || (MAX_CACHE_ENTRIES < entries))
+    {
+        print_error("expr_cache_create(): Invalid number of entries.");
+        goto END;
+    }
+
+    while (capacity < entries)
+    {
+        capacity <<= 1;
+    }
+
+    cache_p = calloc(1, sizeof(expr_cache_t));
+    if (NULL == cache_p)
+    {
+        print_error("expr_cache_create(): calloc() failed.");
+        goto END;
+    }
+
+    cache_p->entries_p = calloc(capacity, sizeof(expr_entry_t));
+    if (NULL == cache_p->entries_p)
+    {
+        print_error("expr_cache_create(): Unable to allocate entries.");
+        expr_cache_destroy(&cache_p);
+        goto END;
+    }
+    cache_p->mask = capacity - 1;
+
+END:
+    return cache_p;
+}
+
+void expr_cache_destroy(expr_cache_t ** cache_pp)
+{
+    if ((NULL == cache_pp) || (NULL == *cache_pp))
+    {
+        return;
+    }
+
+    free((*cache_pp)->entries_p);
+    free(*cache_pp);
+    *cache_pp = NULL;
+}
+
+int expr_cache_evaluate(expr_cache_t * cache_p,
+                        const char *   text_p,
+                        size_t         length,
+                        int32_t *      result_p)
+{
+    size_t         shape_length = 0;
+    uint64_t       hash         = 0;
+    expr_entry_t * entry_p      = NULL;
+    char           shape[EXPR_MAX_SHAPE];
+    int32_t        args[EXPR_MAX_ARGS];
+    expr_program_t program;
+
+    if ((NULL == cache_p) || (NULL == text_p) || (NULL == result_p))
+    {
+        print_error("expr_cache_evaluate(): NULL argument passed.");
+        return E_FAILURE;
+    }
+
+    if (E_SUCCESS !=
+        lex_expression(text_p, length, shape, &shape_length, args))
+    {
+        return E_FAILURE;
+    }
+
+    hash    = hash_shape(shape, shape_length);
+    entry_p = &cache_p->entries_p[hash & cache_p->mask];
+
+    if ((true == entry_p->valid) && (hash == entry_p->hash) &&
+        (shape_length == entry_p->shape_length) &&
+        (0 == memcmp(shape, entry_p->shape, shape_length)))
+    {
+        cache_p->hits++;
+        return expr_evaluate(&entry_p->program, args, result_p);
+    }
+
+    // Only shapes that compile are cached, so a malformed expression that
+    // maps to the same entry leaves the program already there in place
+    cache_p->misses++;
+    if (E_SUCCESS != compile_shape(shape, shape_length, &program))
+    {
+        return E_FAILURE;
+    }
+
+    entry_p->valid        = true;
+    entry_p->hash         = hash;
+    entry_p->shape_length = (uint8_t)shape_length;
+    entry_p->program      = program;
+    memcpy(entry_p->shape, shape, shape_length);
+
+    return expr_evaluate(&entry_p->program, args, result_p);
+}
+
+void expr_cache_stats(const expr_cache_t * cache_p,
+                      uint64_t *           hits_p,
+                      uint64_t *           misses_p)
+{
+    if ((NULL == cache_p) || (NULL == hits_p) || (NULL == misses_p))
+    {
+        return;
+    }
+
+    *hits_p   = cache_p->hits;
+    *misses_p = cache_p->misses;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int lex_expression(const char * text_p,
+                          size_t       length,
+                          char *       shape_p,
+                          size_t *     shape_length_p,
+                          int32_t *    args_p)
+{
+    size_t shape_length = 0;
+    size_t arg_count    = 0;
+    size_t end          = 0;
+
+    if (EXPR_MAX_LENGTH < length)
+    {
+        return E_FAILURE;
+    }
+
+    for (size_t idx = 0; idx < length; idx = end)
+    {
+        end = idx + 1;
+
+        if ((' ' == text_p[idx]) || ('\t' == text_p[idx]))
+        {
+            continue;
+        }
+
+        if (EXPR_MAX_SHAPE == shape_length)
+        {
+            return E_FAILURE;
+        }
+
+        if (('0' <= text_p[idx]) && ('9' >= text_p[idx]))
+        {
+            while ((end < length) && ('0' <= text_p[end]) &&
+                   ('9' >= text_p[end]))
+            {
+                end++;
+            }
+
+            if ((EXPR_MAX_ARGS == arg_count) ||
+                (E_SUCCESS != number_parse_int32(text_p + idx,
+                                                 end - idx,
+                                                 &args_p[arg_count])))
+            {
+                return E_FAILURE;
+            }
+
+            arg_count++;
+            shape_p[shape_length++] = SHAPE_NUMBER;
+            continue;
+        }
+
+        if (NULL == memchr("+-*/%()", text_p[idx], 7))
+        {
+            return E_FAILURE;
+        }
+
+        shape_p[shape_length++] = text_p[idx];
+    }
+
+    *shape_length_p = shape_length;
+    return E_SUCCESS;
+}
+
+static int compile_shape(const char *     shape_p,
+                         size_t           length,
+                         expr_program_t * program_p)
+{
+    expr_parser_t parser = { 0 };
+
+    memset(program_p, 0, sizeof(*program_p));
+    parser.shape_p   = shape_p;
+    parser.length    = length;
+    parser.program_p = program_p;
+
+    if (E_SUCCESS != parse_sum(&parser))
+    {
+        return E_FAILURE;
+    }
+
+    // Everything must be consumed ("1 2" and "1)" are not expressions)
+    return (parser.position == length) ? E_SUCCESS : E_FAILURE;
+}
+
+static int parse_sum(expr_parser_t * parser_p)
+{
+    char token = '\0';
+
+    if (E_SUCCESS != parse_term(parser_p))
+    {
+        return E_FAILURE;
+    }
+
+    while (parser_p->position < parser_p->length)
+    {
+        token = parser_p->shape_p[parser_p->position];
+        if (('+' != token) && ('-' != token))
+        {
+            break;
+        }
+
+        parser_p->position++;
+        if ((E_SUCCESS != parse_term(parser_p)) ||
+            (E_SUCCESS !=
+             emit(parser_p, ('+' == token) ? EXPR_OP_ADD : EXPR_OP_SUB)))
+        {
+            return E_FAILURE;
+        }
+    }
+
+    return E_SUCCESS;
+}
+
+static int parse_term(expr_parser_t * parser_p)
+{
+    char      token = '\0';
+    expr_op_t op    = EXPR_OP_MUL;
+
+    if (E_SUCCESS != parse_unary(parser_p))
+    {
+        return E_FAILURE;
+    }
+
+    while (parser_p->position < parser_p->length)
+    {
+        token = parser_p->shape_p[parser_p->position];
+        if ('*' == token)
+        {
+            op = EXPR_OP_MUL;
+        }
+        else if ('/' == token)
+        {
+            op = EXPR_OP_DIV;
+        }
+        else if ('%' == token)
+        {
+            op = EXPR_OP_MOD;
+        }
+        else
+        {
+            break;
+        }
+
+        parser_p->position++;
+        if ((E_SUCCESS != parse_unary(parser_p)) ||
+            (E_SUCCESS != emit(parser_p, op)))
+        {
+            return E_FAILURE;
+        }
+    }
+
+    return E_SUCCESS;
+}
+
+static int parse_unary(expr_parser_t * parser_p)
+{
+    char token = '\0';
+
+    if (parser_p->position >= parser_p->length)
+    {
+        return E_FAILURE;
+    }
+
+    token = parser_p->shape_p[parser_p->position];
+    if ('+' == token)
+    {
+        parser_p->position++;
+        return parse_unary(parser_p);
+    }
+
+    if ('-' == token)
+    {
+        parser_p->position++;
+        if (E_SUCCESS != parse_unary(parser_p))
+        {
+            return E_FAILURE;
+        }
+        return emit(parser_p, EXPR_OP_NEG);
+    }
+
+    return parse_primary(parser_p);
+}
+
+static int parse_primary(expr_parser_t * parser_p)
+{
+    char token = parser_p->shape_p[parser_p->position];
+
+    parser_p->position++;
+
+    if (SHAPE_NUMBER == token)
+    {
+        parser_p->program_p->arg_count++;
+        return emit(parser_p, EXPR_OP_ARG);
+    }
+
+    if (('(' != token) || (E_SUCCESS != parse_sum(parser_p)) ||
+        (parser_p->position >= parser_p->length) ||
+        (')' != parser_p->shape_p[parser_p->position]))
+    {
+        return E_FAILURE;
+    }
+
+    parser_p->position++;
+    return E_SUCCESS;
+}
+
+static int emit(expr_parser_t * parser_p, expr_op_t op)
+{
+    expr_program_t * program_p = parser_p->program_p;
+
+    if (EXPR_MAX_CODE == program_p->length)
+    {
+        return E_FAILURE;
+    }
+
+    if (EXPR_OP_ARG == op)
+    {
+        parser_p->depth++;
+    }
+    else if (EXPR_OP_NEG != op)
+    {
+        parser_p->depth--;
+    }
+
+    if (EXPR_MAX_STACK < parser_p->depth)
+    {
+        return E_FAILURE;
+    }
+
+    if (program_p->stack_depth < parser_p->depth)
+    {
+        program_p->stack_depth = (uint8_t)parser_p->depth;
+    }
+
+    program_p->code[program_p->length++] = (uint8_t)op;
+    return E_SUCCESS;
+}
+
+static uint64_t hash_shape(const char * shape_p, size_t length)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    for (size_t idx = 0; idx < length; idx++)
+    {
+        hash ^= (uint8_t)shape_p[idx];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*** end of file ***/
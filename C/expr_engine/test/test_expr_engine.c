@@ -0,0 +1,392 @@
+/**
+ * @file test_expr_engine.c
+ * @brief Tests for the Expression Compiler and Evaluator
+ *
+ * Checks precedence, unary operators, wrapping and the division failures of
+ * compiled programs, then the shape cache: numbers of a seen shape are run
+ * by its cached program, a shape mapped to an occupied entry replaces it,
+ * and an expression that does not compile leaves the entry it maps to alone.
+ *
+ * Usage: test-expr-engine
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "expr_engine.h"
+#include "utilities.h"
+
+#define CACHE_ENTRIES 16 // Entries of the cache in the hit and miss test
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr,                                                    \
+                    "%s:%d: CHECK(%s) failed\n",                               \
+                    __FILE__,                                                  \
+                    __LINE__,                                                  \
+                    #condition);                                               \
+            goto END;                                                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @struct test_case
+ * @brief One named test.
+ */
+typedef struct test_case
+{
+    const char * name_p; // Printed with the result
+    int (*run)(void);    // Returns E_SUCCESS if the test passed
+} test_case_t;
+
+/**
+ * @struct sample
+ * @brief An expression and the value it evaluates to.
+ */
+typedef struct sample
+{
+    const char * text_p; // The expression
+    int32_t      value;  // Its value
+} sample_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Checks the values of compiled expressions.
+ */
+static int test_evaluate(void);
+
+/**
+ * @brief Checks that malformed expressions and division by zero fail.
+ */
+static int test_errors(void);
+
+/**
+ * @brief Checks that expressions of one shape share a cached program.
+ */
+static int test_hit_miss(void);
+
+/**
+ * @brief Checks two shapes taking turns in a cache of one entry.
+ */
+static int test_collision(void);
+
+/**
+ * @brief Checks that a shape that does not compile keeps the cached one.
+ */
+static int test_compile_failure(void);
+
+/**
+ * @brief Compiles and runs one expression.
+ *
+ * @param text_p The expression, NUL terminated.
+ * @param result_p Pointer to where the value is stored on success.
+ * @return E_SUCCESS if it compiled and ran, E_FAILURE otherwise.
+ */
+static int evaluate(const char * text_p, int32_t * result_p);
+
+/**
+ * @brief Runs one expression through a cache.
+ *
+ * @param cache_p The cache.
+ * @param text_p The expression, NUL terminated.
+ * @param result_p Pointer to where the value is stored on success.
+ * @return The result of expr_cache_evaluate().
+ */
+static int cache_evaluate(expr_cache_t * cache_p,
+                          const char *   text_p,
+                          int32_t *      result_p);
+
+/**
+ * @brief Checks a cache's hit and miss counters.
+ *
+ * @param cache_p The cache.
+ * @param hits The expected number of hits.
+ * @param misses The expected number of misses.
+ * @return E_SUCCESS if both match, E_FAILURE otherwise.
+ */
+static int check_stats(const expr_cache_t * cache_p,
+                       uint64_t             hits,
+                       uint64_t             misses);
+
+int main(void)
+{
+    static const test_case_t tests[] = {
+        { "evaluate", test_evaluate },
+        { "errors", test_errors },
+        { "hit-miss", test_hit_miss },
+        { "collision", test_collision },
+        { "compile-failure", test_compile_failure },
+    };
+    int exit_code = E_SUCCESS;
+
+    for (size_t idx = 0; idx < sizeof(tests) / sizeof(tests[0]); idx++)
+    {
+        if (E_SUCCESS == tests[idx].run())
+        {
+            printf("PASS %s\n", tests[idx].name_p);
+        }
+        else
+        {
+            printf("FAIL %s\n", tests[idx].name_p);
+            exit_code = E_FAILURE;
+        }
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int test_evaluate(void)
+{
+    static const sample_t samples[] = {
+        { "42", 42 },
+        { "1 + 2 * 3", 7 },
+        { "(3 + 4) * 2 - 7 % 3", 13 },
+        { "10 - 4 - 3", 3 },
+        { "100 / 10 / 5", 2 },
+        { "-2 * -3", 6 },
+        { "- -5", 5 },
+        { "+7", 7 },
+        { "-7 % 3", -1 },
+        { "7 / -2", -3 },
+        { "((1))", 1 },
+        { "\t2 *(3+4)", 14 },
+        { "2147483647 + 1", INT32_MIN },
+        { "0 - 2147483647 - 2", INT32_MAX },
+        { "65536 * 65536", 0 },
+        { "(-2147483647 - 1) / -1", INT32_MIN },
+        { "(-2147483647 - 1) % -1", 0 },
+    };
+    int     exit_code = E_FAILURE;
+    int32_t result    = 0;
+
+    for (size_t idx = 0; idx < sizeof(samples) / sizeof(samples[0]); idx++)
+    {
+        result = 0;
+        if ((E_SUCCESS != evaluate(samples[idx].text_p, &result)) ||
+            (samples[idx].value != result))
+        {
+            fprintf(stderr,
+                    "test_evaluate(): '%s' gave %d, expected %d\n",
+                    samples[idx].text_p,
+                    (int)result,
+                    (int)samples[idx].value);
+            goto END;
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int test_errors(void)
+{
+    static const char * malformed[] = {
+        "",   "1 2",   "1)",         "(1",  "1 +", "*1",
+        "()", "1 $ 2", "2147483648", "1.5", "(((", "1 + (2 * )",
+    };
+    int            exit_code = E_FAILURE;
+    int32_t        result    = 0;
+    int32_t        args[EXPR_MAX_ARGS];
+    expr_program_t program;
+    char           text[EXPR_MAX_LENGTH + 2];
+
+    for (size_t idx = 0; idx < sizeof(malformed) / sizeof(malformed[0]); idx++)
+    {
+        if (E_SUCCESS == evaluate(malformed[idx], &result))
+        {
+            fprintf(stderr,
+                    "test_errors(): '%s' was accepted\n",
+                    malformed[idx]);
+            goto END;
+        }
+    }
+
+    // Compiled, but the evaluation fails
+    CHECK(E_FAILURE == evaluate("1 / 0", &result));
+    CHECK(E_FAILURE == evaluate("5 % (2 - 2)", &result));
+
+    // Longer than EXPR_MAX_LENGTH, and more tokens than fit in a shape
+    memset(text, ' ', sizeof(text));
+    text[0] = '1';
+    CHECK(E_FAILURE ==
+          expr_compile(text, EXPR_MAX_LENGTH + 1, &program, args));
+
+    for (size_t idx = 0; idx <= EXPR_MAX_ARGS; idx++)
+    {
+        memcpy(&text[idx * 2], "1+", 2);
+    }
+    text[(EXPR_MAX_ARGS * 2) + 1] = '\0';
+    CHECK(E_FAILURE == evaluate(text, &result));
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int test_hit_miss(void)
+{
+    int            exit_code = E_FAILURE;
+    expr_cache_t * cache_p   = NULL;
+    int32_t        result    = 0;
+
+    CHECK(NULL == expr_cache_create(0));
+
+    cache_p = expr_cache_create(CACHE_ENTRIES);
+    CHECK(NULL != cache_p);
+    CHECK(E_SUCCESS == check_stats(cache_p, 0, 0));
+
+    CHECK(E_SUCCESS == cache_evaluate(cache_p, "1 + 2 * 3", &result));
+    CHECK(7 == result);
+    CHECK(E_SUCCESS == check_stats(cache_p, 0, 1));
+
+    // Same shape, other numbers and spacing: the cached program runs
+    CHECK(E_SUCCESS == cache_evaluate(cache_p, "40+5*60", &result));
+    CHECK(340 == result);
+    CHECK(E_SUCCESS == cache_evaluate(cache_p, "  0 + 0 * 0 ", &result));
+    CHECK(0 == result);
+    CHECK(E_SUCCESS == check_stats(cache_p, 2, 1));
+
+    // A different shape of the same numbers is compiled on its own
+    CHECK(E_SUCCESS == cache_evaluate(cache_p, "(1 + 2) * 3", &result));
+    CHECK(9 == result);
+    CHECK(E_SUCCESS == check_stats(cache_p, 2, 2));
+
+    // A shape that compiles is cached even if its first evaluation fails,
+    // and a failing evaluation on a hit keeps the entry
+    CHECK(E_FAILURE == cache_evaluate(cache_p, "(1 + 2) / 0", &result));
+    CHECK(E_SUCCESS == check_stats(cache_p, 2, 3));
+    CHECK(E_FAILURE == cache_evaluate(cache_p, "(7 + 2) / 0", &result));
+    CHECK(E_SUCCESS == cache_evaluate(cache_p, "(7 + 2) / 3", &result));
+    CHECK(3 == result);
+    CHECK(E_SUCCESS == check_stats(cache_p, 4, 3));
+
+    expr_cache_destroy(&cache_p);
+    CHECK(NULL == cache_p);
+
+    exit_code = E_SUCCESS;
+END:
+    expr_cache_destroy(&cache_p);
+    return exit_code;
+}
+
+static int test_collision(void)
+{
+    int            exit_code = E_FAILURE;
+    expr_cache_t * cache_p   = NULL;
+    int32_t        result    = 0;
+
+    // Every shape maps to the only entry
+    cache_p = expr_cache_create(1);
+    CHECK(NULL != cache_p);
+
+    CHECK(E_SUCCESS == cache_evaluate(cache_p, "6 - 2", &result));
+    CHECK(4 == result);
+    CHECK(E_SUCCESS == cache_evaluate(cache_p, "6 * 2 + 1", &result));
+    CHECK(13 == result);
+    CHECK(E_SUCCESS == check_stats(cache_p, 0, 2));
+
+    // The first shape was replaced, not merged with the second
+    CHECK(E_SUCCESS == cache_evaluate(cache_p, "9 - 3", &result));
+    CHECK(6 == result);
+    CHECK(E_SUCCESS == cache_evaluate(cache_p, "9 - 4", &result));
+    CHECK(5 == result);
+    CHECK(E_SUCCESS == check_stats(cache_p, 1, 3));
+
+    exit_code = E_SUCCESS;
+END:
+    expr_cache_destroy(&cache_p);
+    return exit_code;
+}
+
+static int test_compile_failure(void)
+{
+    int            exit_code = E_FAILURE;
+    expr_cache_t * cache_p   = NULL;
+    int32_t        result    = 0;
+
+    cache_p = expr_cache_create(1);
+    CHECK(NULL != cache_p);
+
+    CHECK(E_SUCCESS == cache_evaluate(cache_p, "(1 + 2) * 3", &result));
+    CHECK(9 == result);
+    CHECK(E_SUCCESS == check_stats(cache_p, 0, 1));
+
+    // Lexes, so it reaches the only entry, but does not compile
+    CHECK(E_FAILURE == cache_evaluate(cache_p, "(1 + 2) *", &result));
+    CHECK(E_FAILURE == cache_evaluate(cache_p, "1 2", &result));
+    CHECK(E_SUCCESS == check_stats(cache_p, 0, 3));
+
+    // Does not lex, so the cache is not consulted at all
+    CHECK(E_FAILURE == cache_evaluate(cache_p, "1 ^ 2", &result));
+    CHECK(E_SUCCESS == check_stats(cache_p, 0, 3));
+
+    // The good template survived
+    CHECK(E_SUCCESS == cache_evaluate(cache_p, "(4 + 5) * 6", &result));
+    CHECK(54 == result);
+    CHECK(E_SUCCESS == check_stats(cache_p, 1, 3));
+
+    exit_code = E_SUCCESS;
+END:
+    expr_cache_destroy(&cache_p);
+    return exit_code;
+}
+
+static int evaluate(const char * text_p, int32_t * result_p)
+{
+    int            exit_code = E_FAILURE;
+    int32_t        args[EXPR_MAX_ARGS];
+    expr_program_t program;
+
+    exit_code = expr_compile(text_p, strlen(text_p), &program, args);
+    if (E_SUCCESS != exit_code)
+    {
+        goto END;
+    }
+
+    exit_code = expr_evaluate(&program, args, result_p);
+END:
+    return exit_code;
+}
+
+static int cache_evaluate(expr_cache_t * cache_p,
+                          const char *   text_p,
+                          int32_t *      result_p)
+{
+    return expr_cache_evaluate(cache_p, text_p, strlen(text_p), result_p);
+}
+
+static int check_stats(const expr_cache_t * cache_p,
+                       uint64_t             hits,
+                       uint64_t             misses)
+{
+    uint64_t cache_hits   = 0;
+    uint64_t cache_misses = 0;
+
+    expr_cache_stats(cache_p, &cache_hits, &cache_misses);
+    if ((hits != cache_hits) || (misses != cache_misses))
+    {
+        fprintf(stderr,
+                "check_stats(): %llu hits and %llu misses, expected %llu and "
+                "%llu\n",
+                (unsigned long long)cache_hits,
+                (unsigned long long)cache_misses,
+                (unsigned long long)hits,
+                (unsigned long long)misses);
+        return E_FAILURE;
+    }
+
+    return E_SUCCESS;
+}
+
+/*** end of file ***/
@@ -0,0 +1,110 @@
+/**
+ * @file handoff.h
+ * @brief Header for Listening Socket Handoff
+ *
+ * This header file provides the interface for '--takeover=PATH', which lets
+ * a new NetCalc process replace a running one without ever closing its
+ * ports. The running process offers its listening sockets on the UNIX
+ * socket PATH; the new process connects, receives them with SCM_RIGHTS and
+ * acknowledges. From then on both processes hold the same sockets, so no
+ * connection in an accept backlog is lost: the old process stops accepting,
+ * closes its copies, finishes the requests it already queued and exits,
+ * while the new process accepts from the very same backlogs.
+ *
+ * A restart with a new configuration therefore looks like:
+ *
+ *   new: handoff_take(PATH)       -> the old process's sockets, if any
+ *   new: match them with listener_socket_port(), open any new '-p' ports
+ *   new: handoff_create(PATH), then handoff_offer() on a thread of its own
+ *   old: handoff_offer() returns  -> stop accepting, drain, exit
+ *
+ * Sockets for ports the new configuration no longer uses should be closed
+ * only after the old process has exited, or the connections already queued
+ * on them are reset.
+ *
+ */
+#ifndef _HANDOFF_H
+#define _HANDOFF_H
+
+#include <stddef.h>
+
+#define HANDOFF_MAX_FDS    253  // Most sockets per handoff (SCM_MAX_FD)
+#define HANDOFF_TIMEOUT_MS 5000 // Longest wait on a connected peer
+
+/**
+ * @struct handoff
+ * @brief Opaque handle of an offer made on a UNIX socket path.
+ */
+typedef struct handoff handoff_t;
+
+/**
+ * @brief Receives the listening sockets offered on a path.
+ *
+ * If no process is offering on the path (it does not exist, or nothing
+ * listens on it any more) this succeeds with no sockets, so a first start
+ * and a restart take the same code path. The offering process is only told
+ * to drain once every socket has been received.
+ *
+ * @param path_p The path of the UNIX socket.
+ * @param fds_p Array of 'max_fds' entries receiving the sockets, in the
+ * order they were offered. The caller owns them.
+ * @param max_fds The number of entries in fds_p.
+ * @param count_p Pointer to where the number of sockets is stored.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int handoff_take(const char * path_p,
+                 int *        fds_p,
+                 size_t       max_fds,
+                 size_t *     count_p);
+
+/**
+ * @brief Creates the UNIX socket a successor takes the sockets over from.
+ *
+ * A stale socket left at the path is replaced. The socket is only
+ * accessible to the owner, and connections from other users are refused.
+ *
+ * @param path_p The path of the UNIX socket.
+ * @return handoff_t * - The new handle, or NULL on failure.
+ */
+handoff_t * handoff_create(const char * path_p);
+
+/**
+ * @brief Removes the UNIX socket, destroys a handle and sets the caller's
+ * pointer to NULL.
+ *
+ * The path is only unlinked while it is still this handle's socket, so a
+ * successor that has already replaced it keeps its own. No offer may be in
+ * progress.
+ *
+ * @param handoff_pp The address of the handle pointer.
+ */
+void handoff_destroy(handoff_t ** handoff_pp);
+
+/**
+ * @brief Waits on the calling thread for a successor to take the sockets.
+ *
+ * A successor that disconnects or does not acknowledge within
+ * HANDOFF_TIMEOUT_MS is dropped and the wait goes on; the sockets are only
+ * given up once one acknowledges. The offered sockets stay open and owned
+ * by the caller either way.
+ *
+ * @param handoff_p The handle.
+ * @param fds_p The listening sockets.
+ * @param count The number of sockets, at most HANDOFF_MAX_FDS.
+ * @return int - Returns E_SUCCESS once a successor has the sockets and this
+ * process should drain and exit, otherwise E_FAILURE (also after
+ * handoff_stop()).
+ */
+int handoff_offer(handoff_t * handoff_p, const int * fds_p, size_t count);
+
+/**
+ * @brief Asks handoff_offer() to return without handing anything over.
+ *
+ * This is the one call that may be made from another thread.
+ *
+ * @param handoff_p The handle.
+ */
+void handoff_stop(handoff_t * handoff_p);
+
+#endif /* _HANDOFF_H */
+/*** end of file ***/
@@ -0,0 +1,560 @@
+/**
+ * @file handoff.c
+ * @brief Listening Socket Handoff
+ *
+ * This file implements both ends of a takeover. The offering process sends
+ * one message holding a small header and every listening socket as
+ * SCM_RIGHTS ancillary data; the kernel installs duplicates of them in the
+ * receiving process, which answers with a single acknowledgement byte. The
+ * offer only counts as taken once that byte arrives, so a successor that
+ * dies half way leaves the old process serving as before.
+ */
+#define _GNU_SOURCE // for accept4(), struct ucred and MSG_CMSG_CLOEXEC
+#include <errno.h>
+#include <poll.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "handoff.h"
+#include "utilities.h"
+
+#define HANDOFF_MAGIC   0x4E434B31 // "NCK1": protocol and version
+#define HANDOFF_ACK     'A'        // Sent by the successor once it has all
+#define HANDOFF_BACKLOG 4          // Successors that may wait to connect
+
+/**
+ * @struct handoff_message
+ * @brief The bytes sent alongside the sockets.
+ */
+typedef struct handoff_message
+{
+    uint32_t magic; // HANDOFF_MAGIC
+    uint32_t count; // Sockets attached
+} handoff_message_t;
+
+/**
+ * @struct handoff_control
+ * @brief Room for the SCM_RIGHTS message of HANDOFF_MAX_FDS sockets.
+ */
+typedef struct handoff_control
+{
+    alignas(struct cmsghdr) char buffer[CMSG_SPACE(sizeof(int) *
+                                                   HANDOFF_MAX_FDS)];
+} handoff_control_t;
+
+struct handoff
+{
+    int         listen_fd; // UNIX socket successors connect to
+    int         wake_fd;   // eventfd for handoff_stop()
+    atomic_bool stop;      // handoff_stop() was called
+    dev_t       device;    // Identity of the socket file, so that
+    ino_t       inode;     // destroy never unlinks a successor's
+    // Where the socket is bound
+    char        path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Fills in the address of a UNIX socket path.
+ *
+ * @param path_p The path.
+ * @param address_p Pointer to the address to fill in.
+ * @return E_SUCCESS on success, E_FAILURE if the path does not fit.
+ */
+static int make_address(const char * path_p, struct sockaddr_un * address_p);
+
+/**
+ * @brief Bounds every send and receive on a connected socket.
+ *
+ * @param fd The socket.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int set_timeouts(int fd);
+
+/**
+ * @brief Checks that the peer of a connected socket is the same user.
+ *
+ * @param fd The socket.
+ * @return true if the peer runs as this process's effective user.
+ */
+static bool is_same_user(int fd);
+
+/**
+ * @brief Sends the sockets and waits for the acknowledgement.
+ *
+ * @param fd The connected socket.
+ * @param fds_p The sockets to send.
+ * @param count The number of sockets.
+ * @return E_SUCCESS once acknowledged, E_FAILURE otherwise.
+ */
+static int send_sockets(int fd, const int * fds_p, size_t count);
+
+/**
+ * @brief Receives the sockets. On failure none of them are left open.
+ *
+ * @param fd The connected socket.
+ * @param fds_p Array of 'max_fds' entries receiving the sockets.
+ * @param max_fds The number of entries in fds_p.
+ * @param count_p Pointer to where the number of sockets is stored.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int receive_sockets(int      fd,
+                           int *    fds_p,
+                           size_t   max_fds,
+                           size_t * count_p);
+
+/**
+ * @brief Closes 'count' file descriptors.
+ *
+ * @param fds_p The descriptors.
+ * @param count The number of entries in fds_p.
+ */
+static void close_all(const int * fds_p, size_t count);
+
+// +---------------------------------------------------------------------------+
+// |                               HANDOFF API                                 |
+// +---------------------------------------------------------------------------+
+
+int handoff_take(const char * path_p,
+                 int *        fds_p,
+                 size_t       max_fds,
+                 size_t *     count_p)
+{
+    int                exit_code = E_FAILURE;
+    int                fd        = -1;
+    char               ack       = HANDOFF_ACK;
+    struct sockaddr_un address   = { 0 };
+
+    if ((NULL == path_p) || (NULL == fds_p) || (NULL == count_p))
+    {
+        print_error("handoff_take(): NULL argument passed.");
+        goto END;
+    }
+
+    *count_p = 0;
+
+    if (E_SUCCESS != make_address(path_p, &address))
+    {
+        goto END;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (-1 == fd)
+    {
+        perror("handoff_take(): socket()");
+        goto END;
+    }
+
+    if (0 != connect(fd, (struct sockaddr *)&address, sizeof(address)))
+    {
+        // Nobody to take over from: start with fresh sockets
+        if ((ENOENT == errno) || (ECONNREFUSED == errno))
+        {
+            exit_code = E_SUCCESS;
+            goto END;
+        }
+        perror("handoff_take(): connect()");
+        goto END;
+    }
+
+    if ((E_SUCCESS != set_timeouts(fd)) || (false == is_same_user(fd)))
+    {
+        print_error("handoff_take(): Refusing the offering process.");
+        goto END;
+    }
+
+    if (E_SUCCESS != receive_sockets(fd, fds_p, max_fds, count_p))
+    {
+        goto END;
+    }
+
+    if (1 != send(fd, &ack, 1, MSG_NOSIGNAL))
+    {
+        // Without the acknowledgement the old process keeps serving
+        perror("handoff_take(): send()");
+        close_all(fds_p, *count_p);
+        *count_p = 0;
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    if (-1 != fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+handoff_t * handoff_create(const char * path_p)
+{
+    handoff_t *        handoff_p = NULL;
+    struct sockaddr_un address   = { 0 };
+    struct stat        status    = { 0 };
+
+    if (NULL == path_p)
+    {
+        print_error("handoff_create(): NULL argument passed.");
+        goto END;
+    }
+
+    if (E_SUCCESS != make_address(path_p, &address))
+    {
+        goto END;
+    }
+
+    if (0 == lstat(path_p, &status))
+    {
+        if (!S_ISSOCK(status.st_mode))
+        {
+            print_error("handoff_create(): Path exists and is not a socket.");
+            goto END;
+        }
+        unlink(path_p);
+    }
+
+    handoff_p = calloc(1, sizeof(handoff_t));
+    if (NULL == handoff_p)
+    {
+        print_error("handoff_create(): calloc() failed.");
+        goto END;
+    }
+    atomic_init(&handoff_p->stop, false);
+    memcpy(handoff_p->path, address.sun_path, sizeof(handoff_p->path));
+
+    handoff_p->wake_fd   = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    handoff_p->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ((-1 == handoff_p->wake_fd) || (-1 == handoff_p->listen_fd))
+    {
+        perror("handoff_create(): eventfd()/socket()");
+        goto FAIL;
+    }
+
+    if (0 != bind(handoff_p->listen_fd,
+                  (struct sockaddr *)&address,
+                  sizeof(address)))
+    {
+        perror("handoff_create(): bind()");
+        goto FAIL;
+    }
+
+    if ((0 != chmod(path_p, S_IRUSR | S_IWUSR)) ||
+        (0 != stat(path_p, &status)) ||
+        (0 != listen(handoff_p->listen_fd, HANDOFF_BACKLOG)))
+    {
+        perror("handoff_create(): chmod()/listen()");
+        unlink(path_p);
+        goto FAIL;
+    }
+    handoff_p->device = status.st_dev;
+    handoff_p->inode  = status.st_ino;
+
+    goto END;
+
+FAIL:
+    if (-1 != handoff_p->listen_fd)
+    {
+        close(handoff_p->listen_fd);
+    }
+    if (-1 != handoff_p->wake_fd)
+    {
+        close(handoff_p->wake_fd);
+    }
+    free(handoff_p);
+    handoff_p = NULL;
+END:
+    return handoff_p;
+}
+
+void handoff_destroy(handoff_t ** handoff_pp)
+{
+    handoff_t * handoff_p = NULL;
+    struct stat status    = { 0 };
+
+    if ((NULL == handoff_pp) || (NULL == *handoff_pp))
+    {
+        return;
+    }
+    handoff_p = *handoff_pp;
+
+    if ((0 == stat(handoff_p->path, &status)) &&
+        (handoff_p->device == status.st_dev) &&
+        (handoff_p->inode == status.st_ino))
+    {
+        unlink(handoff_p->path);
+    }
+
+    close(handoff_p->listen_fd);
+    close(handoff_p->wake_fd);
+    free(handoff_p);
+    *handoff_pp = NULL;
+}
+
+int handoff_offer(handoff_t * handoff_p, const int * fds_p, size_t count)
+{
+    int           exit_code = E_FAILURE;
+    int           conn_fd   = -1;
+    struct pollfd poll_fds[2];
+
+    if ((NULL == handoff_p) || (NULL == fds_p) || (0 == count) ||
+        (HANDOFF_MAX_FDS < count))
+    {
+        print_error("handoff_offer(): Invalid argument passed.");
+        goto END;
+    }
+
+    poll_fds[0].fd     = handoff_p->listen_fd;
+    poll_fds[0].events = POLLIN;
+    poll_fds[1].fd     = handoff_p->wake_fd;
+    poll_fds[1].events = POLLIN;
+
+    while (false == atomic_load(&handoff_p->stop))
+    {
+        if (-1 == poll(poll_fds, 2, -1))
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            perror("handoff_offer(): poll()");
+            goto END;
+        }
+
+        if (0 != poll_fds[1].revents)
+        {
+            break;
+        }
+
+        conn_fd = accept4(handoff_p->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (-1 == conn_fd)
+        {
+            continue;
+        }
+
+        if ((true == is_same_user(conn_fd)) &&
+            (E_SUCCESS == set_timeouts(conn_fd)) &&
+            (E_SUCCESS == send_sockets(conn_fd, fds_p, count)))
+        {
+            exit_code = E_SUCCESS;
+            close(conn_fd);
+            goto END;
+        }
+
+        print_error("handoff_offer(): Successor dropped; still serving.");
+        close(conn_fd);
+    }
+
+END:
+    return exit_code;
+}
+
+void handoff_stop(handoff_t * handoff_p)
+{
+    uint64_t one = 1;
+
+    if (NULL == handoff_p)
+    {
+        return;
+    }
+
+    atomic_store(&handoff_p->stop, true);
+    if (sizeof(one) != write(handoff_p->wake_fd, &one, sizeof(one)))
+    {
+        perror("handoff_stop(): write()");
+    }
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int make_address(const char * path_p, struct sockaddr_un * address_p)
+{
+    size_t length = strnlen(path_p, sizeof(address_p->sun_path));
+
+    if ((0 == length) || (sizeof(address_p->sun_path) <= length))
+    {
+        print_error("make_address(): Invalid UNIX socket path.");
+        return E_FAILURE;
+    }
+
+    memset(address_p, 0, sizeof(*address_p));
+    address_p->sun_family = AF_UNIX;
+    memcpy(address_p->sun_path, path_p, length);
+    return E_SUCCESS;
+}
+
+static int set_timeouts(int fd)
+{
+    struct timeval timeout = { 0 };
+
+    timeout.tv_sec  = HANDOFF_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (HANDOFF_TIMEOUT_MS % 1000) * 1000;
+
+    if ((0 != setsockopt(
+                  fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout))) ||
+        (0 != setsockopt(
+                  fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout))))
+    {
+        perror("set_timeouts(): setsockopt()");
+        return E_FAILURE;
+    }
+
+    return E_SUCCESS;
+}
+
+static bool is_same_user(int fd)
+{
+    struct ucred credentials = { 0 };
+    socklen_t    length      = sizeof(credentials);
+
+    if (0 != getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length))
+    {
+        perror("is_same_user(): SO_PEERCRED");
+        return false;
+    }
+
+    return (geteuid() == credentials.uid);
+}
+
+static int send_sockets(int fd, const int * fds_p, size_t count)
+{
+    handoff_message_t message = { .magic = HANDOFF_MAGIC };
+    handoff_control_t control = { 0 };
+    struct iovec      vector  = { .iov_base = &message,
+                                  .iov_len  = sizeof(message) };
+    struct msghdr     header  = { 0 };
+    struct cmsghdr *  cmsg_p  = NULL;
+    char              ack     = '\0';
+
+    message.count = (uint32_t)count;
+
+    header.msg_iov        = &vector;
+    header.msg_iovlen     = 1;
+    header.msg_control    = control.buffer;
+    header.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+    cmsg_p             = CMSG_FIRSTHDR(&header);
+    cmsg_p->cmsg_level = SOL_SOCKET;
+    cmsg_p->cmsg_type  = SCM_RIGHTS;
+    cmsg_p->cmsg_len   = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg_p), fds_p, sizeof(int) * count);
+
+    if ((ssize_t)sizeof(message) != sendmsg(fd, &header, MSG_NOSIGNAL))
+    {
+        perror("send_sockets(): sendmsg()");
+        return E_FAILURE;
+    }
+
+    if ((1 != recv(fd, &ack, 1, 0)) || (HANDOFF_ACK != ack))
+    {
+        return E_FAILURE;
+    }
+
+    return E_SUCCESS;
+}
+
+static int receive_sockets(int      fd,
+                           int *    fds_p,
+                           size_t   max_fds,
+                           size_t * count_p)
+{
+    int               exit_code = E_FAILURE;
+    handoff_message_t message   = { 0 };
+    handoff_control_t control   = { 0 };
+    struct iovec      vector    = { .iov_base = &message,
+                                    .iov_len  = sizeof(message) };
+    struct msghdr     header    = { 0 };
+    ssize_t           received  = 0;
+    size_t            count     = 0;
+    size_t            attached  = 0;
+    struct stat       status    = { 0 };
+    int               fds[HANDOFF_MAX_FDS];
+
+    header.msg_iov        = &vector;
+    header.msg_iovlen     = 1;
+    header.msg_control    = control.buffer;
+    header.msg_controllen = sizeof(control.buffer);
+
+    received = recvmsg(fd, &header, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    if (-1 == received)
+    {
+        perror("receive_sockets(): recvmsg()");
+        goto END;
+    }
+
+    // Collect every descriptor first, so that all of them are closed on
+    // any failure below
+    for (struct cmsghdr * cmsg_p = CMSG_FIRSTHDR(&header); NULL != cmsg_p;
+         cmsg_p                  = CMSG_NXTHDR(&header, cmsg_p))
+    {
+        if ((SOL_SOCKET != cmsg_p->cmsg_level) ||
+            (SCM_RIGHTS != cmsg_p->cmsg_type))
+        {
+            continue;
+        }
+
+        attached = (cmsg_p->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (HANDOFF_MAX_FDS - count < attached)
+        {
+            attached = HANDOFF_MAX_FDS - count;
+        }
+        memcpy(&fds[count], CMSG_DATA(cmsg_p), sizeof(int) * attached);
+        count += attached;
+    }
+
+    if (((ssize_t)sizeof(message) != received) ||
+        (0 != (header.msg_flags & MSG_CTRUNC)) ||
+        (HANDOFF_MAGIC != message.magic) || (count != message.count))
+    {
+        print_error("receive_sockets(): Malformed handoff message.");
+        goto END;
+    }
+
+    if (max_fds < count)
+    {
+        print_error("receive_sockets(): More sockets than expected.");
+        goto END;
+    }
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        if ((0 != fstat(fds[idx], &status)) || !S_ISSOCK(status.st_mode))
+        {
+            print_error("receive_sockets(): Received a non-socket.");
+            goto END;
+        }
+    }
+
+    memcpy(fds_p, fds, sizeof(int) * count);
+    *count_p = count;
+    count    = 0;
+
+    exit_code = E_SUCCESS;
+END:
+    close_all(fds, count);
+    return exit_code;
+}
+
+static void close_all(const int * fds_p, size_t count)
+{
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        close(fds_p[idx]);
+    }
+}
+
+/*** end of file ***/
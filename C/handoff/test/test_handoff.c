@@ -0,0 +1,553 @@
+/**
+ * @file test_handoff.c
+ * @brief Tests for Listening Socket Handoff
+ *
+ * Plays both processes of a takeover in one: a thread offers loopback TCP
+ * listeners with handoff_offer() while the main thread takes them with
+ * handoff_take(). The tests check that a start with nobody to take over
+ * from gets no sockets; that the taken sockets are the offered ones, with
+ * a connection queued before the handoff accepted from the new copy; that
+ * a successor with too little room is dropped and the offer keeps waiting
+ * for the next; that handoff_stop() ends an offer without handing anything
+ * over; and that a stale socket is replaced while a regular file or a
+ * successor's socket at the path is left alone.
+ *
+ * Usage: test-handoff
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h> // htonl
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "handoff.h"
+#include "utilities.h"
+
+#define TEST_LISTENERS 3   // Sockets offered in each test
+#define TEST_DIR_SIZE  64  // Room for the temporary directory
+#define TEST_PATH_SIZE 108 // sizeof(sun_path)
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr,                                                    \
+                    "%s:%d: CHECK(%s) failed\n",                               \
+                    __FILE__,                                                  \
+                    __LINE__,                                                  \
+                    #condition);                                               \
+            goto END;                                                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @struct harness
+ * @brief The path, the offered listeners and the thread offering them.
+ */
+typedef struct harness
+{
+    char        path[TEST_PATH_SIZE];      // UNIX socket of the offer
+    char        directory[TEST_DIR_SIZE];  // Holds 'path'
+    int         fds[TEST_LISTENERS];       // Offered listeners
+    handoff_t * handoff_p;                 // The offer under test
+    pthread_t   thread;                    // Runs handoff_offer()
+    bool        offering;                  // 'thread' was started
+    int         result;                    // handoff_offer()'s return
+} harness_t;
+
+/**
+ * @struct test_case
+ * @brief One named test.
+ */
+typedef struct test_case
+{
+    const char * name_p;               // Printed with the result
+    int (*run)(harness_t * harness_p); // Returns E_SUCCESS if it passed
+} test_case_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Checks that taking from a path nobody offers on yields nothing.
+ */
+static int test_no_offer(harness_t * harness_p);
+
+/**
+ * @brief Takes the listeners over and accepts a queued connection.
+ */
+static int test_takeover(harness_t * harness_p);
+
+/**
+ * @brief Drops a successor that cannot hold every socket, then hands over.
+ */
+static int test_dropped_successor(harness_t * harness_p);
+
+/**
+ * @brief Checks that handoff_stop() ends an offer.
+ */
+static int test_stop(harness_t * harness_p);
+
+/**
+ * @brief Checks which files at the path create and destroy replace.
+ */
+static int test_path(harness_t * harness_p);
+
+/**
+ * @brief Checks that an offer with bad arguments fails at once.
+ */
+static int test_arguments(harness_t * harness_p);
+
+/**
+ * @brief Makes a private directory and opens the listeners.
+ *
+ * @param harness_p The harness to set up.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int harness_start(harness_t * harness_p);
+
+/**
+ * @brief Stops the offer, closes the listeners and removes the directory.
+ *
+ * @param harness_p The harness to tear down.
+ */
+static void harness_stop(harness_t * harness_p);
+
+/**
+ * @brief Creates the offer and starts the thread making it.
+ *
+ * @param harness_p The harness.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int harness_offer(harness_t * harness_p);
+
+/**
+ * @brief Waits for the offering thread and returns what the offer returned.
+ *
+ * @param harness_p The harness.
+ * @return The result of handoff_offer().
+ */
+static int harness_join(harness_t * harness_p);
+
+/**
+ * @brief Offers the harness's listeners.
+ *
+ * @param arg_p The harness.
+ * @return NULL.
+ */
+static void * run_offer(void * arg_p);
+
+/**
+ * @brief Opens a loopback TCP listener on a port of the kernel's choosing.
+ *
+ * @return The listening socket, or -1 on failure.
+ */
+static int open_listener(void);
+
+/**
+ * @brief Returns the port a socket is bound to.
+ *
+ * @return The port in network byte order, or 0 on failure.
+ */
+static in_port_t socket_port(int fd);
+
+/**
+ * @brief Connects to a port on the loopback address.
+ *
+ * @return The connected socket, or -1 on failure.
+ */
+static int connect_to(in_port_t port);
+
+/**
+ * @brief Closes 'count' sockets.
+ */
+static void close_all(const int * fds_p, size_t count);
+
+int main(void)
+{
+    static const test_case_t tests[] = {
+        { "no-offer", test_no_offer },
+        { "takeover", test_takeover },
+        { "dropped-successor", test_dropped_successor },
+        { "stop", test_stop },
+        { "path", test_path },
+        { "arguments", test_arguments },
+    };
+    int         exit_code = E_SUCCESS;
+    harness_t * harness_p = NULL;
+
+    for (size_t idx = 0; idx < sizeof(tests) / sizeof(tests[0]); idx++)
+    {
+        // A fresh directory per test, so a failure cannot leak into the next
+        harness_p = calloc(1, sizeof(*harness_p));
+        if ((NULL != harness_p) && (E_SUCCESS == harness_start(harness_p)) &&
+            (E_SUCCESS == tests[idx].run(harness_p)))
+        {
+            printf("PASS %s\n", tests[idx].name_p);
+        }
+        else
+        {
+            printf("FAIL %s\n", tests[idx].name_p);
+            exit_code = E_FAILURE;
+        }
+
+        if (NULL != harness_p)
+        {
+            harness_stop(harness_p);
+            free(harness_p);
+        }
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int test_no_offer(harness_t * harness_p)
+{
+    int                exit_code = E_FAILURE;
+    int                fd        = -1;
+    size_t             count     = 1;
+    struct sockaddr_un address   = { .sun_family = AF_UNIX };
+    int                fds[TEST_LISTENERS];
+
+    // A first start: the path does not exist
+    CHECK(E_SUCCESS ==
+          handoff_take(harness_p->path, fds, TEST_LISTENERS, &count));
+    CHECK(0 == count);
+
+    // A crashed predecessor: the socket is there but nobody listens
+    memcpy(address.sun_path, harness_p->path, sizeof(address.sun_path));
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    CHECK(0 <= fd);
+    CHECK(0 == bind(fd, (struct sockaddr *)&address, sizeof(address)));
+    close(fd);
+    fd    = -1;
+    count = 1;
+    CHECK(E_SUCCESS ==
+          handoff_take(harness_p->path, fds, TEST_LISTENERS, &count));
+    CHECK(0 == count);
+
+    // ...and its stale socket does not stop the next offer
+    harness_p->handoff_p = handoff_create(harness_p->path);
+    CHECK(NULL != harness_p->handoff_p);
+
+    exit_code = E_SUCCESS;
+END:
+    if (0 <= fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+static int test_takeover(harness_t * harness_p)
+{
+    int    exit_code = E_FAILURE;
+    int    queued_fd = -1;
+    int    conn_fd   = -1;
+    size_t count     = 0;
+    int    fds[TEST_LISTENERS];
+
+    // Queued in the backlog before the handoff, accepted after it
+    queued_fd = connect_to(socket_port(harness_p->fds[1]));
+    CHECK(0 <= queued_fd);
+
+    CHECK(E_SUCCESS == harness_offer(harness_p));
+    CHECK(E_SUCCESS ==
+          handoff_take(harness_p->path, fds, TEST_LISTENERS, &count));
+    CHECK(TEST_LISTENERS == count);
+    CHECK(E_SUCCESS == harness_join(harness_p));
+
+    // The old process closes its copies; the ports stay open
+    for (size_t idx = 0; idx < TEST_LISTENERS; idx++)
+    {
+        CHECK(socket_port(harness_p->fds[idx]) == socket_port(fds[idx]));
+        close(harness_p->fds[idx]);
+        harness_p->fds[idx] = -1;
+    }
+
+    conn_fd = accept(fds[1], NULL, NULL);
+    CHECK(0 <= conn_fd);
+
+    exit_code = E_SUCCESS;
+END:
+    if (0 <= conn_fd)
+    {
+        close(conn_fd);
+    }
+    if (0 <= queued_fd)
+    {
+        close(queued_fd);
+    }
+    close_all(fds, count);
+    return exit_code;
+}
+
+static int test_dropped_successor(harness_t * harness_p)
+{
+    int    exit_code = E_FAILURE;
+    size_t count     = 0;
+    int    fds[TEST_LISTENERS];
+
+    CHECK(E_SUCCESS == harness_offer(harness_p));
+
+    // Too little room: no acknowledgement, and the offer stands
+    CHECK(E_FAILURE ==
+          handoff_take(harness_p->path, fds, TEST_LISTENERS - 1, &count));
+    CHECK(0 == count);
+
+    CHECK(E_SUCCESS ==
+          handoff_take(harness_p->path, fds, TEST_LISTENERS, &count));
+    CHECK(TEST_LISTENERS == count);
+    CHECK(E_SUCCESS == harness_join(harness_p));
+
+    exit_code = E_SUCCESS;
+END:
+    close_all(fds, count);
+    return exit_code;
+}
+
+static int test_stop(harness_t * harness_p)
+{
+    int exit_code = E_FAILURE;
+
+    CHECK(E_SUCCESS == harness_offer(harness_p));
+    handoff_stop(harness_p->handoff_p);
+    CHECK(E_FAILURE == harness_join(harness_p));
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int test_path(harness_t * harness_p)
+{
+    int         exit_code   = E_FAILURE;
+    int         fd          = -1;
+    handoff_t * successor_p = NULL;
+    struct stat status      = { 0 };
+
+    // A regular file is never replaced
+    fd = open(harness_p->path, O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR);
+    CHECK(0 <= fd);
+    close(fd);
+    CHECK(NULL == handoff_create(harness_p->path));
+    CHECK((0 == stat(harness_p->path, &status)) && S_ISREG(status.st_mode));
+    CHECK(0 == unlink(harness_p->path));
+
+    // A successor replaces the socket; the predecessor leaves it alone
+    harness_p->handoff_p = handoff_create(harness_p->path);
+    CHECK(NULL != harness_p->handoff_p);
+    CHECK((0 == stat(harness_p->path, &status)) &&
+          (S_IRUSR | S_IWUSR) == (status.st_mode & 0777));
+    successor_p = handoff_create(harness_p->path);
+    CHECK(NULL != successor_p);
+    handoff_destroy(&harness_p->handoff_p);
+    CHECK(NULL == harness_p->handoff_p);
+    CHECK(0 == stat(harness_p->path, &status));
+
+    handoff_destroy(&successor_p);
+    CHECK(0 != stat(harness_p->path, &status));
+
+    exit_code = E_SUCCESS;
+END:
+    handoff_destroy(&successor_p);
+    return exit_code;
+}
+
+static int test_arguments(harness_t * harness_p)
+{
+    int    exit_code = E_FAILURE;
+    size_t count     = 0;
+
+    harness_p->handoff_p = handoff_create(harness_p->path);
+    CHECK(NULL != harness_p->handoff_p);
+
+    CHECK(E_FAILURE == handoff_offer(harness_p->handoff_p, harness_p->fds, 0));
+    CHECK(E_FAILURE == handoff_offer(harness_p->handoff_p,
+                                     harness_p->fds,
+                                     HANDOFF_MAX_FDS + 1));
+    CHECK(E_FAILURE == handoff_offer(NULL, harness_p->fds, TEST_LISTENERS));
+    CHECK(E_FAILURE ==
+          handoff_take(NULL, harness_p->fds, TEST_LISTENERS, &count));
+    CHECK(NULL == handoff_create(NULL));
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int harness_start(harness_t * harness_p)
+{
+    int exit_code = E_FAILURE;
+
+    for (size_t idx = 0; idx < TEST_LISTENERS; idx++)
+    {
+        harness_p->fds[idx] = -1;
+    }
+
+    snprintf(harness_p->directory,
+             sizeof(harness_p->directory),
+             "/tmp/test-handoff-XXXXXX");
+    CHECK(NULL != mkdtemp(harness_p->directory));
+    snprintf(harness_p->path,
+             sizeof(harness_p->path),
+             "%s/takeover.sock",
+             harness_p->directory);
+
+    for (size_t idx = 0; idx < TEST_LISTENERS; idx++)
+    {
+        harness_p->fds[idx] = open_listener();
+        CHECK(0 <= harness_p->fds[idx]);
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static void harness_stop(harness_t * harness_p)
+{
+    if (true == harness_p->offering)
+    {
+        handoff_stop(harness_p->handoff_p);
+        harness_join(harness_p);
+    }
+    handoff_destroy(&harness_p->handoff_p);
+
+    for (size_t idx = 0; idx < TEST_LISTENERS; idx++)
+    {
+        if (0 <= harness_p->fds[idx])
+        {
+            close(harness_p->fds[idx]);
+        }
+    }
+
+    if ('\0' != harness_p->directory[0])
+    {
+        unlink(harness_p->path);
+        rmdir(harness_p->directory);
+    }
+}
+
+static int harness_offer(harness_t * harness_p)
+{
+    int exit_code = E_FAILURE;
+
+    // Created before the thread starts, so a take never finds no path
+    harness_p->handoff_p = handoff_create(harness_p->path);
+    CHECK(NULL != harness_p->handoff_p);
+    CHECK(0 == pthread_create(&harness_p->thread, NULL, run_offer, harness_p));
+    harness_p->offering = true;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int harness_join(harness_t * harness_p)
+{
+    if (true == harness_p->offering)
+    {
+        pthread_join(harness_p->thread, NULL);
+        harness_p->offering = false;
+    }
+
+    return harness_p->result;
+}
+
+static void * run_offer(void * arg_p)
+{
+    harness_t * harness_p = arg_p;
+
+    harness_p->result =
+        handoff_offer(harness_p->handoff_p, harness_p->fds, TEST_LISTENERS);
+    return NULL;
+}
+
+static int open_listener(void)
+{
+    int                fd      = -1;
+    struct sockaddr_in address = { 0 };
+
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (-1 == fd)
+    {
+        perror("open_listener(): socket()");
+        return -1;
+    }
+
+    if ((-1 == bind(fd, (struct sockaddr *)&address, sizeof(address))) ||
+        (-1 == listen(fd, TEST_LISTENERS)))
+    {
+        perror("open_listener()");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static in_port_t socket_port(int fd)
+{
+    socklen_t          length  = sizeof(struct sockaddr_in);
+    struct sockaddr_in address = { 0 };
+
+    if (0 != getsockname(fd, (struct sockaddr *)&address, &length))
+    {
+        return 0;
+    }
+
+    return address.sin_port;
+}
+
+static int connect_to(in_port_t port)
+{
+    int                fd      = -1;
+    struct sockaddr_in address = { 0 };
+
+    address.sin_family      = AF_INET;
+    address.sin_port        = port;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ((-1 == fd) ||
+        (-1 == connect(fd, (struct sockaddr *)&address, sizeof(address))))
+    {
+        perror("connect_to()");
+        if (-1 != fd)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    return fd;
+}
+
+static void close_all(const int * fds_p, size_t count)
+{
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        close(fds_p[idx]);
+    }
+}
+
+/*** end of file ***/
@@ -0,0 +1,64 @@
+/**
+ * @file io_backend.h
+ * @brief Header for I/O Backend Selection Functions
+ *
+ * This header file provides the interface for choosing the I/O engine NetCalc
+ * uses for its accept/receive/send path, and for checking that the running
+ * kernel supports it.
+ *
+ */
+#ifndef _IO_BACKEND_H
+#define _IO_BACKEND_H
+
+/**
+ * @enum io_backend
+ * @brief The available I/O engines.
+ */
+typedef enum io_backend
+{
+    IO_BACKEND_EPOLL = 0, // Readiness based, one syscall per read/write
+    IO_BACKEND_IO_URING,  // Completion based, batched submissions
+} io_backend_t;
+
+/**
+ * @brief Converts a backend name ("epoll" or "io_uring") to an io_backend_t.
+ *
+ * Nothing is printed for an unknown name, so the caller decides how the
+ * failure is reported.
+ *
+ * @param name_p The backend name.
+ * @param backend_p Pointer to where the backend will be stored.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int io_backend_from_string(const char * name_p, io_backend_t * backend_p);
+
+/**
+ * @brief Returns the name of a backend.
+ *
+ * @param backend The backend.
+ * @return const char * - The backend name, or "unknown".
+ */
+const char * io_backend_to_string(io_backend_t backend);
+
+/**
+ * @brief Checks that the running kernel supports a backend.
+ *
+ * epoll is always available. For io_uring a throwaway ring is created and
+ * the kernel is asked (IORING_REGISTER_PROBE) whether the accept, recv, send
+ * and provide-buffers operations the receive path relies on are supported.
+ * Multishot accept and recv and provided buffer rings have no probe bit of
+ * their own; they arrived by Linux 6.0, as did IORING_OP_SEND_ZC, so that
+ * operation is required as well. This fails when io_uring is missing, too
+ * old, or disabled (e.g. by the kernel.io_uring_disabled sysctl or a seccomp
+ * profile).
+ *
+ * This makes system calls, so it belongs to backend initialisation at
+ * server start, not to option parsing.
+ *
+ * @param backend The backend to check.
+ * @return int - Returns E_SUCCESS if supported, otherwise E_FAILURE.
+ */
+int io_backend_probe(io_backend_t backend);
+
+#endif /* _IO_BACKEND_H */
+/*** end of file ***/
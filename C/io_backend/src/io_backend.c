@@ -0,0 +1,171 @@
+/**
+ * @file io_backend.c
+ * @brief I/O Backend Selection
+ *
+ * This file contains functions for naming and probing the I/O engines the
+ * server can run on. io_uring is probed through the raw system calls so that
+ * no liburing dependency is required just to decide whether to use it.
+ */
+#define _GNU_SOURCE // for syscall()
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h> // SYS_io_uring_*
+#include <unistd.h>      // close, syscall
+
+#include "io_backend.h"
+#include "utilities.h"
+
+#define PROBE_RING_ENTRIES 1   // Entries in the throwaway probe ring
+#define PROBE_MAX_OPS      256 // Operation slots requested from the kernel
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Checks io_uring availability and the operations NetCalc needs.
+ *
+ * @return E_SUCCESS if io_uring is usable, E_FAILURE otherwise.
+ */
+static int probe_io_uring(void);
+
+// +---------------------------------------------------------------------------+
+// |                              IO BACKEND API                               |
+// +---------------------------------------------------------------------------+
+
+int io_backend_from_string(const char * name_p, io_backend_t * backend_p)
+{
+    int exit_code = E_FAILURE;
+
+    if ((NULL == name_p) || (NULL == backend_p))
+    {
+        print_error("io_backend_from_string(): NULL argument passed.");
+        goto END;
+    }
+
+    if (0 == strcmp(name_p, "epoll"))
+    {
+        *backend_p = IO_BACKEND_EPOLL;
+    }
+    else if (0 == strcmp(name_p, "io_uring"))
+    {
+        *backend_p = IO_BACKEND_IO_URING;
+    }
+    else
+    {
+        // Unknown names are the caller's to report
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+const char * io_backend_to_string(io_backend_t backend)
+{
+    switch (backend)
+    {
+        case IO_BACKEND_EPOLL:
+            return "epoll";
+        case IO_BACKEND_IO_URING:
+            return "io_uring";
+        default:
+            return "unknown";
+    }
+}
+
+int io_backend_probe(io_backend_t backend)
+{
+    int exit_code = E_FAILURE;
+
+    switch (backend)
+    {
+        case IO_BACKEND_EPOLL:
+            exit_code = E_SUCCESS;
+            break;
+
+        case IO_BACKEND_IO_URING:
+            exit_code = probe_io_uring();
+            break;
+
+        default:
+            print_error("io_backend_probe(): Unknown I/O backend.");
+            break;
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int probe_io_uring(void)
+{
+    static const uint8_t required_ops[] = {
+        IORING_OP_ACCEPT,
+        IORING_OP_RECV,
+        IORING_OP_SEND,
+        IORING_OP_PROVIDE_BUFFERS,
+        IORING_OP_SEND_ZC, // Linux 6.0: multishot accept/recv, buffer rings
+    };
+
+    int                     exit_code = E_FAILURE;
+    int                     ring_fd   = -1;
+    struct io_uring_params  params    = { 0 };
+    struct io_uring_probe * probe_p   = NULL;
+    size_t                  probe_len = 0;
+
+    ring_fd = (int)syscall(SYS_io_uring_setup, PROBE_RING_ENTRIES, &params);
+    if (0 > ring_fd)
+    {
+        print_error("probe_io_uring(): io_uring is unavailable.");
+        goto END;
+    }
+
+    probe_len = sizeof(*probe_p) +
+                (PROBE_MAX_OPS * sizeof(struct io_uring_probe_op));
+    probe_p   = calloc(1, probe_len);
+    if (NULL == probe_p)
+    {
+        print_error("probe_io_uring(): calloc() failed.");
+        goto END;
+    }
+
+    if (0 > syscall(SYS_io_uring_register,
+                    ring_fd,
+                    IORING_REGISTER_PROBE,
+                    probe_p,
+                    PROBE_MAX_OPS))
+    {
+        print_error("probe_io_uring(): Unable to probe supported operations.");
+        goto END;
+    }
+
+    for (size_t idx = 0; idx < (sizeof(required_ops) / sizeof(*required_ops));
+         idx++)
+    {
+        if ((probe_p->last_op < required_ops[idx]) ||
+            (0 == (probe_p->ops[required_ops[idx]].flags &
+                   IO_URING_OP_SUPPORTED)))
+        {
+            print_error("probe_io_uring(): Kernel io_uring is too old.");
+            goto END;
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    free(probe_p);
+    if (0 <= ring_fd)
+    {
+        close(ring_fd);
+    }
+    return exit_code;
+}
+
+/*** end of file ***/
@@ -0,0 +1,125 @@
+/**
+ * @file io_ring.h
+ * @brief Header for the Minimal io_uring Ring
+ *
+ * This header file provides the interface for '--io-backend io_uring': a
+ * submission and completion queue pair set up with the raw system calls, so
+ * that no liburing dependency is required. Besides the two queues a ring
+ * can hold one group of provided buffers (a buffer ring the kernel picks
+ * receive buffers from) and one registered buffer region (pinned once, so
+ * fixed-buffer sends skip the per-call page lookup).
+ *
+ * A ring is not thread safe; it belongs to the thread that submits to it.
+ *
+ */
+#ifndef _IO_RING_H
+#define _IO_RING_H
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define IO_RING_BUFFER_GROUP 0 // Group id of the ring's provided buffers
+
+/**
+ * @struct io_ring
+ * @brief Opaque ring handle.
+ */
+typedef struct io_ring io_ring_t;
+
+/**
+ * @brief Creates a ring with 'entries' submission queue entries.
+ *
+ * The completion queue gets four times as many, so that multishot requests
+ * rarely overflow it.
+ *
+ * @param entries Submission queue entries, a power of two.
+ * @return io_ring_t * - The new ring, or NULL on failure.
+ */
+io_ring_t * io_ring_create(uint32_t entries);
+
+/**
+ * @brief Destroys a ring and sets the caller's pointer to NULL.
+ *
+ * Every request still in flight is cancelled, and waited for, before the
+ * ring is closed, so the caller may then free the provided and registered
+ * buffers.
+ *
+ * @param ring_pp The address of the ring pointer.
+ */
+void io_ring_destroy(io_ring_t ** ring_pp);
+
+/**
+ * @brief Returns a cleared submission queue entry.
+ *
+ * When the queue is full, what it holds is submitted first.
+ *
+ * @param ring_p The ring.
+ * @return struct io_uring_sqe * - The entry, or NULL on failure.
+ */
+struct io_uring_sqe * io_ring_get_sqe(io_ring_t * ring_p);
+
+/**
+ * @brief Submits the queued entries and waits for at least one completion.
+ *
+ * @param ring_p The ring.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int io_ring_submit_and_wait(io_ring_t * ring_p);
+
+/**
+ * @brief Returns the oldest completion without waiting.
+ *
+ * @param ring_p The ring.
+ * @return struct io_uring_cqe * - The completion, or NULL if there is none.
+ * Call io_ring_cqe_seen() once done with it.
+ */
+struct io_uring_cqe * io_ring_peek_cqe(io_ring_t * ring_p);
+
+/**
+ * @brief Hands the oldest completion's slot back to the kernel.
+ *
+ * @param ring_p The ring.
+ */
+void io_ring_cqe_seen(io_ring_t * ring_p);
+
+/**
+ * @brief Registers one region of memory for fixed-buffer requests.
+ *
+ * The region becomes buffer index 0; any address inside it may be used.
+ * Pinned pages count against RLIMIT_MEMLOCK.
+ *
+ * @param ring_p The ring.
+ * @param base_p The start of the region.
+ * @param length The size of the region.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int io_ring_register_buffers(io_ring_t * ring_p, void * base_p, size_t length);
+
+/**
+ * @brief Sets up the ring's provided buffers as IO_RING_BUFFER_GROUP.
+ *
+ * Buffer 'i' is 'buffer_size' bytes at base_p + i * buffer_size; every one
+ * of them is handed to the kernel at once.
+ *
+ * @param ring_p The ring.
+ * @param base_p The first buffer.
+ * @param buffer_size The size of each buffer.
+ * @param count The number of buffers, a power of two up to 32768.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int io_ring_provide_buffers(io_ring_t * ring_p,
+                            void *      base_p,
+                            uint32_t    buffer_size,
+                            uint32_t    count);
+
+/**
+ * @brief Gives one provided buffer back to the kernel once it is consumed.
+ *
+ * @param ring_p The ring.
+ * @param buffer_id The id the completion reported (IORING_CQE_BUFFER_SHIFT).
+ */
+void io_ring_recycle_buffer(io_ring_t * ring_p, uint16_t buffer_id);
+
+#endif /* _IO_RING_H */
+/*** end of file ***/
@@ -0,0 +1,493 @@
+/**
+ * @file io_ring.c
+ * @brief Minimal io_uring Ring
+ *
+ * This file sets up and drives an io_uring instance through the raw system
+ * calls. The submission queue array is filled with the identity mapping
+ * once, so handing out an entry is a matter of advancing a private tail,
+ * which is published to the kernel on the next submit. Indices shared with
+ * the kernel are read with acquire and written with release ordering; the
+ * kernel writes the other side of each without locks.
+ */
+#define _GNU_SOURCE // for syscall()
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h> // SYS_io_uring_*
+#include <sys/uio.h>     // struct iovec
+#include <unistd.h>      // close, syscall
+
+#include "io_ring.h"
+#include "utilities.h"
+
+#define CQ_MULTIPLIER   4     // Completion entries per submission entry
+#define MAX_BUFFERS     32768 // Most provided buffers the kernel allows
+
+// Indices shared with the kernel
+#define LOAD_ACQUIRE(index_p)                                                  \
+    atomic_load_explicit((_Atomic uint32_t *)(index_p), memory_order_acquire)
+#define STORE_RELEASE(index_p, value)                                          \
+    atomic_store_explicit(                                                     \
+        (_Atomic uint32_t *)(index_p), (value), memory_order_release)
+
+struct io_ring
+{
+    int ring_fd; // From io_uring_setup()
+
+    // Submission queue
+    uint32_t *            sq_head_p;  // Advanced by the kernel
+    uint32_t *            sq_tail_p;  // Published by submit
+    uint32_t *            sq_array_p; // Identity mapping of 'sqes_p'
+    uint32_t              sq_mask;    // Entries - 1
+    uint32_t              sq_entries; // Entries
+    uint32_t              sqe_tail;   // Entries handed out
+    struct io_uring_sqe * sqes_p;     // The entries
+
+    // Completion queue
+    uint32_t *            cq_head_p; // Advanced by io_ring_cqe_seen()
+    uint32_t *            cq_tail_p; // Advanced by the kernel
+    uint32_t              cq_mask;   // Entries - 1
+    struct io_uring_cqe * cqes_p;    // The entries
+
+    // Mappings
+    void * sq_ring_p;    // Holds the submission indices
+    size_t sq_ring_size; // Its size
+    void * cq_ring_p;    // Holds the completions; may equal 'sq_ring_p'
+    size_t cq_ring_size; // Its size
+    size_t sqes_size;    // Size of the 'sqes_p' mapping
+
+    // Provided buffers
+    struct io_uring_buf_ring * buf_ring_p;    // Shared with the kernel
+    size_t                     buf_ring_size; // Its size
+    uint8_t *                  buf_base_p;    // First buffer
+    uint32_t                   buf_size;      // Bytes per buffer
+    uint16_t                   buf_mask;      // Buffers - 1
+    uint16_t                   buf_tail;      // Buffers handed to the kernel
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Maps the queues of a ring that io_uring_setup() just created.
+ *
+ * @param ring_p The ring, with 'ring_fd' set.
+ * @param params_p What io_uring_setup() returned.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int map_queues(io_ring_t *                    ring_p,
+                      const struct io_uring_params * params_p);
+
+/**
+ * @brief Passes the queued entries to the kernel.
+ *
+ * @param ring_p The ring.
+ * @param wait Whether to wait for a completion as well.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int enter(io_ring_t * ring_p, bool wait);
+
+/**
+ * @brief Puts one buffer at the tail of the buffer ring, unpublished.
+ *
+ * @param ring_p The ring.
+ * @param buffer_id The buffer.
+ */
+static void add_buffer(io_ring_t * ring_p, uint16_t buffer_id);
+
+// +---------------------------------------------------------------------------+
+// |                                IO RING API                                |
+// +---------------------------------------------------------------------------+
+
+io_ring_t * io_ring_create(uint32_t entries)
+{
+    io_ring_t *            ring_p = NULL;
+    struct io_uring_params params = { 0 };
+
+    if ((0 == entries) || (0 != (entries & (entries - 1))))
+    {
+        print_error("io_ring_create(): Invalid argument passed.");
+        goto END;
+    }
+
+    ring_p = calloc(1, sizeof(io_ring_t));
+    if (NULL == ring_p)
+    {
+        print_error("io_ring_create(): calloc() failed.");
+        goto END;
+    }
+    ring_p->sq_ring_p  = MAP_FAILED;
+    ring_p->cq_ring_p  = MAP_FAILED;
+    ring_p->sqes_p     = MAP_FAILED;
+    ring_p->buf_ring_p = MAP_FAILED;
+
+    params.flags      = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * CQ_MULTIPLIER;
+
+    ring_p->ring_fd = (int)syscall(SYS_io_uring_setup, entries, &params);
+    if (0 > ring_p->ring_fd)
+    {
+        perror("io_ring_create(): io_uring_setup()");
+        goto FAIL;
+    }
+
+    if (E_SUCCESS != map_queues(ring_p, &params))
+    {
+        goto FAIL;
+    }
+
+    goto END;
+
+FAIL:
+    io_ring_destroy(&ring_p);
+END:
+    return ring_p;
+}
+
+void io_ring_destroy(io_ring_t ** ring_pp)
+{
+    io_ring_t *                     ring_p = NULL;
+    struct io_uring_sync_cancel_reg cancel = { 0 };
+
+    if ((NULL == ring_pp) || (NULL == *ring_pp))
+    {
+        return;
+    }
+
+    ring_p = *ring_pp;
+
+    // Closing the ring alone may leave the cancellations to a kernel worker,
+    // so a receive could still land in a buffer the caller is about to free
+    if (0 <= ring_p->ring_fd)
+    {
+        cancel.fd    = -1;
+        cancel.flags = IORING_ASYNC_CANCEL_ALL | IORING_ASYNC_CANCEL_ANY;
+        cancel.timeout.tv_sec  = -1;
+        cancel.timeout.tv_nsec = -1;
+        if ((0 > syscall(SYS_io_uring_register,
+                         ring_p->ring_fd,
+                         IORING_REGISTER_SYNC_CANCEL,
+                         &cancel,
+                         1)) &&
+            (ENOENT != errno))
+        {
+            perror("io_ring_destroy(): IORING_REGISTER_SYNC_CANCEL");
+        }
+        close(ring_p->ring_fd);
+    }
+    if (MAP_FAILED != ring_p->buf_ring_p)
+    {
+        munmap(ring_p->buf_ring_p, ring_p->buf_ring_size);
+    }
+    if (MAP_FAILED != ring_p->sqes_p)
+    {
+        munmap(ring_p->sqes_p, ring_p->sqes_size);
+    }
+    if ((MAP_FAILED != ring_p->cq_ring_p) &&
+        (ring_p->cq_ring_p != ring_p->sq_ring_p))
+    {
+        munmap(ring_p->cq_ring_p, ring_p->cq_ring_size);
+    }
+    if (MAP_FAILED != ring_p->sq_ring_p)
+    {
+        munmap(ring_p->sq_ring_p, ring_p->sq_ring_size);
+    }
+
+    free(ring_p);
+    *ring_pp = NULL;
+}
+
+struct io_uring_sqe * io_ring_get_sqe(io_ring_t * ring_p)
+{
+    struct io_uring_sqe * sqe_p = NULL;
+
+    if ((ring_p->sqe_tail - LOAD_ACQUIRE(ring_p->sq_head_p)) >=
+        ring_p->sq_entries)
+    {
+        if ((E_SUCCESS != enter(ring_p, false)) ||
+            ((ring_p->sqe_tail - LOAD_ACQUIRE(ring_p->sq_head_p)) >=
+             ring_p->sq_entries))
+        {
+            print_error("io_ring_get_sqe(): Submission queue is full.");
+            return NULL;
+        }
+    }
+
+    sqe_p = &ring_p->sqes_p[ring_p->sqe_tail & ring_p->sq_mask];
+    memset(sqe_p, 0, sizeof(*sqe_p));
+    ring_p->sqe_tail++;
+
+    return sqe_p;
+}
+
+int io_ring_submit_and_wait(io_ring_t * ring_p)
+{
+    if (NULL == ring_p)
+    {
+        print_error("io_ring_submit_and_wait(): NULL argument passed.");
+        return E_FAILURE;
+    }
+
+    return enter(ring_p, true);
+}
+
+struct io_uring_cqe * io_ring_peek_cqe(io_ring_t * ring_p)
+{
+    uint32_t head = *ring_p->cq_head_p;
+
+    if (head == LOAD_ACQUIRE(ring_p->cq_tail_p))
+    {
+        return NULL;
+    }
+
+    return &ring_p->cqes_p[head & ring_p->cq_mask];
+}
+
+void io_ring_cqe_seen(io_ring_t * ring_p)
+{
+    STORE_RELEASE(ring_p->cq_head_p, *ring_p->cq_head_p + 1);
+}
+
+int io_ring_register_buffers(io_ring_t * ring_p, void * base_p, size_t length)
+{
+    struct iovec region = { .iov_base = base_p, .iov_len = length };
+
+    if ((NULL == ring_p) || (NULL == base_p) || (0 == length))
+    {
+        print_error("io_ring_register_buffers(): Invalid argument passed.");
+        return E_FAILURE;
+    }
+
+    if (0 > syscall(SYS_io_uring_register,
+                    ring_p->ring_fd,
+                    IORING_REGISTER_BUFFERS,
+                    &region,
+                    1))
+    {
+        perror("io_ring_register_buffers(): IORING_REGISTER_BUFFERS");
+        return E_FAILURE;
+    }
+
+    return E_SUCCESS;
+}
+
+int io_ring_provide_buffers(io_ring_t * ring_p,
+                            void *      base_p,
+                            uint32_t    buffer_size,
+                            uint32_t    count)
+{
+    int                     exit_code    = E_FAILURE;
+    struct io_uring_buf_reg registration = { 0 };
+
+    if ((NULL == ring_p) || (NULL == base_p) || (0 == buffer_size) ||
+        (0 == count) || (MAX_BUFFERS < count) ||
+        (0 != (count & (count - 1))) || (MAP_FAILED != ring_p->buf_ring_p))
+    {
+        print_error("io_ring_provide_buffers(): Invalid argument passed.");
+        goto END;
+    }
+
+    // The kernel wants the buffer ring page aligned
+    ring_p->buf_ring_size = count * sizeof(struct io_uring_buf);
+    ring_p->buf_ring_p    = mmap(NULL,
+                              ring_p->buf_ring_size,
+                              PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS,
+                              -1,
+                              0);
+    if (MAP_FAILED == ring_p->buf_ring_p)
+    {
+        perror("io_ring_provide_buffers(): mmap()");
+        goto END;
+    }
+
+    registration.ring_addr    = (uint64_t)(uintptr_t)ring_p->buf_ring_p;
+    registration.ring_entries = count;
+    registration.bgid         = IO_RING_BUFFER_GROUP;
+    if (0 > syscall(SYS_io_uring_register,
+                    ring_p->ring_fd,
+                    IORING_REGISTER_PBUF_RING,
+                    &registration,
+                    1))
+    {
+        perror("io_ring_provide_buffers(): IORING_REGISTER_PBUF_RING");
+        munmap(ring_p->buf_ring_p, ring_p->buf_ring_size);
+        ring_p->buf_ring_p = MAP_FAILED;
+        goto END;
+    }
+
+    ring_p->buf_base_p = base_p;
+    ring_p->buf_size   = buffer_size;
+    ring_p->buf_mask   = (uint16_t)(count - 1);
+    ring_p->buf_tail   = 0;
+
+    for (uint32_t idx = 0; idx < count; idx++)
+    {
+        add_buffer(ring_p, (uint16_t)idx);
+    }
+    atomic_store_explicit((_Atomic uint16_t *)&ring_p->buf_ring_p->tail,
+                          ring_p->buf_tail,
+                          memory_order_release);
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+void io_ring_recycle_buffer(io_ring_t * ring_p, uint16_t buffer_id)
+{
+    add_buffer(ring_p, buffer_id);
+    atomic_store_explicit((_Atomic uint16_t *)&ring_p->buf_ring_p->tail,
+                          ring_p->buf_tail,
+                          memory_order_release);
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int map_queues(io_ring_t *                    ring_p,
+                      const struct io_uring_params * params_p)
+{
+    uint8_t * sq_p = NULL;
+    uint8_t * cq_p = NULL;
+
+    ring_p->sq_ring_size =
+        params_p->sq_off.array + (params_p->sq_entries * sizeof(uint32_t));
+    ring_p->cq_ring_size = params_p->cq_off.cqes +
+                           (params_p->cq_entries * sizeof(struct io_uring_cqe));
+    ring_p->sqes_size = params_p->sq_entries * sizeof(struct io_uring_sqe);
+
+    // Since Linux 5.4 both rings share one mapping
+    if (0 != (params_p->features & IORING_FEAT_SINGLE_MMAP))
+    {
+        if (ring_p->cq_ring_size > ring_p->sq_ring_size)
+        {
+            ring_p->sq_ring_size = ring_p->cq_ring_size;
+        }
+        ring_p->cq_ring_size = ring_p->sq_ring_size;
+    }
+
+    ring_p->sq_ring_p = mmap(NULL,
+                             ring_p->sq_ring_size,
+                             PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE,
+                             ring_p->ring_fd,
+                             IORING_OFF_SQ_RING);
+    if (MAP_FAILED == ring_p->sq_ring_p)
+    {
+        perror("io_ring_create(): mmap(IORING_OFF_SQ_RING)");
+        return E_FAILURE;
+    }
+
+    if (0 != (params_p->features & IORING_FEAT_SINGLE_MMAP))
+    {
+        ring_p->cq_ring_p = ring_p->sq_ring_p;
+    }
+    else
+    {
+        ring_p->cq_ring_p = mmap(NULL,
+                                 ring_p->cq_ring_size,
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE,
+                                 ring_p->ring_fd,
+                                 IORING_OFF_CQ_RING);
+        if (MAP_FAILED == ring_p->cq_ring_p)
+        {
+            perror("io_ring_create(): mmap(IORING_OFF_CQ_RING)");
+            return E_FAILURE;
+        }
+    }
+
+    ring_p->sqes_p = mmap(NULL,
+                          ring_p->sqes_size,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE,
+                          ring_p->ring_fd,
+                          IORING_OFF_SQES);
+    if (MAP_FAILED == ring_p->sqes_p)
+    {
+        perror("io_ring_create(): mmap(IORING_OFF_SQES)");
+        return E_FAILURE;
+    }
+
+    sq_p               = ring_p->sq_ring_p;
+    ring_p->sq_head_p  = (uint32_t *)(sq_p + params_p->sq_off.head);
+    ring_p->sq_tail_p  = (uint32_t *)(sq_p + params_p->sq_off.tail);
+    ring_p->sq_array_p = (uint32_t *)(sq_p + params_p->sq_off.array);
+    ring_p->sq_mask    = *(uint32_t *)(sq_p + params_p->sq_off.ring_mask);
+    ring_p->sq_entries = params_p->sq_entries;
+    ring_p->sqe_tail   = *ring_p->sq_tail_p;
+
+    cq_p              = ring_p->cq_ring_p;
+    ring_p->cq_head_p = (uint32_t *)(cq_p + params_p->cq_off.head);
+    ring_p->cq_tail_p = (uint32_t *)(cq_p + params_p->cq_off.tail);
+    ring_p->cq_mask   = *(uint32_t *)(cq_p + params_p->cq_off.ring_mask);
+    ring_p->cqes_p    = (struct io_uring_cqe *)(cq_p + params_p->cq_off.cqes);
+
+    for (uint32_t idx = 0; idx < ring_p->sq_entries; idx++)
+    {
+        ring_p->sq_array_p[idx] = idx;
+    }
+
+    return E_SUCCESS;
+}
+
+static int enter(io_ring_t * ring_p, bool wait)
+{
+    uint32_t to_submit = 0;
+    long     result    = 0;
+
+    STORE_RELEASE(ring_p->sq_tail_p, ring_p->sqe_tail);
+
+    for (;;)
+    {
+        to_submit = ring_p->sqe_tail - LOAD_ACQUIRE(ring_p->sq_head_p);
+        result    = syscall(SYS_io_uring_enter,
+                         ring_p->ring_fd,
+                         to_submit,
+                         (true == wait) ? 1 : 0,
+                         (true == wait) ? IORING_ENTER_GETEVENTS : 0,
+                         NULL,
+                         0);
+        if (0 <= result)
+        {
+            return E_SUCCESS;
+        }
+
+        // Completions are waiting to be reaped: let the caller reap them
+        if ((EAGAIN == errno) || (EBUSY == errno))
+        {
+            return E_SUCCESS;
+        }
+
+        if (EINTR != errno)
+        {
+            perror("io_ring: io_uring_enter()");
+            return E_FAILURE;
+        }
+    }
+}
+
+static void add_buffer(io_ring_t * ring_p, uint16_t buffer_id)
+{
+    struct io_uring_buf * buf_p = NULL;
+
+    buf_p = &ring_p->buf_ring_p->bufs[ring_p->buf_tail & ring_p->buf_mask];
+    buf_p->addr =
+        (uint64_t)(uintptr_t)(ring_p->buf_base_p +
+                              ((size_t)buffer_id * ring_p->buf_size));
+    buf_p->len = ring_p->buf_size;
+    buf_p->bid = buffer_id;
+    ring_p->buf_tail++;
+}
+
+/*** end of file ***/
@@ -0,0 +1,108 @@
+/**
+ * @file latency_histogram.h
+ * @brief Header for the Log-Linear Latency Histogram
+ *
+ * This header file provides a fixed-size, allocation-free latency histogram
+ * in the style of HdrHistogram: values are counted in buckets whose width
+ * grows with magnitude, giving about 1.6% relative precision over the whole
+ * 64-bit range. Histograms are meant to be owned and written by one thread
+ * and merged by whoever reads them.
+ *
+ */
+#ifndef _LATENCY_HISTOGRAM_H
+#define _LATENCY_HISTOGRAM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define HISTOGRAM_SUB_BUCKETS 64   // Linear sub-buckets per power of two
+#define HISTOGRAM_BUCKETS     3776 // Buckets needed to cover 64-bit values
+
+/**
+ * @struct latency_histogram
+ * @brief Counts of recorded values per bucket.
+ *
+ * The counters are atomics written with relaxed ordering by a single owner
+ * (a load and a store, no read-modify-write), so another thread may read a
+ * histogram while it is being recorded into without a data race and without
+ * adding locked instructions to the recording path.
+ */
+typedef struct latency_histogram
+{
+    atomic_uint_least64_t counts[HISTOGRAM_BUCKETS]; // Per bucket counts
+    atomic_uint_least64_t total;                     // Number of values
+    atomic_uint_least64_t sum;                       // Sum of the values
+    atomic_uint_least64_t max;                       // Largest value seen
+} latency_histogram_t;
+
+/**
+ * @brief Clears every count of a histogram.
+ *
+ * @param histogram_p The histogram.
+ */
+void latency_histogram_reset(latency_histogram_t * histogram_p);
+
+/**
+ * @brief Records one value. Owner thread only.
+ *
+ * @param histogram_p The histogram.
+ * @param value The value, typically a latency in nanoseconds.
+ */
+void latency_histogram_record(latency_histogram_t * histogram_p,
+                              uint64_t              value);
+
+/**
+ * @brief Adds the counts of one histogram to another.
+ *
+ * @param dest_p The histogram to add to. Must not be recorded into
+ * concurrently.
+ * @param source_p The histogram to add. May be recorded into concurrently.
+ */
+void latency_histogram_merge(latency_histogram_t *       dest_p,
+                             const latency_histogram_t * source_p);
+
+/**
+ * @brief Returns the number of values recorded.
+ *
+ * @param histogram_p The histogram.
+ * @return uint64_t - The count, or 0 if histogram_p is NULL.
+ */
+uint64_t latency_histogram_count(const latency_histogram_t * histogram_p);
+
+/**
+ * @brief Returns the exact sum of the values recorded.
+ *
+ * @param histogram_p The histogram.
+ * @return uint64_t - The sum, wrapping on overflow, or 0 if histogram_p is
+ * NULL.
+ */
+uint64_t latency_histogram_sum(const latency_histogram_t * histogram_p);
+
+/**
+ * @brief Returns the value at or below which a percentage of values fall.
+ *
+ * @param histogram_p The histogram.
+ * @param percentile The percentile, from 0.0 to 100.0.
+ * @return uint64_t - The highest value equivalent to the bucket containing
+ * the percentile, capped at the largest value recorded, or 0 if the
+ * histogram is empty.
+ */
+uint64_t latency_histogram_percentile(const latency_histogram_t * histogram_p,
+                                      double                      percentile);
+
+/**
+ * @brief Prints a histogram in the HdrHistogram percentile distribution
+ * format, which HdrHistogram's plotting tools accept.
+ *
+ * @param histogram_p The histogram.
+ * @param stream_p The stream to print to.
+ * @param unit_scale Divisor applied to values when printing (e.g. 1000.0 to
+ * print nanosecond values as microseconds).
+ */
+void latency_histogram_print(const latency_histogram_t * histogram_p,
+                             FILE *                      stream_p,
+                             double                      unit_scale);
+
+#endif /* _LATENCY_HISTOGRAM_H */
+/*** end of file ***/
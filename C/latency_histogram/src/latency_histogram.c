@@ -0,0 +1,319 @@
+/**
+ * @file latency_histogram.c
+ * @brief Log-Linear Latency Histogram
+ *
+ * This file implements the histogram bucketing. Values below
+ * 2 * HISTOGRAM_SUB_BUCKETS are counted exactly. Above that, a value with
+ * its highest set bit at position 'b' falls in a group of
+ * HISTOGRAM_SUB_BUCKETS equal-width buckets covering [2^b, 2^(b+1)), so
+ * every bucket is at most 1/64th of its value wide.
+ */
+#include <math.h>
+
+#include "latency_histogram.h"
+
+#define SUB_BUCKET_BITS 6 // log2(HISTOGRAM_SUB_BUCKETS)
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Maps a value to its bucket index.
+ *
+ * @param value The value.
+ * @return The bucket index, below HISTOGRAM_BUCKETS.
+ */
+static size_t bucket_index(uint64_t value);
+
+/**
+ * @brief Returns the lowest value counted in a bucket.
+ *
+ * @param index The bucket index.
+ * @return The lowest value of the bucket.
+ */
+static uint64_t bucket_lowest(size_t index);
+
+/**
+ * @brief Returns the highest value counted in a bucket.
+ *
+ * @param index The bucket index.
+ * @return The highest value of the bucket.
+ */
+static uint64_t bucket_highest(size_t index);
+
+/**
+ * @brief Reads a counter.
+ *
+ * @param counter_p The counter.
+ * @return Its current value.
+ */
+static uint64_t load(const atomic_uint_least64_t * counter_p);
+
+// +---------------------------------------------------------------------------+
+// |                          LATENCY HISTOGRAM API                            |
+// +---------------------------------------------------------------------------+
+
+void latency_histogram_reset(latency_histogram_t * histogram_p)
+{
+    if (NULL == histogram_p)
+    {
+        return;
+    }
+
+    for (size_t idx = 0; idx < HISTOGRAM_BUCKETS; idx++)
+    {
+        atomic_store_explicit(
+            &histogram_p->counts[idx], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&histogram_p->total, 0, memory_order_relaxed);
+    atomic_store_explicit(&histogram_p->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&histogram_p->max, 0, memory_order_relaxed);
+}
+
+void latency_histogram_record(latency_histogram_t * histogram_p,
+                              uint64_t              value)
+{
+    atomic_uint_least64_t * count_p = NULL;
+
+    if (NULL == histogram_p)
+    {
+        return;
+    }
+
+    // Single writer: a plain load and store is enough and avoids a locked
+    // read-modify-write instruction on the recording path.
+    count_p = &histogram_p->counts[bucket_index(value)];
+    atomic_store_explicit(count_p, load(count_p) + 1, memory_order_relaxed);
+    atomic_store_explicit(&histogram_p->total,
+                          load(&histogram_p->total) + 1,
+                          memory_order_relaxed);
+    atomic_store_explicit(&histogram_p->sum,
+                          load(&histogram_p->sum) + value,
+                          memory_order_relaxed);
+    if (value > load(&histogram_p->max))
+    {
+        atomic_store_explicit(&histogram_p->max, value, memory_order_relaxed);
+    }
+}
+
+void latency_histogram_merge(latency_histogram_t *       dest_p,
+                             const latency_histogram_t * source_p)
+{
+    uint64_t count = 0;
+    uint64_t total = 0;
+
+    if ((NULL == dest_p) || (NULL == source_p))
+    {
+        return;
+    }
+
+    // Sum the buckets rather than trusting the source's total, which may be
+    // mid-update relative to the buckets.
+    for (size_t idx = 0; idx < HISTOGRAM_BUCKETS; idx++)
+    {
+        count = load(&source_p->counts[idx]);
+        if (0 != count)
+        {
+            atomic_store_explicit(&dest_p->counts[idx],
+                                  load(&dest_p->counts[idx]) + count,
+                                  memory_order_relaxed);
+            total += count;
+        }
+    }
+
+    atomic_store_explicit(
+        &dest_p->total, load(&dest_p->total) + total, memory_order_relaxed);
+    atomic_store_explicit(&dest_p->sum,
+                          load(&dest_p->sum) + load(&source_p->sum),
+                          memory_order_relaxed);
+    if (load(&source_p->max) > load(&dest_p->max))
+    {
+        atomic_store_explicit(
+            &dest_p->max, load(&source_p->max), memory_order_relaxed);
+    }
+}
+
+uint64_t latency_histogram_count(const latency_histogram_t * histogram_p)
+{
+    return (NULL == histogram_p) ? 0 : load(&histogram_p->total);
+}
+
+uint64_t latency_histogram_sum(const latency_histogram_t * histogram_p)
+{
+    return (NULL == histogram_p) ? 0 : load(&histogram_p->sum);
+}
+
+uint64_t latency_histogram_percentile(const latency_histogram_t * histogram_p,
+                                      double                      percentile)
+{
+    uint64_t total     = 0;
+    uint64_t target    = 0;
+    uint64_t cumulated = 0;
+
+    if (NULL == histogram_p)
+    {
+        return 0;
+    }
+
+    total = load(&histogram_p->total);
+    if (0 == total)
+    {
+        return 0;
+    }
+
+    percentile = (percentile < 0.0) ? 0.0 : percentile;
+    percentile = (percentile > 100.0) ? 100.0 : percentile;
+    target     = (uint64_t)ceil((percentile / 100.0) * (double)total);
+    target     = (0 == target) ? 1 : target;
+
+    for (size_t idx = 0; idx < HISTOGRAM_BUCKETS; idx++)
+    {
+        cumulated += load(&histogram_p->counts[idx]);
+        if (cumulated >= target)
+        {
+            // Never report more than was actually recorded
+            return (bucket_highest(idx) < load(&histogram_p->max))
+                       ? bucket_highest(idx)
+                       : load(&histogram_p->max);
+        }
+    }
+
+    return load(&histogram_p->max);
+}
+
+void latency_histogram_print(const latency_histogram_t * histogram_p,
+                             FILE *                      stream_p,
+                             double                      unit_scale)
+{
+    uint64_t count     = 0;
+    uint64_t total     = 0;
+    uint64_t cumulated = 0;
+    double   value     = 0.0;
+    double   sum       = 0.0;
+    double   sum_sq    = 0.0;
+    double   fraction  = 0.0;
+    double   mean      = 0.0;
+    double   std_dev   = 0.0;
+
+    if ((NULL == histogram_p) || (NULL == stream_p) || (0.0 >= unit_scale))
+    {
+        return;
+    }
+
+    for (size_t idx = 0; idx < HISTOGRAM_BUCKETS; idx++)
+    {
+        total += load(&histogram_p->counts[idx]);
+    }
+
+    fprintf(stream_p,
+            "%12s %14s %10s %14s\n\n",
+            "Value",
+            "Percentile",
+            "TotalCount",
+            "1/(1-Percentile)");
+
+    for (size_t idx = 0; (0 != total) && (idx < HISTOGRAM_BUCKETS); idx++)
+    {
+        count = load(&histogram_p->counts[idx]);
+        if (0 == count)
+        {
+            continue;
+        }
+
+        cumulated += count;
+        value    = (double)bucket_highest(idx) / unit_scale;
+        fraction = (double)cumulated / (double)total;
+        sum += value * (double)count;
+        sum_sq += value * value * (double)count;
+
+        if (cumulated < total)
+        {
+            fprintf(stream_p,
+                    "%12.3f %1.12f %10llu %14.2f\n",
+                    value,
+                    fraction,
+                    (unsigned long long)cumulated,
+                    1.0 / (1.0 - fraction));
+        }
+        else
+        {
+            fprintf(stream_p,
+                    "%12.3f %1.12f %10llu\n",
+                    value,
+                    fraction,
+                    (unsigned long long)cumulated);
+        }
+    }
+
+    if (0 != total)
+    {
+        mean    = sum / (double)total;
+        std_dev = sqrt(fmax(0.0, (sum_sq / (double)total) - (mean * mean)));
+    }
+
+    fprintf(stream_p,
+            "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n",
+            mean,
+            std_dev);
+    fprintf(stream_p,
+            "#[Max     = %12.3f, Total count    = %12llu]\n",
+            (double)load(&histogram_p->max) / unit_scale,
+            (unsigned long long)total);
+    fprintf(stream_p,
+            "#[Buckets = %12d, SubBuckets     = %12d]\n",
+            HISTOGRAM_BUCKETS / HISTOGRAM_SUB_BUCKETS,
+            HISTOGRAM_SUB_BUCKETS);
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static size_t bucket_index(uint64_t value)
+{
+    int shift = 0;
+
+    if ((2 * HISTOGRAM_SUB_BUCKETS) > value)
+    {
+        return (size_t)value;
+    }
+
+    // Keep the top SUB_BUCKET_BITS + 1 bits of the value
+    shift = (63 - __builtin_clzll(value)) - SUB_BUCKET_BITS;
+    return ((size_t)shift * HISTOGRAM_SUB_BUCKETS) + (size_t)(value >> shift);
+}
+
+static uint64_t bucket_lowest(size_t index)
+{
+    size_t shift = 0;
+
+    if ((2 * HISTOGRAM_SUB_BUCKETS) > index)
+    {
+        return (uint64_t)index;
+    }
+
+    shift = (index / HISTOGRAM_SUB_BUCKETS) - 1;
+    return (uint64_t)(index - (shift * HISTOGRAM_SUB_BUCKETS)) << shift;
+}
+
+static uint64_t bucket_highest(size_t index)
+{
+    size_t shift = 0;
+
+    if ((2 * HISTOGRAM_SUB_BUCKETS) > index)
+    {
+        return (uint64_t)index;
+    }
+
+    shift = (index / HISTOGRAM_SUB_BUCKETS) - 1;
+    return bucket_lowest(index) + ((UINT64_C(1) << shift) - 1);
+}
+
+static uint64_t load(const atomic_uint_least64_t * counter_p)
+{
+    return atomic_load_explicit(
+        (atomic_uint_least64_t *)counter_p, memory_order_relaxed);
+}
+
+/*** end of file ***/
@@ -0,0 +1,114 @@
+/**
+ * @file listener.h
+ * @brief Header for Listening Socket Functions
+ *
+ * This header file provides the interface for opening the TCP listening
+ * sockets NetCalc accepts connections on, including groups of SO_REUSEPORT
+ * sockets that let the kernel spread incoming connections across acceptor
+ * threads, and the socket tuning ('--tcp-nodelay', '--busy-poll-us',
+ * '--rcvbuf', '--sndbuf', '--defer-accept', '--backlog') applied to them.
+ *
+ */
+#ifndef _LISTENER_H
+#define _LISTENER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @struct listener_tuning
+ * @brief Socket options applied to a listening socket.
+ *
+ * A zero field leaves the kernel default in place. Everything but the
+ * backlog and TCP_DEFER_ACCEPT is inherited by the connections accepted
+ * from the socket, so one setsockopt() per listener tunes every connection
+ * without a system call on the accept path. The buffer sizes are set before
+ * listen() so that the TCP window scale offered to clients matches them.
+ */
+typedef struct listener_tuning
+{
+    bool    tcp_nodelay;    // Set TCP_NODELAY (disable Nagle's algorithm)
+    int32_t busy_poll_us;   // SO_BUSY_POLL time in microseconds
+    int32_t rcvbuf;         // SO_RCVBUF in bytes
+    int32_t sndbuf;         // SO_SNDBUF in bytes
+    int32_t defer_accept_s; // TCP_DEFER_ACCEPT timeout in seconds
+    int32_t backlog;        // listen() backlog, SOMAXCONN if zero
+} listener_tuning_t;
+
+/**
+ * @brief Opens a single TCP listening socket on the given port.
+ *
+ * The socket is bound to all local addresses (IPv6 dual-stack where
+ * available) with SO_REUSEADDR set.
+ *
+ * @param port_p The port to listen on, as a string.
+ * @param reuseport Whether SO_REUSEPORT should be set on the socket.
+ * @param tuning_p Socket options to apply, or NULL for the kernel defaults.
+ * @param fd_p Pointer to where the listening file descriptor is stored.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int listener_open(const char *              port_p,
+                  bool                      reuseport,
+                  const listener_tuning_t * tuning_p,
+                  int *                     fd_p);
+
+/**
+ * @brief Opens a group of SO_REUSEPORT listening sockets on the same port.
+ *
+ * Each socket is meant to be owned by its own acceptor thread. On failure
+ * any sockets already opened by this call are closed.
+ *
+ * @param port_p The port to listen on, as a string.
+ * @param count The number of sockets to open.
+ * @param tuning_p Socket options to apply, or NULL for the kernel defaults.
+ * @param fds_p Array of at least 'count' entries receiving the descriptors.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int listener_open_group(const char *              port_p,
+                        size_t                    count,
+                        const listener_tuning_t * tuning_p,
+                        int *                     fds_p);
+
+/**
+ * @brief Opens a group of SO_REUSEPORT UDP sockets on the same port.
+ *
+ * The UDP counterpart of listener_open_group() for '--transport udp': the
+ * kernel hashes each client's datagrams to one socket of the group, so each
+ * socket can be read by its own worker without locking. Of 'tuning_p' only
+ * the buffer sizes and SO_BUSY_POLL apply.
+ *
+ * @param port_p The port to bind, as a string.
+ * @param count The number of sockets to open.
+ * @param tuning_p Socket options to apply, or NULL for the kernel defaults.
+ * @param fds_p Array of at least 'count' entries receiving the descriptors.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int listener_open_datagram_group(const char *              port_p,
+                                 size_t                    count,
+                                 const listener_tuning_t * tuning_p,
+                                 int *                     fds_p);
+
+/**
+ * @brief Reads the local port and type of a socket.
+ *
+ * Used after '--takeover' to match the sockets handed over by the previous
+ * process against the ports of the new configuration.
+ *
+ * @param fd The socket.
+ * @param port_p Pointer to where the port, in host byte order, is stored.
+ * @param socktype_p Pointer to where SOCK_STREAM or SOCK_DGRAM is stored.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int listener_socket_port(int fd, uint16_t * port_p, int * socktype_p);
+
+/**
+ * @brief Closes 'count' listening sockets.
+ *
+ * @param fds_p Array of descriptors to close. Negative entries are skipped.
+ * @param count The number of entries in fds_p.
+ */
+void listener_close_all(int * fds_p, size_t count);
+
+#endif /* _LISTENER_H */
+/*** end of file ***/
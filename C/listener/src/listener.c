@@ -0,0 +1,443 @@
+/**
+ * @file listener.c
+ * @brief Listening Socket Setup
+ *
+ * This file contains functions for creating the server's listening sockets.
+ * With SO_REUSEPORT several sockets can be bound to one port; the kernel then
+ * hashes incoming connections across them, removing the single accept queue
+ * as a point of contention.
+ */
+#define _GNU_SOURCE // for SO_REUSEPORT and SO_BUSY_POLL
+
+#include <arpa/inet.h> // ntohs
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h> // TCP_NODELAY, TCP_DEFER_ACCEPT
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h> // close
+
+#include "listener.h"
+#include "utilities.h"
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Resolves the wildcard address of a port and opens a socket on it.
+ *
+ * The IPv6 wildcard is tried first, as a dual-stack socket; the IPv4
+ * wildcard is used only when no IPv6 address can be bound.
+ *
+ * @param port_p The port to bind, as a string.
+ * @param socktype SOCK_STREAM for a listener, SOCK_DGRAM for a UDP socket.
+ * @param reuseport Whether SO_REUSEPORT should be set on the socket.
+ * @param tuning_p Socket options to apply; may be NULL.
+ * @param fd_p Pointer to where the file descriptor is stored.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int open_socket(const char *              port_p,
+                       int                       socktype,
+                       bool                      reuseport,
+                       const listener_tuning_t * tuning_p,
+                       int *                     fd_p);
+
+/**
+ * @brief Creates, configures, binds and listens on a socket for one address.
+ *
+ * A SOCK_DGRAM socket is only bound.
+ *
+ * @param addr_p The address to bind to.
+ * @param reuseport Whether SO_REUSEPORT should be set on the socket.
+ * @param tuning_p Socket options to apply; may be NULL.
+ * @param fd_p Pointer to where the listening file descriptor is stored.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int open_on_address(struct addrinfo *         addr_p,
+                           bool                      reuseport,
+                           const listener_tuning_t * tuning_p,
+                           int *                     fd_p);
+
+/**
+ * @brief Applies the options of 'tuning_p' that must be set before listen().
+ *
+ * @param fd The unbound or bound, not yet listening, socket.
+ * @param socktype The socket's type; TCP options are skipped for SOCK_DGRAM.
+ * @param tuning_p Socket options to apply.
+ * @return E_SUCCESS on success, E_FAILURE if the kernel refused one.
+ */
+static int apply_tuning(int                       fd,
+                        int                       socktype,
+                        const listener_tuning_t * tuning_p);
+
+/**
+ * @brief Sets one integer socket option, reporting a refusal by name.
+ *
+ * @param fd The socket.
+ * @param level The option level, e.g. SOL_SOCKET.
+ * @param name The option, e.g. SO_RCVBUF.
+ * @param value The value to set.
+ * @param label_p The option's name for the error message.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int set_int_option(
+    int fd, int level, int name, int value, const char * label_p);
+
+// +---------------------------------------------------------------------------+
+// |                               LISTENER API                                |
+// +---------------------------------------------------------------------------+
+
+int listener_open(const char *              port_p,
+                  bool                      reuseport,
+                  const listener_tuning_t * tuning_p,
+                  int *                     fd_p)
+{
+    return open_socket(port_p, SOCK_STREAM, reuseport, tuning_p, fd_p);
+}
+
+int listener_open_group(const char *              port_p,
+                        size_t                    count,
+                        const listener_tuning_t * tuning_p,
+                        int *                     fds_p)
+{
+    int    exit_code = E_FAILURE;
+    size_t opened    = 0;
+
+    if ((NULL == port_p) || (NULL == fds_p))
+    {
+        print_error("listener_open_group(): NULL argument passed.");
+        goto END;
+    }
+
+    for (opened = 0; opened < count; opened++)
+    {
+        exit_code = listener_open(port_p, true, tuning_p, &fds_p[opened]);
+        if (E_SUCCESS != exit_code)
+        {
+            print_error("listener_open_group(): Unable to open listener.");
+            listener_close_all(fds_p, opened);
+            goto END;
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+int listener_open_datagram_group(const char *              port_p,
+                                 size_t                    count,
+                                 const listener_tuning_t * tuning_p,
+                                 int *                     fds_p)
+{
+    int    exit_code = E_FAILURE;
+    size_t opened    = 0;
+
+    if ((NULL == port_p) || (NULL == fds_p))
+    {
+        print_error("listener_open_datagram_group(): NULL argument passed.");
+        goto END;
+    }
+
+    for (opened = 0; opened < count; opened++)
+    {
+        exit_code = open_socket(
+            port_p, SOCK_DGRAM, true, tuning_p, &fds_p[opened]);
+        if (E_SUCCESS != exit_code)
+        {
+            print_error(
+                "listener_open_datagram_group(): Unable to open socket.");
+            listener_close_all(fds_p, opened);
+            goto END;
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+int listener_socket_port(int fd, uint16_t * port_p, int * socktype_p)
+{
+    int                     exit_code = E_FAILURE;
+    struct sockaddr_storage address   = { 0 };
+    socklen_t               length    = sizeof(address);
+    socklen_t               type_len  = sizeof(*socktype_p);
+
+    if ((NULL == port_p) || (NULL == socktype_p))
+    {
+        print_error("listener_socket_port(): NULL argument passed.");
+        goto END;
+    }
+
+    if ((0 != getsockname(fd, (struct sockaddr *)&address, &length)) ||
+        (0 != getsockopt(fd, SOL_SOCKET, SO_TYPE, socktype_p, &type_len)))
+    {
+        perror("listener_socket_port(): getsockname()/SO_TYPE");
+        goto END;
+    }
+
+    if (AF_INET6 == address.ss_family)
+    {
+        *port_p = ntohs(((struct sockaddr_in6 *)&address)->sin6_port);
+    }
+    else if (AF_INET == address.ss_family)
+    {
+        *port_p = ntohs(((struct sockaddr_in *)&address)->sin_port);
+    }
+    else
+    {
+        print_error("listener_socket_port(): Not an internet socket.");
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+void listener_close_all(int * fds_p, size_t count)
+{
+    if (NULL == fds_p)
+    {
+        return;
+    }
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        if (0 <= fds_p[idx])
+        {
+            close(fds_p[idx]);
+            fds_p[idx] = -1;
+        }
+    }
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int open_socket(const char *              port_p,
+                       int                       socktype,
+                       bool                      reuseport,
+                       const listener_tuning_t * tuning_p,
+                       int *                     fd_p)
+{
+    // The IPv6 wildcard also takes IPv4 clients once IPV6_V6ONLY is cleared;
+    // IPv4 alone is the fallback for hosts without IPv6.
+    static const int families[] = { AF_INET6, AF_INET };
+
+    int               exit_code = E_FAILURE;
+    int               error     = 0;
+    struct addrinfo   hints     = { 0 };
+    struct addrinfo * result_p  = NULL;
+
+    if ((NULL == port_p) || (NULL == fd_p))
+    {
+        print_error("open_socket(): NULL argument passed.");
+        goto END;
+    }
+
+    hints.ai_socktype = socktype;
+    hints.ai_flags    = AI_PASSIVE;
+
+    for (size_t idx = 0; idx < sizeof(families) / sizeof(families[0]); idx++)
+    {
+        hints.ai_family = families[idx];
+
+        error = getaddrinfo(NULL, port_p, &hints, &result_p);
+        if (0 != error)
+        {
+            result_p = NULL;
+            continue;
+        }
+
+        for (struct addrinfo * addr_p = result_p; NULL != addr_p;
+             addr_p                   = addr_p->ai_next)
+        {
+            exit_code = open_on_address(addr_p, reuseport, tuning_p, fd_p);
+            if (E_SUCCESS == exit_code)
+            {
+                goto END;
+            }
+        }
+
+        freeaddrinfo(result_p);
+        result_p = NULL;
+    }
+
+    if (0 != error)
+    {
+        fprintf(stderr, "open_socket(): %s\n", gai_strerror(error));
+    }
+    print_error("open_socket(): Unable to bind to any address.");
+    exit_code = E_FAILURE;
+END:
+    if (NULL != result_p)
+    {
+        freeaddrinfo(result_p);
+    }
+    return exit_code;
+}
+
+static int open_on_address(struct addrinfo *         addr_p,
+                           bool                      reuseport,
+                           const listener_tuning_t * tuning_p,
+                           int *                     fd_p)
+{
+    int exit_code = E_FAILURE;
+    int fd        = -1;
+    int enable    = 1;
+    int disable   = 0;
+    int backlog   = SOMAXCONN;
+
+    fd = socket(addr_p->ai_family, addr_p->ai_socktype, addr_p->ai_protocol);
+    if (-1 == fd)
+    {
+        goto END;
+    }
+
+    // Dual-stack regardless of the net.ipv6.bindv6only default
+    if ((AF_INET6 == addr_p->ai_family) &&
+        (0 !=
+         setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable))))
+    {
+        goto END;
+    }
+
+    if (0 != setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)))
+    {
+        perror("open_on_address(): SO_REUSEADDR");
+        goto END;
+    }
+
+    if ((true == reuseport) &&
+        (0 !=
+         setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable))))
+    {
+        perror("open_on_address(): SO_REUSEPORT");
+        goto END;
+    }
+
+    if ((NULL != tuning_p) &&
+        (E_SUCCESS != apply_tuning(fd, addr_p->ai_socktype, tuning_p)))
+    {
+        goto END;
+    }
+
+    if (0 != bind(fd, addr_p->ai_addr, addr_p->ai_addrlen))
+    {
+        goto END;
+    }
+
+    if (SOCK_DGRAM == addr_p->ai_socktype)
+    {
+        goto BOUND;
+    }
+
+    if ((NULL != tuning_p) && (0 < tuning_p->backlog))
+    {
+        backlog = tuning_p->backlog;
+    }
+
+    if (0 != listen(fd, backlog))
+    {
+        perror("open_on_address(): listen()");
+        goto END;
+    }
+
+BOUND:
+    *fd_p = fd;
+    fd    = -1;
+
+    exit_code = E_SUCCESS;
+END:
+    if (-1 != fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+static int apply_tuning(int                       fd,
+                        int                       socktype,
+                        const listener_tuning_t * tuning_p)
+{
+    int exit_code = E_FAILURE;
+
+    if ((SOCK_STREAM == socktype) && (true == tuning_p->tcp_nodelay) &&
+        (E_SUCCESS !=
+         set_int_option(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY")))
+    {
+        goto END;
+    }
+
+    // Raising SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN
+    if ((0 < tuning_p->busy_poll_us) &&
+        (E_SUCCESS != set_int_option(fd,
+                                     SOL_SOCKET,
+                                     SO_BUSY_POLL,
+                                     tuning_p->busy_poll_us,
+                                     "SO_BUSY_POLL")))
+    {
+        goto END;
+    }
+
+    // The kernel doubles these for its own bookkeeping and silently caps
+    // them at net.core.rmem_max and net.core.wmem_max.
+    if ((0 < tuning_p->rcvbuf) &&
+        (E_SUCCESS != set_int_option(fd,
+                                     SOL_SOCKET,
+                                     SO_RCVBUF,
+                                     tuning_p->rcvbuf,
+                                     "SO_RCVBUF")))
+    {
+        goto END;
+    }
+
+    if ((0 < tuning_p->sndbuf) &&
+        (E_SUCCESS != set_int_option(fd,
+                                     SOL_SOCKET,
+                                     SO_SNDBUF,
+                                     tuning_p->sndbuf,
+                                     "SO_SNDBUF")))
+    {
+        goto END;
+    }
+
+    // Connections are not handed to accept() until the client's first
+    // request arrives, so an acceptor never wakes for an idle connection.
+    if ((SOCK_STREAM == socktype) && (0 < tuning_p->defer_accept_s) &&
+        (E_SUCCESS != set_int_option(fd,
+                                     IPPROTO_TCP,
+                                     TCP_DEFER_ACCEPT,
+                                     tuning_p->defer_accept_s,
+                                     "TCP_DEFER_ACCEPT")))
+    {
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int set_int_option(
+    int fd, int level, int name, int value, const char * label_p)
+{
+    char message[64] = { 0 };
+
+    if (0 == setsockopt(fd, level, name, &value, sizeof(value)))
+    {
+        return E_SUCCESS;
+    }
+
+    snprintf(message, sizeof(message), "open_on_address(): %s", label_p);
+    perror(message);
+    return E_FAILURE;
+}
+
+/*** end of file ***/
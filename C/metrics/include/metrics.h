@@ -0,0 +1,131 @@
+/**
+ * @file metrics.h
+ * @brief Header for Hot-Path Metrics and the Metrics Endpoint
+ *
+ * This header file provides per-thread counters and latency histograms for
+ * the request path, and a small HTTP endpoint that serves them in the
+ * Prometheus text format when NetCalc runs with '--metrics-port'.
+ *
+ * Every thread that records metrics registers once and receives its own
+ * cache-line aligned slot, which only that thread writes. Nothing is shared
+ * or summed until the endpoint is scraped, so recording costs a few
+ * uncontended stores and never bounces a cache line between workers.
+ *
+ */
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct metrics        metrics_t;
+typedef struct metrics_thread metrics_thread_t;
+
+/**
+ * @brief Creates a metrics registry.
+ *
+ * @param max_threads The largest number of threads that may register.
+ * @return metrics_t* - The registry, or NULL on failure.
+ */
+metrics_t * metrics_create(size_t max_threads);
+
+/**
+ * @brief Stops the endpoint, if running, and frees a registry.
+ *
+ * @param metrics_pp Pointer to the registry pointer, set to NULL on return.
+ */
+void metrics_destroy(metrics_t ** metrics_pp);
+
+/**
+ * @brief Claims a slot for the calling thread.
+ *
+ * Called once per thread at start-up, not on the request path.
+ *
+ * @param metrics_p The registry.
+ * @return metrics_thread_t* - The thread's slot, or NULL if every slot has
+ * been claimed.
+ */
+metrics_thread_t * metrics_register_thread(metrics_t * metrics_p);
+
+/**
+ * @brief Counts a request placed on the work queue. Owner thread only.
+ *
+ * @param thread_p The calling thread's slot.
+ */
+void metrics_count_enqueue(metrics_thread_t * thread_p);
+
+/**
+ * @brief Counts a request taken off the work queue. Owner thread only.
+ *
+ * @param thread_p The calling thread's slot.
+ * @param wait_ns Time the request spent queued, from metrics_now_ns()
+ * readings taken at enqueue and dequeue.
+ */
+void metrics_count_dequeue(metrics_thread_t * thread_p, uint64_t wait_ns);
+
+/**
+ * @brief Records a computed request. Owner thread only.
+ *
+ * @param thread_p The calling thread's slot.
+ * @param service_ns Time spent computing the request, which also counts
+ * towards the thread's busy time.
+ */
+void metrics_record_request(metrics_thread_t * thread_p, uint64_t service_ns);
+
+/**
+ * @brief Returns the monotonic clock in nanoseconds, for timing requests.
+ *
+ * @return uint64_t - The current time.
+ */
+uint64_t metrics_now_ns(void);
+
+/**
+ * @brief Sums the counters the adaptive pool controller needs.
+ *
+ * @param metrics_p The registry.
+ * @param dequeued_p Pointer to where the requests taken off the queue are
+ * stored.
+ * @param wait_ns_p Pointer to where their total queue wait is stored.
+ * @param busy_ns_p Pointer to where the total compute time is stored.
+ */
+void metrics_load(metrics_t * metrics_p,
+                  uint64_t *  dequeued_p,
+                  uint64_t *  wait_ns_p,
+                  uint64_t *  busy_ns_p);
+
+/**
+ * @brief Aggregates every slot into Prometheus text format.
+ *
+ * @param metrics_p The registry.
+ * @param buffer_p Buffer receiving the text. Always NUL terminated.
+ * @param size The size of buffer_p.
+ * @param length_p Pointer to where the text length is stored.
+ * @return int - Returns E_SUCCESS on success, or E_FAILURE if the text did
+ * not fit.
+ */
+int metrics_format(metrics_t * metrics_p,
+                   char *      buffer_p,
+                   size_t      size,
+                   size_t *    length_p);
+
+/**
+ * @brief Starts a thread serving the metrics over HTTP on a port.
+ *
+ * Any request on a connection is answered with the current metrics and the
+ * connection is closed.
+ *
+ * @param metrics_p The registry.
+ * @param port_p The port to listen on, as a string.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int metrics_serve_start(metrics_t * metrics_p, const char * port_p);
+
+/**
+ * @brief Stops the endpoint thread and closes its socket.
+ *
+ * @param metrics_p The registry.
+ */
+void metrics_serve_stop(metrics_t * metrics_p);
+
+#endif /* _METRICS_H */
+/*** end of file ***/
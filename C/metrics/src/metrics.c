@@ -0,0 +1,665 @@
+/**
+ * @file metrics.c
+ * @brief Hot-Path Metrics and the Metrics Endpoint
+ *
+ * This file implements the per-thread metric slots and their aggregation.
+ * Each counter is written only by the thread that owns its slot, with a
+ * relaxed load and store rather than an atomic increment, so the request
+ * path never executes a locked instruction. The endpoint thread reads the
+ * slots with relaxed loads while they are being written; a scrape may
+ * therefore see one slot a few requests behind another, which is fine for
+ * monitoring and costs the workers nothing.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "latency_histogram.h"
+#include "listener.h"
+#include "metrics.h"
+#include "utilities.h"
+
+#define CACHE_LINE_SIZE      64   // Assumed size of a CPU cache line
+#define NSEC_PER_SEC         1000000000.0
+#define POLL_INTERVAL_MS     100  // How often the endpoint checks for stop
+#define REQUEST_BUFFER_SIZE  4096 // Bytes of a scrape request read
+#define RESPONSE_HEADER_SIZE 256  // Room for the HTTP response header
+#define BASE_TEXT_SIZE       4096 // Text for the registry-wide metrics
+#define PER_THREAD_TEXT_SIZE 256  // Text for one thread's metrics
+#define SCRAPE_TIMEOUT_SEC   1    // Longest a scraper may stall the endpoint
+
+/**
+ * @struct metrics_thread
+ * @brief One thread's metrics, written only by that thread.
+ *
+ * Aligned so that no two slots share a cache line.
+ */
+struct metrics_thread
+{
+    alignas(CACHE_LINE_SIZE) atomic_uint_least64_t enqueued; // Queued
+    atomic_uint_least64_t dequeued;                          // Taken off
+    atomic_uint_least64_t requests;                          // Computed
+    atomic_uint_least64_t busy_ns;                           // Computing
+    latency_histogram_t   queue_wait;                        // Wait in ns
+    latency_histogram_t   service;                           // Compute in ns
+};
+
+/**
+ * @struct metrics
+ * @brief The registry: every slot plus the endpoint thread's state.
+ */
+struct metrics
+{
+    metrics_thread_t *  threads_p;   // 'max_threads' slots
+    size_t              max_threads; // Number of slots
+    atomic_size_t       registered;  // Slots claimed so far
+    uint64_t            start_ns;    // Creation time, for uptime
+    int                 listen_fd;   // Endpoint socket, -1 if not serving
+    pthread_t           server;      // Endpoint thread
+    atomic_bool         running;     // Cleared to stop the endpoint
+    latency_histogram_t merged;      // Scratch space for one scrape
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Adds to a counter written only by the calling thread.
+ *
+ * @param counter_p The counter.
+ * @param amount The amount to add.
+ */
+static void add(atomic_uint_least64_t * counter_p, uint64_t amount);
+
+/**
+ * @brief Reads a counter written by another thread.
+ *
+ * @param counter_p The counter.
+ * @return The counter's value.
+ */
+static uint64_t load(atomic_uint_least64_t * counter_p);
+
+/**
+ * @brief Appends formatted text to a buffer.
+ *
+ * @param buffer_p The buffer.
+ * @param size The size of the buffer.
+ * @param offset_p The current text length, advanced by the text appended.
+ * @param format_p printf() style format.
+ * @return int - Returns E_SUCCESS on success, or E_FAILURE if the text did
+ * not fit.
+ */
+static int append(char *       buffer_p,
+                  size_t       size,
+                  size_t *     offset_p,
+                  const char * format_p,
+                  ...) __attribute__((format(printf, 4, 5)));
+
+/**
+ * @brief Appends a merged latency histogram as a Prometheus summary.
+ *
+ * @param metrics_p The registry. Its 'merged' histogram is overwritten.
+ * @param wait Whether to merge the queue wait (true) or service (false)
+ * histograms.
+ * @param name_p The metric name.
+ * @param help_p The metric description.
+ * @param buffer_p The buffer.
+ * @param size The size of the buffer.
+ * @param offset_p The current text length.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int append_summary(metrics_t *  metrics_p,
+                          bool         wait,
+                          const char * name_p,
+                          const char * help_p,
+                          char *       buffer_p,
+                          size_t       size,
+                          size_t *     offset_p);
+
+/**
+ * @brief Endpoint thread: answers each connection with the metrics.
+ *
+ * @param arg_p The registry.
+ * @return void* - Always NULL.
+ */
+static void * serve_metrics(void * arg_p);
+
+/**
+ * @brief Reads a request from a scraper and writes the response.
+ *
+ * @param metrics_p The registry.
+ * @param client_fd The accepted connection.
+ * @param text_p Buffer for the metrics text.
+ * @param text_size The size of text_p.
+ */
+static void answer_scrape(metrics_t * metrics_p,
+                          int         client_fd,
+                          char *      text_p,
+                          size_t      text_size);
+
+// +---------------------------------------------------------------------------+
+// |                               METRICS API                                 |
+// +---------------------------------------------------------------------------+
+
+metrics_t * metrics_create(size_t max_threads)
+{
+    metrics_t * metrics_p = NULL;
+
+    if (0 == max_threads)
+    {
+        print_error("metrics_create(): max_threads must be at least 1.");
+        goto END;
+    }
+
+    metrics_p = calloc(1, sizeof(metrics_t));
+    if (NULL == metrics_p)
+    {
+        print_error("metrics_create(): calloc() failed.");
+        goto END;
+    }
+
+    // sizeof(metrics_thread_t) is a multiple of its alignment, as
+    // aligned_alloc() requires of the total size.
+    metrics_p->threads_p = aligned_alloc(
+        CACHE_LINE_SIZE, max_threads * sizeof(metrics_thread_t));
+    if (NULL == metrics_p->threads_p)
+    {
+        print_error("metrics_create(): aligned_alloc() failed.");
+        free(metrics_p);
+        metrics_p = NULL;
+        goto END;
+    }
+
+    memset(metrics_p->threads_p, 0, max_threads * sizeof(metrics_thread_t));
+    metrics_p->max_threads = max_threads;
+    metrics_p->start_ns    = metrics_now_ns();
+    metrics_p->listen_fd   = -1;
+    atomic_init(&metrics_p->registered, 0);
+    atomic_init(&metrics_p->running, false);
+
+END:
+    return metrics_p;
+}
+
+void metrics_destroy(metrics_t ** metrics_pp)
+{
+    if ((NULL == metrics_pp) || (NULL == *metrics_pp))
+    {
+        return;
+    }
+
+    metrics_serve_stop(*metrics_pp);
+    free((*metrics_pp)->threads_p);
+    free(*metrics_pp);
+    *metrics_pp = NULL;
+}
+
+metrics_thread_t * metrics_register_thread(metrics_t * metrics_p)
+{
+    size_t slot = 0;
+
+    if (NULL == metrics_p)
+    {
+        print_error("metrics_register_thread(): NULL argument passed.");
+        return NULL;
+    }
+
+    slot = atomic_fetch_add(&metrics_p->registered, 1);
+    if (metrics_p->max_threads <= slot)
+    {
+        print_error("metrics_register_thread(): No free slots.");
+        return NULL;
+    }
+
+    return &metrics_p->threads_p[slot];
+}
+
+void metrics_count_enqueue(metrics_thread_t * thread_p)
+{
+    if (NULL != thread_p)
+    {
+        add(&thread_p->enqueued, 1);
+    }
+}
+
+void metrics_count_dequeue(metrics_thread_t * thread_p, uint64_t wait_ns)
+{
+    if (NULL != thread_p)
+    {
+        add(&thread_p->dequeued, 1);
+        latency_histogram_record(&thread_p->queue_wait, wait_ns);
+    }
+}
+
+void metrics_record_request(metrics_thread_t * thread_p, uint64_t service_ns)
+{
+    if (NULL != thread_p)
+    {
+        add(&thread_p->requests, 1);
+        add(&thread_p->busy_ns, service_ns);
+        latency_histogram_record(&thread_p->service, service_ns);
+    }
+}
+
+uint64_t metrics_now_ns(void)
+{
+    struct timespec now = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+void metrics_load(metrics_t * metrics_p,
+                  uint64_t *  dequeued_p,
+                  uint64_t *  wait_ns_p,
+                  uint64_t *  busy_ns_p)
+{
+    size_t             count    = 0;
+    metrics_thread_t * thread_p = NULL;
+
+    if ((NULL == metrics_p) || (NULL == dequeued_p) || (NULL == wait_ns_p) ||
+        (NULL == busy_ns_p))
+    {
+        print_error("metrics_load(): NULL argument passed.");
+        return;
+    }
+
+    *dequeued_p = 0;
+    *wait_ns_p  = 0;
+    *busy_ns_p  = 0;
+
+    count = atomic_load(&metrics_p->registered);
+    count = (count > metrics_p->max_threads) ? metrics_p->max_threads : count;
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        thread_p = &metrics_p->threads_p[idx];
+        *dequeued_p += load(&thread_p->dequeued);
+        *wait_ns_p += latency_histogram_sum(&thread_p->queue_wait);
+        *busy_ns_p += load(&thread_p->busy_ns);
+    }
+}
+
+int metrics_format(metrics_t * metrics_p,
+                   char *      buffer_p,
+                   size_t      size,
+                   size_t *    length_p)
+{
+    int                exit_code = E_FAILURE;
+    size_t             offset    = 0;
+    size_t             count     = 0;
+    uint64_t           enqueued  = 0;
+    uint64_t           dequeued  = 0;
+    metrics_thread_t * thread_p  = NULL;
+
+    if ((NULL == metrics_p) || (NULL == buffer_p) || (0 == size) ||
+        (NULL == length_p))
+    {
+        print_error("metrics_format(): NULL argument passed.");
+        goto END;
+    }
+
+    buffer_p[0] = '\0';
+    count       = atomic_load(&metrics_p->registered);
+    count = (count > metrics_p->max_threads) ? metrics_p->max_threads : count;
+
+    // Requests move between threads' queues, so depth is only meaningful
+    // summed over every slot.
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        enqueued += load(&metrics_p->threads_p[idx].enqueued);
+        dequeued += load(&metrics_p->threads_p[idx].dequeued);
+    }
+
+    if ((E_SUCCESS !=
+         append(buffer_p,
+                size,
+                &offset,
+                "# HELP netcalc_uptime_seconds Time since start-up.\n"
+                "# TYPE netcalc_uptime_seconds gauge\n"
+                "netcalc_uptime_seconds %.3f\n"
+                "# HELP netcalc_queue_depth Requests queued, not yet "
+                "dequeued.\n"
+                "# TYPE netcalc_queue_depth gauge\n"
+                "netcalc_queue_depth %llu\n",
+                (double)(metrics_now_ns() - metrics_p->start_ns) /
+                    NSEC_PER_SEC,
+                (unsigned long long)((enqueued > dequeued)
+                                         ? (enqueued - dequeued)
+                                         : 0))) ||
+        (E_SUCCESS != append(buffer_p,
+                             size,
+                             &offset,
+                             "# HELP netcalc_requests_total Requests "
+                             "computed.\n"
+                             "# TYPE netcalc_requests_total counter\n")))
+    {
+        goto END;
+    }
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        thread_p = &metrics_p->threads_p[idx];
+        if (E_SUCCESS != append(buffer_p,
+                                size,
+                                &offset,
+                                "netcalc_requests_total{thread=\"%zu\"} %llu\n",
+                                idx,
+                                (unsigned long long)load(&thread_p->requests)))
+        {
+            goto END;
+        }
+    }
+
+    if (E_SUCCESS != append(buffer_p,
+                            size,
+                            &offset,
+                            "# HELP netcalc_busy_seconds_total Time spent "
+                            "computing; divide its rate by 1s for "
+                            "utilization.\n"
+                            "# TYPE netcalc_busy_seconds_total counter\n"))
+    {
+        goto END;
+    }
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        thread_p = &metrics_p->threads_p[idx];
+        if (E_SUCCESS !=
+            append(buffer_p,
+                   size,
+                   &offset,
+                   "netcalc_busy_seconds_total{thread=\"%zu\"} %.6f\n",
+                   idx,
+                   (double)load(&thread_p->busy_ns) / NSEC_PER_SEC))
+        {
+            goto END;
+        }
+    }
+
+    if ((E_SUCCESS != append_summary(metrics_p,
+                                     true,
+                                     "netcalc_queue_wait_seconds",
+                                     "Time from enqueue to dequeue.",
+                                     buffer_p,
+                                     size,
+                                     &offset)) ||
+        (E_SUCCESS != append_summary(metrics_p,
+                                     false,
+                                     "netcalc_service_seconds",
+                                     "Time spent computing a request.",
+                                     buffer_p,
+                                     size,
+                                     &offset)))
+    {
+        goto END;
+    }
+
+    *length_p = offset;
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+int metrics_serve_start(metrics_t * metrics_p, const char * port_p)
+{
+    int exit_code = E_FAILURE;
+
+    if ((NULL == metrics_p) || (NULL == port_p))
+    {
+        print_error("metrics_serve_start(): NULL argument passed.");
+        goto END;
+    }
+
+    if (-1 != metrics_p->listen_fd)
+    {
+        print_error("metrics_serve_start(): Already serving.");
+        goto END;
+    }
+
+    if (E_SUCCESS != listener_open(port_p, false, NULL, &metrics_p->listen_fd))
+    {
+        metrics_p->listen_fd = -1;
+        goto END;
+    }
+
+    atomic_store(&metrics_p->running, true);
+    if (0 != pthread_create(&metrics_p->server, NULL, serve_metrics, metrics_p))
+    {
+        print_error("metrics_serve_start(): pthread_create() failed.");
+        atomic_store(&metrics_p->running, false);
+        close(metrics_p->listen_fd);
+        metrics_p->listen_fd = -1;
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+void metrics_serve_stop(metrics_t * metrics_p)
+{
+    if ((NULL == metrics_p) || (-1 == metrics_p->listen_fd))
+    {
+        return;
+    }
+
+    atomic_store(&metrics_p->running, false);
+    pthread_join(metrics_p->server, NULL);
+    close(metrics_p->listen_fd);
+    metrics_p->listen_fd = -1;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static void add(atomic_uint_least64_t * counter_p, uint64_t amount)
+{
+    // Single writer: load and store instead of a locked fetch_add
+    atomic_store_explicit(
+        counter_p,
+        atomic_load_explicit(counter_p, memory_order_relaxed) + amount,
+        memory_order_relaxed);
+}
+
+static uint64_t load(atomic_uint_least64_t * counter_p)
+{
+    return atomic_load_explicit(counter_p, memory_order_relaxed);
+}
+
+static int append(char *       buffer_p,
+                  size_t       size,
+                  size_t *     offset_p,
+                  const char * format_p,
+                  ...)
+{
+    int     written = 0;
+    va_list args;
+
+    va_start(args, format_p);
+    written = vsnprintf(
+        &buffer_p[*offset_p], size - *offset_p, format_p, args);
+    va_end(args);
+
+    if ((0 > written) || ((size - *offset_p) <= (size_t)written))
+    {
+        print_error("metrics_format(): Buffer too small.");
+        return E_FAILURE;
+    }
+
+    *offset_p += (size_t)written;
+    return E_SUCCESS;
+}
+
+static int append_summary(metrics_t *  metrics_p,
+                          bool         wait,
+                          const char * name_p,
+                          const char * help_p,
+                          char *       buffer_p,
+                          size_t       size,
+                          size_t *     offset_p)
+{
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    latency_histogram_t * merged_p = &metrics_p->merged;
+    size_t                count    = 0;
+
+    count = atomic_load(&metrics_p->registered);
+    count = (count > metrics_p->max_threads) ? metrics_p->max_threads : count;
+
+    latency_histogram_reset(merged_p);
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        latency_histogram_merge(merged_p,
+                                (true == wait)
+                                    ? &metrics_p->threads_p[idx].queue_wait
+                                    : &metrics_p->threads_p[idx].service);
+    }
+
+    if (E_SUCCESS != append(buffer_p,
+                            size,
+                            offset_p,
+                            "# HELP %s %s\n# TYPE %s summary\n",
+                            name_p,
+                            help_p,
+                            name_p))
+    {
+        return E_FAILURE;
+    }
+
+    for (size_t idx = 0; idx < (sizeof(quantiles) / sizeof(quantiles[0]));
+         idx++)
+    {
+        if (E_SUCCESS !=
+            append(buffer_p,
+                   size,
+                   offset_p,
+                   "%s{quantile=\"%g\"} %.9f\n",
+                   name_p,
+                   quantiles[idx],
+                   (double)latency_histogram_percentile(
+                       merged_p, quantiles[idx] * 100.0) /
+                       NSEC_PER_SEC))
+        {
+            return E_FAILURE;
+        }
+    }
+
+    return append(buffer_p,
+                  size,
+                  offset_p,
+                  "%s_sum %.9f\n%s_count %llu\n",
+                  name_p,
+                  (double)latency_histogram_sum(merged_p) / NSEC_PER_SEC,
+                  name_p,
+                  (unsigned long long)latency_histogram_count(merged_p));
+}
+
+static void * serve_metrics(void * arg_p)
+{
+    metrics_t *   metrics_p = arg_p;
+    struct pollfd poll_fd   = { 0 };
+    char *        text_p    = NULL;
+    size_t        text_size = 0;
+    int           client_fd = -1;
+
+    text_size =
+        BASE_TEXT_SIZE + (metrics_p->max_threads * PER_THREAD_TEXT_SIZE);
+    text_p    = malloc(text_size);
+    if (NULL == text_p)
+    {
+        print_error("serve_metrics(): malloc() failed.");
+        return NULL;
+    }
+
+    poll_fd.fd     = metrics_p->listen_fd;
+    poll_fd.events = POLLIN;
+
+    // Poll with a timeout rather than block in accept() so that
+    // metrics_serve_stop() is noticed without signalling this thread.
+    while (true == atomic_load(&metrics_p->running))
+    {
+        if (0 >= poll(&poll_fd, 1, POLL_INTERVAL_MS))
+        {
+            continue;
+        }
+
+        client_fd = accept(metrics_p->listen_fd, NULL, NULL);
+        if (-1 == client_fd)
+        {
+            continue;
+        }
+
+        answer_scrape(metrics_p, client_fd, text_p, text_size);
+        close(client_fd);
+    }
+
+    free(text_p);
+    return NULL;
+}
+
+static void answer_scrape(metrics_t * metrics_p,
+                          int         client_fd,
+                          char *      text_p,
+                          size_t      text_size)
+{
+    char           request[REQUEST_BUFFER_SIZE] = { 0 };
+    char           header[RESPONSE_HEADER_SIZE] = { 0 };
+    struct timeval timeout                      = { 0 };
+    size_t         length                       = 0;
+    int            header_length                = 0;
+
+    // A stalled scraper must not hold up the next one
+    timeout.tv_sec = SCRAPE_TIMEOUT_SEC;
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // The request itself is not parsed: every path returns the metrics
+    if (0 >= recv(client_fd, request, sizeof(request) - 1, 0))
+    {
+        return;
+    }
+
+    if (E_SUCCESS != metrics_format(metrics_p, text_p, text_size, &length))
+    {
+        header_length = snprintf(header,
+                                 sizeof(header),
+                                 "HTTP/1.0 500 Internal Server Error\r\n"
+                                 "Content-Length: 0\r\n"
+                                 "Connection: close\r\n\r\n");
+        length        = 0;
+    }
+    else
+    {
+        header_length = snprintf(header,
+                                 sizeof(header),
+                                 "HTTP/1.0 200 OK\r\n"
+                                 "Content-Type: text/plain; version=0.0.4\r\n"
+                                 "Content-Length: %zu\r\n"
+                                 "Connection: close\r\n\r\n",
+                                 length);
+    }
+
+    if (header_length ==
+        send(client_fd, header, (size_t)header_length, MSG_NOSIGNAL))
+    {
+        send(client_fd, text_p, length, MSG_NOSIGNAL);
+    }
+}
+
+/*** end of file ***/
@@ -0,0 +1,102 @@
+/**
+ * @file mpmc_queue.h
+ * @brief Header for the Lock-Free MPMC Queue
+ *
+ * This header file provides the interface for a bounded, lock-free,
+ * multi-producer multi-consumer ring buffer used as the thread pool's work
+ * queue when '--queue lockfree' is selected.
+ *
+ */
+#ifndef _MPMC_QUEUE_H
+#define _MPMC_QUEUE_H
+
+#include <stddef.h>
+
+/**
+ * @struct mpmc_queue
+ * @brief Opaque lock-free queue handle.
+ */
+typedef struct mpmc_queue mpmc_queue_t;
+
+/**
+ * @brief Creates a queue holding at least 'capacity' items.
+ *
+ * The capacity is rounded up to the next power of two.
+ *
+ * @param capacity The minimum number of items the queue can hold (>= 2).
+ * @return mpmc_queue_t * - The new queue, or NULL on failure.
+ */
+mpmc_queue_t * mpmc_queue_create(size_t capacity);
+
+/**
+ * @brief Destroys a queue and sets the caller's pointer to NULL.
+ *
+ * Items still in the queue are not freed. No other thread may be using the
+ * queue.
+ *
+ * @param queue_pp The address of the queue pointer.
+ */
+void mpmc_queue_destroy(mpmc_queue_t ** queue_pp);
+
+/**
+ * @brief Adds an item to the queue without blocking.
+ *
+ * @param queue_p The queue.
+ * @param item_p The item to add. May not be NULL.
+ * @return int - Returns E_SUCCESS on success, E_FAILURE if the queue is full
+ * or an argument is invalid.
+ */
+int mpmc_queue_enqueue(mpmc_queue_t * queue_p, void * item_p);
+
+/**
+ * @brief Removes the oldest item from the queue without blocking.
+ *
+ * @param queue_p The queue.
+ * @param item_pp Pointer to where the removed item is stored.
+ * @return int - Returns E_SUCCESS on success, E_FAILURE if the queue is empty
+ * or an argument is invalid.
+ */
+int mpmc_queue_dequeue(mpmc_queue_t * queue_p, void ** item_pp);
+
+/**
+ * @brief Removes up to 'max_items' of the oldest items in one operation.
+ *
+ * A run of consecutive filled slots is claimed with a single compare-and-swap
+ * on the dequeue index, so a batch costs one contended operation rather than
+ * one per item. Fewer than 'max_items' are returned if fewer are ready.
+ *
+ * @param queue_p The queue.
+ * @param items_pp Array of at least 'max_items' entries receiving the items.
+ * @param max_items The maximum number of items to remove.
+ * @param count_p Pointer to where the number of items removed is stored.
+ * @return int - Returns E_SUCCESS if at least one item was removed, E_FAILURE
+ * if the queue is empty or an argument is invalid.
+ */
+int mpmc_queue_dequeue_batch(mpmc_queue_t * queue_p,
+                             void **        items_pp,
+                             size_t         max_items,
+                             size_t *       count_p);
+
+/**
+ * @brief Returns the capacity of the queue after rounding.
+ *
+ * @param queue_p The queue.
+ * @return size_t - The number of slots in the queue.
+ */
+size_t mpmc_queue_capacity(const mpmc_queue_t * queue_p);
+
+/**
+ * @brief Returns the number of items in the queue.
+ *
+ * The value is a snapshot taken without synchronising with producers or
+ * consumers, so it may be stale by the time it is used. It is meant for
+ * admission control and metrics, not for deciding whether a dequeue will
+ * succeed.
+ *
+ * @param queue_p The queue.
+ * @return size_t - The approximate number of queued items.
+ */
+size_t mpmc_queue_size(const mpmc_queue_t * queue_p);
+
+#endif /* _MPMC_QUEUE_H */
+/*** end of file ***/
@@ -0,0 +1,344 @@
+/**
+ * @file mpmc_queue.c
+ * @brief Bounded Lock-Free MPMC Queue
+ *
+ * This file implements a bounded multi-producer multi-consumer queue after
+ * Dmitry Vyukov's design. Each slot carries a sequence number that tells
+ * producers and consumers whether the slot is ready for them, so the only
+ * shared writes are one compare-and-swap on the head or tail index and one
+ * store to the claimed slot. The head and tail indexes live on separate
+ * cache lines so producers and consumers do not false-share.
+ */
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "mpmc_queue.h"
+#include "utilities.h"
+
+#define CACHE_LINE_SIZE 64 // Assumed size of a CPU cache line
+#define MIN_QUEUE_SLOTS 2  // Smallest capacity supported
+
+/**
+ * @struct mpmc_slot
+ * @brief One ring buffer slot and its sequence number.
+ */
+typedef struct mpmc_slot
+{
+    atomic_size_t sequence; // Position this slot is ready for
+    void *        item_p;   // Stored item
+} mpmc_slot_t;
+
+struct mpmc_queue
+{
+    alignas(CACHE_LINE_SIZE) atomic_size_t enqueue_pos; // Next slot to fill
+    alignas(CACHE_LINE_SIZE) atomic_size_t dequeue_pos; // Next slot to drain
+    alignas(CACHE_LINE_SIZE) size_t mask;               // capacity - 1
+    mpmc_slot_t * slots_p;                              // The ring buffer
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Rounds a value up to the next power of two.
+ *
+ * @param value The value to round.
+ * @return The smallest power of two >= value, or 0 on overflow.
+ */
+static size_t round_up_pow2(size_t value);
+
+// +---------------------------------------------------------------------------+
+// |                              MPMC QUEUE API                               |
+// +---------------------------------------------------------------------------+
+
+mpmc_queue_t * mpmc_queue_create(size_t capacity)
+{
+    mpmc_queue_t * queue_p = NULL;
+    size_t         slots   = 0;
+
+    if (MIN_QUEUE_SLOTS > capacity)
+    {
+        print_error("mpmc_queue_create(): Capacity must be 2 or more.");
+        goto END;
+    }
+
+    slots = round_up_pow2(capacity);
+    if (0 == slots)
+    {
+        print_error("mpmc_queue_create(): Capacity too large.");
+        goto END;
+    }
+
+    queue_p = aligned_alloc(CACHE_LINE_SIZE, sizeof(*queue_p));
+    if (NULL == queue_p)
+    {
+        print_error("mpmc_queue_create(): aligned_alloc() failed.");
+        goto END;
+    }
+
+    queue_p->slots_p = calloc(slots, sizeof(*queue_p->slots_p));
+    if (NULL == queue_p->slots_p)
+    {
+        print_error("mpmc_queue_create(): calloc() failed.");
+        free(queue_p);
+        queue_p = NULL;
+        goto END;
+    }
+
+    for (size_t idx = 0; idx < slots; idx++)
+    {
+        atomic_init(&queue_p->slots_p[idx].sequence, idx);
+    }
+    atomic_init(&queue_p->enqueue_pos, 0);
+    atomic_init(&queue_p->dequeue_pos, 0);
+    queue_p->mask = slots - 1;
+
+END:
+    return queue_p;
+}
+
+void mpmc_queue_destroy(mpmc_queue_t ** queue_pp)
+{
+    if ((NULL == queue_pp) || (NULL == *queue_pp))
+    {
+        return;
+    }
+
+    free((*queue_pp)->slots_p);
+    free(*queue_pp);
+    *queue_pp = NULL;
+}
+
+int mpmc_queue_enqueue(mpmc_queue_t * queue_p, void * item_p)
+{
+    int           exit_code = E_FAILURE;
+    mpmc_slot_t * slot_p    = NULL;
+    size_t        pos       = 0;
+    size_t        sequence  = 0;
+    intptr_t      diff      = 0;
+
+    if ((NULL == queue_p) || (NULL == item_p))
+    {
+        goto END;
+    }
+
+    pos = atomic_load_explicit(&queue_p->enqueue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        slot_p   = &queue_p->slots_p[pos & queue_p->mask];
+        sequence =
+            atomic_load_explicit(&slot_p->sequence, memory_order_acquire);
+        diff     = (intptr_t)sequence - (intptr_t)pos;
+
+        if (0 == diff)
+        {
+            // Slot is free for this position; try to claim it
+            if (atomic_compare_exchange_weak_explicit(&queue_p->enqueue_pos,
+                                                      &pos,
+                                                      pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (0 > diff)
+        {
+            // The slot still holds an item from the previous lap: full
+            goto END;
+        }
+        else
+        {
+            // Another producer claimed this position first
+            pos = atomic_load_explicit(&queue_p->enqueue_pos,
+                                       memory_order_relaxed);
+        }
+    }
+
+    slot_p->item_p = item_p;
+    atomic_store_explicit(&slot_p->sequence, pos + 1, memory_order_release);
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+int mpmc_queue_dequeue(mpmc_queue_t * queue_p, void ** item_pp)
+{
+    int           exit_code = E_FAILURE;
+    mpmc_slot_t * slot_p    = NULL;
+    size_t        pos       = 0;
+    size_t        sequence  = 0;
+    intptr_t      diff      = 0;
+
+    if ((NULL == queue_p) || (NULL == item_pp))
+    {
+        goto END;
+    }
+
+    pos = atomic_load_explicit(&queue_p->dequeue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        slot_p   = &queue_p->slots_p[pos & queue_p->mask];
+        sequence =
+            atomic_load_explicit(&slot_p->sequence, memory_order_acquire);
+        diff     = (intptr_t)sequence - (intptr_t)(pos + 1);
+
+        if (0 == diff)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue_p->dequeue_pos,
+                                                      &pos,
+                                                      pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (0 > diff)
+        {
+            // No producer has filled this position yet: empty
+            goto END;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&queue_p->dequeue_pos,
+                                       memory_order_relaxed);
+        }
+    }
+
+    *item_pp = slot_p->item_p;
+
+    // Mark the slot free for the producer one lap ahead
+    atomic_store_explicit(
+        &slot_p->sequence, pos + queue_p->mask + 1, memory_order_release);
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+int mpmc_queue_dequeue_batch(mpmc_queue_t * queue_p,
+                             void **        items_pp,
+                             size_t         max_items,
+                             size_t *       count_p)
+{
+    int           exit_code = E_FAILURE;
+    mpmc_slot_t * slot_p    = NULL;
+    size_t        pos       = 0;
+    size_t        ready     = 0;
+
+    if ((NULL == queue_p) || (NULL == items_pp) || (NULL == count_p) ||
+        (0 == max_items))
+    {
+        goto END;
+    }
+
+    if (max_items > (queue_p->mask + 1))
+    {
+        max_items = queue_p->mask + 1;
+    }
+
+    pos = atomic_load_explicit(&queue_p->dequeue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        // Count the filled slots starting at 'pos'
+        for (ready = 0; ready < max_items; ready++)
+        {
+            slot_p = &queue_p->slots_p[(pos + ready) & queue_p->mask];
+            if ((pos + ready + 1) !=
+                atomic_load_explicit(&slot_p->sequence, memory_order_acquire))
+            {
+                break;
+            }
+        }
+
+        if (0 == ready)
+        {
+            // Either empty, or another consumer moved past 'pos'
+            if (pos == atomic_load_explicit(&queue_p->dequeue_pos,
+                                            memory_order_relaxed))
+            {
+                goto END;
+            }
+            pos = atomic_load_explicit(&queue_p->dequeue_pos,
+                                       memory_order_relaxed);
+            continue;
+        }
+
+        if (atomic_compare_exchange_weak_explicit(&queue_p->dequeue_pos,
+                                                  &pos,
+                                                  pos + ready,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        {
+            break;
+        }
+    }
+
+    for (size_t idx = 0; idx < ready; idx++)
+    {
+        slot_p        = &queue_p->slots_p[(pos + idx) & queue_p->mask];
+        items_pp[idx] = slot_p->item_p;
+        atomic_store_explicit(&slot_p->sequence,
+                              pos + idx + queue_p->mask + 1,
+                              memory_order_release);
+    }
+    *count_p = ready;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+size_t mpmc_queue_capacity(const mpmc_queue_t * queue_p)
+{
+    return (NULL == queue_p) ? 0 : (queue_p->mask + 1);
+}
+
+size_t mpmc_queue_size(const mpmc_queue_t * queue_p)
+{
+    size_t dequeue_pos = 0;
+    size_t enqueue_pos = 0;
+
+    if (NULL == queue_p)
+    {
+        return 0;
+    }
+
+    // Read the consumer position first: it never passes the producer
+    // position, so the difference cannot go negative.
+    dequeue_pos = atomic_load_explicit(
+        (atomic_size_t *)&queue_p->dequeue_pos, memory_order_relaxed);
+    enqueue_pos = atomic_load_explicit(
+        (atomic_size_t *)&queue_p->enqueue_pos, memory_order_relaxed);
+
+    return ((enqueue_pos - dequeue_pos) > (queue_p->mask + 1))
+               ? (queue_p->mask + 1)
+               : (enqueue_pos - dequeue_pos);
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static size_t round_up_pow2(size_t value)
+{
+    size_t result = 1;
+
+    while (result < value)
+    {
+        if ((SIZE_MAX / 2) < result)
+        {
+            return 0;
+        }
+        result <<= 1;
+    }
+
+    return result;
+}
+
+/*** end of file ***/
@@ -0,0 +1,455 @@
+/**
+ * @file test_mpmc_queue.c
+ * @brief Tests for the Lock-Free MPMC Queue
+ *
+ * Single-threaded checks of capacity, FIFO order and batched dequeues,
+ * followed by a stress test in which several producers and consumers share
+ * one small queue. Consumers alternate between mpmc_queue_dequeue() and
+ * mpmc_queue_dequeue_batch(); every item must be seen exactly once, and the
+ * items of each producer must reach any one consumer in the order they were
+ * enqueued. Build with -fsanitize=thread to check the memory ordering as
+ * well.
+ *
+ * Usage: test-mpmc-queue
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mpmc_queue.h"
+#include "utilities.h"
+
+#define STRESS_PRODUCERS 4      // Producer threads
+#define STRESS_CONSUMERS 4      // Consumer threads
+#define STRESS_ITEMS     200000 // Items enqueued by each producer
+#define STRESS_DEPTH     64     // Queue capacity, kept small to force wraps
+#define STRESS_BATCH     16     // Largest batch a consumer asks for
+
+// Items are encoded as pointers; +1 keeps item 0 of producer 0 non-NULL
+#define ITEM_ENCODE(producer, seq)                                             \
+    ((void *)(uintptr_t)((((uint64_t)(producer) << 32) | (seq)) + 1))
+#define ITEM_VALUE(item_p)    (((uint64_t)(uintptr_t)(item_p)) - 1)
+#define ITEM_PRODUCER(item_p) (ITEM_VALUE(item_p) >> 32)
+#define ITEM_SEQ(item_p)      (ITEM_VALUE(item_p) & 0xFFFFFFFF)
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr,                                                    \
+                    "%s:%d: CHECK(%s) failed\n",                               \
+                    __FILE__,                                                  \
+                    __LINE__,                                                  \
+                    #condition);                                               \
+            goto END;                                                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @struct stress
+ * @brief State shared by the threads of test_stress().
+ */
+typedef struct stress
+{
+    mpmc_queue_t * queue_p;  // The queue under test
+    atomic_size_t  consumed; // Items dequeued so far, by every consumer
+    atomic_bool    failed;   // A consumer saw an item out of order
+    // How often each item was seen
+    atomic_uchar   seen[STRESS_PRODUCERS][STRESS_ITEMS];
+} stress_t;
+
+/**
+ * @struct stress_thread
+ * @brief One producer or consumer of test_stress().
+ */
+typedef struct stress_thread
+{
+    stress_t * stress_p; // Shared state
+    size_t     id;       // Producer index, or consumer index
+} stress_thread_t;
+
+/**
+ * @struct test_case
+ * @brief One named test.
+ */
+typedef struct test_case
+{
+    const char * name_p; // Printed with the result
+    int (*run)(void);    // Returns E_SUCCESS if the test passed
+} test_case_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Checks the capacity rounding and the full and empty cases.
+ */
+static int test_capacity(void);
+
+/**
+ * @brief Checks FIFO order through several wraps of the ring.
+ */
+static int test_fifo(void);
+
+/**
+ * @brief Checks that a batch stops at the items ready and keeps their order.
+ */
+static int test_batch(void);
+
+/**
+ * @brief Checks that invalid arguments are rejected.
+ */
+static int test_arguments(void);
+
+/**
+ * @brief Runs STRESS_PRODUCERS producers against STRESS_CONSUMERS consumers.
+ */
+static int test_stress(void);
+
+/**
+ * @brief Enqueues STRESS_ITEMS items, retrying while the queue is full.
+ *
+ * @param arg_p The stress_thread_t.
+ * @return NULL.
+ */
+static void * stress_producer(void * arg_p);
+
+/**
+ * @brief Dequeues until every producer's items have been consumed.
+ *
+ * @param arg_p The stress_thread_t.
+ * @return NULL.
+ */
+static void * stress_consumer(void * arg_p);
+
+/**
+ * @brief Records one consumed item, checking it against the consumer's last.
+ *
+ * @param stress_p Shared state.
+ * @param last_p The next sequence number the consumer expects at least, per
+ * producer.
+ * @param item_p The item.
+ */
+static void stress_record(stress_t * stress_p,
+                          uint64_t * last_p,
+                          void *     item_p);
+
+int main(void)
+{
+    static const test_case_t tests[] = {
+        { "capacity", test_capacity },   { "fifo", test_fifo },
+        { "batch", test_batch },         { "arguments", test_arguments },
+        { "stress", test_stress },
+    };
+    int exit_code = E_SUCCESS;
+
+    for (size_t idx = 0; idx < sizeof(tests) / sizeof(tests[0]); idx++)
+    {
+        if (E_SUCCESS == tests[idx].run())
+        {
+            printf("PASS %s\n", tests[idx].name_p);
+        }
+        else
+        {
+            printf("FAIL %s\n", tests[idx].name_p);
+            exit_code = E_FAILURE;
+        }
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int test_capacity(void)
+{
+    int            exit_code = E_FAILURE;
+    mpmc_queue_t * queue_p   = NULL;
+    void *         item_p    = NULL;
+
+    queue_p = mpmc_queue_create(5);
+    CHECK(NULL != queue_p);
+    CHECK(8 == mpmc_queue_capacity(queue_p));
+    CHECK(0 == mpmc_queue_size(queue_p));
+    CHECK(E_FAILURE == mpmc_queue_dequeue(queue_p, &item_p));
+
+    for (uint64_t seq = 0; seq < 8; seq++)
+    {
+        CHECK(E_SUCCESS == mpmc_queue_enqueue(queue_p, ITEM_ENCODE(0, seq)));
+    }
+    CHECK(8 == mpmc_queue_size(queue_p));
+    CHECK(E_FAILURE == mpmc_queue_enqueue(queue_p, ITEM_ENCODE(0, 8)));
+
+    CHECK(E_SUCCESS == mpmc_queue_dequeue(queue_p, &item_p));
+    CHECK(ITEM_ENCODE(0, 0) == item_p);
+    CHECK(E_SUCCESS == mpmc_queue_enqueue(queue_p, ITEM_ENCODE(0, 8)));
+
+    exit_code = E_SUCCESS;
+END:
+    mpmc_queue_destroy(&queue_p);
+    return exit_code;
+}
+
+static int test_fifo(void)
+{
+    int            exit_code = E_FAILURE;
+    mpmc_queue_t * queue_p   = NULL;
+    void *         item_p    = NULL;
+    uint64_t       next_in   = 0;
+    uint64_t       next_out  = 0;
+
+    queue_p = mpmc_queue_create(4);
+    CHECK(NULL != queue_p);
+
+    // Three in, two out, so the indices wrap the ring many times
+    for (size_t round = 0; round < 1000; round++)
+    {
+        for (size_t idx = 0; idx < 3; idx++)
+        {
+            if (E_SUCCESS ==
+                mpmc_queue_enqueue(queue_p, ITEM_ENCODE(0, next_in)))
+            {
+                next_in++;
+            }
+        }
+
+        for (size_t idx = 0; idx < 2; idx++)
+        {
+            CHECK(E_SUCCESS == mpmc_queue_dequeue(queue_p, &item_p));
+            CHECK(ITEM_ENCODE(0, next_out) == item_p);
+            next_out++;
+        }
+    }
+
+    while (E_SUCCESS == mpmc_queue_dequeue(queue_p, &item_p))
+    {
+        CHECK(ITEM_ENCODE(0, next_out) == item_p);
+        next_out++;
+    }
+    CHECK(next_in == next_out);
+
+    exit_code = E_SUCCESS;
+END:
+    mpmc_queue_destroy(&queue_p);
+    return exit_code;
+}
+
+static int test_batch(void)
+{
+    int            exit_code = E_FAILURE;
+    mpmc_queue_t * queue_p   = NULL;
+    size_t         count     = 0;
+    void *         items[16] = { 0 };
+
+    queue_p = mpmc_queue_create(16);
+    CHECK(NULL != queue_p);
+    CHECK(E_FAILURE == mpmc_queue_dequeue_batch(queue_p, items, 16, &count));
+    CHECK(0 == count);
+
+    for (uint64_t seq = 0; seq < 5; seq++)
+    {
+        CHECK(E_SUCCESS == mpmc_queue_enqueue(queue_p, ITEM_ENCODE(0, seq)));
+    }
+
+    CHECK(E_SUCCESS == mpmc_queue_dequeue_batch(queue_p, items, 3, &count));
+    CHECK(3 == count);
+    CHECK((ITEM_ENCODE(0, 0) == items[0]) && (ITEM_ENCODE(0, 2) == items[2]));
+
+    CHECK(E_SUCCESS == mpmc_queue_dequeue_batch(queue_p, items, 16, &count));
+    CHECK(2 == count);
+    CHECK((ITEM_ENCODE(0, 3) == items[0]) && (ITEM_ENCODE(0, 4) == items[1]));
+    CHECK(0 == mpmc_queue_size(queue_p));
+
+    exit_code = E_SUCCESS;
+END:
+    mpmc_queue_destroy(&queue_p);
+    return exit_code;
+}
+
+static int test_arguments(void)
+{
+    int            exit_code = E_FAILURE;
+    mpmc_queue_t * queue_p   = NULL;
+    void *         item_p    = NULL;
+    size_t         count     = 0;
+
+    CHECK(NULL == mpmc_queue_create(0));
+    CHECK(NULL == mpmc_queue_create(1));
+
+    queue_p = mpmc_queue_create(2);
+    CHECK(NULL != queue_p);
+    CHECK(E_FAILURE == mpmc_queue_enqueue(NULL, ITEM_ENCODE(0, 0)));
+    CHECK(E_FAILURE == mpmc_queue_enqueue(queue_p, NULL));
+    CHECK(E_FAILURE == mpmc_queue_dequeue(queue_p, NULL));
+    CHECK(E_FAILURE == mpmc_queue_dequeue_batch(queue_p, &item_p, 0, &count));
+
+    mpmc_queue_destroy(&queue_p);
+    CHECK(NULL == queue_p);
+    mpmc_queue_destroy(&queue_p);
+
+    exit_code = E_SUCCESS;
+END:
+    mpmc_queue_destroy(&queue_p);
+    return exit_code;
+}
+
+static int test_stress(void)
+{
+    int             exit_code = E_FAILURE;
+    stress_t *      stress_p  = NULL;
+    size_t          started   = 0;
+    pthread_t       threads[STRESS_PRODUCERS + STRESS_CONSUMERS];
+    stress_thread_t args[STRESS_PRODUCERS + STRESS_CONSUMERS];
+
+    // Too large for the stack
+    stress_p = calloc(1, sizeof(*stress_p));
+    CHECK(NULL != stress_p);
+    stress_p->queue_p = mpmc_queue_create(STRESS_DEPTH);
+    CHECK(NULL != stress_p->queue_p);
+
+    for (size_t idx = 0; idx < STRESS_PRODUCERS + STRESS_CONSUMERS; idx++)
+    {
+        args[idx].stress_p = stress_p;
+        args[idx].id       = (idx < STRESS_PRODUCERS)
+                                 ? idx
+                                 : (idx - STRESS_PRODUCERS);
+        CHECK(0 == pthread_create(&threads[idx],
+                                  NULL,
+                                  (idx < STRESS_PRODUCERS) ? stress_producer
+                                                           : stress_consumer,
+                                  &args[idx]));
+        started++;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    for (size_t idx = 0; idx < started; idx++)
+    {
+        pthread_join(threads[idx], NULL);
+    }
+
+    if ((E_SUCCESS == exit_code) &&
+        ((true == atomic_load(&stress_p->failed)) ||
+         (0 != mpmc_queue_size(stress_p->queue_p))))
+    {
+        exit_code = E_FAILURE;
+    }
+
+    for (size_t producer = 0;
+         (E_SUCCESS == exit_code) && (producer < STRESS_PRODUCERS);
+         producer++)
+    {
+        for (size_t seq = 0; seq < STRESS_ITEMS; seq++)
+        {
+            if (1 != atomic_load(&stress_p->seen[producer][seq]))
+            {
+                fprintf(stderr,
+                        "test_stress(): item %zu of producer %zu seen %u "
+                        "times\n",
+                        seq,
+                        producer,
+                        (unsigned)atomic_load(&stress_p->seen[producer][seq]));
+                exit_code = E_FAILURE;
+                break;
+            }
+        }
+    }
+
+    if (NULL != stress_p)
+    {
+        mpmc_queue_destroy(&stress_p->queue_p);
+        free(stress_p);
+    }
+    return exit_code;
+}
+
+static void * stress_producer(void * arg_p)
+{
+    stress_thread_t * thread_p = arg_p;
+
+    for (uint64_t seq = 0; seq < STRESS_ITEMS; seq++)
+    {
+        while (E_SUCCESS !=
+               mpmc_queue_enqueue(thread_p->stress_p->queue_p,
+                                  ITEM_ENCODE(thread_p->id, seq)))
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void * stress_consumer(void * arg_p)
+{
+    stress_thread_t * thread_p               = arg_p;
+    stress_t *        stress_p               = thread_p->stress_p;
+    size_t            count                  = 0;
+    size_t            want                   = 1;
+    size_t            total                  = 0;
+    void *            items[STRESS_BATCH]    = { 0 };
+    uint64_t          next[STRESS_PRODUCERS] = { 0 };
+
+    total = (size_t)STRESS_PRODUCERS * STRESS_ITEMS;
+
+    while (atomic_load(&stress_p->consumed) < total)
+    {
+        // Odd consumers take single items, even ones batches of 1 to
+        // STRESS_BATCH, so both paths race against each other
+        if (1 == (thread_p->id % 2))
+        {
+            count = (E_SUCCESS ==
+                     mpmc_queue_dequeue(stress_p->queue_p, &items[0]))
+                        ? 1
+                        : 0;
+        }
+        else if (E_SUCCESS != mpmc_queue_dequeue_batch(
+                                  stress_p->queue_p, items, want, &count))
+        {
+            count = 0;
+        }
+        want = (want % STRESS_BATCH) + 1;
+
+        if (0 == count)
+        {
+            sched_yield();
+            continue;
+        }
+
+        for (size_t idx = 0; idx < count; idx++)
+        {
+            stress_record(stress_p, next, items[idx]);
+        }
+        atomic_fetch_add(&stress_p->consumed, count);
+    }
+
+    return NULL;
+}
+
+static void stress_record(stress_t * stress_p,
+                          uint64_t * last_p,
+                          void *     item_p)
+{
+    uint64_t producer = ITEM_PRODUCER(item_p);
+    uint64_t seq      = ITEM_SEQ(item_p);
+
+    if ((STRESS_PRODUCERS <= producer) || (STRESS_ITEMS <= seq) ||
+        (seq < last_p[producer]))
+    {
+        atomic_store(&stress_p->failed, true);
+        return;
+    }
+
+    last_p[producer] = seq + 1;
+    atomic_fetch_add(&stress_p->seen[producer][seq], 1);
+}
+
+/*** end of file ***/
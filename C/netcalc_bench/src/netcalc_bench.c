@@ -0,0 +1,1037 @@
+/**
+ * @file netcalc_bench.c
+ * @brief Open-Loop Load Generator for NetCalc
+ *
+ * netcalc-bench opens a set of connections to a NetCalc server running with
+ * '--protocol binary' and sends requests at a fixed aggregate rate for a
+ * fixed duration, regardless of how quickly replies arrive. Latency is
+ * measured from the time each request was scheduled to be sent rather than
+ * the time it was actually sent, so a stalled server shows up as latency
+ * instead of silently lowering the offered load (coordinated omission).
+ *
+ * The flags are parsed by the server's option handler, so '-p' and '-n'
+ * accept exactly what the server accepts: '-p' may be repeated to spread
+ * connections across listener ports, and '-n' sets the number of client
+ * threads (at least 2, or 'auto'). Only the command line is read; neither
+ * NETCALC_* environment variables nor config files can change a run.
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "calc_kernels.h"
+#include "latency_histogram.h"
+#include "number_parser.h"
+#include "option_handler.h"
+#include "utilities.h"
+#include "wire_protocol.h"
+
+#define DEFAULT_HOST        "127.0.0.1" // Server address when '--host' unset
+#define DEFAULT_THREADS     2           // Client threads when '-n' unset
+#define DEFAULT_CONNECTIONS 16          // Connections when unset
+#define DEFAULT_RATE        10000       // Requests per second when unset
+#define DEFAULT_DURATION    10          // Seconds when unset
+#define MAX_CONNECTIONS     65536       // Largest '--connections' accepted
+#define MAX_RATE            100000000   // Largest '--rate' accepted
+#define MAX_DURATION        86400       // Largest '--duration' accepted
+#define MAX_HOST_SIZE       256         // Size of the '--host' buffer
+#define MAX_MIX_SIZE        128         // Size of a copied '--mix' value
+#define MAX_MIX_WEIGHT      1000000     // Largest '--mix' weight accepted
+#define DRAIN_SECONDS       2           // Wait for replies after the run
+#define INFLIGHT_WINDOW     65536       // Outstanding requests per thread
+#define RECEIVE_BUFFER_SIZE 65536       // Per connection receive buffer
+#define REQUEST_PAYLOAD     8           // Two 32-bit operands
+#define REQUEST_SIZE        (WIRE_HEADER_SIZE + REQUEST_PAYLOAD)
+#define NSEC_PER_SEC        1000000000ULL
+#define NSEC_PER_USEC       1000.0
+
+// Writes the value of a numeric macro as a string literal
+#define STRINGIFY(value)       #value
+#define STRINGIFY_VALUE(value) STRINGIFY(value)
+
+/**
+ * @struct bench_config
+ * @brief Settings for one benchmark run.
+ */
+typedef struct bench_config
+{
+    options_t server;                // '-p' and '-n', as the server takes them
+    char      host[MAX_HOST_SIZE];   // Server address
+    int32_t   threads;               // Client threads
+    int32_t   connections;           // Total connections
+    int32_t   rate;                  // Total requests per second
+    int32_t   duration;              // Seconds to send for
+    uint32_t  mix[CALC_OP_COUNT];    // Relative weight of each op
+    uint32_t  mix_total;             // Sum of the weights, 0 until '--mix'
+    bool      json;                  // Report as JSON
+} bench_config_t;
+
+/**
+ * @struct bench_connection
+ * @brief A connection and its partially received replies.
+ */
+typedef struct bench_connection
+{
+    int     fd;                          // Connected socket
+    size_t  filled;                      // Bytes in 'buffer'
+    uint8_t buffer[RECEIVE_BUFFER_SIZE]; // Received, undecoded bytes
+} bench_connection_t;
+
+/**
+ * @struct bench_worker
+ * @brief State owned by one client thread.
+ */
+typedef struct bench_worker
+{
+    pthread_t              thread;           // The client thread
+    const bench_config_t * config_p;         // Shared, read-only settings
+    bench_connection_t *   connections_p;    // Connections owned by thread
+    struct pollfd *        poll_fds_p;       // One entry per connection
+    size_t                 connection_count; // Entries in both arrays
+    uint64_t               interval_ns;      // Time between requests
+    uint64_t               sent;             // Requests sent
+    uint64_t               received;         // Replies matched to a request
+    uint64_t               busy;             // Replies refused as overloaded
+    uint64_t               dropped;          // Requests not sent
+    uint64_t               errors;           // Failed sends and bad replies
+    uint64_t               random_state;     // Operator and operand source
+    uint64_t *             scheduled_p;      // Scheduled time per request id
+    latency_histogram_t    histogram;        // Latency in nanoseconds
+} bench_worker_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Parses the command line with options_parse_command_line().
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @param config_p The configuration to fill in.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int parse_bench_args(int argc, char ** argv, bench_config_t * config_p);
+
+/**
+ * @brief Parses a positive integer option value.
+ *
+ * @param value_p The value.
+ * @param max The largest value accepted.
+ * @param range_p The reason given for a number outside 1 to max.
+ * @param result_p Pointer to where the value is stored.
+ * @param reason_pp Pointer to where the reason for a rejection is stored.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int parse_positive(const char *  value_p,
+                          int32_t       max,
+                          const char *  range_p,
+                          int32_t *     result_p,
+                          const char ** reason_pp);
+
+/**
+ * @brief The option_extra_parse_t functions of netcalc-bench's own options.
+ *
+ * Each stores its value in the bench_config_t passed as 'context_p'. The
+ * '--mix' value is an operator mix such as "add:50,sub:30,mul:20".
+ */
+static int parse_host(const char *  value_p,
+                      void *        context_p,
+                      const char ** reason_pp);
+static int parse_connections(const char *  value_p,
+                             void *        context_p,
+                             const char ** reason_pp);
+static int parse_rate(const char *  value_p,
+                      void *        context_p,
+                      const char ** reason_pp);
+static int parse_duration(const char *  value_p,
+                          void *        context_p,
+                          const char ** reason_pp);
+static int parse_mix(const char *  value_p,
+                     void *        context_p,
+                     const char ** reason_pp);
+static int parse_json(const char *  value_p,
+                      void *        context_p,
+                      const char ** reason_pp);
+
+/**
+ * @brief Opens every connection, spreading them across threads and ports.
+ *
+ * @param config_p The configuration.
+ * @param workers_p The workers, whose connections are opened.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int open_connections(const bench_config_t * config_p,
+                            bench_worker_t *       workers_p);
+
+/**
+ * @brief Connects a TCP socket to the server.
+ *
+ * @param host_p The server address.
+ * @param port_p The server port.
+ * @param fd_p Pointer to where the connected socket is stored.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int connect_to(const char * host_p, const char * port_p, int * fd_p);
+
+/**
+ * @brief Client thread: sends on schedule and records reply latency.
+ *
+ * @param arg_p The thread's bench_worker_t.
+ * @return void* - Always NULL.
+ */
+static void * run_worker(void * arg_p);
+
+/**
+ * @brief Sends one request on the next connection in turn.
+ *
+ * @param worker_p The worker.
+ * @param scheduled_ns The time the request was scheduled for.
+ */
+static void send_request(bench_worker_t * worker_p, uint64_t scheduled_ns);
+
+/**
+ * @brief Reads what is available on a connection and records the latency
+ * of every complete reply.
+ *
+ * @param worker_p The worker.
+ * @param connection_p The readable connection.
+ * @return int - Returns E_SUCCESS, or E_FAILURE if the connection was lost.
+ */
+static int receive_replies(bench_worker_t *     worker_p,
+                           bench_connection_t * connection_p);
+
+/**
+ * @brief Prints the results as text, followed by the latency distribution
+ * in HdrHistogram format, or as a single JSON object.
+ *
+ * @param config_p The configuration.
+ * @param workers_p The finished workers.
+ * @param elapsed_ns The length of the sending phase.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int report_results(const bench_config_t * config_p,
+                          bench_worker_t *       workers_p,
+                          uint64_t               elapsed_ns);
+
+/**
+ * @brief Returns the monotonic clock in nanoseconds.
+ *
+ * @return uint64_t - The current time.
+ */
+static uint64_t now_ns(void);
+
+/**
+ * @brief Returns the next value of a worker's xorshift generator.
+ *
+ * @param state_p The generator state.
+ * @return uint64_t - A pseudo random value.
+ */
+static uint64_t next_random(uint64_t * state_p);
+
+/**
+ * @brief Prints how to use netcalc-bench.
+ */
+static void print_bench_help(void);
+
+// +---------------------------------------------------------------------------+
+// |                                   MAIN                                    |
+// +---------------------------------------------------------------------------+
+
+int main(int argc, char ** argv)
+{
+    int              exit_code = E_FAILURE;
+    bench_config_t * config_p  = NULL;
+    bench_worker_t * workers_p = NULL;
+    int32_t          started   = 0;
+    uint64_t         start_ns  = 0;
+    uint64_t         elapsed   = 0;
+
+    config_p = calloc(1, sizeof(bench_config_t));
+    if (NULL == config_p)
+    {
+        print_error("main(): calloc() failed.");
+        goto END;
+    }
+
+    if (E_SUCCESS != parse_bench_args(argc, argv, config_p))
+    {
+        goto END;
+    }
+
+    workers_p = calloc((size_t)config_p->threads, sizeof(bench_worker_t));
+    if (NULL == workers_p)
+    {
+        print_error("main(): calloc() failed.");
+        goto END;
+    }
+
+    if (E_SUCCESS != open_connections(config_p, workers_p))
+    {
+        goto END;
+    }
+
+    for (int32_t idx = 0; idx < config_p->threads; idx++)
+    {
+        workers_p[idx].config_p     = config_p;
+        workers_p[idx].random_state = 0x9E3779B97F4A7C15ULL * (idx + 1);
+
+        // Each thread sends an equal share of the total rate
+        workers_p[idx].interval_ns =
+            (NSEC_PER_SEC * (uint64_t)config_p->threads) /
+            (uint64_t)config_p->rate;
+
+        workers_p[idx].scheduled_p = calloc(INFLIGHT_WINDOW, sizeof(uint64_t));
+        if (NULL == workers_p[idx].scheduled_p)
+        {
+            print_error("main(): calloc() failed.");
+            goto END;
+        }
+        latency_histogram_reset(&workers_p[idx].histogram);
+    }
+
+    start_ns = now_ns();
+    for (started = 0; started < config_p->threads; started++)
+    {
+        if (0 != pthread_create(&workers_p[started].thread,
+                                NULL,
+                                run_worker,
+                                &workers_p[started]))
+        {
+            print_error("main(): pthread_create() failed.");
+            goto END;
+        }
+    }
+
+    for (int32_t idx = 0; idx < started; idx++)
+    {
+        pthread_join(workers_p[idx].thread, NULL);
+    }
+    started = 0;
+    elapsed = now_ns() - start_ns;
+    elapsed = (elapsed > ((uint64_t)config_p->duration * NSEC_PER_SEC))
+                  ? ((uint64_t)config_p->duration * NSEC_PER_SEC)
+                  : elapsed;
+
+    exit_code = report_results(config_p, workers_p, elapsed);
+
+END:
+    for (int32_t idx = 0; idx < started; idx++)
+    {
+        pthread_join(workers_p[idx].thread, NULL);
+    }
+
+    for (int32_t idx = 0; (NULL != workers_p) && (idx < config_p->threads);
+         idx++)
+    {
+        for (size_t conn = 0; conn < workers_p[idx].connection_count; conn++)
+        {
+            close(workers_p[idx].connections_p[conn].fd);
+        }
+        free(workers_p[idx].connections_p);
+        free(workers_p[idx].poll_fds_p);
+        free(workers_p[idx].scheduled_p);
+    }
+
+    free(workers_p);
+    free(config_p);
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int parse_bench_args(int argc, char ** argv, bench_config_t * config_p)
+{
+    // The server's '-p' and '-n', checked by its own option table
+    static const char * const shared_names[] = { "p", "n", "h", NULL };
+
+    static const option_extra_t bench_options[] = {
+        { "host", true, parse_host },
+        { "connections", true, parse_connections },
+        { "rate", true, parse_rate },
+        { "duration", true, parse_duration },
+        { "mix", true, parse_mix },
+        { "json", false, parse_json },
+        { NULL, false, NULL },
+    };
+
+    int exit_code = E_FAILURE;
+
+    if ((NULL == argv) || (NULL == *argv) || (NULL == config_p))
+    {
+        print_error("parse_bench_args(): NULL argument passed.");
+        goto END;
+    }
+
+    strncpy(config_p->host, DEFAULT_HOST, MAX_HOST_SIZE - 1);
+    config_p->connections = DEFAULT_CONNECTIONS;
+    config_p->rate        = DEFAULT_RATE;
+    config_p->duration    = DEFAULT_DURATION;
+
+    // Unknown options and bad values are reported by the option handler
+    if (E_SUCCESS != options_parse_command_line(argc,
+                                                argv,
+                                                shared_names,
+                                                bench_options,
+                                                config_p,
+                                                &config_p->server))
+    {
+        if (OPTION_ERROR_NONE == config_p->server.error.code)
+        {
+            print_bench_help();
+        }
+        goto END;
+    }
+
+    if (0 == config_p->server.p_count)
+    {
+        print_error("netcalc-bench: '-p' is required.");
+        print_bench_help();
+        goto END;
+    }
+
+    config_p->threads = (true == config_p->server.n_flag)
+                            ? config_p->server.n_value
+                            : DEFAULT_THREADS;
+
+    if (0 == config_p->mix_total)
+    {
+        for (size_t op = 0; op < CALC_OP_COUNT; op++)
+        {
+            config_p->mix[op] = 1;
+        }
+        config_p->mix_total = CALC_OP_COUNT;
+    }
+
+    // Every thread needs a connection and a non-zero share of the rate
+    if (config_p->threads > config_p->connections)
+    {
+        config_p->threads = config_p->connections;
+    }
+    if (config_p->threads > config_p->rate)
+    {
+        config_p->threads = config_p->rate;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int parse_positive(const char *  value_p,
+                          int32_t       max,
+                          const char *  range_p,
+                          int32_t *     result_p,
+                          const char ** reason_pp)
+{
+    int     exit_code = E_FAILURE;
+    int32_t number    = 0;
+
+    if (E_SUCCESS != number_parse_int32_str(value_p, &number))
+    {
+        *reason_pp = "not a number";
+        goto END;
+    }
+
+    if ((1 > number) || (max < number))
+    {
+        *reason_pp = range_p;
+        goto END;
+    }
+
+    *result_p = number;
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int parse_host(const char *  value_p,
+                      void *        context_p,
+                      const char ** reason_pp)
+{
+    bench_config_t * config_p = context_p;
+
+    if (MAX_HOST_SIZE <= strlen(value_p))
+    {
+        *reason_pp = "address too long";
+        return E_FAILURE;
+    }
+
+    strncpy(config_p->host, value_p, MAX_HOST_SIZE - 1);
+    return E_SUCCESS;
+}
+
+static int parse_connections(const char *  value_p,
+                             void *        context_p,
+                             const char ** reason_pp)
+{
+    bench_config_t * config_p = context_p;
+
+    return parse_positive(value_p,
+                          MAX_CONNECTIONS,
+                          "must be from 1 to " STRINGIFY_VALUE(MAX_CONNECTIONS),
+                          &config_p->connections,
+                          reason_pp);
+}
+
+static int parse_rate(const char *  value_p,
+                      void *        context_p,
+                      const char ** reason_pp)
+{
+    bench_config_t * config_p = context_p;
+
+    return parse_positive(value_p,
+                          MAX_RATE,
+                          "must be from 1 to " STRINGIFY_VALUE(MAX_RATE),
+                          &config_p->rate,
+                          reason_pp);
+}
+
+static int parse_duration(const char *  value_p,
+                          void *        context_p,
+                          const char ** reason_pp)
+{
+    bench_config_t * config_p = context_p;
+
+    return parse_positive(value_p,
+                          MAX_DURATION,
+                          "must be from 1 to " STRINGIFY_VALUE(MAX_DURATION),
+                          &config_p->duration,
+                          reason_pp);
+}
+
+static int parse_mix(const char *  value_p,
+                     void *        context_p,
+                     const char ** reason_pp)
+{
+    static const char * op_names[CALC_OP_COUNT] = { "add", "sub", "mul" };
+
+    int              exit_code         = E_FAILURE;
+    bench_config_t * config_p          = context_p;
+    char             mix[MAX_MIX_SIZE] = { 0 };
+    char *           save_p            = NULL;
+    char *           entry_p           = NULL;
+    char *           weight_p          = NULL;
+    int32_t          weight            = 0;
+    size_t           op                = 0;
+
+    if (MAX_MIX_SIZE <= strlen(value_p))
+    {
+        *reason_pp = "mix too long";
+        goto END;
+    }
+
+    strncpy(mix, value_p, MAX_MIX_SIZE - 1);
+    memset(config_p->mix, 0, sizeof(config_p->mix));
+    config_p->mix_total = 0;
+
+    for (entry_p = strtok_r(mix, ",", &save_p); NULL != entry_p;
+         entry_p = strtok_r(NULL, ",", &save_p))
+    {
+        weight_p = strchr(entry_p, ':');
+        if (NULL == weight_p)
+        {
+            *reason_pp = "entries must be 'op:weight'";
+            goto END;
+        }
+        *weight_p++ = '\0';
+
+        for (op = 0; op < CALC_OP_COUNT; op++)
+        {
+            if (0 == strcmp(entry_p, op_names[op]))
+            {
+                break;
+            }
+        }
+
+        if (CALC_OP_COUNT == op)
+        {
+            *reason_pp = "operators are add, sub and mul";
+            goto END;
+        }
+
+        if ((E_SUCCESS != number_parse_int32_str(weight_p, &weight)) ||
+            (0 > weight) || (MAX_MIX_WEIGHT < weight))
+        {
+            *reason_pp = "weights must be from 0 to "
+                         STRINGIFY_VALUE(MAX_MIX_WEIGHT);
+            goto END;
+        }
+
+        config_p->mix[op] = (uint32_t)weight;
+    }
+
+    for (op = 0; op < CALC_OP_COUNT; op++)
+    {
+        config_p->mix_total += config_p->mix[op];
+    }
+
+    if (0 == config_p->mix_total)
+    {
+        *reason_pp = "at least one weight must be non-zero";
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int parse_json(const char *  value_p,
+                      void *        context_p,
+                      const char ** reason_pp)
+{
+    bench_config_t * config_p = context_p;
+
+    (void)value_p;
+    (void)reason_pp;
+    config_p->json = true;
+    return E_SUCCESS;
+}
+
+static int open_connections(const bench_config_t * config_p,
+                            bench_worker_t *       workers_p)
+{
+    int              exit_code = E_FAILURE;
+    bench_worker_t * worker_p  = NULL;
+    size_t           share     = 0;
+    int32_t          opened    = 0;
+
+    for (int32_t idx = 0; idx < config_p->threads; idx++)
+    {
+        worker_p = &workers_p[idx];
+        share    = (size_t)(config_p->connections / config_p->threads);
+        share += ((config_p->connections % config_p->threads) > idx) ? 1 : 0;
+
+        worker_p->connections_p = calloc(share, sizeof(bench_connection_t));
+        worker_p->poll_fds_p    = calloc(share, sizeof(struct pollfd));
+        if ((NULL == worker_p->connections_p) ||
+            (NULL == worker_p->poll_fds_p))
+        {
+            print_error("open_connections(): calloc() failed.");
+            goto END;
+        }
+
+        for (size_t conn = 0; conn < share; conn++)
+        {
+            // Round robin over the ports so every listener gets its share
+            if (E_SUCCESS !=
+                connect_to(config_p->host,
+                           config_p->server.p_values[(size_t)opened %
+                                                     config_p->server.p_count],
+                           &worker_p->connections_p[conn].fd))
+            {
+                goto END;
+            }
+
+            worker_p->poll_fds_p[conn].fd = worker_p->connections_p[conn].fd;
+            worker_p->poll_fds_p[conn].events = POLLIN;
+            worker_p->connection_count++;
+            opened++;
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int connect_to(const char * host_p, const char * port_p, int * fd_p)
+{
+    int               exit_code = E_FAILURE;
+    struct addrinfo   hints     = { 0 };
+    struct addrinfo * result_p  = NULL;
+    struct addrinfo * addr_p    = NULL;
+    int               fd        = -1;
+    int               status    = 0;
+
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    status = getaddrinfo(host_p, port_p, &hints, &result_p);
+    if (0 != status)
+    {
+        fprintf(stderr,
+                "connect_to(): getaddrinfo(): %s\n",
+                gai_strerror(status));
+        goto END;
+    }
+
+    for (addr_p = result_p; NULL != addr_p; addr_p = addr_p->ai_next)
+    {
+        fd = socket(
+            addr_p->ai_family, addr_p->ai_socktype, addr_p->ai_protocol);
+        if (-1 == fd)
+        {
+            continue;
+        }
+
+        if (0 == connect(fd, addr_p->ai_addr, addr_p->ai_addrlen))
+        {
+            break;
+        }
+
+        close(fd);
+        fd = -1;
+    }
+
+    if (-1 == fd)
+    {
+        fprintf(stderr,
+                "connect_to(): Unable to connect to %s:%s.\n",
+                host_p,
+                port_p);
+        goto END;
+    }
+
+    *fd_p     = fd;
+    exit_code = E_SUCCESS;
+END:
+    if (NULL != result_p)
+    {
+        freeaddrinfo(result_p);
+    }
+    return exit_code;
+}
+
+static void * run_worker(void * arg_p)
+{
+    bench_worker_t * worker_p    = arg_p;
+    uint64_t         start       = now_ns();
+    uint64_t         stop        = 0;
+    uint64_t         drain_until = 0;
+    uint64_t         next_send   = start;
+    uint64_t         now         = start;
+    int              timeout_ms  = 0;
+    int              ready       = 0;
+
+    stop = start + ((uint64_t)worker_p->config_p->duration * NSEC_PER_SEC);
+    drain_until = stop + ((uint64_t)DRAIN_SECONDS * NSEC_PER_SEC);
+
+    while ((now < drain_until) &&
+           ((now < stop) || (worker_p->received < worker_p->sent)))
+    {
+        // Send everything that is due, even if it is late; that lateness is
+        // part of the latency recorded for those requests.
+        while ((next_send <= now) && (next_send < stop))
+        {
+            if ((worker_p->sent - worker_p->received) >= INFLIGHT_WINDOW)
+            {
+                worker_p->dropped++;
+            }
+            else
+            {
+                send_request(worker_p, next_send);
+            }
+            next_send += worker_p->interval_ns;
+        }
+
+        timeout_ms = 0;
+        if ((next_send > now) && (next_send < stop))
+        {
+            timeout_ms = (int)((next_send - now) / 1000000);
+        }
+        else if (now >= stop)
+        {
+            timeout_ms = (int)((drain_until - now) / 1000000);
+        }
+
+        ready = poll(worker_p->poll_fds_p,
+                     (nfds_t)worker_p->connection_count,
+                     timeout_ms);
+
+        for (size_t idx = 0; (0 < ready) && (idx < worker_p->connection_count);
+             idx++)
+        {
+            if (0 == worker_p->poll_fds_p[idx].revents)
+            {
+                continue;
+            }
+
+            if (E_SUCCESS !=
+                receive_replies(worker_p, &worker_p->connections_p[idx]))
+            {
+                // Stop polling a lost connection
+                worker_p->poll_fds_p[idx].fd = -1;
+                worker_p->errors++;
+            }
+        }
+
+        now = now_ns();
+    }
+
+    return NULL;
+}
+
+static void send_request(bench_worker_t * worker_p, uint64_t scheduled_ns)
+{
+    uint8_t                request[REQUEST_SIZE] = { 0 };
+    const bench_config_t * config_p              = worker_p->config_p;
+    bench_connection_t *   connection_p          = NULL;
+    uint32_t               request_id            = (uint32_t)worker_p->sent;
+    uint64_t               random                = 0;
+    uint32_t               pick                  = 0;
+    uint32_t               operand               = 0;
+    uint8_t                op                    = 0;
+
+    connection_p =
+        &worker_p->connections_p[worker_p->sent % worker_p->connection_count];
+
+    random = next_random(&worker_p->random_state);
+    pick   = (uint32_t)(random % config_p->mix_total);
+    while (pick >= config_p->mix[op])
+    {
+        pick -= config_p->mix[op];
+        op++;
+    }
+
+    wire_encode_header(request, op, request_id, REQUEST_PAYLOAD);
+
+    // Small operands keep the results meaningful for every operator
+    operand = htonl((uint32_t)((random >> 16) & 0xFFFF));
+    memcpy(&request[WIRE_HEADER_SIZE], &operand, sizeof(operand));
+    operand = htonl((uint32_t)((random >> 32) & 0xFFFF));
+    memcpy(&request[WIRE_HEADER_SIZE + sizeof(operand)],
+           &operand,
+           sizeof(operand));
+
+    worker_p->scheduled_p[request_id % INFLIGHT_WINDOW] = scheduled_ns;
+
+    if ((-1 == connection_p->fd) ||
+        (REQUEST_SIZE !=
+         send(connection_p->fd, request, REQUEST_SIZE, MSG_NOSIGNAL)))
+    {
+        worker_p->errors++;
+        worker_p->dropped++;
+        return;
+    }
+
+    worker_p->sent++;
+}
+
+static int receive_replies(bench_worker_t *     worker_p,
+                           bench_connection_t * connection_p)
+{
+    int           exit_code = E_FAILURE;
+    ssize_t       received  = 0;
+    size_t        offset    = 0;
+    size_t        consumed  = 0;
+    wire_frame_t  frame     = { 0 };
+    wire_status_t status    = WIRE_FRAME_OK;
+    uint64_t      now       = 0;
+
+    received = recv(connection_p->fd,
+                    &connection_p->buffer[connection_p->filled],
+                    RECEIVE_BUFFER_SIZE - connection_p->filled,
+                    MSG_DONTWAIT);
+    if (0 >= received)
+    {
+        exit_code = ((-1 == received) && (EAGAIN == errno)) ? E_SUCCESS
+                                                            : E_FAILURE;
+        goto END;
+    }
+
+    connection_p->filled += (size_t)received;
+    now = now_ns();
+
+    for (;;)
+    {
+        status = wire_decode_frame(&connection_p->buffer[offset],
+                                   connection_p->filled - offset,
+                                   &frame,
+                                   &consumed);
+        if (WIRE_FRAME_OK != status)
+        {
+            break;
+        }
+
+        // Busy replies are fast by design; keep them out of the latency
+        // distribution so they do not flatter it.
+        if (WIRE_REPLY_BUSY == frame.type)
+        {
+            worker_p->busy++;
+        }
+        else
+        {
+            latency_histogram_record(
+                &worker_p->histogram,
+                now -
+                    worker_p->scheduled_p[frame.request_id % INFLIGHT_WINDOW]);
+        }
+        worker_p->received++;
+        offset += consumed;
+    }
+
+    if (WIRE_FRAME_INVALID == status)
+    {
+        print_error("receive_replies(): Invalid reply frame.");
+        goto END;
+    }
+
+    // Keep the partial frame at the start of the buffer
+    memmove(connection_p->buffer,
+            &connection_p->buffer[offset],
+            connection_p->filled - offset);
+    connection_p->filled -= offset;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int report_results(const bench_config_t * config_p,
+                          bench_worker_t *       workers_p,
+                          uint64_t               elapsed_ns)
+{
+    int                   exit_code  = E_FAILURE;
+    latency_histogram_t * merged_p   = NULL;
+    uint64_t              sent       = 0;
+    uint64_t              received   = 0;
+    uint64_t              busy       = 0;
+    uint64_t              dropped    = 0;
+    uint64_t              errors     = 0;
+    double                seconds    = (double)elapsed_ns / NSEC_PER_SEC;
+    double                throughput = 0.0;
+
+    merged_p = calloc(1, sizeof(latency_histogram_t));
+    if (NULL == merged_p)
+    {
+        print_error("report_results(): calloc() failed.");
+        goto END;
+    }
+
+    for (int32_t idx = 0; idx < config_p->threads; idx++)
+    {
+        latency_histogram_merge(merged_p, &workers_p[idx].histogram);
+        sent += workers_p[idx].sent;
+        received += workers_p[idx].received;
+        busy += workers_p[idx].busy;
+        dropped += workers_p[idx].dropped;
+        errors += workers_p[idx].errors;
+    }
+
+    throughput =
+        (0.0 < seconds) ? ((double)(received - busy) / seconds) : 0.0;
+
+    if (true == config_p->json)
+    {
+        printf("{\"threads\":%d,\"connections\":%d,\"rate\":%d,"
+               "\"duration_s\":%.3f,\"sent\":%llu,\"received\":%llu,"
+               "\"busy\":%llu,\"dropped\":%llu,\"errors\":%llu,"
+               "\"throughput_rps\":%.1f,"
+               "\"latency_us\":{\"p50\":%.3f,\"p99\":%.3f,\"p999\":%.3f,"
+               "\"max\":%.3f}}\n",
+               (int)config_p->threads,
+               (int)config_p->connections,
+               (int)config_p->rate,
+               seconds,
+               (unsigned long long)sent,
+               (unsigned long long)received,
+               (unsigned long long)busy,
+               (unsigned long long)dropped,
+               (unsigned long long)errors,
+               throughput,
+               latency_histogram_percentile(merged_p, 50.0) / NSEC_PER_USEC,
+               latency_histogram_percentile(merged_p, 99.0) / NSEC_PER_USEC,
+               latency_histogram_percentile(merged_p, 99.9) / NSEC_PER_USEC,
+               latency_histogram_percentile(merged_p, 100.0) / NSEC_PER_USEC);
+    }
+    else
+    {
+        printf("Threads: %d, connections: %d, target rate: %d/s, "
+               "duration: %.3fs\n",
+               (int)config_p->threads,
+               (int)config_p->connections,
+               (int)config_p->rate,
+               seconds);
+        printf("Sent: %llu, received: %llu, busy: %llu, dropped: %llu, "
+               "errors: %llu\n",
+               (unsigned long long)sent,
+               (unsigned long long)received,
+               (unsigned long long)busy,
+               (unsigned long long)dropped,
+               (unsigned long long)errors);
+        printf("Throughput: %.1f requests/s\n", throughput);
+        printf("Latency (us): p50 %.3f, p99 %.3f, p99.9 %.3f\n\n",
+               latency_histogram_percentile(merged_p, 50.0) / NSEC_PER_USEC,
+               latency_histogram_percentile(merged_p, 99.0) / NSEC_PER_USEC,
+               latency_histogram_percentile(merged_p, 99.9) / NSEC_PER_USEC);
+        latency_histogram_print(merged_p, stdout, NSEC_PER_USEC);
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    free(merged_p);
+    return exit_code;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec now = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * NSEC_PER_SEC) + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t * state_p)
+{
+    uint64_t state = *state_p;
+
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    *state_p = state;
+    return state;
+}
+
+static void print_bench_help(void)
+{
+    printf("\nnetcalc-bench - Open-loop load generator for NetCalc\n");
+    printf("-------------------------------------------------------\n");
+    printf("Usage: netcalc-bench -p <port> [options]\n\n");
+    printf("Options:\n");
+    printf("  -p <port>               Server port (MIN: 1025). Repeat, up to "
+           "8 times,\n");
+    printf("                          to spread connections.\n");
+    printf("  -n <num>                Number of client threads; (MIN: 2), "
+           "'auto' or\n");
+    printf("                          'auto:N%%' as for the server "
+           "(default %d).\n",
+           DEFAULT_THREADS);
+    printf("  --host=ADDR             Server address (default %s).\n",
+           DEFAULT_HOST);
+    printf("  --connections=N         Total connections (default %d).\n",
+           DEFAULT_CONNECTIONS);
+    printf("  --rate=N                Total requests per second "
+           "(default %d).\n",
+           DEFAULT_RATE);
+    printf("  --duration=SECONDS      Time to send for (default %d).\n",
+           DEFAULT_DURATION);
+    printf("  --mix=OP:W[,OP:W...]    Operator weights, OP is add, sub or "
+           "mul\n");
+    printf("                          (default equal weights).\n");
+    printf("  --json                  Print results as one JSON object.\n");
+    printf("  -h, --help              Display this help menu.\n\n");
+    printf("The server must run with '--protocol binary'. Latency is "
+           "measured from\n");
+    printf("each request's scheduled send time and reported as an "
+           "HdrHistogram\n");
+    printf("percentile distribution, in microseconds.\n\n");
+    printf("Example:\n");
+    printf("  netcalc-bench -p 31337 -n 4 --connections=64 --rate=200000 "
+           "--duration=30\n\n");
+}
+
+/*** end of file ***/
@@ -0,0 +1,49 @@
+/**
+ * @file number_parser.h
+ * @brief Header for the Fast Decimal Integer Parser
+ *
+ * This header file provides the interface for parsing decimal int32 values
+ * from option values and request text. The accepted format is that of
+ * str_to_int32(): an optional '+' or '-' followed by at least one digit and
+ * nothing else. Leading zeros are allowed ("08080" is 8080), and values
+ * outside the int32_t range are rejected rather than clamped. Unlike
+ * strtol(), leading whitespace is not skipped and no locale is consulted.
+ *
+ * Digits are validated and converted eight at a time within a 64-bit word
+ * (SWAR), and the input is never read past 'length' bytes, so text may be
+ * parsed straight out of a receive buffer.
+ *
+ */
+#ifndef _NUMBER_PARSER_H
+#define _NUMBER_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NUMBER_MAX_TEXT 32 // Longest string number_parse_int32_str() reads
+
+/**
+ * @brief Parses a decimal int32 from a buffer.
+ *
+ * @param text_p The text. Need not be NUL terminated.
+ * @param length The number of bytes of text; all of them must belong to the
+ * number.
+ * @param value_p Pointer to where the value is stored on success.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int number_parse_int32(const char * text_p, size_t length, int32_t * value_p);
+
+/**
+ * @brief Parses a NUL terminated decimal int32.
+ *
+ * At most NUMBER_MAX_TEXT characters are examined; longer strings are
+ * rejected.
+ *
+ * @param text_p The string.
+ * @param value_p Pointer to where the value is stored on success.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int number_parse_int32_str(const char * text_p, int32_t * value_p);
+
+#endif /* _NUMBER_PARSER_H */
+/*** end of file ***/
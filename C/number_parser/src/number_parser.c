@@ -0,0 +1,177 @@
+/**
+ * @file number_parser.c
+ * @brief Fast Decimal Integer Parser
+ *
+ * This file contains the decimal int32 parser. Leading zeros are skipped
+ * first, which leaves at most ten significant digits for any valid value.
+ * When eight or more remain, the first eight are loaded into one 64-bit word,
+ * checked for being digits with two additions and a mask, and combined with
+ * three multiplications; the rest are handled one at a time. The running
+ * value is held in 64 bits, so the int32 range check is a single comparison
+ * at the end and no overflow can happen on the way.
+ */
+#define _GNU_SOURCE // for strnlen()
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "number_parser.h"
+#include "utilities.h"
+
+#define MAX_SIGNIFICANT_DIGITS 10 // Digits in INT32_MIN without the sign
+#define SWAR_DIGITS            8  // Digits converted per 64-bit word
+
+#define SWAR_ZEROS   0x3030303030303030ULL // '0' in every byte
+#define SWAR_ABOVE_9 0x4646464646464646ULL // Carries into bit 7 above '9'
+#define SWAR_HIGH    0x8080808080808080ULL // Bit 7 of every byte
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Checks and converts eight ASCII digits.
+ *
+ * @param text_p The eight bytes, most significant digit first.
+ * @param value_p Pointer to where their value (0 to 99999999) is stored.
+ * @return bool - true if all eight bytes are digits, false otherwise.
+ */
+static bool parse_eight_digits(const char * text_p, uint64_t * value_p);
+
+// +---------------------------------------------------------------------------+
+// |                            NUMBER PARSER API                              |
+// +---------------------------------------------------------------------------+
+
+int number_parse_int32(const char * text_p, size_t length, int32_t * value_p)
+{
+    int      exit_code = E_FAILURE;
+    size_t   pos       = 0;
+    size_t   digits    = 0;
+    bool     negative  = false;
+    uint64_t value     = 0;
+    uint64_t chunk     = 0;
+    uint64_t limit     = INT32_MAX;
+    unsigned digit     = 0;
+
+    if ((NULL == text_p) || (NULL == value_p) || (0 == length))
+    {
+        goto END;
+    }
+
+    if (('-' == text_p[0]) || ('+' == text_p[0]))
+    {
+        negative = ('-' == text_p[0]);
+        pos++;
+    }
+
+    // A lone sign is not a number; a run of zeros is
+    if (pos == length)
+    {
+        goto END;
+    }
+
+    while ((pos < length) && ('0' == text_p[pos]))
+    {
+        pos++;
+    }
+
+    digits = length - pos;
+    if (MAX_SIGNIFICANT_DIGITS < digits)
+    {
+        goto END;
+    }
+
+    if (SWAR_DIGITS <= digits)
+    {
+        if (false == parse_eight_digits(text_p + pos, &chunk))
+        {
+            goto END;
+        }
+        value = chunk;
+        pos += SWAR_DIGITS;
+    }
+
+    for (; pos < length; pos++)
+    {
+        // Unsigned, so bytes below '0' wrap around and fail the same test
+        digit = (unsigned)(unsigned char)text_p[pos] - '0';
+        if (9 < digit)
+        {
+            goto END;
+        }
+        value = (value * 10) + digit;
+    }
+
+    if (true == negative)
+    {
+        limit = (uint64_t)INT32_MAX + 1;
+    }
+
+    if (limit < value)
+    {
+        goto END;
+    }
+
+    *value_p  = (true == negative) ? (int32_t)(0 - (int64_t)value)
+                                   : (int32_t)value;
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+int number_parse_int32_str(const char * text_p, int32_t * value_p)
+{
+    size_t length = 0;
+
+    if (NULL == text_p)
+    {
+        return E_FAILURE;
+    }
+
+    length = strnlen(text_p, NUMBER_MAX_TEXT + 1);
+    if (NUMBER_MAX_TEXT < length)
+    {
+        return E_FAILURE;
+    }
+
+    return number_parse_int32(text_p, length, value_p);
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static bool parse_eight_digits(const char * text_p, uint64_t * value_p)
+{
+    uint64_t word = 0;
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    // memcpy() because the text need not be aligned; compiles to one load.
+    // The first digit lands in the lowest byte.
+    memcpy(&word, text_p, sizeof(word));
+#else
+    for (size_t idx = 0; idx < SWAR_DIGITS; idx++)
+    {
+        word |= (uint64_t)(unsigned char)text_p[idx] << (8 * idx);
+    }
+#endif
+
+    // A byte is a digit when neither it minus '0' nor it plus 0x46 reaches
+    // bit 7: the first catches bytes below '0', the second bytes above '9'
+    if (0 != (((word - SWAR_ZEROS) | (word + SWAR_ABOVE_9)) & SWAR_HIGH))
+    {
+        return false;
+    }
+
+    // Each step merges neighbouring groups: eight 1-digit values become four
+    // 2-digit values, then two 4-digit values, then one 8-digit value
+    word -= SWAR_ZEROS;
+    word = ((word * 10) + (word >> 8)) & 0x00FF00FF00FF00FFULL;
+    word = ((word * 100) + (word >> 16)) & 0x0000FFFF0000FFFFULL;
+    word = ((word * 10000) + (word >> 32)) & 0x00000000FFFFFFFFULL;
+
+    *value_p = word;
+    return true;
+}
+
+/*** end of file ***/
@@ -0,0 +1,81 @@
+/**
+ * @file object_pool.h
+ * @brief Header for the Fixed-Size Object Pool
+ *
+ * This header file provides the interface for a slab allocator of fixed-size
+ * objects (work items, receive buffers). All objects of a pool come from one
+ * allocation made at creation, and each thread keeps a small cache of free
+ * objects, so steady-state allocation neither calls malloc() nor takes a
+ * shared lock.
+ *
+ */
+#ifndef _OBJECT_POOL_H
+#define _OBJECT_POOL_H
+
+#include <stddef.h>
+
+#define MAX_OBJECT_POOLS          8  // Maximum number of pools alive at once
+#define OBJECT_POOL_MAGAZINE_SIZE 32 // Most objects one thread cache holds
+
+/**
+ * @struct object_pool
+ * @brief Opaque object pool handle.
+ */
+typedef struct object_pool object_pool_t;
+
+/**
+ * @brief Creates a pool of 'object_count' objects of 'object_size' bytes.
+ *
+ * Objects are aligned to a cache line so that objects used by different
+ * threads never share one. Each thread using the pool may keep up to
+ * OBJECT_POOL_MAGAZINE_SIZE free objects in its cache, out of reach of the
+ * others, so size the pool for every thread's cache on top of the objects
+ * actually in use.
+ *
+ * @param object_size The size of each object in bytes.
+ * @param object_count The number of objects in the slab.
+ * @return object_pool_t * - The new pool, or NULL on failure.
+ */
+object_pool_t * object_pool_create(size_t object_size, size_t object_count);
+
+/**
+ * @brief Destroys a pool and sets the caller's pointer to NULL.
+ *
+ * All threads must have stopped using the pool. Objects still held by
+ * thread caches are released along with the slab.
+ *
+ * @param pool_pp The address of the pool pointer.
+ */
+void object_pool_destroy(object_pool_t ** pool_pp);
+
+/**
+ * @brief Takes an object from the pool.
+ *
+ * @param pool_p The pool.
+ * @return void * - An object, or NULL if the pool is exhausted.
+ */
+void * object_pool_alloc(object_pool_t * pool_p);
+
+/**
+ * @brief Returns an object to the pool.
+ *
+ * The object may be freed by a different thread than the one that
+ * allocated it.
+ *
+ * @param pool_p The pool the object came from.
+ * @param object_p The object.
+ */
+void object_pool_free(object_pool_t * pool_p, void * object_p);
+
+/**
+ * @brief Returns the calling thread's cached objects to the shared depot.
+ *
+ * Worker threads should call this before exiting so their cached objects
+ * remain available to other threads.
+ *
+ * @param pool_p The pool.
+ */
+void object_pool_thread_flush(object_pool_t * pool_p);
+
+#endif /* _OBJECT_POOL_H */
+/*** end of file ***/
@@ -0,0 +1,293 @@
+/**
+ * @file object_pool.c
+ * @brief Fixed-Size Object Pool with Per-Thread Caches
+ *
+ * This file implements a two level allocator. A mutex protected depot holds
+ * the free objects of the slab; each thread has a per-pool cache (a
+ * "magazine") it allocates from and frees into without locking. The depot
+ * lock is taken only to move half a magazine at a time, so it is touched
+ * once per MAGAZINE_SIZE / 2 operations at most.
+ *
+ * Thread caches are tagged with the serial number of the pool they belong
+ * to, so a cache left over from a destroyed pool is never handed out.
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "object_pool.h"
+#include "utilities.h"
+
+#define CACHE_LINE_SIZE 64                        // Assumed CPU cache line
+#define MAGAZINE_SIZE   OBJECT_POOL_MAGAZINE_SIZE // Objects per thread cache
+
+/**
+ * @struct thread_cache
+ * @brief Free objects held by one thread for one pool.
+ */
+typedef struct thread_cache
+{
+    uint64_t serial;                 // Serial of the owning pool, 0 if unused
+    size_t   count;                  // Number of cached objects
+    void *   objects[MAGAZINE_SIZE]; // Cached objects
+} thread_cache_t;
+
+struct object_pool
+{
+    pthread_mutex_t depot_lock;   // Protects the depot
+    void **         depot_pp;     // Stack of free objects
+    size_t          depot_count;  // Number of free objects in the depot
+    unsigned char * slab_p;       // Backing storage for every object
+    size_t          object_size;  // Size of one object, cache line rounded
+    size_t          object_count; // Number of objects in the slab
+    size_t          slot;         // Index into each thread's cache array
+    uint64_t        serial;       // Unique id of this pool
+};
+
+static pthread_mutex_t g_slots_lock = PTHREAD_MUTEX_INITIALIZER;
+static object_pool_t * g_slots[MAX_OBJECT_POOLS];
+static uint64_t        g_next_serial = 1;
+
+static _Thread_local thread_cache_t g_caches[MAX_OBJECT_POOLS];
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Returns the calling thread's cache for a pool, resetting it if it
+ * belonged to an earlier pool in the same slot.
+ *
+ * @param pool_p The pool.
+ * @return The thread's cache for the pool.
+ */
+static thread_cache_t * get_cache(object_pool_t * pool_p);
+
+/**
+ * @brief Moves up to 'count' objects from the depot into a thread cache.
+ *
+ * @param pool_p The pool.
+ * @param cache_p The cache to fill.
+ * @param count The maximum number of objects to move.
+ */
+static void refill_cache(object_pool_t *  pool_p,
+                         thread_cache_t * cache_p,
+                         size_t           count);
+
+/**
+ * @brief Moves up to 'count' objects from a thread cache to the depot.
+ *
+ * @param pool_p The pool.
+ * @param cache_p The cache to drain.
+ * @param count The maximum number of objects to move.
+ */
+static void drain_cache(object_pool_t *  pool_p,
+                        thread_cache_t * cache_p,
+                        size_t           count);
+
+// +---------------------------------------------------------------------------+
+// |                             OBJECT POOL API                               |
+// +---------------------------------------------------------------------------+
+
+object_pool_t * object_pool_create(size_t object_size, size_t object_count)
+{
+    object_pool_t * pool_p = NULL;
+    size_t          slot   = 0;
+    size_t          stride = 0;
+
+    if ((0 == object_size) || (0 == object_count))
+    {
+        print_error("object_pool_create(): Invalid size or count.");
+        goto END;
+    }
+
+    stride = ((object_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) *
+             CACHE_LINE_SIZE;
+    if ((SIZE_MAX / stride) < object_count)
+    {
+        print_error("object_pool_create(): Pool too large.");
+        goto END;
+    }
+
+    pool_p = calloc(1, sizeof(*pool_p));
+    if (NULL == pool_p)
+    {
+        print_error("object_pool_create(): calloc() failed.");
+        goto END;
+    }
+
+    pool_p->object_size  = stride;
+    pool_p->object_count = object_count;
+    pool_p->slab_p   = aligned_alloc(CACHE_LINE_SIZE, stride * object_count);
+    pool_p->depot_pp = malloc(object_count * sizeof(*pool_p->depot_pp));
+    if ((NULL == pool_p->slab_p) || (NULL == pool_p->depot_pp))
+    {
+        print_error("object_pool_create(): Unable to allocate slab.");
+        goto ERROR;
+    }
+
+    // Push in reverse so the first allocations come from the slab start
+    for (size_t idx = 0; idx < object_count; idx++)
+    {
+        pool_p->depot_pp[idx] =
+            pool_p->slab_p + ((object_count - 1 - idx) * stride);
+    }
+    pool_p->depot_count = object_count;
+
+    if (0 != pthread_mutex_init(&pool_p->depot_lock, NULL))
+    {
+        print_error("object_pool_create(): pthread_mutex_init() failed.");
+        goto ERROR;
+    }
+
+    pthread_mutex_lock(&g_slots_lock);
+    for (slot = 0; slot < MAX_OBJECT_POOLS; slot++)
+    {
+        if (NULL == g_slots[slot])
+        {
+            break;
+        }
+    }
+    if (MAX_OBJECT_POOLS == slot)
+    {
+        pthread_mutex_unlock(&g_slots_lock);
+        print_error("object_pool_create(): Too many pools.");
+        pthread_mutex_destroy(&pool_p->depot_lock);
+        goto ERROR;
+    }
+    g_slots[slot]  = pool_p;
+    pool_p->slot   = slot;
+    pool_p->serial = g_next_serial++;
+    pthread_mutex_unlock(&g_slots_lock);
+
+    goto END;
+
+ERROR:
+    free(pool_p->depot_pp);
+    free(pool_p->slab_p);
+    free(pool_p);
+    pool_p = NULL;
+END:
+    return pool_p;
+}
+
+void object_pool_destroy(object_pool_t ** pool_pp)
+{
+    object_pool_t * pool_p = NULL;
+
+    if ((NULL == pool_pp) || (NULL == *pool_pp))
+    {
+        return;
+    }
+    pool_p = *pool_pp;
+
+    pthread_mutex_lock(&g_slots_lock);
+    g_slots[pool_p->slot] = NULL;
+    pthread_mutex_unlock(&g_slots_lock);
+
+    pthread_mutex_destroy(&pool_p->depot_lock);
+    free(pool_p->depot_pp);
+    free(pool_p->slab_p);
+    free(pool_p);
+    *pool_pp = NULL;
+}
+
+void * object_pool_alloc(object_pool_t * pool_p)
+{
+    thread_cache_t * cache_p = NULL;
+
+    if (NULL == pool_p)
+    {
+        return NULL;
+    }
+
+    cache_p = get_cache(pool_p);
+    if (0 == cache_p->count)
+    {
+        refill_cache(pool_p, cache_p, MAGAZINE_SIZE / 2);
+        if (0 == cache_p->count)
+        {
+            return NULL;
+        }
+    }
+
+    return cache_p->objects[--cache_p->count];
+}
+
+void object_pool_free(object_pool_t * pool_p, void * object_p)
+{
+    thread_cache_t * cache_p = NULL;
+
+    if ((NULL == pool_p) || (NULL == object_p))
+    {
+        return;
+    }
+
+    cache_p = get_cache(pool_p);
+    if (MAGAZINE_SIZE == cache_p->count)
+    {
+        drain_cache(pool_p, cache_p, MAGAZINE_SIZE / 2);
+    }
+
+    cache_p->objects[cache_p->count++] = object_p;
+}
+
+void object_pool_thread_flush(object_pool_t * pool_p)
+{
+    if (NULL == pool_p)
+    {
+        return;
+    }
+
+    drain_cache(pool_p, get_cache(pool_p), MAGAZINE_SIZE);
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static thread_cache_t * get_cache(object_pool_t * pool_p)
+{
+    thread_cache_t * cache_p = &g_caches[pool_p->slot];
+
+    if (pool_p->serial != cache_p->serial)
+    {
+        // Anything cached belonged to a pool that has since been destroyed
+        cache_p->serial = pool_p->serial;
+        cache_p->count  = 0;
+    }
+
+    return cache_p;
+}
+
+static void refill_cache(object_pool_t *  pool_p,
+                         thread_cache_t * cache_p,
+                         size_t           count)
+{
+    pthread_mutex_lock(&pool_p->depot_lock);
+    while ((0 < count) && (0 < pool_p->depot_count) &&
+           (MAGAZINE_SIZE > cache_p->count))
+    {
+        cache_p->objects[cache_p->count++] =
+            pool_p->depot_pp[--pool_p->depot_count];
+        count--;
+    }
+    pthread_mutex_unlock(&pool_p->depot_lock);
+}
+
+static void drain_cache(object_pool_t *  pool_p,
+                        thread_cache_t * cache_p,
+                        size_t           count)
+{
+    pthread_mutex_lock(&pool_p->depot_lock);
+    while ((0 < count) && (0 < cache_p->count) &&
+           (pool_p->object_count > pool_p->depot_count))
+    {
+        pool_p->depot_pp[pool_p->depot_count++] =
+            cache_p->objects[--cache_p->count];
+        count--;
+    }
+    pthread_mutex_unlock(&pool_p->depot_lock);
+}
+
+/*** end of file ***/
@@ -0,0 +1,498 @@
+/**
+ * @file test_object_pool.c
+ * @brief Tests for the Fixed-Size Object Pool
+ *
+ * Checks of object size and alignment and of an exhausted pool, then of the
+ * thread caches: an allocation refills the caller's magazine with half a
+ * magazine from the depot, leaving the rest out of reach of other threads
+ * until object_pool_thread_flush(), and frees beyond a full magazine drain
+ * half of it back. A stress test then runs several threads allocating,
+ * freeing and passing objects to each other; no object may be held by two
+ * threads at once, and every object must be back in the pool at the end.
+ * Build with -fsanitize=thread to check the locking as well.
+ *
+ * Usage: test-object-pool
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "object_pool.h"
+#include "utilities.h"
+
+#define HALF_MAGAZINE (OBJECT_POOL_MAGAZINE_SIZE / 2) // Objects per refill
+#define DRAIN_OBJECTS (4 * OBJECT_POOL_MAGAZINE_SIZE) // Pool of test_drain()
+
+#define CACHE_LINE     64    // Alignment and size granule of objects
+#define OBJECT_SIZE    100   // Rounded up to two cache lines by the pool
+#define STRESS_THREADS 4     // Threads sharing one pool
+#define STRESS_ROUNDS  20000 // Rounds run by each thread
+#define STRESS_BATCH   8     // Objects held at once by a thread
+
+// Enough for every thread's full magazine and batch, plus the handoffs
+#define STRESS_OBJECTS                                                         \
+    (STRESS_THREADS * (OBJECT_POOL_MAGAZINE_SIZE + STRESS_BATCH + 1))
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr,                                                    \
+                    "%s:%d: CHECK(%s) failed\n",                               \
+                    __FILE__,                                                  \
+                    __LINE__,                                                  \
+                    #condition);                                               \
+            goto END;                                                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @struct pool_job
+ * @brief Work handed to a short-lived thread, and what it found.
+ */
+typedef struct pool_job
+{
+    object_pool_t * pool_p;    // The pool under test
+    void **         objects_p; // Objects allocated or to free
+    size_t          count;     // Entries used in 'objects_p'
+    bool            flush;     // Flush the thread's cache before exiting
+} pool_job_t;
+
+/**
+ * @struct stress
+ * @brief State shared by the threads of test_stress().
+ */
+typedef struct stress
+{
+    object_pool_t * pool_p;                  // The pool under test
+    atomic_bool     failed;                  // A check failed in a thread
+    _Atomic(void *) handoff[STRESS_THREADS]; // Object passed to the next
+} stress_t;
+
+/**
+ * @struct stress_thread
+ * @brief One thread of test_stress().
+ */
+typedef struct stress_thread
+{
+    stress_t * stress_p; // Shared state
+    size_t     id;       // Thread index, from 0
+} stress_thread_t;
+
+/**
+ * @struct test_case
+ * @brief One named test.
+ */
+typedef struct test_case
+{
+    const char * name_p; // Printed with the result
+    int (*run)(void);    // Returns E_SUCCESS if the test passed
+} test_case_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Checks object alignment and spacing, exhaustion and bad arguments.
+ */
+static int test_basic(void);
+
+/**
+ * @brief Checks that a refill takes half a magazine from the depot, and
+ * that a flush gives back what the thread did not use.
+ */
+static int test_refill(void);
+
+/**
+ * @brief Checks that frees drain a full magazine by half, and that objects
+ * left cached by an exited thread stay out of reach until it flushes.
+ */
+static int test_drain(void);
+
+/**
+ * @brief Runs STRESS_THREADS threads allocating and freeing at once.
+ */
+static int test_stress(void);
+
+/**
+ * @brief Runs one job on a new thread and waits for it.
+ *
+ * @param routine_p The job.
+ * @param job_p Its state.
+ * @return int - Returns E_SUCCESS if the thread ran, otherwise E_FAILURE.
+ */
+static int run_job(void * (*routine_p)(void *), pool_job_t * job_p);
+
+/**
+ * @brief Allocates until the pool is exhausted, keeping every object.
+ *
+ * @param arg_p The pool_job_t; 'objects_p' must hold every object.
+ * @return NULL.
+ */
+static void * alloc_all(void * arg_p);
+
+/**
+ * @brief Frees the job's objects, then flushes if asked to.
+ *
+ * @param arg_p The pool_job_t.
+ * @return NULL.
+ */
+static void * free_all(void * arg_p);
+
+/**
+ * @brief Counts the objects the calling thread can allocate, then gives
+ * them all back and flushes.
+ *
+ * @param arg_p The pool_job_t.
+ * @return NULL.
+ */
+static void * count_available(void * arg_p);
+
+/**
+ * @brief Allocates batches, marks each object as its own, and frees them,
+ * passing one object per round to the next thread.
+ *
+ * @param arg_p The stress_thread_t.
+ * @return NULL.
+ */
+static void * stress_worker(void * arg_p);
+
+int main(void)
+{
+    static const test_case_t tests[] = {
+        { "basic", test_basic }, { "refill", test_refill },
+        { "drain", test_drain }, { "stress", test_stress },
+    };
+    int exit_code = E_SUCCESS;
+
+    for (size_t idx = 0; idx < sizeof(tests) / sizeof(tests[0]); idx++)
+    {
+        if (E_SUCCESS == tests[idx].run())
+        {
+            printf("PASS %s\n", tests[idx].name_p);
+        }
+        else
+        {
+            printf("FAIL %s\n", tests[idx].name_p);
+            exit_code = E_FAILURE;
+        }
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int test_basic(void)
+{
+    int             exit_code  = E_FAILURE;
+    object_pool_t * pool_p     = NULL;
+    void *          objects[4] = { NULL };
+    uintptr_t       distance   = 0;
+
+    CHECK(NULL == object_pool_create(0, 4));
+    CHECK(NULL == object_pool_create(OBJECT_SIZE, 0));
+    CHECK(NULL == object_pool_alloc(NULL));
+
+    pool_p = object_pool_create(OBJECT_SIZE, 4);
+    CHECK(NULL != pool_p);
+
+    for (size_t idx = 0; idx < 4; idx++)
+    {
+        objects[idx] = object_pool_alloc(pool_p);
+        CHECK(NULL != objects[idx]);
+        CHECK(0 == ((uintptr_t)objects[idx] % CACHE_LINE));
+    }
+    CHECK(NULL == object_pool_alloc(pool_p));
+
+    // Objects never share a cache line
+    for (size_t idx = 1; idx < 4; idx++)
+    {
+        distance = ((uintptr_t)objects[idx] > (uintptr_t)objects[0])
+                       ? ((uintptr_t)objects[idx] - (uintptr_t)objects[0])
+                       : ((uintptr_t)objects[0] - (uintptr_t)objects[idx]);
+        CHECK((2 * CACHE_LINE) <= distance);
+    }
+
+    for (size_t idx = 0; idx < 4; idx++)
+    {
+        object_pool_free(pool_p, objects[idx]);
+    }
+    object_pool_free(pool_p, NULL);
+
+    objects[0] = object_pool_alloc(pool_p);
+    CHECK(NULL != objects[0]);
+    object_pool_free(pool_p, objects[0]);
+
+    object_pool_destroy(&pool_p);
+    CHECK(NULL == pool_p);
+    object_pool_destroy(&pool_p);
+
+    exit_code = E_SUCCESS;
+END:
+    object_pool_destroy(&pool_p);
+    return exit_code;
+}
+
+static int test_refill(void)
+{
+    int             exit_code                  = E_FAILURE;
+    object_pool_t * pool_p                     = NULL;
+    void *          object_p                   = NULL;
+    void *          objects[HALF_MAGAZINE + 1] = { NULL };
+    pool_job_t      job                        = { 0 };
+
+    pool_p = object_pool_create(OBJECT_SIZE, HALF_MAGAZINE + 1);
+    CHECK(NULL != pool_p);
+    job.pool_p    = pool_p;
+    job.objects_p = objects;
+
+    // One allocation here moves half a magazine into this thread's cache
+    object_p = object_pool_alloc(pool_p);
+    CHECK(NULL != object_p);
+    CHECK(E_SUCCESS == run_job(count_available, &job));
+    CHECK(1 == job.count);
+
+    // The flush hands the rest of the refill to the others
+    object_pool_thread_flush(pool_p);
+    CHECK(E_SUCCESS == run_job(count_available, &job));
+    CHECK(HALF_MAGAZINE == job.count);
+
+    object_pool_free(pool_p, object_p);
+    object_pool_thread_flush(pool_p);
+    CHECK(E_SUCCESS == run_job(count_available, &job));
+    CHECK((HALF_MAGAZINE + 1) == job.count);
+
+    exit_code = E_SUCCESS;
+END:
+    object_pool_destroy(&pool_p);
+    return exit_code;
+}
+
+static int test_drain(void)
+{
+    int             exit_code              = E_FAILURE;
+    object_pool_t * pool_p                 = NULL;
+    void *          objects[DRAIN_OBJECTS] = { NULL };
+    pool_job_t      job                    = { 0 };
+
+    for (int flush = 0; flush < 2; flush++)
+    {
+        pool_p = object_pool_create(OBJECT_SIZE, DRAIN_OBJECTS);
+        CHECK(NULL != pool_p);
+        job.pool_p    = pool_p;
+        job.objects_p = objects;
+
+        CHECK(E_SUCCESS == run_job(alloc_all, &job));
+        CHECK(DRAIN_OBJECTS == job.count);
+
+        // Freed on another thread, whose magazine drains by half each time
+        // it is full, and ends full
+        job.flush = (1 == flush);
+        CHECK(E_SUCCESS == run_job(free_all, &job));
+        job.flush = false;
+
+        CHECK(E_SUCCESS == run_job(count_available, &job));
+        CHECK(((1 == flush) ? DRAIN_OBJECTS
+                            : (DRAIN_OBJECTS - OBJECT_POOL_MAGAZINE_SIZE)) ==
+              job.count);
+
+        object_pool_destroy(&pool_p);
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    object_pool_destroy(&pool_p);
+    return exit_code;
+}
+
+static int test_stress(void)
+{
+    int             exit_code               = E_FAILURE;
+    stress_t *      stress_p                = NULL;
+    size_t          started                 = 0;
+    void *          object_p                = NULL;
+    void *          objects[STRESS_OBJECTS] = { NULL };
+    pool_job_t      job                     = { 0 };
+    pthread_t       threads[STRESS_THREADS];
+    stress_thread_t args[STRESS_THREADS];
+
+    stress_p = calloc(1, sizeof(*stress_p));
+    CHECK(NULL != stress_p);
+    stress_p->pool_p = object_pool_create(sizeof(atomic_size_t),
+                                          STRESS_OBJECTS);
+    CHECK(NULL != stress_p->pool_p);
+
+    // Each object holds the id + 1 of the thread holding it, 0 when free
+    job.pool_p    = stress_p->pool_p;
+    job.objects_p = objects;
+    CHECK(E_SUCCESS == run_job(alloc_all, &job));
+    CHECK(STRESS_OBJECTS == job.count);
+    for (size_t idx = 0; idx < job.count; idx++)
+    {
+        atomic_init((atomic_size_t *)objects[idx], 0);
+    }
+    job.flush = true;
+    CHECK(E_SUCCESS == run_job(free_all, &job));
+
+    for (size_t idx = 0; idx < STRESS_THREADS; idx++)
+    {
+        args[idx].stress_p = stress_p;
+        args[idx].id       = idx;
+        CHECK(0 == pthread_create(
+                       &threads[idx], NULL, stress_worker, &args[idx]));
+        started++;
+    }
+
+    for (; 0 < started; started--)
+    {
+        pthread_join(threads[started - 1], NULL);
+    }
+    CHECK(false == atomic_load(&stress_p->failed));
+
+    for (size_t idx = 0; idx < STRESS_THREADS; idx++)
+    {
+        object_p = atomic_exchange(&stress_p->handoff[idx], NULL);
+        object_pool_free(stress_p->pool_p, object_p);
+    }
+    object_pool_thread_flush(stress_p->pool_p);
+
+    // Every thread flushed before exiting, so nothing is lost
+    CHECK(E_SUCCESS == run_job(count_available, &job));
+    CHECK(STRESS_OBJECTS == job.count);
+
+    exit_code = E_SUCCESS;
+END:
+    for (; 0 < started; started--)
+    {
+        pthread_join(threads[started - 1], NULL);
+    }
+    if (NULL != stress_p)
+    {
+        object_pool_destroy(&stress_p->pool_p);
+    }
+    free(stress_p);
+    return exit_code;
+}
+
+static int run_job(void * (*routine_p)(void *), pool_job_t * job_p)
+{
+    pthread_t thread;
+
+    if (0 != pthread_create(&thread, NULL, routine_p, job_p))
+    {
+        return E_FAILURE;
+    }
+
+    pthread_join(thread, NULL);
+    return E_SUCCESS;
+}
+
+static void * alloc_all(void * arg_p)
+{
+    pool_job_t * job_p    = arg_p;
+    void *       object_p = NULL;
+
+    job_p->count = 0;
+    for (object_p = object_pool_alloc(job_p->pool_p); NULL != object_p;
+         object_p = object_pool_alloc(job_p->pool_p))
+    {
+        job_p->objects_p[job_p->count++] = object_p;
+    }
+
+    return NULL;
+}
+
+static void * free_all(void * arg_p)
+{
+    pool_job_t * job_p = arg_p;
+
+    for (size_t idx = 0; idx < job_p->count; idx++)
+    {
+        object_pool_free(job_p->pool_p, job_p->objects_p[idx]);
+    }
+
+    if (true == job_p->flush)
+    {
+        object_pool_thread_flush(job_p->pool_p);
+    }
+
+    return NULL;
+}
+
+static void * count_available(void * arg_p)
+{
+    pool_job_t * job_p = arg_p;
+
+    alloc_all(job_p);
+    job_p->flush = true;
+    free_all(job_p);
+    job_p->flush = false;
+
+    return NULL;
+}
+
+static void * stress_worker(void * arg_p)
+{
+    stress_thread_t * thread_p            = arg_p;
+    stress_t *        stress_p            = thread_p->stress_p;
+    size_t            owner               = thread_p->id + 1;
+    size_t            next                = (thread_p->id + 1) % STRESS_THREADS;
+    size_t            expected            = 0;
+    void *            batch[STRESS_BATCH] = { NULL };
+    void *            passed_p            = NULL;
+    size_t            count               = 0;
+
+    for (size_t round = 0; round < STRESS_ROUNDS; round++)
+    {
+        count = 1 + (round % STRESS_BATCH);
+        for (size_t idx = 0; idx < count; idx++)
+        {
+            batch[idx] = object_pool_alloc(stress_p->pool_p);
+            expected   = 0;
+            if ((NULL == batch[idx]) ||
+                (false == atomic_compare_exchange_strong(
+                              (atomic_size_t *)batch[idx], &expected, owner)))
+            {
+                // Exhausted, or handed out twice
+                atomic_store(&stress_p->failed, true);
+                count = idx;
+                break;
+            }
+        }
+
+        // Keep the first object for the next thread, free the rest here
+        for (size_t idx = 0; idx < count; idx++)
+        {
+            atomic_store((atomic_size_t *)batch[idx], 0);
+            if (0 == idx)
+            {
+                passed_p = atomic_exchange(&stress_p->handoff[next],
+                                           batch[idx]);
+                batch[idx] = passed_p;
+                if (NULL == passed_p)
+                {
+                    continue;
+                }
+            }
+            object_pool_free(stress_p->pool_p, batch[idx]);
+        }
+
+        if (true == atomic_load(&stress_p->failed))
+        {
+            break;
+        }
+    }
+
+    object_pool_thread_flush(stress_p->pool_p);
+    return NULL;
+}
+
+/*** end of file ***/
@@ -10,8 +10,103 @@
 #define _OPTION_HANDLER_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
-#define MAX_PORT_SIZE 6 // Maximum size (in characters) for the port string
+#include "admission.h"
+#include "calc_kernels.h"
+#include "cpu_topology.h"
+#include "io_backend.h"
+#include "listener.h"
+#include "qos_queue.h"
+
+#define MAX_PORT_SIZE    6 // Maximum size (in characters, with NUL) of a port
+#define MAX_LISTEN_PORTS 8 // Maximum number of '-p' options accepted
+
+#define MAX_OPTION_NAME    32  // Size of the option recorded with an error
+#define MAX_OPTION_MESSAGE 128 // Size of the message recorded with an error
+#define MAX_CONFIG_PATH    256 // Size of the '-c' config file path
+#define MAX_TAKEOVER_PATH  108 // Size of the '--takeover' path (sun_path)
+
+#define DEF_QUEUE_DEPTH 4096 // Work queue capacity when '--queue-depth' unset
+
+/**
+ * @enum protocol
+ * @brief Wire format spoken on client connections.
+ */
+typedef enum protocol
+{
+    PROTOCOL_TEXT = 0, // One request per round trip
+    PROTOCOL_BINARY,   // Length-prefixed frames (wire_protocol.h)
+} protocol_t;
+
+/**
+ * @enum transport
+ * @brief How requests reach the server.
+ */
+typedef enum transport
+{
+    TRANSPORT_TCP = 0, // Connections accepted on each '-p' port
+    TRANSPORT_UDP,     // One request per datagram (datagram.h)
+} transport_t;
+
+/**
+ * @enum queue_mode
+ * @brief Work queue implementation used by the thread pool.
+ */
+typedef enum queue_mode
+{
+    QUEUE_MODE_LOCKED = 0, // Single mutex protected FIFO
+    QUEUE_MODE_LOCKFREE,   // Bounded lock-free MPMC ring (mpmc_queue.h)
+} queue_mode_t;
+
+/**
+ * @enum scheduler_mode
+ * @brief How the thread pool distributes work among its workers.
+ */
+typedef enum scheduler_mode
+{
+    SCHEDULER_MODE_SHARED = 0,    // All workers take from one shared queue
+    SCHEDULER_MODE_WORK_STEALING, // Per-worker deques with stealing
+} scheduler_mode_t;
+
+/**
+ * @enum exec_mode
+ * @brief Who writes replies back to clients.
+ */
+typedef enum exec_mode
+{
+    EXEC_MODE_SYNC = 0, // The worker that computed a request writes its reply
+    EXEC_MODE_ASYNC,    // Workers complete to an event loop (async_loop.h)
+} exec_mode_t;
+
+/**
+ * @enum option_error
+ * @brief Why process_options() failed.
+ *
+ * The values are stable so that an orchestrator can rely on them.
+ */
+typedef enum option_error
+{
+    OPTION_ERROR_NONE = 0,         // No error
+    OPTION_ERROR_UNKNOWN_OPTION,   // Option not recognised
+    OPTION_ERROR_MISSING_ARGUMENT, // Option given without its value
+    OPTION_ERROR_INVALID_VALUE,    // Value rejected by the option's checks
+    OPTION_ERROR_CONFLICT,         // Options inconsistent with each other
+    OPTION_ERROR_EXTRA_ARGUMENT,   // Non-option argument on the command line
+    OPTION_ERROR_INTERNAL,         // NULL argument or similar caller error
+    OPTION_ERROR_SOURCE,           // Unreadable config file or bad NETCALC_*
+} option_error_t;
+
+/**
+ * @struct options_error
+ * @brief The first failure seen by process_options().
+ */
+typedef struct options_error
+{
+    option_error_t code;                        // Kind of failure
+    char           option[MAX_OPTION_NAME];     // Option, e.g. "--queue-depth"
+    char           message[MAX_OPTION_MESSAGE]; // Most specific message
+} options_error_t;
 
 /**
  * @struct options
@@ -20,26 +115,284 @@
  * This structure is used to store the options passed via the command-line
  * arguments. It keeps track of whether certain flags are activated and stores
  * their corresponding values if they are provided.
+ *
+ * When a CPU list is given, worker 'i' of the pool is pinned to
+ * cpu_list[i % cpu_list_count] (see cpu_topology_bind_worker()).
+ *
+ * The structure is self-contained: every parsed string is copied into it
+ * rather than pointing into argv, so it may be copied with memcpy() (see
+ * options_clone()) and outlives the arguments it was parsed from.
+ *
+ * '-p' may be repeated; the server listens on every port in p_values. With
+ * '--reuseport' each port gets reuseport_value SO_REUSEPORT sockets, each
+ * owned by its own acceptor thread (see listener_open_group()). Every
+ * listener is opened with listen_tuning, whose zero fields keep the kernel
+ * defaults. With '--transport udp' each port instead gets one SO_REUSEPORT
+ * UDP socket per worker (see listener_open_datagram_group()).
+ *
+ * With '--shared-nothing' there is no shared queue or pool: listener 'i' of
+ * every port belongs to worker 'i', which reads, computes and replies to its
+ * requests itself (see shard.h), so listeners are opened n_value per port.
+ *
+ * With '--qos-classes', requests arriving on p_values[i] are queued in
+ * qos_classes[i], or in the last class when there are more ports than
+ * classes.
  */
 typedef struct options
 {
-    bool    n_flag;  // Used to set the truth value for the n flag
-    int32_t n_value; // Set the value of 'n'
-    bool    p_flag;  // Used to set the truth value for the p flag
-    char *  p_value; // Stores the port value as a string
+    bool          n_flag;           // Used to set the truth value for n flag
+    int32_t       n_value;          // Set the value of 'n'
+    bool          max_threads_flag; // Truth value for max-threads
+    int32_t       max_threads;      // Largest the pool grows to from 'n'
+    bool          cpu_list_flag;    // Truth value for the cpu-list flag
+    size_t        cpu_list_count;   // Number of CPUs in 'cpu_list'
+    // CPUs to pin workers to
+    uint16_t      cpu_list[MAX_CPU_LIST_SIZE];
+    bool          numa_policy_flag; // Truth value for the numa-policy flag
+    numa_policy_t numa_policy;      // Memory placement policy for workers
+
+    bool         p_flag;            // Used to set the truth value for p flag
+    // Stores the first port as a string
+    char         p_value[MAX_PORT_SIZE];
+    size_t       p_count;           // Number of ports in 'p_values'
+    // Every port given with '-p'
+    char         p_values[MAX_LISTEN_PORTS][MAX_PORT_SIZE];
+    bool         metrics_port_flag; // Truth value for metrics-port
+    // Port of the metrics endpoint
+    char         metrics_port[MAX_PORT_SIZE];
+    bool         reuseport_flag;    // Truth value for the reuseport flag
+    int32_t      reuseport_value;   // SO_REUSEPORT listeners per port
+    bool         io_backend_flag;   // Truth value for the io-backend flag
+    io_backend_t io_backend;        // I/O engine for the network path
+    bool         protocol_flag;     // Truth value for the protocol flag
+    protocol_t   protocol;          // Request wire format
+    bool         transport_flag;    // Truth value for the transport flag
+    transport_t  transport;         // TCP connections or UDP datagrams
+
+    bool              busy_poll_flag;    // Truth value for busy-poll-us
+    bool              rcvbuf_flag;       // Truth value for rcvbuf
+    bool              sndbuf_flag;       // Truth value for sndbuf
+    bool              defer_accept_flag; // Truth value for defer-accept
+    bool              backlog_flag;      // Truth value for backlog
+    listener_tuning_t listen_tuning;     // Socket options for every listener
+
+    bool              queue_flag;           // Truth value for queue
+    queue_mode_t      queue_mode;           // Work queue implementation
+    bool              queue_depth_flag;     // Truth value for queue-depth
+    int32_t           queue_depth;          // Capacity of the work queue
+    bool              scheduler_flag;       // Truth value for scheduler
+    scheduler_mode_t  scheduler_mode;       // How work reaches workers
+    bool              exec_mode_flag;       // Truth value for exec-mode
+    exec_mode_t       exec_mode;            // Who writes replies
+    bool              shared_nothing_flag;  // Truth value for shared-nothing
+    bool              batch_size_flag;      // Truth value for batch-size
+    int32_t           batch_size;           // Max items per dequeue
+    bool              batch_timeout_flag;   // Truth value for batch-timeout
+    int32_t           batch_timeout_us;     // Max wait to fill a batch
+    bool              max_queue_depth_flag; // Truth value for max-queue-depth
+    int32_t           max_queue_depth;      // Depth at which overload fires
+    bool              overload_policy_flag; // Truth value for overload-policy
+    overload_policy_t overload_policy;      // What to do at the limit
+    bool              qos_classes_flag;     // Truth value for qos-classes
+    size_t            qos_class_count;      // Classes in 'qos_classes'
+    // Work queue classes, highest priority first
+    qos_class_t       qos_classes[QOS_MAX_CLASSES];
+    bool              qos_policy_flag;      // Truth value for qos-policy
+    qos_policy_t      qos_policy;           // How classes share the workers
+
+    bool         simd_flag;            // Truth value for the simd flag
+    simd_level_t simd_level;           // Requested calculation kernel level
+    bool         pool_slab_count_flag; // Truth value for pool-slab-count
+    int32_t      pool_slab_count;      // Preallocated objects per pool
+    bool         buffer_size_flag;     // Truth value for buffer-size
+    int32_t      buffer_size;          // Bytes per pooled receive buffer
+    bool         cache_entries_flag;   // Truth value for cache-entries
+    int32_t      cache_entries;        // Result cache size, 0 if disabled
+    bool         trace_sample_flag;    // Truth value for trace-sample
+    int32_t      trace_sample_every;   // Trace one request in this many
+
+    bool            c_flag;        // Truth value for the c flag
+    // Path of the config file given with '-c' or NETCALC_C
+    char            c_value[MAX_CONFIG_PATH];
+    bool            takeover_flag; // Truth value for takeover
+    // UNIX socket the listening sockets are handed over on
+    char            takeover_path[MAX_TAKEOVER_PATH];
+    bool            quiet_flag;    // Truth value for quiet (machine) mode
+    options_error_t error;         // Why process_options() failed, if it did
+    // Options given on the command line or in the environment, which a
+    // config file loaded later must not override
+    uint64_t        pinned_set;
 } options_t;
 
+/**
+ * @brief Checks and stores the value of an option_extra_t.
+ *
+ * @param value_p The value as given, or NULL for an option without one.
+ * @param context_p The context given to options_parse_command_line().
+ * @param reason_pp Pointer to where a short reason for rejecting the value
+ * may be stored, e.g. "must be from 1 to 65536".
+ *
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+typedef int (*option_extra_parse_t)(const char *  value_p,
+                                    void *        context_p,
+                                    const char ** reason_pp);
+
+/**
+ * @struct option_extra
+ * @brief An option a program accepts beside the NetCalc options it shares.
+ *
+ * Extra options have a long name only. Like the table's long options they
+ * are written "--name value" or "--name=value", and may be abbreviated to a
+ * unique prefix.
+ */
+typedef struct option_extra
+{
+    const char *         long_name_p; // Without dashes, e.g. "rate"
+    bool                 has_value;   // Takes a value
+    option_extra_parse_t parse;       // Checks and stores it
+} option_extra_t;
+
 /**
  * @brief Processes command-line options and populates an options_t structure.
  *
+ * Options are also read from NETCALC_* environment variables (NETCALC_N=8,
+ * NETCALC_QUEUE_DEPTH=4096, NETCALC_P=8080,8081) and from the config file
+ * named by '-c FILE' or NETCALC_C (see options_load_file() for the format).
+ * The command line takes precedence over the environment, which takes
+ * precedence over the file; an option given by a source replaces every
+ * value of that option from the sources below it. Every source is checked
+ * against the same option table, and the checks between options run once
+ * all of them are applied.
+ *
+ * The parser keeps its state on the caller's stack and does not allocate,
+ * so it may be called from any thread, for several options_t at once.
+ *
  * @param argc The number of command-line arguments.
  * @param argv The array containing the command-line arguments.
  * @param options The address of a pointer to an options_t structure
  * where the options will be stored.
  * @return int - Returns E_SUCCESS on successful processing, otherwise
- * E_FAILURE.
+ * E_FAILURE. On failure 'error' in the options says why. With '-q' or
+ * '--quiet' that is printed as a single line instead of the help menu.
  */
 int process_options(int argc, char ** argv, options_t * options_p);
 
+/**
+ * @brief Parses a command line holding some of the NetCalc options.
+ *
+ * For programs that take a few options exactly as the server does, such as
+ * netcalc-bench with '-p' and '-n'. Only the options named in 'names_pp'
+ * and the program's own 'extras_p' are accepted, with the same walk through
+ * argv and the same checks as process_options(). Nothing else is read: no
+ * NETCALC_* variable and no config file, and the checks between options are
+ * not run.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array containing the command-line arguments.
+ * @param names_pp The shared options accepted, NULL terminated, named as in
+ * a config file, e.g. { "p", "n", "h", NULL }.
+ * @param extras_p The program's own options, terminated by an entry whose
+ * long_name_p is NULL, or NULL if there are none.
+ * @param context_p Passed to every extra option's parse function.
+ * @param options_p Pointer to the options_t receiving the shared options.
+ * Zero it before the call.
+ * @return int - Returns E_SUCCESS on successful processing, otherwise
+ * E_FAILURE. On failure 'error' in the options says why; error.code is
+ * OPTION_ERROR_NONE when '-h' was given, and the caller prints its own
+ * help. With '-q' (if accepted) the error is printed as a single line.
+ */
+int options_parse_command_line(int                    argc,
+                               char **                argv,
+                               const char * const *   names_pp,
+                               const option_extra_t * extras_p,
+                               void *                 context_p,
+                               options_t *            options_p);
+
+/**
+ * @brief Returns the stable name of an option error, e.g. "invalid-value".
+ *
+ * @param code The error.
+ * @return const char * - The name.
+ */
+const char * options_error_string(option_error_t code);
+
+/**
+ * @brief Loads options from a config file into an options_t structure.
+ *
+ * Each non-blank line holds one option, written as its command-line name
+ * without dashes followed by its value, separated by whitespace or '='
+ * (e.g. "n = 8" or "queue-depth 4096"). Text after '#' is a comment. The
+ * entries are checked against the same option table as the command line, so
+ * a file accepts exactly what the command line accepts, except that it may
+ * not name another config file. Unlike process_options(), the environment is
+ * not consulted, and the checks between options are left to options_check(),
+ * since the file may only hold part of the configuration.
+ *
+ * Options in 'pinned_set', as process_options() leaves it, are skipped, so
+ * a file loaded into a copy of the running options (e.g. on reload) keeps
+ * the command line > environment > file precedence of the start.
+ *
+ * @param path_p The path of the config file.
+ * @param options_p Pointer to the options_t structure to fill.
+ * @return int - Returns E_SUCCESS on successful processing, otherwise
+ * E_FAILURE.
+ */
+int options_load_file(const char * path_p, options_t * options_p);
+
+/**
+ * @brief Runs the checks between options on a complete configuration.
+ *
+ * These are the checks process_options() runs once every source is
+ * applied, e.g. that '-n' fits under '--max-threads'. Run them again on any
+ * configuration put together from several parts, such as a reloaded file
+ * merged into the running options.
+ *
+ * @param options_p Pointer to the options to check. On failure 'error'
+ * says why.
+ * @return int - Returns E_SUCCESS if the options are consistent, otherwise
+ * E_FAILURE.
+ */
+int options_check(options_t * options_p);
+
+/**
+ * @brief Creates a heap allocated copy of an options_t structure.
+ *
+ * The copy is a single allocation that shares nothing with the original,
+ * making it suitable as a read-only snapshot handed to worker threads.
+ *
+ * @param options_p The options to copy.
+ * @return options_t * - The copy, or NULL on failure. Free it with
+ * options_destroy().
+ */
+options_t * options_clone(const options_t * options_p);
+
+/**
+ * @brief Frees an options_t created by options_clone().
+ *
+ * @param options_pp The address of the options pointer, set to NULL.
+ */
+void options_destroy(options_t ** options_pp);
+
+/**
+ * @brief Finds an option whose setting differs between two options_t.
+ *
+ * Only the options set in 'given_p' are compared, flag and value, so the
+ * options loaded from a config file can be checked against the
+ * configuration in use. Both structures should have been zeroed, padding
+ * included, before they were filled.
+ *
+ * @param given_p The options to look for.
+ * @param current_p The options to compare them with.
+ * @param name_p Buffer receiving the first differing option's name, e.g.
+ * "-n" or "--queue-depth".
+ * @param size The size of name_p.
+ * @return bool - true if an option differs, otherwise false.
+ */
+bool options_find_difference(const options_t * given_p,
+                             const options_t * current_p,
+                             char *            name_p,
+                             size_t            size);
+
 #endif /* _OPTION_HANDLER_H */
 /*** end of file ***/
@@ -5,309 +5,3133 @@
  * This file contains functions for processing command-line options and printing
  * the help menu. It is responsible for setting up initial configurations based
  * on the options passed to the application.
+ *
+ * Every option is described by one entry of g_option_table: its names, the
+ * options_t fields it sets and how its value is checked. Plain numbers and
+ * keywords are handled by the table alone; only options with more involved
+ * values have a process_X_option() function. The parser keeps all of its
+ * state on the caller's stack and never allocates, so it may run on any
+ * thread, for several options_t at once, and again on reload.
  */
 #define _GNU_SOURCE // for strnlen()
 
-#include <getopt.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h> // getopt
+#include <ctype.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> // environ
+
+#include "cpu_topology.h"
+#include "number_parser.h"
+#include "object_pool.h"
+#include "option_handler.h"
+#include "utilities.h"
+
+#define MIN_NUM_THREADS 2     // Minimum number of threads allowed
+#define DEF_NUM_THREADS 4     // Number of threads when '-n' is not given
+#define MAX_NUM_THREADS 1024  // Maximum value of '--max-threads'
+#define MAX_PORT_VALUE  65535 // Maximum allowable port number
+#define MIN_PORT_VALUE  1025  // Minimum allowable port number
+
+#define MIN_REUSEPORT_LISTENERS 1  // Minimum SO_REUSEPORT listeners per port
+#define MAX_REUSEPORT_LISTENERS 64 // Maximum SO_REUSEPORT listeners per port
+
+#define AUTO_KEYWORD          "auto" // '-n' value requesting automatic sizing
+#define AUTO_KEYWORD_LEN      4      // Length of AUTO_KEYWORD
+#define AUTO_PERCENT_PREFIX   ':'    // Separates "auto" from a percentage
+#define MIN_AUTO_PERCENT      1      // Minimum percentage for "auto:N%"
+#define MAX_AUTO_PERCENT      100    // Maximum percentage for "auto:N%"
+#define MAX_AUTO_PERCENT_SIZE 3      // Maximum digits in the "auto:N%" value
+
+#define MAX_CONFIG_LINE 256 // Maximum length of a config file line
+#define CONFIG_COMMENT  '#' // Starts a comment in a config file
+
+#define MIN_QUEUE_DEPTH 2        // Minimum work queue depth
+#define MAX_QUEUE_DEPTH 16777216 // Maximum work queue depth (2^24)
+
+#define MIN_BATCH_SIZE       1       // Minimum items drained per dequeue
+#define MAX_BATCH_SIZE       1024    // Maximum items drained per dequeue
+#define MAX_BATCH_TIMEOUT_US 1000000 // Maximum batch fill wait (1 second)
+
+#define MIN_POOL_SLAB_COUNT 96         // Minimum objects per pool slab
+#define MAX_POOL_SLAB_COUNT 4194304    // Maximum objects per pool slab (2^22)
+#define MIN_BUFFER_SIZE     512        // Minimum receive buffer size in bytes
+#define MAX_BUFFER_SIZE     1048576    // Maximum receive buffer size (1 MiB)
+#define MAX_POOL_BYTES      4294967296 // Most bytes of buffers (4 GiB)
+#define POOL_SPARE_CACHES   2          // Magazines beyond one per worker
+
+#define MAX_CACHE_ENTRIES 16777216 // Maximum result cache entries (2^24)
+
+#define MAX_BUSY_POLL_US   1000000  // Maximum SO_BUSY_POLL time (1 second)
+#define MIN_SOCKET_BUFFER  4096     // Minimum SO_RCVBUF/SO_SNDBUF in bytes
+#define MAX_SOCKET_BUFFER  67108864 // Maximum SO_RCVBUF/SO_SNDBUF (64 MiB)
+#define MAX_DEFER_ACCEPT_S 3600     // Maximum TCP_DEFER_ACCEPT (1 hour)
+#define MAX_LISTEN_BACKLOG 65535    // Maximum listen() backlog
+
+#define TRACE_RATE_PREFIX     "1/"    // '--trace-sample' is written "1/N"
+#define TRACE_RATE_PREFIX_LEN 2       // Length of TRACE_RATE_PREFIX
+#define MAX_TRACE_SAMPLE      1000000 // Largest N of '--trace-sample=1/N'
+
+#define MAX_REPORT_SIZE 256 // Longest error message built by this file
+
+#define OPTION_SET_ALL UINT64_MAX // Every entry of g_option_table
+
+#define ENV_PREFIX         "NETCALC_" // Prefix of option variables
+#define ENV_LIST_SEPARATOR ","        // Separates a repeatable option's values
+
+/**
+ * @enum option_kind
+ * @brief How the value of an option is checked and stored.
+ */
+typedef enum option_kind
+{
+    OPTION_KIND_FLAG = 0, // No value; only sets the option's bool
+    OPTION_KIND_INT32,    // A number from 'min' to 'max', stored as int32_t
+    OPTION_KIND_KEYWORD,  // One of 'keywords_p', stored as its enum value
+    OPTION_KIND_CUSTOM,   // Checked and stored by 'parse'
+    OPTION_KIND_HELP,     // Stops parsing so the help menu is printed
+} option_kind_t;
+
+/**
+ * @struct option_keyword
+ * @brief One accepted value of an OPTION_KIND_KEYWORD option.
+ */
+typedef struct option_keyword
+{
+    const char * name_p; // As written, e.g. "lockfree"
+    int          value;  // Enum value stored, e.g. QUEUE_MODE_LOCKFREE
+} option_keyword_t;
+
+/**
+ * @brief Checks and stores the value of an OPTION_KIND_CUSTOM option.
+ *
+ * @param optarg The value as given.
+ * @param options_p The options to store it in.
+ *
+ * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
+ */
+typedef int (*option_parse_t)(char * optarg, options_t * options_p);
+
+/**
+ * @struct option_spec
+ * @brief One entry of g_option_table.
+ *
+ * Fields are named by their offset in options_t so that the table can be a
+ * compile-time constant shared by every parse.
+ */
+typedef struct option_spec
+{
+    const char *             long_name_p;  // e.g. "queue-depth", or NULL
+    char                     short_name;   // e.g. 'n', or '\0'
+    option_kind_t            kind;         // How the value is handled
+    bool                     repeatable;   // May be given more than once
+    size_t                   flag_offset;  // The option's bool
+    size_t                   value_offset; // First field holding the value
+    size_t                   value_size;   // Bytes from value_offset, or 0
+    int32_t                  min;          // Smallest INT32 value
+    int32_t                  max;          // Largest INT32 value
+    const option_keyword_t * keywords_p;   // KEYWORD values, NULL terminated
+    option_parse_t           parse;        // CUSTOM handler
+} option_spec_t;
+
+/**
+ * @enum option_status
+ * @brief What next_option() found.
+ */
+typedef enum option_status
+{
+    OPTION_FOUND = 0,        // An option, with its value if it takes one
+    OPTION_DONE,             // No arguments left
+    OPTION_UNKNOWN,          // Not in g_option_table (or ambiguous)
+    OPTION_NO_VALUE,         // Takes a value but none was given
+    OPTION_UNEXPECTED_VALUE, // '--name=value' for an option without one
+} option_status_t;
+
+/**
+ * @struct option_cursor
+ * @brief Position of one walk through argv.
+ *
+ * Holds what getopt() keeps in globals (optind, optarg and its position
+ * inside "-abc"), so that walks are reentrant. Like GNU getopt(), options
+ * may follow non-option arguments, and "--" ends the options.
+ */
+typedef struct option_cursor
+{
+    int                    argc;          // Number of arguments
+    char **                argv;          // The arguments
+    int                    index;         // Next argument to look at
+    char *                 cluster_p;     // Rest of a "-abc" short group
+    bool                   operands_only; // "--" has been seen
+    int                    operand_count; // Non-option arguments seen
+    const char *           operand_p;     // The first of them
+    uint64_t               allowed;       // Table entries accepted
+    const option_extra_t * extras_p;      // The caller's options, or NULL
+    const option_extra_t * extra_p;       // Caller's option found, or NULL
+    // Last option found, as written
+    char                   name[MAX_OPTION_NAME];
+} option_cursor_t;
+
+/**
+ * The options_t being filled in by process_options() on this thread, or NULL
+ * outside of it. Lets report_error() record and silence messages raised deep
+ * inside the option functions without passing options_p to every helper.
+ */
+static _Thread_local options_t * g_reporting_p = NULL;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Prints the help menu to the console.
+ *
+ * The function provides information on how to use the server application,
+ * detailing available options and their usage.
+ */
+static void print_help_menu();
+
+/**
+ * @brief Reports a failed parse: one line in quiet mode, else the menu.
+ *
+ * A failure with no error recorded is a request for help ('-h').
+ *
+ * @param options_p Pointer to the options whose error record is printed.
+ * @param show_help Whether the help menu is printed outside quiet mode.
+ */
+static void report_failure(options_t * options_p, bool show_help);
+
+/**
+ * @brief Finds the next option in argv.
+ *
+ * Only the table entries in the cursor's 'allowed' set are looked at. A
+ * long name may also be one of the cursor's extra options, in which case
+ * 'extra_p' is set and no table entry is stored.
+ *
+ * @param cursor_p The walk. Start it at index 1 with 'allowed' set and
+ * everything else zero.
+ * @param spec_pp Pointer to where the option's table entry is stored.
+ * @param value_pp Pointer to where its value (NULL if none) is stored.
+ *
+ * @return The option_status_t of the argument found.
+ */
+static option_status_t next_option(option_cursor_t *      cursor_p,
+                                   const option_spec_t ** spec_pp,
+                                   char **                value_pp);
+
+/**
+ * @brief Looks up an option by its short name.
+ *
+ * @param short_name The letter, e.g. 'n'.
+ *
+ * @return The table entry, or NULL if there is none.
+ */
+static const option_spec_t * find_short_option(char short_name);
+
+/**
+ * @brief Looks up an option by its long name.
+ *
+ * @param name_p The name without dashes. Need not be NUL terminated.
+ * @param length The length of the name.
+ * @param abbreviated Whether an unambiguous prefix ("--queue-dep") is
+ * accepted, as on the command line.
+ * @param allowed The table entries looked at, one bit each.
+ *
+ * @return The table entry, or NULL if there is none.
+ */
+static const option_spec_t * find_long_option(const char * name_p,
+                                              size_t       length,
+                                              bool         abbreviated,
+                                              uint64_t     allowed);
+
+/**
+ * @brief Looks up one of a caller's extra options by its long name.
+ *
+ * @param extras_p The extra options, or NULL.
+ * @param name_p The name without dashes. Need not be NUL terminated.
+ * @param length The length of the name.
+ *
+ * @return The extra option, or NULL if there is none or the prefix is
+ * ambiguous.
+ */
+static const option_extra_t * find_extra_option(
+    const option_extra_t * extras_p, const char * name_p, size_t length);
+
+/**
+ * @brief Looks up an option as named in a config file or the environment.
+ *
+ * Single letter names are short options, anything longer is a long option
+ * written in full.
+ *
+ * @param name_p The name, e.g. "n" or "queue-depth".
+ * @param length The length of the name.
+ *
+ * @return The table entry, or NULL if there is none.
+ */
+static const option_spec_t * find_named_option(const char * name_p,
+                                               size_t       length);
+
+/**
+ * @brief Checks and stores one option.
+ *
+ * @param spec_p The option's table entry.
+ * @param value_p Its value, or NULL for flags.
+ * @param options_p The options to store it in.
+ *
+ * @return E_SUCCESS on success, E_FAILURE if the value was rejected (an
+ * error is recorded) or help was requested (none is).
+ */
+static int apply_option(const option_spec_t * spec_p,
+                        char *                value_p,
+                        options_t *           options_p);
+
+/**
+ * @brief Stores the value of an OPTION_KIND_INT32 option.
+ *
+ * @param spec_p The option's table entry, holding its range.
+ * @param name_p The option's name, for messages.
+ * @param value_p The value.
+ * @param options_p The options to store it in.
+ *
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int apply_int32(const option_spec_t * spec_p,
+                       const char *          name_p,
+                       const char *          value_p,
+                       options_t *           options_p);
+
+/**
+ * @brief Stores the value of an OPTION_KIND_KEYWORD option.
+ *
+ * @param spec_p The option's table entry, holding its keywords.
+ * @param name_p The option's name, for messages.
+ * @param value_p The value.
+ * @param options_p The options to store it in.
+ *
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int apply_keyword(const option_spec_t * spec_p,
+                         const char *          name_p,
+                         const char *          value_p,
+                         options_t *           options_p);
+
+/**
+ * @brief Checks the command line without applying it.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ * @param given_p Pointer to where the set of options given is stored, one
+ * bit per g_option_table entry.
+ * @param path_pp Pointer to where the '-c' path (NULL if none) is stored.
+ *
+ * @return E_SUCCESS if every argument is a well formed option, E_FAILURE if
+ * the command line holds anything apply_command_line() must report
+ * (unknown options, missing values, extra arguments, or '-h').
+ */
+static int scan_command_line(int        argc,
+                             char **    argv,
+                             uint64_t * given_p,
+                             char **    path_pp);
+
+/**
+ * @brief Applies every option on the command line, in order.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ * @param options_p The options to fill.
+ *
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int apply_command_line(int argc, char ** argv, options_t * options_p);
+
+/**
+ * @brief Maps a NETCALC_* variable to its option.
+ *
+ * The variable name after the prefix is the option name in upper case with
+ * '-' written as '_': NETCALC_N names '-n', NETCALC_QUEUE_DEPTH names
+ * '--queue-depth'.
+ *
+ * @param entry_p The environment entry, "NAME=VALUE".
+ * @param value_pp Pointer to where the value is stored.
+ *
+ * @return The table entry, or NULL if the name is not an option.
+ */
+static const option_spec_t * find_env_option(char * entry_p, char ** value_pp);
+
+/**
+ * @brief Checks the NETCALC_* environment variables without applying them.
+ *
+ * Unknown NETCALC_* names are an error, so a typo is not silently ignored.
+ *
+ * @param given_p Pointer to where the set of options given is stored.
+ * @param path_pp Pointer to where NETCALC_C (NULL if unset) is stored.
+ *
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int scan_environment(uint64_t * given_p, char ** path_pp);
+
+/**
+ * @brief Applies the NETCALC_* environment variables.
+ *
+ * Flags such as NETCALC_QUIET are set by any value. A repeatable option may
+ * list several comma separated values (NETCALC_P=8080,8081).
+ *
+ * @param options_p The options to fill.
+ * @param skip The options to leave alone, as they are given by the command
+ * line.
+ *
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int apply_environment(options_t * options_p, uint64_t skip);
+
+/**
+ * @brief Applies a config file, one line at a time.
+ *
+ * See options_load_file() for the format. A config file may not name
+ * another config file.
+ *
+ * @param path_p The path of the config file.
+ * @param options_p The options to fill.
+ * @param skip The options to leave alone, as they are given by a source
+ * that takes precedence.
+ *
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int apply_file(const char * path_p,
+                      options_t *  options_p,
+                      uint64_t     skip);
+
+/**
+ * @brief Splits one config file line into an option name and value.
+ *
+ * Comments and surrounding whitespace are removed. The name and value may be
+ * separated by whitespace or '='.
+ *
+ * @param line_p The line to parse. Modified in place.
+ * @param name_pp Pointer to where the name (NULL for a blank line) is stored.
+ * @param value_pp Pointer to where the value (NULL if none) is stored.
+ *
+ * @return E_SUCCESS if the line is blank, a comment or a valid entry,
+ * E_FAILURE otherwise.
+ */
+static int split_config_line(char * line_p, char ** name_pp, char ** value_pp);
+
+/**
+ * @brief Runs the checks between options, once every source is applied.
+ *
+ * @param options_p Pointer to the parsed options.
+ *
+ * @return E_SUCCESS if the options are consistent, E_FAILURE otherwise.
+ */
+static int check_conflicts(options_t * options_p);
+
+//
+// ------------------------------REPORT FUNCTIONS------------------------------
+//
+
+/**
+ * @brief Reports an error raised while processing options.
+ *
+ * While process_options() is running, the first message is kept in the
+ * options' error record, since it is the most specific one (each caller adds
+ * a more general message as the failure propagates). In quiet mode nothing
+ * is printed; process_options() prints a single summary line instead.
+ *
+ * @param message_p The error message.
+ */
+static void report_error(const char * message_p);
+
+/**
+ * @brief Records the kind of failure and the option that caused it.
+ *
+ * Only the first failure is recorded.
+ *
+ * @param options_p Pointer to the options being processed.
+ * @param code The kind of failure.
+ * @param option_p The option as given on the command line, or NULL.
+ */
+static void record_error(options_t *    options_p,
+                         option_error_t code,
+                         const char *   option_p);
+
+/**
+ * @brief Writes the command-line spelling of an option.
+ *
+ * @param spec_p The option's table entry.
+ * @param buffer_p Buffer receiving the name, e.g. "-n" or "--queue-depth".
+ * @param size The size of buffer_p.
+ */
+static void option_name(const option_spec_t * spec_p,
+                        char *                buffer_p,
+                        size_t                size);
+
+/**
+ * @brief Checks argv for '-q' or '--quiet' ahead of parsing.
+ *
+ * Quiet mode must be known before the first error can be reported, and the
+ * failing option may come before '--quiet' on the command line.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ *
+ * @return true if quiet mode was requested, false otherwise.
+ */
+static bool find_quiet_flag(int argc, char ** argv);
+
+/**
+ * @brief Reports the non-option arguments found by a walk through argv.
+ *
+ * @param cursor_p The finished walk.
+ * @param options_p Pointer to the options whose error record is set.
+ */
+static void report_extra_arguments(const option_cursor_t * cursor_p,
+                                   options_t *             options_p);
+
+/**
+ * @brief Reports an unknown or incomplete option.
+ *
+ * @param cursor_p The walk, naming the option as written.
+ * @param status What was wrong with it.
+ * @param options_p Pointer to the options whose error record is set.
+ */
+static void report_invalid_option(const option_cursor_t * cursor_p,
+                                  option_status_t         status,
+                                  options_t *             options_p);
+
+//
+// ------------------------------OPTION FUNCTIONS------------------------------
+//
+
+/**
+ * @brief Process the '-c' command-line option.
+ *
+ * The file itself is read by process_options() before any option is
+ * parsed; this only records its path so a reload can read it again.
+ *
+ * @param optarg Pointer to the string containing the argument for the '-c'
+ * option.
+ * @param options_p Pointer to the options_t struct where the parsed value
+ * should be stored.
+ *
+ * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
+ */
+static int process_c_option(char * optarg, options_t * options_p);
+
+/**
+ * @brief Process the '-n' command-line option.
+ *
+ * This function is responsible for processing the '-n' option passed in the
+ * command line. The '-n' option specifies the number of threads in the thread
+ * pool.
+ *
+ * @param optarg Pointer to the string containing the argument for the '-n'
+ * option.
+ * @param options_p Pointer to the options_t struct where the parsed value
+ * should be stored.
+ *
+ * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
+ */
+static int process_n_option(char * optarg, options_t * options_p);
+
+/**
+ * @brief Resolve an "auto" or "auto:N%" value for the '-n' option.
+ *
+ * The number of threads is derived from the CPUs available to the process
+ * (see cpu_topology_available_cpus()). With "auto:N%" only N percent of those
+ * CPUs are used, rounded up. The result is never below MIN_NUM_THREADS.
+ *
+ * @param optarg Pointer to the string containing the argument for the '-n'
+ * option. Must begin with AUTO_KEYWORD.
+ * @param num_threads_p Pointer to where the resolved thread count is stored.
+ *
+ * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
+ */
+static int resolve_auto_threads(char * optarg, int32_t * num_threads_p);
+
+/**
+ * @brief Process the '--cpu-list' command-line option.
+ *
+ * The '--cpu-list' option specifies the CPUs the pool workers are pinned to,
+ * in kernel CPU list format (e.g. "0-3,8").
+ *
+ * @param optarg Pointer to the string containing the argument for the
+ * '--cpu-list' option.
+ * @param options_p Pointer to the options_t struct where the parsed value
+ * should be stored.
+ *
+ * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
+ */
+static int process_cpu_list_option(char * optarg, options_t * options_p);
+
+/**
+ * @brief Process the '-p' command-line option.
+ *
+ * This function is responsible for processing the '-p' option passed in the
+ * command line. The '-p' option specifies a port number on which the server
+ * should listen. It may be given up to MAX_LISTEN_PORTS times, but the same
+ * port may not be given twice.
+ *
+ * @param optarg Pointer to the string containing the argument for the '-p'
+ * option.
+ * @param options_p Pointer to the options_t struct where the parsed value
+ * should be stored.
+ *
+ * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
+ */
+static int process_p_option(char * optarg, options_t * options_p);
+
+/**
+ * @brief Process the '--io-backend' command-line option.
+ *
+ * The '--io-backend' option selects the I/O engine used for the accept,
+ * receive and send path. Only the '--shared-nothing' shards have an
+ * io_uring engine, which check_io_backend() enforces. The kernel is not
+ * probed here; that is done when the backend is initialised (see
+ * io_backend_probe()).
+ *
+ * @param optarg Pointer to the string containing the argument for the
+ * '--io-backend' option.
+ * @param options_p Pointer to the options_t struct where the parsed value
+ * should be stored.
+ *
+ * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
+ */
+static int process_io_backend_option(char * optarg, options_t * options_p);
+
+/**
+ * @brief Process the '--simd' command-line option.
+ *
+ * The '--simd' option selects the instruction set of the batched calculation
+ * kernels: "auto", "off", "avx2" or "avx512". An explicit level the CPU does
+ * not support is rejected. Only the requested level is stored; the kernel is
+ * installed at server start (see calc_kernels_select()).
+ *
+ * @param optarg Pointer to the string containing the argument for the
+ * '--simd' option.
+ * @param options_p Pointer to the options_t struct where the parsed value
+ * should be stored.
+ *
+ * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
+ */
+static int process_simd_option(char * optarg, options_t * options_p);
+
+/**
+ * @brief Process the '--metrics-port' command-line option.
+ *
+ * The '--metrics-port' option starts the metrics endpoint (see metrics.h)
+ * on its own port, which must differ from every '-p' port.
+ *
+ * @param optarg Pointer to the string containing the argument for the
+ * '--metrics-port' option.
+ * @param options_p Pointer to the options_t struct where the parsed value
+ * should be stored.
+ *
+ * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
+ */
+static int process_metrics_port_option(char * optarg, options_t * options_p);
+
+/**
+ * @brief Checks that the metrics port is not also a listener port.
+ *
+ * Run after every option has been parsed, since '--metrics-port' may be
+ * given before or after the '-p' options.
+ *
+ * @param options_p Pointer to the parsed options.
+ *
+ * @return E_SUCCESS if the ports are distinct, E_FAILURE otherwise.
+ */
+static int check_metrics_port(options_t * options_p);
+
+/**
+ * @brief Checks that the admission limit fits in the work queue.
+ *
+ * Run after every option has been parsed, since '--max-queue-depth' and
+ * '--queue-depth' may be given in either order. Without '--queue-depth' the
+ * limit must fit in a queue of DEF_QUEUE_DEPTH.
+ *
+ * @param options_p Pointer to the parsed options.
+ *
+ * @return E_SUCCESS if the limits are consistent, E_FAILURE otherwise.
+ */
+static int check_queue_limits(options_t * options_p);
+
+/**
+ * @brief Checks that async execution has the protocol it needs.
+ *
+ * The async loop matches replies to requests by request id, which only the
+ * binary protocol carries, so '--exec-mode async' requires
+ * '--protocol binary'.
+ *
+ * @param options_p Pointer to the parsed options.
+ *
+ * @return E_SUCCESS if the options are consistent, E_FAILURE otherwise.
+ */
+static int check_exec_mode(options_t * options_p);
+
+/**
+ * @brief Checks that '--transport udp' is not given connection options.
+ *
+ * A UDP socket has no connections to accept, keep or hand to an event loop,
+ * and already gets one socket per worker, so the TCP tuning options,
+ * '--reuseport' and '--exec-mode async' do not apply to it.
+ *
+ * @param options_p Pointer to the parsed options.
+ *
+ * @return E_SUCCESS if the options are consistent, E_FAILURE otherwise.
+ */
+static int check_transport(options_t * options_p);
+
+/**
+ * @brief Checks that '--shared-nothing' is not given shared queue options.
+ *
+ * Each shard computes its own requests, so there is no work queue to size,
+ * split or steal from and no thread to hand replies to. Shards frame
+ * requests with the binary protocol and own one TCP listener per port.
+ *
+ * @param options_p Pointer to the parsed options.
+ *
+ * @return E_SUCCESS if the options are consistent, E_FAILURE otherwise.
+ */
+static int check_shared_nothing(options_t * options_p);
+
+/**
+ * @brief Checks that '--io-backend io_uring' is given '--shared-nothing'.
+ *
+ * The shards are the only event loops with an io_uring engine; the accept
+ * thread, the async loop and the datagram loop are built on epoll.
+ *
+ * @param options_p Pointer to the parsed options.
+ *
+ * @return E_SUCCESS if the options are consistent, E_FAILURE otherwise.
+ */
+static int check_io_backend(options_t * options_p);
+
+/**
+ * @brief Checks that '--max-threads' can grow the pool from '-n'.
+ *
+ * Parked workers must not own anything another worker needs, so the
+ * pool cannot adapt when every worker has its own socket: with
+ * '--shared-nothing' or '--transport udp' the worker count stays '-n'.
+ *
+ * @param options_p Pointer to the parsed options.
+ *
+ * @return E_SUCCESS if the options are consistent, E_FAILURE otherwise.
+ */
+static int check_max_threads(options_t * options_p);
+
+/**
+ * @brief Checks that '--pool-slab-count' and '--buffer-size' fit together.
+ *
+ * Every thread may strand a full magazine of free objects in its own cache,
+ * so the slab needs one magazine per worker (up to '--max-threads'), one for
+ * the accepting thread and one left in the depot. The buffers of one pool
+ * may take at most MAX_POOL_BYTES.
+ *
+ * @param options_p Pointer to the parsed options.
+ *
+ * @return E_SUCCESS if the options are consistent, E_FAILURE otherwise.
+ */
+static int check_pool_size(options_t * options_p);
+
+/**
+ * @brief Checks that '--qos-policy' has classes to apply to.
+ *
+ * @param options_p Pointer to the parsed options.
+ *
+ * @return E_SUCCESS if the options are consistent, E_FAILURE otherwise.
+ */
+static int check_qos_policy(options_t * options_p);
+
+/**
+ * @brief Process the '--qos-classes' command-line option.
+ *
+ * @param optarg Pointer to the string containing the argument for the
+ * '--qos-classes' option (see qos_parse_classes()).
+ * @param options_p Pointer to the options_t struct where the parsed value
+ * should be stored.
+ *
+ * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
+ */
+static int process_qos_classes_option(char * optarg, options_t * options_p);
+
+/**
+ * @brief Process the '--takeover' command-line option.
+ *
+ * @param optarg Pointer to the string containing the path of the UNIX
+ * socket the listening sockets are received from and later offered on.
+ * @param options_p Pointer to the options_t struct where the parsed value
+ * should be stored.
+ *
+ * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
+ */
+static int process_takeover_option(char * optarg, options_t * options_p);
+
+/**
+ * @brief Process the '--trace-sample' command-line option.
+ *
+ * The argument is a rate written "1/N": one request in N is traced.
+ *
+ * @param optarg Pointer to the string containing the argument for the
+ * '--trace-sample' option.
+ * @param options_p Pointer to the options_t struct where the parsed value
+ * should be stored.
+ *
+ * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
+ */
+static int process_trace_sample_option(char * optarg, options_t * options_p);
+
+//
+// -------------------------------OPTION TABLE--------------------------------
+//
+
+// Every keyword option is stored in a plain C enum, which is int sized.
+static const option_keyword_t g_numa_policies[] = {
+    { "none", NUMA_POLICY_NONE },
+    { "local", NUMA_POLICY_LOCAL },
+    { "interleave", NUMA_POLICY_INTERLEAVE },
+    { NULL, 0 },
+};
+
+static const option_keyword_t g_queue_modes[] = {
+    { "locked", QUEUE_MODE_LOCKED },
+    { "lockfree", QUEUE_MODE_LOCKFREE },
+    { NULL, 0 },
+};
+
+static const option_keyword_t g_scheduler_modes[] = {
+    { "shared", SCHEDULER_MODE_SHARED },
+    { "work-stealing", SCHEDULER_MODE_WORK_STEALING },
+    { NULL, 0 },
+};
+
+static const option_keyword_t g_protocols[] = {
+    { "text", PROTOCOL_TEXT },
+    { "binary", PROTOCOL_BINARY },
+    { NULL, 0 },
+};
+
+static const option_keyword_t g_transports[] = {
+    { "tcp", TRANSPORT_TCP },
+    { "udp", TRANSPORT_UDP },
+    { NULL, 0 },
+};
+
+static const option_keyword_t g_overload_policies[] = {
+    { "reject", OVERLOAD_POLICY_REJECT },
+    { "shed-oldest", OVERLOAD_POLICY_SHED_OLDEST },
+    { "block-accept", OVERLOAD_POLICY_BLOCK_ACCEPT },
+    { NULL, 0 },
+};
+
+static const option_keyword_t g_exec_modes[] = {
+    { "sync", EXEC_MODE_SYNC },
+    { "async", EXEC_MODE_ASYNC },
+    { NULL, 0 },
+};
+
+static const option_keyword_t g_qos_policies[] = {
+    { "weighted", QOS_POLICY_WEIGHTED },
+    { "strict", QOS_POLICY_STRICT },
+    { NULL, 0 },
+};
+
+// Size of an options_t field, which may be a member of a nested struct
+#define FIELD_SIZE(field) sizeof(((options_t *)NULL)->field)
+
+// Bytes an option's value spans, from the first to the last field it sets
+#define FIELD_SPAN(first, last)                                                \
+    (offsetof(options_t, last) + FIELD_SIZE(last) - offsetof(options_t, first))
+
+#define OPTION_FLAG(short_opt, long_opt, flag)                                 \
+    {                                                                          \
+        .long_name_p = (long_opt), .short_name = (short_opt),                  \
+        .kind = OPTION_KIND_FLAG, .repeatable = true,                          \
+        .flag_offset = offsetof(options_t, flag)                               \
+    }
+
+#define OPTION_HELP(short_opt, long_opt)                                       \
+    {                                                                          \
+        .long_name_p = (long_opt), .short_name = (short_opt),                  \
+        .kind = OPTION_KIND_HELP                                               \
+    }
+
+#define OPTION_INT32(long_opt, flag, field, low, high)                         \
+    {                                                                          \
+        .long_name_p = (long_opt), .kind = OPTION_KIND_INT32,                  \
+        .flag_offset  = offsetof(options_t, flag),                             \
+        .value_offset = offsetof(options_t, field),                            \
+        .value_size = FIELD_SIZE(field), .min = (low), .max = (high)           \
+    }
+
+#define OPTION_KEYWORD(long_opt, flag, field, keywords)                        \
+    {                                                                          \
+        .long_name_p = (long_opt), .kind = OPTION_KIND_KEYWORD,                \
+        .flag_offset  = offsetof(options_t, flag),                             \
+        .value_offset = offsetof(options_t, field),                            \
+        .value_size = FIELD_SIZE(field), .keywords_p = (keywords)              \
+    }
+
+#define OPTION_CUSTOM(short_opt, long_opt, flag, first, last, parser, repeat)  \
+    {                                                                          \
+        .long_name_p = (long_opt), .short_name = (short_opt),                  \
+        .kind = OPTION_KIND_CUSTOM, .repeatable = (repeat),                    \
+        .flag_offset  = offsetof(options_t, flag),                             \
+        .value_offset = offsetof(options_t, first),                            \
+        .value_size = FIELD_SPAN(first, last), .parse = (parser)               \
+    }
+
+/**
+ * Every option accepted on the command line, in a config file or as a
+ * NETCALC_* variable. Adding an option is one entry here (plus its options_t
+ * fields and help text).
+ */
+static const option_spec_t g_option_table[] = {
+    OPTION_CUSTOM('c',
+                  NULL,
+                  c_flag,
+                  c_value,
+                  c_value,
+                  process_c_option,
+                  false),
+    OPTION_CUSTOM('n',
+                  NULL,
+                  n_flag,
+                  n_value,
+                  n_value,
+                  process_n_option,
+                  false),
+    OPTION_CUSTOM('p',
+                  NULL,
+                  p_flag,
+                  p_value,
+                  p_values,
+                  process_p_option,
+                  true),
+    OPTION_INT32("max-threads",
+                 max_threads_flag,
+                 max_threads,
+                 MIN_NUM_THREADS,
+                 MAX_NUM_THREADS),
+    OPTION_CUSTOM('\0',
+                  "cpu-list",
+                  cpu_list_flag,
+                  cpu_list_count,
+                  cpu_list,
+                  process_cpu_list_option,
+                  false),
+    OPTION_KEYWORD(
+        "numa-policy", numa_policy_flag, numa_policy, g_numa_policies),
+    OPTION_INT32("reuseport",
+                 reuseport_flag,
+                 reuseport_value,
+                 MIN_REUSEPORT_LISTENERS,
+                 MAX_REUSEPORT_LISTENERS),
+    OPTION_FLAG('\0', "tcp-nodelay", listen_tuning.tcp_nodelay),
+    OPTION_INT32("busy-poll-us",
+                 busy_poll_flag,
+                 listen_tuning.busy_poll_us,
+                 1,
+                 MAX_BUSY_POLL_US),
+    OPTION_INT32("rcvbuf",
+                 rcvbuf_flag,
+                 listen_tuning.rcvbuf,
+                 MIN_SOCKET_BUFFER,
+                 MAX_SOCKET_BUFFER),
+    OPTION_INT32("sndbuf",
+                 sndbuf_flag,
+                 listen_tuning.sndbuf,
+                 MIN_SOCKET_BUFFER,
+                 MAX_SOCKET_BUFFER),
+    OPTION_INT32("defer-accept",
+                 defer_accept_flag,
+                 listen_tuning.defer_accept_s,
+                 1,
+                 MAX_DEFER_ACCEPT_S),
+    OPTION_INT32(
+        "backlog", backlog_flag, listen_tuning.backlog, 1, MAX_LISTEN_BACKLOG),
+    OPTION_CUSTOM('\0',
+                  "io-backend",
+                  io_backend_flag,
+                  io_backend,
+                  io_backend,
+                  process_io_backend_option,
+                  false),
+    OPTION_KEYWORD("queue", queue_flag, queue_mode, g_queue_modes),
+    OPTION_INT32("queue-depth",
+                 queue_depth_flag,
+                 queue_depth,
+                 MIN_QUEUE_DEPTH,
+                 MAX_QUEUE_DEPTH),
+    OPTION_KEYWORD(
+        "scheduler", scheduler_flag, scheduler_mode, g_scheduler_modes),
+    OPTION_INT32("batch-size",
+                 batch_size_flag,
+                 batch_size,
+                 MIN_BATCH_SIZE,
+                 MAX_BATCH_SIZE),
+    OPTION_INT32("batch-timeout-us",
+                 batch_timeout_flag,
+                 batch_timeout_us,
+                 0,
+                 MAX_BATCH_TIMEOUT_US),
+    OPTION_CUSTOM('\0',
+                  "simd",
+                  simd_flag,
+                  simd_level,
+                  simd_level,
+                  process_simd_option,
+                  false),
+    OPTION_KEYWORD("protocol", protocol_flag, protocol, g_protocols),
+    OPTION_KEYWORD("transport", transport_flag, transport, g_transports),
+    OPTION_INT32("pool-slab-count",
+                 pool_slab_count_flag,
+                 pool_slab_count,
+                 MIN_POOL_SLAB_COUNT,
+                 MAX_POOL_SLAB_COUNT),
+    OPTION_INT32("buffer-size",
+                 buffer_size_flag,
+                 buffer_size,
+                 MIN_BUFFER_SIZE,
+                 MAX_BUFFER_SIZE),
+    OPTION_INT32("cache-entries",
+                 cache_entries_flag,
+                 cache_entries,
+                 0,
+                 MAX_CACHE_ENTRIES),
+    OPTION_CUSTOM('\0',
+                  "metrics-port",
+                  metrics_port_flag,
+                  metrics_port,
+                  metrics_port,
+                  process_metrics_port_option,
+                  false),
+    OPTION_INT32("max-queue-depth",
+                 max_queue_depth_flag,
+                 max_queue_depth,
+                 1,
+                 MAX_QUEUE_DEPTH),
+    OPTION_KEYWORD("overload-policy",
+                   overload_policy_flag,
+                   overload_policy,
+                   g_overload_policies),
+    OPTION_KEYWORD("exec-mode", exec_mode_flag, exec_mode, g_exec_modes),
+    OPTION_FLAG('\0', "shared-nothing", shared_nothing_flag),
+    OPTION_CUSTOM('\0',
+                  "qos-classes",
+                  qos_classes_flag,
+                  qos_class_count,
+                  qos_classes,
+                  process_qos_classes_option,
+                  false),
+    OPTION_KEYWORD(
+        "qos-policy", qos_policy_flag, qos_policy, g_qos_policies),
+    OPTION_CUSTOM('\0',
+                  "takeover",
+                  takeover_flag,
+                  takeover_path,
+                  takeover_path,
+                  process_takeover_option,
+                  false),
+    OPTION_CUSTOM('\0',
+                  "trace-sample",
+                  trace_sample_flag,
+                  trace_sample_every,
+                  trace_sample_every,
+                  process_trace_sample_option,
+                  false),
+    OPTION_FLAG('q', "quiet", quiet_flag),
+    OPTION_HELP('h', "help"),
+};
+
+#define OPTION_COUNT (sizeof(g_option_table) / sizeof(g_option_table[0]))
+
+// Sets of options are held as one bit per table entry
+#define OPTION_BIT(spec_p) ((uint64_t)1 << (size_t)((spec_p)-g_option_table))
+
+_Static_assert(64 >= OPTION_COUNT, "g_option_table outgrew uint64_t sets");
+
+// +---------------------------------------------------------------------------+
+// |                            MAIN OPTION HANDLER                            |
+// +---------------------------------------------------------------------------+
+
+int process_options(int argc, char ** argv, options_t * options_p)
+{
+    int         exit_code  = E_FAILURE;
+    uint64_t    cli_given  = 0;
+    uint64_t    env_given  = 0;
+    char *      path_p     = NULL;
+    char *      env_path_p = NULL;
+    options_t * outer_p    = g_reporting_p;
+
+    if ((NULL == argv) || (NULL == *argv) || (NULL == options_p))
+    {
+        report_error("process_options(): NULL argument passed.");
+        if (NULL != options_p)
+        {
+            record_error(options_p, OPTION_ERROR_INTERNAL, NULL);
+        }
+        goto END;
+    }
+
+    memset(&options_p->error, 0, sizeof(options_p->error));
+    options_p->quiet_flag = (find_quiet_flag(argc, argv) ||
+                             (NULL != getenv(ENV_PREFIX "Q")) ||
+                             (NULL != getenv(ENV_PREFIX "QUIET")));
+    g_reporting_p         = options_p;
+
+    // Anything wrong with the command line itself is reported where it goes
+    // wrong, exactly as without the other sources.
+    if (E_SUCCESS != scan_command_line(argc, argv, &cli_given, &path_p))
+    {
+        exit_code = apply_command_line(argc, argv, options_p);
+        goto END;
+    }
+
+    if (E_SUCCESS != scan_environment(&env_given, &env_path_p))
+    {
+        record_error(options_p, OPTION_ERROR_SOURCE, ENV_PREFIX "*");
+        goto END;
+    }
+    options_p->pinned_set = cli_given | env_given;
+
+    // The config file is named on the command line or, failing that, in
+    // the environment (NETCALC_C).
+    if (NULL == path_p)
+    {
+        path_p = env_path_p;
+    }
+
+    // Lowest precedence first. An option given by a source replaces every
+    // value of that option from the sources below it, so each source skips
+    // the options given above it.
+    if ((NULL != path_p) &&
+        (E_SUCCESS != apply_file(path_p, options_p, options_p->pinned_set)))
+    {
+        goto END;
+    }
+
+    if (E_SUCCESS != apply_environment(options_p, cli_given))
+    {
+        goto END;
+    }
+
+    if (E_SUCCESS != apply_command_line(argc, argv, options_p))
+    {
+        goto END;
+    }
+
+    exit_code = check_conflicts(options_p);
+
+END:
+    g_reporting_p = outer_p;
+
+    if ((E_SUCCESS != exit_code) && (NULL != options_p))
+    {
+        report_failure(options_p, true);
+    }
+    return exit_code;
+}
+
+int options_parse_command_line(int                    argc,
+                               char **                argv,
+                               const char * const *   names_pp,
+                               const option_extra_t * extras_p,
+                               void *                 context_p,
+                               options_t *            options_p)
+{
+    int                   exit_code                = E_FAILURE;
+    option_cursor_t       cursor                   = { 0 };
+    option_status_t       status                   = OPTION_FOUND;
+    const option_spec_t * spec_p                   = NULL;
+    char *                value_p                  = NULL;
+    const char *          reason_p                 = NULL;
+    options_t *           outer_p                  = g_reporting_p;
+    char                  name[MAX_OPTION_NAME]    = { 0 };
+    char                  message[MAX_REPORT_SIZE] = { 0 };
+
+    if ((NULL == argv) || (NULL == *argv) || (NULL == names_pp) ||
+        (NULL == options_p))
+    {
+        report_error("options_parse_command_line(): NULL argument passed.");
+        if (NULL != options_p)
+        {
+            record_error(options_p, OPTION_ERROR_INTERNAL, NULL);
+        }
+        goto END;
+    }
+
+    memset(&options_p->error, 0, sizeof(options_p->error));
+    g_reporting_p = options_p;
+
+    cursor.argc     = argc;
+    cursor.argv     = argv;
+    cursor.index    = 1;
+    cursor.extras_p = extras_p;
+    for (const char * const * name_pp = names_pp; NULL != *name_pp; name_pp++)
+    {
+        spec_p = find_named_option(*name_pp, strlen(*name_pp));
+        if (NULL == spec_p)
+        {
+            report_error("options_parse_command_line(): Unknown option name.");
+            record_error(options_p, OPTION_ERROR_INTERNAL, *name_pp);
+            goto END;
+        }
+        cursor.allowed |= OPTION_BIT(spec_p);
+    }
+
+    spec_p                = find_short_option('q');
+    options_p->quiet_flag = ((0 != (cursor.allowed & OPTION_BIT(spec_p))) &&
+                             find_quiet_flag(argc, argv));
+
+    for (;;)
+    {
+        status = next_option(&cursor, &spec_p, &value_p);
+        if (OPTION_DONE == status)
+        {
+            break;
+        }
+
+        if (OPTION_FOUND != status)
+        {
+            report_invalid_option(&cursor, status, options_p);
+            goto END;
+        }
+
+        if (NULL != spec_p)
+        {
+            if (E_SUCCESS != apply_option(spec_p, value_p, options_p))
+            {
+                goto END;
+            }
+            continue;
+        }
+
+        reason_p = NULL;
+        if (E_SUCCESS != cursor.extra_p->parse(value_p, context_p, &reason_p))
+        {
+            snprintf(name, sizeof(name), "--%s", cursor.extra_p->long_name_p);
+            snprintf(message,
+                     sizeof(message),
+                     "Invalid '%s' value: %s.",
+                     name,
+                     (NULL == reason_p) ? "rejected" : reason_p);
+            report_error(message);
+            record_error(options_p, OPTION_ERROR_INVALID_VALUE, name);
+            goto END;
+        }
+    }
+
+    if (0 < cursor.operand_count)
+    {
+        report_extra_arguments(&cursor, options_p);
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    g_reporting_p = outer_p;
+
+    // The caller has its own help menu
+    if ((E_SUCCESS != exit_code) && (NULL != options_p))
+    {
+        report_failure(options_p, false);
+    }
+    return exit_code;
+}
+
+static void report_failure(options_t * options_p, bool show_help)
+{
+    if ((true == options_p->quiet_flag) &&
+        (OPTION_ERROR_NONE != options_p->error.code))
+    {
+        fprintf(stderr,
+                "netcalc: error=%s code=%d option=%s message=\"%s\"\n",
+                options_error_string(options_p->error.code),
+                (int)options_p->error.code,
+                ('\0' == options_p->error.option[0]) ? "-"
+                                                     : options_p->error.option,
+                options_p->error.message);
+    }
+    else if (true == show_help)
+    {
+        print_help_menu();
+    }
+}
+
+const char * options_error_string(option_error_t code)
+{
+    switch (code)
+    {
+        case OPTION_ERROR_NONE:
+            return "none";
+        case OPTION_ERROR_UNKNOWN_OPTION:
+            return "unknown-option";
+        case OPTION_ERROR_MISSING_ARGUMENT:
+            return "missing-argument";
+        case OPTION_ERROR_INVALID_VALUE:
+            return "invalid-value";
+        case OPTION_ERROR_CONFLICT:
+            return "conflict";
+        case OPTION_ERROR_EXTRA_ARGUMENT:
+            return "extra-argument";
+        case OPTION_ERROR_SOURCE:
+            return "bad-source";
+        default:
+            return "internal";
+    }
+}
+
+int options_load_file(const char * path_p, options_t * options_p)
+{
+    int         exit_code = E_FAILURE;
+    options_t * outer_p   = g_reporting_p;
+
+    if ((NULL == path_p) || (NULL == options_p))
+    {
+        report_error("options_load_file(): NULL argument passed.");
+        goto END;
+    }
+
+    memset(&options_p->error, 0, sizeof(options_p->error));
+    g_reporting_p = options_p;
+
+    exit_code = apply_file(path_p, options_p, options_p->pinned_set);
+
+END:
+    g_reporting_p = outer_p;
+    return exit_code;
+}
+
+int options_check(options_t * options_p)
+{
+    int         exit_code = E_FAILURE;
+    options_t * outer_p   = g_reporting_p;
+
+    if (NULL == options_p)
+    {
+        report_error("options_check(): NULL argument passed.");
+        goto END;
+    }
+
+    memset(&options_p->error, 0, sizeof(options_p->error));
+    g_reporting_p = options_p;
+
+    exit_code = check_conflicts(options_p);
+
+END:
+    g_reporting_p = outer_p;
+    return exit_code;
+}
+
+options_t * options_clone(const options_t * options_p)
+{
+    options_t * clone_p = NULL;
+
+    if (NULL == options_p)
+    {
+        report_error("options_clone(): NULL argument passed.");
+        goto END;
+    }
+
+    clone_p = malloc(sizeof(*clone_p));
+    if (NULL == clone_p)
+    {
+        report_error("options_clone(): malloc() failed.");
+        goto END;
+    }
+
+    // options_t holds no pointers, so a flat copy is a complete snapshot
+    memcpy(clone_p, options_p, sizeof(*clone_p));
+
+END:
+    return clone_p;
+}
+
+void options_destroy(options_t ** options_pp)
+{
+    if ((NULL == options_pp) || (NULL == *options_pp))
+    {
+        return;
+    }
+
+    free(*options_pp);
+    *options_pp = NULL;
+}
+
+bool options_find_difference(const options_t * given_p,
+                             const options_t * current_p,
+                             char *            name_p,
+                             size_t            size)
+{
+    bool                  found     = false;
+    bool                  given     = false;
+    const char *          given_b   = (const char *)given_p;
+    const char *          current_b = (const char *)current_p;
+    const option_spec_t * spec_p    = NULL;
+
+    if ((NULL == given_p) || (NULL == current_p) || (NULL == name_p) ||
+        (0 == size))
+    {
+        report_error("options_find_difference(): NULL argument passed.");
+        goto END;
+    }
+
+    for (size_t idx = 0; (false == found) && (idx < OPTION_COUNT); idx++)
+    {
+        spec_p = &g_option_table[idx];
+        if (OPTION_KIND_HELP == spec_p->kind)
+        {
+            continue;
+        }
+
+        given = *(const bool *)(given_b + spec_p->flag_offset);
+        if (false == given)
+        {
+            continue;
+        }
+
+        // A flag option is its bool; every other option also has a value
+        found = ((given != *(const bool *)(current_b + spec_p->flag_offset)) ||
+                 (0 != memcmp(given_b + spec_p->value_offset,
+                              current_b + spec_p->value_offset,
+                              spec_p->value_size)));
+        if (true == found)
+        {
+            option_name(spec_p, name_p, size);
+        }
+    }
+
+END:
+    return found;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int process_c_option(char * optarg, options_t * options_p)
+{
+    int exit_code = E_FAILURE;
+
+    if ((NULL == optarg) || (NULL == options_p))
+    {
+        report_error("NULL argument passed.");
+        goto END;
+    }
+
+    if (MAX_CONFIG_PATH <= strnlen(optarg, MAX_CONFIG_PATH))
+    {
+        report_error("process_options(): Config file path is too long.");
+        goto END;
+    }
+
+    strncpy(options_p->c_value, optarg, MAX_CONFIG_PATH - 1);
+    options_p->c_flag = true;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int process_n_option(char * optarg, options_t * options_p)
+{
+    int     exit_code   = E_FAILURE;
+    int32_t num_threads = 0;
+
+    if ((NULL == optarg) || (NULL == options_p))
+    {
+        report_error("NULL argument passed.");
+        goto END;
+    }
+
+    if (0 == strncmp(optarg, AUTO_KEYWORD, AUTO_KEYWORD_LEN))
+    {
+        exit_code = resolve_auto_threads(optarg, &num_threads);
+        if (E_SUCCESS != exit_code)
+        {
+            report_error("process_options(): Unable to resolve '-n auto'.");
+            goto END;
+        }
+    }
+    else
+    {
+        // Convert string to integer
+        exit_code = number_parse_int32_str(optarg, &num_threads);
+        if (E_SUCCESS != exit_code)
+        {
+            report_error("Unable to convert 'n_value' to number.");
+
+            goto END;
+        }
+    }
+
+    if (MIN_NUM_THREADS > num_threads)
+    {
+        report_error("process_options(): Number of threads must be 2 or more.");
+
+        exit_code = E_FAILURE;
+        goto END;
+    }
+
+    options_p->n_flag  = true;
+    options_p->n_value = num_threads;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int resolve_auto_threads(char * optarg, int32_t * num_threads_p)
+{
+    int     exit_code                         = E_FAILURE;
+    int32_t cpu_count                         = 0;
+    int32_t num_threads                       = 0;
+    int32_t percent                           = MAX_AUTO_PERCENT;
+    char    digits[MAX_AUTO_PERCENT_SIZE + 1] = { 0 };
+    char *  suffix_p                          = NULL;
+    size_t  suffix_len                        = 0;
+
+    if ((NULL == optarg) || (NULL == num_threads_p))
+    {
+        report_error("NULL argument passed.");
+        goto END;
+    }
+
+    suffix_p = optarg + AUTO_KEYWORD_LEN;
+    if ('\0' != *suffix_p)
+    {
+        // Expect exactly ":N%", e.g. "auto:50%"
+        suffix_len = strnlen(suffix_p, MAX_AUTO_PERCENT_SIZE + 3);
+        if ((AUTO_PERCENT_PREFIX != suffix_p[0]) || (3 > suffix_len) ||
+            ((MAX_AUTO_PERCENT_SIZE + 2) < suffix_len) ||
+            ('%' != suffix_p[suffix_len - 1]))
+        {
+            report_error("resolve_auto_threads(): Expected 'auto[:N%]'.");
+            goto END;
+        }
+
+        memcpy(digits, suffix_p + 1, suffix_len - 2);
+        exit_code = number_parse_int32_str(digits, &percent);
+        if (E_SUCCESS != exit_code)
+        {
+            report_error("resolve_auto_threads(): Unable to convert percent.");
+            goto END;
+        }
+
+        exit_code = E_FAILURE;
+        if ((MIN_AUTO_PERCENT > percent) || (MAX_AUTO_PERCENT < percent))
+        {
+            report_error("resolve_auto_threads(): Percentage out of range.");
+            goto END;
+        }
+    }
+
+    exit_code = cpu_topology_available_cpus(&cpu_count);
+    if (E_SUCCESS != exit_code)
+    {
+        report_error("resolve_auto_threads(): Unable to determine CPU count.");
+        goto END;
+    }
+
+    // Round up so that small percentages of small machines still get a CPU
+    num_threads =
+        ((cpu_count * percent) + (MAX_AUTO_PERCENT - 1)) / MAX_AUTO_PERCENT;
+    if (MIN_NUM_THREADS > num_threads)
+    {
+        num_threads = MIN_NUM_THREADS;
+    }
+
+    *num_threads_p = num_threads;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int process_cpu_list_option(char * optarg, options_t * options_p)
+{
+    int          exit_code                = E_FAILURE;
+    const char * reason_p                 = "invalid";
+    char         message[MAX_REPORT_SIZE] = { 0 };
+
+    if ((NULL == optarg) || (NULL == options_p))
+    {
+        report_error("NULL argument passed.");
+        goto END;
+    }
+
+    exit_code = cpu_topology_parse_cpu_list(optarg,
+                                            options_p->cpu_list,
+                                            MAX_CPU_LIST_SIZE,
+                                            &options_p->cpu_list_count,
+                                            &reason_p);
+    if (E_SUCCESS != exit_code)
+    {
+        snprintf(message,
+                 sizeof(message),
+                 "process_options(): Invalid CPU list: %s.",
+                 reason_p);
+        report_error(message);
+        goto END;
+    }
+
+    options_p->cpu_list_flag = true;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int process_p_option(char * optarg, options_t * options_p)
+{
+    int      exit_code     = E_FAILURE;
+    int32_t  port_number   = 0;
+    int32_t  existing      = 0;
+    size_t   optarg_length = 0;
+
+    if ((NULL == optarg) || (NULL == options_p))
+    {
+        report_error("NULL argument passed.");
+        goto END;
+    }
+
+    if (MAX_LISTEN_PORTS <= options_p->p_count)
+    {
+        report_error("process_p_option(): Too many '-p' options.");
+        goto END;
+    }
+
+    // Convert string to integer and check range
+    exit_code = number_parse_int32_str(optarg, &port_number);
+    if (E_SUCCESS != exit_code)
+    {
+        report_error(
+            "process_p_option(): Unable to convert 'p_value' to number.");
+        goto END;
+    }
+    if ((MAX_PORT_VALUE < port_number) || (MIN_PORT_VALUE > port_number))
+    {
+        report_error("process_p_option(): Port number out of range.");
+        exit_code = E_FAILURE;
+        goto END;
+    }
+
+    // Calculate string length; MAX_PORT_SIZE includes the stored NUL
+    optarg_length = strnlen(optarg, MAX_PORT_SIZE);
+    if (MAX_PORT_SIZE <= optarg_length)
+    {
+        report_error("process_p_option(): Port string is too long.");
+        exit_code = E_FAILURE;
+        goto END;
+    }
+
+    // Compare numerically so that "8080" and "08080" are the same port
+    for (size_t idx = 0; idx < options_p->p_count; idx++)
+    {
+        if ((E_SUCCESS ==
+             number_parse_int32_str(options_p->p_values[idx], &existing)) &&
+            (existing == port_number))
+        {
+            report_error("process_p_option(): Port given more than once.");
+            exit_code = E_FAILURE;
+            goto END;
+        }
+    }
+
+    // Copy rather than point into argv so options_t stays self-contained
+    if (false == options_p->p_flag)
+    {
+        memcpy(options_p->p_value, optarg, optarg_length + 1);
+    }
+    memcpy(options_p->p_values[options_p->p_count], optarg, optarg_length + 1);
+    options_p->p_count++;
+    options_p->p_flag = true;
+
+    exit_code = E_SUCCESS;
+
+END:
+    return exit_code;
+}
+
+static int process_io_backend_option(char * optarg, options_t * options_p)
+{
+    int  exit_code                = E_FAILURE;
+    char message[MAX_REPORT_SIZE] = { 0 };
+
+    if ((NULL == optarg) || (NULL == options_p))
+    {
+        report_error("NULL argument passed.");
+        goto END;
+    }
+
+    exit_code = io_backend_from_string(optarg, &options_p->io_backend);
+    if (E_SUCCESS != exit_code)
+    {
+        snprintf(message,
+                 sizeof(message),
+                 "process_options(): Unknown '--io-backend' value '%s'.",
+                 optarg);
+        report_error(message);
+        goto END;
+    }
+
+    options_p->io_backend_flag = true;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int process_simd_option(char * optarg, options_t * options_p)
+{
+    int          exit_code                = E_FAILURE;
+    simd_level_t requested                = SIMD_LEVEL_AUTO;
+    char         message[MAX_REPORT_SIZE] = { 0 };
+
+    if ((NULL == optarg) || (NULL == options_p))
+    {
+        report_error("NULL argument passed.");
+        goto END;
+    }
+
+    exit_code = calc_kernels_level_from_string(optarg, &requested);
+    if (E_SUCCESS != exit_code)
+    {
+        snprintf(message,
+                 sizeof(message),
+                 "process_options(): Unknown '--simd' value '%s'.",
+                 optarg);
+        report_error(message);
+        goto END;
+    }
+
+    if (false == calc_kernels_level_supported(requested))
+    {
+        report_error("process_options(): '--simd' level not supported by "
+                     "this CPU.");
+        exit_code = E_FAILURE;
+        goto END;
+    }
+
+    options_p->simd_level = requested;
+    options_p->simd_flag  = true;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int process_metrics_port_option(char * optarg, options_t * options_p)
+{
+    int      exit_code     = E_FAILURE;
+    int32_t  port_number   = 0;
+    size_t   optarg_length = 0;
+
+    if ((NULL == optarg) || (NULL == options_p))
+    {
+        report_error("NULL argument passed.");
+        goto END;
+    }
+
+    exit_code = number_parse_int32_str(optarg, &port_number);
+    if (E_SUCCESS != exit_code)
+    {
+        report_error("Unable to convert 'metrics_port' to number.");
+        goto END;
+    }
+
+    if ((MAX_PORT_VALUE < port_number) || (MIN_PORT_VALUE > port_number))
+    {
+        report_error("process_options(): Metrics port out of range.");
+        exit_code = E_FAILURE;
+        goto END;
+    }
+
+    optarg_length = strnlen(optarg, MAX_PORT_SIZE);
+    if (MAX_PORT_SIZE <= optarg_length)
+    {
+        report_error("process_options(): Metrics port string is too long.");
+        exit_code = E_FAILURE;
+        goto END;
+    }
+
+    memcpy(options_p->metrics_port, optarg, optarg_length + 1);
+    options_p->metrics_port_flag = true;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int check_metrics_port(options_t * options_p)
+{
+    int     exit_code    = E_FAILURE;
+    int32_t metrics_port = 0;
+    int32_t listen_port  = 0;
+
+    if (false == options_p->metrics_port_flag)
+    {
+        exit_code = E_SUCCESS;
+        goto END;
+    }
+
+    if (E_SUCCESS !=
+        number_parse_int32_str(options_p->metrics_port, &metrics_port))
+    {
+        goto END;
+    }
+
+    for (size_t idx = 0; idx < options_p->p_count; idx++)
+    {
+        if ((E_SUCCESS ==
+             number_parse_int32_str(options_p->p_values[idx], &listen_port)) &&
+            (listen_port == metrics_port))
+        {
+            report_error(
+                "process_options(): '--metrics-port' is also a '-p' port.");
+            goto END;
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int check_queue_limits(options_t * options_p)
+{
+    int     exit_code = E_FAILURE;
+    int32_t depth     = (true == options_p->queue_depth_flag)
+                            ? options_p->queue_depth
+                            : DEF_QUEUE_DEPTH;
+
+    if ((true == options_p->max_queue_depth_flag) &&
+        (options_p->max_queue_depth > depth))
+    {
+        report_error("process_options(): '--max-queue-depth' exceeds "
+                     "'--queue-depth'.");
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int check_exec_mode(options_t * options_p)
+{
+    int exit_code = E_FAILURE;
+
+    if ((EXEC_MODE_ASYNC == options_p->exec_mode) &&
+        (PROTOCOL_BINARY != options_p->protocol))
+    {
+        report_error("process_options(): '--exec-mode async' requires "
+                     "'--protocol binary'.");
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int check_transport(options_t * options_p)
+{
+    int          exit_code                = E_FAILURE;
+    char         message[MAX_REPORT_SIZE] = { 0 };
+    const char * name_p                   = NULL;
+
+    if (TRANSPORT_UDP != options_p->transport)
+    {
+        exit_code = E_SUCCESS;
+        goto END;
+    }
+
+    if (EXEC_MODE_ASYNC == options_p->exec_mode)
+    {
+        name_p = "--exec-mode async";
+    }
+    else if (true == options_p->reuseport_flag)
+    {
+        name_p = "--reuseport";
+    }
+    else if (true == options_p->listen_tuning.tcp_nodelay)
+    {
+        name_p = "--tcp-nodelay";
+    }
+    else if (true == options_p->defer_accept_flag)
+    {
+        name_p = "--defer-accept";
+    }
+    else if (true == options_p->backlog_flag)
+    {
+        name_p = "--backlog";
+    }
+
+    if (NULL != name_p)
+    {
+        snprintf(message,
+                 sizeof(message),
+                 "process_options(): '%s' does not apply to '--transport "
+                 "udp'.",
+                 name_p);
+        report_error(message);
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int check_shared_nothing(options_t * options_p)
+{
+    int          exit_code                = E_FAILURE;
+    char         message[MAX_REPORT_SIZE] = { 0 };
+    const char * name_p                   = NULL;
+
+    if (false == options_p->shared_nothing_flag)
+    {
+        exit_code = E_SUCCESS;
+        goto END;
+    }
+
+    if (PROTOCOL_BINARY != options_p->protocol)
+    {
+        report_error("process_options(): '--shared-nothing' requires "
+                     "'--protocol binary'.");
+        goto END;
+    }
+
+    if (EXEC_MODE_ASYNC == options_p->exec_mode)
+    {
+        name_p = "--exec-mode async";
+    }
+    else if (SCHEDULER_MODE_WORK_STEALING == options_p->scheduler_mode)
+    {
+        name_p = "--scheduler work-stealing";
+    }
+    else if (true == options_p->queue_flag)
+    {
+        name_p = "--queue";
+    }
+    else if (true == options_p->queue_depth_flag)
+    {
+        name_p = "--queue-depth";
+    }
+    else if (true == options_p->max_queue_depth_flag)
+    {
+        name_p = "--max-queue-depth";
+    }
+    else if (true == options_p->qos_classes_flag)
+    {
+        name_p = "--qos-classes";
+    }
+    else if (true == options_p->reuseport_flag)
+    {
+        name_p = "--reuseport";
+    }
+    else if (TRANSPORT_UDP == options_p->transport)
+    {
+        name_p = "--transport udp";
+    }
+
+    if (NULL != name_p)
+    {
+        snprintf(message,
+                 sizeof(message),
+                 "process_options(): '%s' does not apply to "
+                 "'--shared-nothing'.",
+                 name_p);
+        report_error(message);
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int check_io_backend(options_t * options_p)
+{
+    int exit_code = E_FAILURE;
+
+    if ((IO_BACKEND_IO_URING == options_p->io_backend) &&
+        (false == options_p->shared_nothing_flag))
+    {
+        report_error("process_options(): '--io-backend io_uring' requires "
+                     "'--shared-nothing'.");
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int check_max_threads(options_t * options_p)
+{
+    int     exit_code   = E_FAILURE;
+    int32_t min_threads = DEF_NUM_THREADS;
+
+    if (false == options_p->max_threads_flag)
+    {
+        exit_code = E_SUCCESS;
+        goto END;
+    }
+
+    if (true == options_p->n_flag)
+    {
+        min_threads = options_p->n_value;
+    }
+
+    if (options_p->max_threads < min_threads)
+    {
+        report_error("process_options(): '--max-threads' is below '-n'.");
+        goto END;
+    }
+
+    if (true == options_p->shared_nothing_flag)
+    {
+        report_error("process_options(): '--max-threads' does not apply to "
+                     "'--shared-nothing'.");
+        goto END;
+    }
+
+    if (TRANSPORT_UDP == options_p->transport)
+    {
+        report_error("process_options(): '--max-threads' does not apply to "
+                     "'--transport udp'.");
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int check_pool_size(options_t * options_p)
+{
+    int     exit_code                = E_FAILURE;
+    int32_t threads                  = DEF_NUM_THREADS;
+    int64_t min_count                = 0;
+    char    message[MAX_REPORT_SIZE] = { 0 };
+
+    if (false == options_p->pool_slab_count_flag)
+    {
+        exit_code = E_SUCCESS;
+        goto END;
+    }
+
+    if (true == options_p->n_flag)
+    {
+        threads = options_p->n_value;
+    }
+    if ((true == options_p->max_threads_flag) &&
+        (options_p->max_threads > threads))
+    {
+        threads = options_p->max_threads;
+    }
+
+    min_count = ((int64_t)threads + POOL_SPARE_CACHES) *
+                OBJECT_POOL_MAGAZINE_SIZE;
+    if (options_p->pool_slab_count < min_count)
+    {
+        snprintf(message,
+                 sizeof(message),
+                 "process_options(): '--pool-slab-count' must be at least "
+                 "%lld for %d threads.",
+                 (long long)min_count,
+                 (int)threads);
+        report_error(message);
+        goto END;
+    }
+
+    if ((true == options_p->buffer_size_flag) &&
+        (((int64_t)options_p->pool_slab_count * options_p->buffer_size) >
+         MAX_POOL_BYTES))
+    {
+        report_error("process_options(): '--pool-slab-count' buffers of "
+                     "'--buffer-size' exceed 4 GiB.");
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int check_qos_policy(options_t * options_p)
+{
+    int exit_code = E_FAILURE;
+
+    if ((true == options_p->qos_policy_flag) &&
+        (false == options_p->qos_classes_flag))
+    {
+        report_error("process_options(): '--qos-policy' requires "
+                     "'--qos-classes'.");
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int process_qos_classes_option(char * optarg, options_t * options_p)
+{
+    int          exit_code                = E_FAILURE;
+    const char * reason_p                 = "invalid";
+    char         message[MAX_REPORT_SIZE] = { 0 };
+
+    if ((NULL == optarg) || (NULL == options_p))
+    {
+        report_error("NULL argument passed.");
+        goto END;
+    }
+
+    exit_code = qos_parse_classes(optarg,
+                                  options_p->qos_classes,
+                                  QOS_MAX_CLASSES,
+                                  &options_p->qos_class_count,
+                                  &reason_p);
+    if (E_SUCCESS != exit_code)
+    {
+        snprintf(message,
+                 sizeof(message),
+                 "process_options(): Invalid QoS class list: %s.",
+                 reason_p);
+        report_error(message);
+        goto END;
+    }
+
+    options_p->qos_classes_flag = true;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int process_takeover_option(char * optarg, options_t * options_p)
+{
+    int    exit_code = E_FAILURE;
+    size_t length    = 0;
+
+    if ((NULL == optarg) || (NULL == options_p))
+    {
+        report_error("NULL argument passed.");
+        goto END;
+    }
+
+    length = strnlen(optarg, MAX_TAKEOVER_PATH);
+    if (0 == length)
+    {
+        report_error("process_options(): Takeover path is empty.");
+        goto END;
+    }
+
+    if (MAX_TAKEOVER_PATH <= length)
+    {
+        report_error("process_options(): Takeover path is too long.");
+        goto END;
+    }
+
+    memcpy(options_p->takeover_path, optarg, length + 1);
+    options_p->takeover_flag = true;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int process_trace_sample_option(char * optarg, options_t * options_p)
+{
+    int     exit_code = E_FAILURE;
+    int32_t every     = 0;
+
+    if ((NULL == optarg) || (NULL == options_p))
+    {
+        report_error("NULL argument passed.");
+        goto END;
+    }
+
+    if (0 != strncmp(optarg, TRACE_RATE_PREFIX, TRACE_RATE_PREFIX_LEN))
+    {
+        report_error("process_options(): Trace rate must be written '1/N'.");
+        goto END;
+    }
+
+    exit_code =
+        number_parse_int32_str(optarg + TRACE_RATE_PREFIX_LEN, &every);
+    if ((E_SUCCESS != exit_code) || (1 > every) ||
+        (MAX_TRACE_SAMPLE < every))
+    {
+        report_error("process_options(): Trace rate out of range.");
+        exit_code = E_FAILURE;
+        goto END;
+    }
+
+    options_p->trace_sample_every = every;
+    options_p->trace_sample_flag  = true;
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static option_status_t next_option(option_cursor_t *      cursor_p,
+                                   const option_spec_t ** spec_pp,
+                                   char **                value_pp)
+{
+    char *                 arg_p       = NULL;
+    const option_spec_t *  spec_p      = NULL;
+    const option_extra_t * extra_p     = NULL;
+    size_t                 name_len    = 0;
+    bool                   inline_v    = false;
+    bool                   takes_value = false;
+
+    *spec_pp          = NULL;
+    *value_pp         = NULL;
+    cursor_p->extra_p = NULL;
+
+    // Step over non-option arguments, counting them for
+    // report_extra_arguments()
+    while ((NULL == cursor_p->cluster_p) && (cursor_p->index < cursor_p->argc))
+    {
+        arg_p = cursor_p->argv[cursor_p->index];
+        if (NULL == arg_p)
+        {
+            cursor_p->index = cursor_p->argc;
+            break;
+        }
+
+        if ((false == cursor_p->operands_only) && (0 == strcmp(arg_p, "--")))
+        {
+            cursor_p->operands_only = true;
+        }
+        else if ((true == cursor_p->operands_only) || ('-' != arg_p[0]) ||
+                 ('\0' == arg_p[1]))
+        {
+            if (0 == cursor_p->operand_count)
+            {
+                cursor_p->operand_p = arg_p;
+            }
+            cursor_p->operand_count++;
+        }
+        else
+        {
+            break;
+        }
+        cursor_p->index++;
+    }
+
+    if ((NULL == cursor_p->cluster_p) && (cursor_p->index >= cursor_p->argc))
+    {
+        return OPTION_DONE;
+    }
+
+    if (NULL == cursor_p->cluster_p)
+    {
+        arg_p = cursor_p->argv[cursor_p->index++];
+
+        if ('-' != arg_p[1])
+        {
+            cursor_p->cluster_p = arg_p + 1;
+        }
+        else
+        {
+            // "--name", "--name=value" or "--name value"
+            name_len = strcspn(arg_p, "=");
+            inline_v = ('=' == arg_p[name_len]);
+            snprintf(cursor_p->name,
+                     sizeof(cursor_p->name),
+                     "%.*s",
+                     (int)name_len,
+                     arg_p);
+
+            spec_p  = find_long_option(
+                arg_p + 2, name_len - 2, true, cursor_p->allowed);
+            extra_p = find_extra_option(
+                cursor_p->extras_p, arg_p + 2, name_len - 2);
+
+            // A prefix of names in both sets needs one of them exactly
+            if ((NULL != spec_p) && (NULL != extra_p))
+            {
+                if ('\0' == extra_p->long_name_p[name_len - 2])
+                {
+                    spec_p = NULL;
+                }
+                else if ('\0' == spec_p->long_name_p[name_len - 2])
+                {
+                    extra_p = NULL;
+                }
+                else
+                {
+                    return OPTION_UNKNOWN;
+                }
+            }
+
+            if (NULL != extra_p)
+            {
+                cursor_p->extra_p = extra_p;
+                takes_value       = extra_p->has_value;
+            }
+            else if (NULL != spec_p)
+            {
+                *spec_pp    = spec_p;
+                takes_value = ((OPTION_KIND_FLAG != spec_p->kind) &&
+                               (OPTION_KIND_HELP != spec_p->kind));
+            }
+            else
+            {
+                return OPTION_UNKNOWN;
+            }
+
+            if (false == takes_value)
+            {
+                return (true == inline_v) ? OPTION_UNEXPECTED_VALUE
+                                          : OPTION_FOUND;
+            }
+
+            if (true == inline_v)
+            {
+                *value_pp = arg_p + name_len + 1;
+                return OPTION_FOUND;
+            }
+
+            goto NEXT_ARGUMENT;
+        }
+    }
+
+    // One letter of "-n", "-n8" or "-qn 8"
+    snprintf(cursor_p->name,
+             sizeof(cursor_p->name),
+             "-%c",
+             *cursor_p->cluster_p);
+    spec_p = find_short_option(*cursor_p->cluster_p);
+    if ((NULL != spec_p) && (0 == (cursor_p->allowed & OPTION_BIT(spec_p))))
+    {
+        spec_p = NULL;
+    }
+    cursor_p->cluster_p++;
+    if ('\0' == *cursor_p->cluster_p)
+    {
+        cursor_p->cluster_p = NULL;
+    }
+
+    if (NULL == spec_p)
+    {
+        cursor_p->cluster_p = NULL;
+        return OPTION_UNKNOWN;
+    }
+    *spec_pp = spec_p;
+
+    if ((OPTION_KIND_FLAG == spec_p->kind) ||
+        (OPTION_KIND_HELP == spec_p->kind))
+    {
+        return OPTION_FOUND;
+    }
+
+    // The rest of the group is the value
+    if (NULL != cursor_p->cluster_p)
+    {
+        *value_pp           = cursor_p->cluster_p;
+        cursor_p->cluster_p = NULL;
+        return OPTION_FOUND;
+    }
+
+NEXT_ARGUMENT:
+    if ((cursor_p->index >= cursor_p->argc) ||
+        (NULL == cursor_p->argv[cursor_p->index]))
+    {
+        return OPTION_NO_VALUE;
+    }
+
+    *value_pp = cursor_p->argv[cursor_p->index++];
+    return OPTION_FOUND;
+}
+
+static const option_spec_t * find_short_option(char short_name)
+{
+    for (size_t idx = 0; ('\0' != short_name) && (idx < OPTION_COUNT); idx++)
+    {
+        if (short_name == g_option_table[idx].short_name)
+        {
+            return &g_option_table[idx];
+        }
+    }
+
+    return NULL;
+}
+
+static const option_spec_t * find_long_option(const char * name_p,
+                                              size_t       length,
+                                              bool         abbreviated,
+                                              uint64_t     allowed)
+{
+    const option_spec_t * match_p   = NULL;
+    bool                  ambiguous = false;
+    const char *          long_p    = NULL;
+
+    for (size_t idx = 0; idx < OPTION_COUNT; idx++)
+    {
+        long_p = g_option_table[idx].long_name_p;
+        if ((0 == (allowed & OPTION_BIT(&g_option_table[idx]))) ||
+            (NULL == long_p) || (0 != strncmp(long_p, name_p, length)))
+        {
+            continue;
+        }
+
+        // An exact match wins over any longer name it is a prefix of
+        if ('\0' == long_p[length])
+        {
+            return &g_option_table[idx];
+        }
+
+        if (true == abbreviated)
+        {
+            ambiguous = (NULL != match_p);
+            match_p   = &g_option_table[idx];
+        }
+    }
+
+    return ((0 == length) || (true == ambiguous)) ? NULL : match_p;
+}
+
+static const option_spec_t * find_named_option(const char * name_p,
+                                               size_t       length)
+{
+    if (1 == length)
+    {
+        return find_short_option(name_p[0]);
+    }
+
+    return find_long_option(name_p, length, false, OPTION_SET_ALL);
+}
+
+static const option_extra_t * find_extra_option(
+    const option_extra_t * extras_p, const char * name_p, size_t length)
+{
+    const option_extra_t * match_p   = NULL;
+    bool                   ambiguous = false;
+
+    for (const option_extra_t * extra_p = extras_p;
+         (NULL != extra_p) && (NULL != extra_p->long_name_p);
+         extra_p++)
+    {
+        if (0 != strncmp(extra_p->long_name_p, name_p, length))
+        {
+            continue;
+        }
+
+        if ('\0' == extra_p->long_name_p[length])
+        {
+            return extra_p;
+        }
+
+        ambiguous = (NULL != match_p);
+        match_p   = extra_p;
+    }
+
+    return ((0 == length) || (true == ambiguous)) ? NULL : match_p;
+}
+
+static int apply_option(const option_spec_t * spec_p,
+                        char *                value_p,
+                        options_t *           options_p)
+{
+    int    exit_code                = E_FAILURE;
+    bool * flag_p                   = NULL;
+    char   name[MAX_OPTION_NAME]    = { 0 };
+    char   message[MAX_REPORT_SIZE] = { 0 };
+
+    // Nothing is recorded, which report_failure() takes as a request for help
+    if (OPTION_KIND_HELP == spec_p->kind)
+    {
+        return E_FAILURE;
+    }
+
+    flag_p = (bool *)((char *)options_p + spec_p->flag_offset);
+    option_name(spec_p, name, sizeof(name));
+
+    if ((false == spec_p->repeatable) && (true == *flag_p))
+    {
+        snprintf(message,
+                 sizeof(message),
+                 "process_options(): '%s' flag already true.",
+                 name);
+        report_error(message);
+        goto END;
+    }
+
+    if ((OPTION_KIND_FLAG != spec_p->kind) && (NULL == value_p))
+    {
+        report_error("apply_option(): NULL argument passed.");
+        goto END;
+    }
+
+    switch (spec_p->kind)
+    {
+        case OPTION_KIND_FLAG:
+            exit_code = E_SUCCESS;
+            break;
+
+        case OPTION_KIND_INT32:
+            exit_code = apply_int32(spec_p, name, value_p, options_p);
+            break;
+
+        case OPTION_KIND_KEYWORD:
+            exit_code = apply_keyword(spec_p, name, value_p, options_p);
+            break;
+
+        case OPTION_KIND_CUSTOM:
+            exit_code = spec_p->parse(value_p, options_p);
+            break;
+
+        default:
+            report_error("apply_option(): Unknown option kind.");
+            break;
+    }
+
+    if (E_SUCCESS != exit_code)
+    {
+        snprintf(message,
+                 sizeof(message),
+                 "Unable to process '%s' option.",
+                 name);
+        report_error(message);
+        goto END;
+    }
+
+    *flag_p = true;
+
+END:
+    if (E_SUCCESS != exit_code)
+    {
+        record_error(options_p, OPTION_ERROR_INVALID_VALUE, name);
+    }
+    return exit_code;
+}
+
+static int apply_int32(const option_spec_t * spec_p,
+                       const char *          name_p,
+                       const char *          value_p,
+                       options_t *           options_p)
+{
+    int      exit_code                = E_FAILURE;
+    int32_t  number                   = 0;
+    char     message[MAX_REPORT_SIZE] = { 0 };
+
+    exit_code = number_parse_int32_str(value_p, &number);
+    if (E_SUCCESS != exit_code)
+    {
+        snprintf(message,
+                 sizeof(message),
+                 "process_options(): '%s' needs a number.",
+                 name_p);
+        report_error(message);
+        goto END;
+    }
+
+    if ((spec_p->min > number) || (spec_p->max < number))
+    {
+        snprintf(message,
+                 sizeof(message),
+                 "process_options(): '%s' must be from %d to %d.",
+                 name_p,
+                 (int)spec_p->min,
+                 (int)spec_p->max);
+        report_error(message);
+        exit_code = E_FAILURE;
+        goto END;
+    }
+
+    *(int32_t *)((char *)options_p + spec_p->value_offset) = number;
+
+END:
+    return exit_code;
+}
+
+static int apply_keyword(const option_spec_t * spec_p,
+                         const char *          name_p,
+                         const char *          value_p,
+                         options_t *           options_p)
+{
+    char message[MAX_REPORT_SIZE] = { 0 };
+
+    for (const option_keyword_t * keyword_p = spec_p->keywords_p;
+         NULL != keyword_p->name_p;
+         keyword_p++)
+    {
+        if (0 == strcmp(value_p, keyword_p->name_p))
+        {
+            *(int *)((char *)options_p + spec_p->value_offset) =
+                keyword_p->value;
+            return E_SUCCESS;
+        }
+    }
+
+    snprintf(message,
+             sizeof(message),
+             "process_options(): Unknown '%s' value '%s'.",
+             name_p,
+             value_p);
+    report_error(message);
+    return E_FAILURE;
+}
+
+static int scan_command_line(int        argc,
+                             char **    argv,
+                             uint64_t * given_p,
+                             char **    path_pp)
+{
+    option_cursor_t       cursor  = { 0 };
+    option_status_t       status  = OPTION_FOUND;
+    const option_spec_t * spec_p  = NULL;
+    char *                value_p = NULL;
+
+    cursor.argc    = argc;
+    cursor.argv    = argv;
+    cursor.index   = 1;
+    cursor.allowed = OPTION_SET_ALL;
+    *given_p     = 0;
+    *path_pp     = NULL;
+
+    for (;;)
+    {
+        status = next_option(&cursor, &spec_p, &value_p);
+        if (OPTION_DONE == status)
+        {
+            break;
+        }
+
+        if ((OPTION_FOUND != status) || (OPTION_KIND_HELP == spec_p->kind))
+        {
+            return E_FAILURE;
+        }
+
+        *given_p |= OPTION_BIT(spec_p);
+        if (('c' == spec_p->short_name) && (NULL == *path_pp))
+        {
+            *path_pp = value_p;
+        }
+    }
+
+    return (0 == cursor.operand_count) ? E_SUCCESS : E_FAILURE;
+}
+
+static int apply_command_line(int argc, char ** argv, options_t * options_p)
+{
+    int                   exit_code = E_FAILURE;
+    option_cursor_t       cursor    = { 0 };
+    option_status_t       status    = OPTION_FOUND;
+    const option_spec_t * spec_p    = NULL;
+    char *                value_p   = NULL;
+
+    cursor.argc    = argc;
+    cursor.argv    = argv;
+    cursor.index   = 1;
+    cursor.allowed = OPTION_SET_ALL;
+
+    for (;;)
+    {
+        status = next_option(&cursor, &spec_p, &value_p);
+        if (OPTION_DONE == status)
+        {
+            break;
+        }
+
+        if (OPTION_FOUND != status)
+        {
+            report_invalid_option(&cursor, status, options_p);
+            goto END;
+        }
+
+        if (E_SUCCESS != apply_option(spec_p, value_p, options_p))
+        {
+            goto END;
+        }
+    }
+
+    if (0 < cursor.operand_count)
+    {
+        report_extra_arguments(&cursor, options_p);
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static const option_spec_t * find_env_option(char * entry_p, char ** value_pp)
+{
+    const char * var_p                 = entry_p + strlen(ENV_PREFIX);
+    char *       equals_p              = strchr(var_p, '=');
+    size_t       name_len              = 0;
+    char         name[MAX_OPTION_NAME] = { 0 };
+
+    *value_pp = NULL;
+    if (NULL == equals_p)
+    {
+        return NULL;
+    }
+
+    name_len = (size_t)(equals_p - var_p);
+    if ((0 == name_len) || (sizeof(name) <= name_len))
+    {
+        return NULL;
+    }
 
-#include "number_converter.h"
-#include "option_handler.h"
-#include "utilities.h"
+    for (size_t idx = 0; idx < name_len; idx++)
+    {
+        name[idx] = (char)tolower((unsigned char)var_p[idx]);
+        if ('_' == var_p[idx])
+        {
+            name[idx] = '-';
+        }
+    }
 
-#define MIN_NUM_THREADS 2     // Minimum number of threads allowed
-#define MAX_PORT_VALUE  65535 // Maximum allowable port number
-#define MIN_PORT_VALUE  1025  // Minimum allowable port number
+    *value_pp = equals_p + 1;
+    return find_named_option(name, name_len);
+}
 
-//
-// -----------------------------UTILITY FUNCTIONS-----------------------------
-//
+static int scan_environment(uint64_t * given_p, char ** path_pp)
+{
+    const option_spec_t * spec_p                   = NULL;
+    char *                value_p                  = NULL;
+    char                  message[MAX_REPORT_SIZE] = { 0 };
 
-/**
- * @brief Prints the help menu to the console.
- *
- * The function provides information on how to use the server application,
- * detailing available options and their usage.
- */
-static void print_help_menu();
+    *given_p = 0;
+    *path_pp = NULL;
 
-//
-// ------------------------------REPORT FUNCTIONS------------------------------
-//
+    for (char ** env_pp = environ; NULL != *env_pp; env_pp++)
+    {
+        if (0 != strncmp(*env_pp, ENV_PREFIX, strlen(ENV_PREFIX)))
+        {
+            continue;
+        }
 
-/**
- * @brief Report any additional arguments passed to the program.
- *
- * This function is responsible for checking if there are any extra arguments
- * that `getopt` didn't process. If there are, it reports them to the stderr.
- *
- * @param optind Index of the next element to be processed in argv.
- * @param argc The number of command-line arguments.
- * @param argv The array of command-line arguments.
- *
- * @return E_SUCCESS if no additional invalid arguments are found, E_FAILURE
- * otherwise.
- */
-static int report_extra_arguments(int optind, int argc, char ** argv);
+        spec_p = find_env_option(*env_pp, &value_p);
+        if (NULL == spec_p)
+        {
+            snprintf(message,
+                     sizeof(message),
+                     "process_options(): Unknown variable '%.*s'.",
+                     (int)strcspn(*env_pp, "="),
+                     *env_pp);
+            report_error(message);
+            return E_FAILURE;
+        }
 
-/**
- * @brief Reports invalid or incomplete options to stderr.
- *
- * This function is called when an unknown option or an option requiring an
- * argument (like `-n` or `-p`) is passed without one. It prints an appropriate
- * error message to stderr.
- */
-static void report_invalid_options();
+        *given_p |= OPTION_BIT(spec_p);
+        if ('c' == spec_p->short_name)
+        {
+            *path_pp = value_p;
+        }
+    }
 
-//
-// ------------------------------OPTION FUNCTIONS------------------------------
-//
+    return E_SUCCESS;
+}
 
-/**
- * @brief Process the '-n' command-line option.
- *
- * This function is responsible for processing the '-n' option passed in the
- * command line. The '-n' option specifies the number of threads in the thread
- * pool.
- *
- * @param optarg Pointer to the string containing the argument for the '-n'
- * option.
- * @param options_p Pointer to the options_t struct where the parsed value
- * should be stored.
- *
- * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
- */
-static int process_n_option(char * optarg, options_t * options_p);
+static int apply_environment(options_t * options_p, uint64_t skip)
+{
+    int                   exit_code             = E_SUCCESS;
+    const option_spec_t * spec_p                = NULL;
+    char *                value_p               = NULL;
+    char *                item_p                = NULL;
+    char *                save_p                = NULL;
+    char                  list[MAX_CONFIG_LINE] = { 0 };
 
-/**
- * @brief Process the '-p' command-line option.
- *
- * This function is responsible for processing the '-p' option passed in the
- * command line. The '-p' option specifies the port number on which the server
- * should listen.
- *
- * @param optarg Pointer to the string containing the argument for the '-p'
- * option.
- * @param options_p Pointer to the options_t struct where the parsed value
- * should be stored.
- *
- * @return E_SUCCESS on successful processing, E_FAILURE otherwise.
- */
-static int process_p_option(char * optarg, options_t * options_p);
+    for (char ** env_pp = environ;
+         (E_SUCCESS == exit_code) && (NULL != *env_pp);
+         env_pp++)
+    {
+        if (0 != strncmp(*env_pp, ENV_PREFIX, strlen(ENV_PREFIX)))
+        {
+            continue;
+        }
 
-// +---------------------------------------------------------------------------+
-// |                            MAIN OPTION HANDLER                            |
-// +---------------------------------------------------------------------------+
+        // Checked by scan_environment(), but the environment may have
+        // changed since
+        spec_p = find_env_option(*env_pp, &value_p);
+        if (NULL == spec_p)
+        {
+            record_error(options_p, OPTION_ERROR_SOURCE, ENV_PREFIX "*");
+            exit_code = E_FAILURE;
+            break;
+        }
 
-int process_options(int argc, char ** argv, options_t * options_p)
+        if (0 != (skip & OPTION_BIT(spec_p)))
+        {
+            continue;
+        }
+
+        if ((OPTION_KIND_FLAG == spec_p->kind) ||
+            (OPTION_KIND_HELP == spec_p->kind))
+        {
+            // A flag is set by the variable existing, whatever its value
+            exit_code = apply_option(spec_p, NULL, options_p);
+        }
+        else if (false == spec_p->repeatable)
+        {
+            exit_code = apply_option(spec_p, value_p, options_p);
+        }
+        else if (sizeof(list) <= strlen(value_p))
+        {
+            report_error("process_options(): Environment list is too long.");
+            record_error(options_p, OPTION_ERROR_SOURCE, ENV_PREFIX "*");
+            exit_code = E_FAILURE;
+        }
+        else
+        {
+            // NETCALC_P=8080,8081 is '-p 8080 -p 8081'; the environment
+            // itself is left untouched
+            strcpy(list, value_p);
+            item_p = strtok_r(list, ENV_LIST_SEPARATOR, &save_p);
+            while ((E_SUCCESS == exit_code) && (NULL != item_p))
+            {
+                exit_code = apply_option(spec_p, item_p, options_p);
+                item_p    = strtok_r(NULL, ENV_LIST_SEPARATOR, &save_p);
+            }
+        }
+    }
+
+    return exit_code;
+}
+
+static int apply_file(const char * path_p,
+                      options_t *  options_p,
+                      uint64_t     skip)
 {
-    int exit_code = E_FAILURE;
-    int option    = 0;
+    int                   exit_code                = E_FAILURE;
+    FILE *                file_p                   = NULL;
+    char *                name_p                   = NULL;
+    char *                value_p                  = NULL;
+    const option_spec_t * spec_p                   = NULL;
+    bool                  has_value                = false;
+    size_t                line_number              = 0;
+    char                  line[MAX_CONFIG_LINE]    = { 0 };
+    char                  message[MAX_REPORT_SIZE] = { 0 };
 
-    if ((NULL == argv) || (NULL == *argv) || (NULL == options_p))
+    file_p = fopen(path_p, "r");
+    if (NULL == file_p)
     {
-        print_error("process_options(): NULL argument passed.");
+        snprintf(message,
+                 sizeof(message),
+                 "process_options(): Unable to open '%s': %s.",
+                 path_p,
+                 strerror(errno));
+        report_error(message);
+        record_error(options_p, OPTION_ERROR_SOURCE, "-c");
         goto END;
     }
 
-    // Generally assignments inside conditional statements go against Barr-C and
-    // CSD-T coding standards, however the following conditional was pulled
-    // directly from the 'getopt()' man page, and follows a more idomatic
-    // approach that is more recognizable to C programmers who are familiar with
-    // 'getopt()'.
-    while (-1 != (option = getopt(argc, argv, "n:p:h")))
+    while (NULL != fgets(line, sizeof(line), file_p))
     {
-        switch (option)
+        line_number++;
+
+        if ((NULL == strchr(line, '\n')) && (0 == feof(file_p)))
         {
-            case 'n':
-                exit_code = process_n_option(optarg, options_p);
-                if (E_SUCCESS != exit_code)
-                {
-                    print_error("Unable to process 'n' option.");
-                    goto END;
-                }
-                break;
+            snprintf(message,
+                     sizeof(message),
+                     "process_options(): %s:%zu: Line too long.",
+                     path_p,
+                     line_number);
+            report_error(message);
+            record_error(options_p, OPTION_ERROR_SOURCE, "-c");
+            goto END;
+        }
 
-            case 'p':
-                exit_code = process_p_option(optarg, options_p);
-                if (E_SUCCESS != exit_code)
-                {
-                    print_error("Unable to process 'p' option.");
-                    goto END;
-                }
-                break;
+        spec_p = NULL;
+        if (E_SUCCESS == split_config_line(line, &name_p, &value_p))
+        {
+            if (NULL == name_p)
+            {
+                continue;
+            }
 
-            case 'h':
-                goto END;
-                break;
+            spec_p = find_named_option(name_p, strlen(name_p));
+        }
 
-            case '?':
-                report_invalid_options();
-                exit_code = E_FAILURE;
-                goto END;
-                break;
+        // A file may not include another, and every entry must carry a value
+        // exactly when its option takes one
+        has_value = ((NULL != spec_p) && (OPTION_KIND_FLAG != spec_p->kind) &&
+                     (OPTION_KIND_HELP != spec_p->kind));
+        if ((NULL == spec_p) || ('c' == spec_p->short_name) ||
+            (has_value != (NULL != value_p)))
+        {
+            snprintf(message,
+                     sizeof(message),
+                     "process_options(): %s:%zu: Invalid entry.",
+                     path_p,
+                     line_number);
+            report_error(message);
+            record_error(options_p, OPTION_ERROR_SOURCE, "-c");
+            goto END;
+        }
 
-            default:
-                fprintf(stderr, "Unknown option encountered.\n");
-                exit_code = E_FAILURE;
-                goto END;
+        if (0 != (skip & OPTION_BIT(spec_p)))
+        {
+            continue;
         }
-    }
 
-    exit_code = report_extra_arguments(optind, argc, argv);
-    if (E_SUCCESS != exit_code)
-    {
-        print_error("Invalid arguments passed.");
-        goto END;
+        if (E_SUCCESS != apply_option(spec_p, value_p, options_p))
+        {
+            goto END;
+        }
     }
 
     exit_code = E_SUCCESS;
 END:
-    if (E_FAILURE == exit_code)
+    if (NULL != file_p)
     {
-        print_help_menu();
+        fclose(file_p);
     }
     return exit_code;
 }
 
-// *****************************************************************************
-//                          STATIC FUNCTION DEFINITIONS
-// *****************************************************************************
-
-static int process_n_option(char * optarg, options_t * options_p)
+static int split_config_line(char * line_p, char ** name_pp, char ** value_pp)
 {
-    int      exit_code     = E_FAILURE;
-    number_t num_threads_p = { 0 };
+    int    exit_code = E_FAILURE;
+    char * name_p    = line_p;
+    char * end_p     = NULL;
+    size_t name_len  = 0;
 
-    if ((NULL == optarg) || (NULL == options_p))
+    *name_pp  = NULL;
+    *value_pp = NULL;
+
+    end_p = strchr(line_p, CONFIG_COMMENT);
+    if (NULL != end_p)
     {
-        print_error("NULL argument passed.");
-        goto END;
+        *end_p = '\0';
     }
 
-    // Check if the 'n' flag was already set
-    if (true == options_p->n_flag)
+    name_p += strspn(name_p, " \t");
+    end_p = name_p + strlen(name_p);
+    while ((end_p > name_p) && (NULL != strchr(" \t\r\n", end_p[-1])))
     {
-        print_error("process_options(): '-n' flag already true.");
-        goto END;
+        *--end_p = '\0';
     }
 
-    // Convert string to integer
-    exit_code = str_to_int32(optarg, &num_threads_p);
-    if (E_SUCCESS != exit_code)
+    if ('\0' == *name_p)
     {
-        print_error("Unable to convert 'n_value' to number.");
-
+        exit_code = E_SUCCESS;
         goto END;
     }
 
-    if (MIN_NUM_THREADS > num_threads_p.signed_num)
+    name_len = strcspn(name_p, " \t=");
+    if (('-' == name_p[0]) || (0 == name_len))
     {
-        print_error("process_options(): Number of threads must be 2 or more.");
-
-        exit_code = E_FAILURE;
         goto END;
     }
 
-    options_p->n_flag  = true;
-    options_p->n_value = num_threads_p.signed_num;
+    if ('\0' != name_p[name_len])
+    {
+        name_p[name_len] = '\0';
+        *value_pp        = name_p + name_len + 1;
+        *value_pp += strspn(*value_pp, " \t=");
+        if ('\0' == **value_pp)
+        {
+            *value_pp = NULL;
+        }
+    }
+
+    *name_pp = name_p;
 
     exit_code = E_SUCCESS;
 END:
     return exit_code;
 }
 
-static int process_p_option(char * optarg, options_t * options_p)
+static int check_conflicts(options_t * options_p)
 {
-    int      exit_code     = E_FAILURE;
-    number_t port_number_p = { 0 };
-    size_t   optarg_length = 0;
+    int exit_code = E_FAILURE;
 
-    if ((NULL == optarg) || (NULL == options_p))
+    exit_code = check_metrics_port(options_p);
+    if (E_SUCCESS != exit_code)
     {
-        print_error("NULL argument passed.");
+        record_error(options_p, OPTION_ERROR_CONFLICT, "--metrics-port");
         goto END;
     }
 
-    // Check if the 'p' flag was already set
-    if (true == options_p->p_flag)
+    exit_code = check_queue_limits(options_p);
+    if (E_SUCCESS != exit_code)
     {
-        print_error("process_p_option(): '-p' flag already true.");
+        record_error(options_p, OPTION_ERROR_CONFLICT, "--max-queue-depth");
         goto END;
     }
 
-    // Convert string to integer and check range
-    exit_code = str_to_int32(optarg, &port_number_p);
+    exit_code = check_exec_mode(options_p);
     if (E_SUCCESS != exit_code)
     {
-        print_error(
-            "process_p_option(): Unable to convert 'p_value' to number.");
+        record_error(options_p, OPTION_ERROR_CONFLICT, "--exec-mode");
+        goto END;
+    }
+
+    exit_code = check_transport(options_p);
+    if (E_SUCCESS != exit_code)
+    {
+        record_error(options_p, OPTION_ERROR_CONFLICT, "--transport");
         goto END;
     }
-    if ((MAX_PORT_VALUE < port_number_p.signed_num) ||
-        (MIN_PORT_VALUE > port_number_p.signed_num))
+
+    exit_code = check_shared_nothing(options_p);
+    if (E_SUCCESS != exit_code)
     {
-        print_error("process_p_option(): Port number out of range.");
-        exit_code = E_FAILURE;
+        record_error(options_p, OPTION_ERROR_CONFLICT, "--shared-nothing");
         goto END;
     }
 
-    // Calculate string length
-    optarg_length = strnlen(optarg, MAX_PORT_SIZE);
-    if (MAX_PORT_SIZE < optarg_length)
+    exit_code = check_io_backend(options_p);
+    if (E_SUCCESS != exit_code)
     {
-        print_error("process_p_option(): Port string is too long.");
+        record_error(options_p, OPTION_ERROR_CONFLICT, "--io-backend");
         goto END;
     }
 
-    options_p->p_flag  = true;
-    options_p->p_value = optarg;
+    exit_code = check_qos_policy(options_p);
+    if (E_SUCCESS != exit_code)
+    {
+        record_error(options_p, OPTION_ERROR_CONFLICT, "--qos-policy");
+        goto END;
+    }
 
-    exit_code = E_SUCCESS;
+    exit_code = check_max_threads(options_p);
+    if (E_SUCCESS != exit_code)
+    {
+        record_error(options_p, OPTION_ERROR_CONFLICT, "--max-threads");
+        goto END;
+    }
+
+    exit_code = check_pool_size(options_p);
+    if (E_SUCCESS != exit_code)
+    {
+        record_error(options_p, OPTION_ERROR_CONFLICT, "--pool-slab-count");
+        goto END;
+    }
 
 END:
     return exit_code;
 }
 
-static void report_invalid_options()
+static void report_error(const char * message_p)
 {
-    if (optopt == 'n' || optopt == 'p')
+    options_t * options_p = g_reporting_p;
+
+    if ((NULL != options_p) && ('\0' == options_p->error.message[0]))
     {
-        fprintf(stderr, "Option '-%c' requires an argument.\n", optopt);
+        snprintf(options_p->error.message,
+                 sizeof(options_p->error.message),
+                 "%s",
+                 message_p);
     }
-    else
+
+    if ((NULL == options_p) || (false == options_p->quiet_flag))
     {
-        fprintf(stderr, "Unknown option '-%c'.\n", optopt);
+        print_error(message_p);
     }
 }
 
-static int report_extra_arguments(int optind, int argc, char ** argv)
+static void record_error(options_t *    options_p,
+                         option_error_t code,
+                         const char *   option_p)
 {
-    int exit_code = E_FAILURE;
+    if (OPTION_ERROR_NONE != options_p->error.code)
+    {
+        return;
+    }
 
-    if ((NULL == argv) || (NULL == *argv))
+    options_p->error.code = code;
+    if (NULL != option_p)
     {
-        print_error("NULL argument passed.");
-        goto END;
+        snprintf(options_p->error.option,
+                 sizeof(options_p->error.option),
+                 "%s",
+                 option_p);
+    }
+}
+
+static void option_name(const option_spec_t * spec_p,
+                        char *                buffer_p,
+                        size_t                size)
+{
+    if ('\0' != spec_p->short_name)
+    {
+        snprintf(buffer_p, size, "-%c", spec_p->short_name);
+    }
+    else
+    {
+        snprintf(buffer_p, size, "--%s", spec_p->long_name_p);
     }
+}
 
-    if (optind < argc)
+static bool find_quiet_flag(int argc, char ** argv)
+{
+    for (int idx = 1; (idx < argc) && (NULL != argv[idx]); idx++)
     {
-        fprintf(stderr, "Invalid arguments encountered: ");
-        while (optind < argc)
+        if (0 == strcmp(argv[idx], "--"))
         {
-            fprintf(stderr, "%s ", argv[optind++]);
+            break;
+        }
+
+        if ((0 == strcmp(argv[idx], "-q")) ||
+            (0 == strcmp(argv[idx], "--quiet")))
+        {
+            return true;
         }
-        fprintf(stderr, "\n");
-        goto END;
     }
 
-    exit_code = E_SUCCESS;
-END:
-    return exit_code;
+    return false;
+}
+
+static void report_invalid_option(const option_cursor_t * cursor_p,
+                                  option_status_t         status,
+                                  options_t *             options_p)
+{
+    char           message[MAX_REPORT_SIZE] = { 0 };
+    option_error_t code                     = OPTION_ERROR_UNKNOWN_OPTION;
+
+    if (OPTION_NO_VALUE == status)
+    {
+        code = OPTION_ERROR_MISSING_ARGUMENT;
+        snprintf(message,
+                 sizeof(message),
+                 "Option '%s' requires an argument.",
+                 cursor_p->name);
+    }
+    else if (OPTION_UNEXPECTED_VALUE == status)
+    {
+        code = OPTION_ERROR_INVALID_VALUE;
+        snprintf(message,
+                 sizeof(message),
+                 "Option '%s' does not take an argument.",
+                 cursor_p->name);
+    }
+    else
+    {
+        snprintf(
+            message, sizeof(message), "Unknown option '%s'.", cursor_p->name);
+    }
+
+    report_error(message);
+    record_error(options_p, code, cursor_p->name);
+}
+
+static void report_extra_arguments(const option_cursor_t * cursor_p,
+                                   options_t *             options_p)
+{
+    char message[MAX_REPORT_SIZE] = { 0 };
+
+    snprintf(message,
+             sizeof(message),
+             "Invalid arguments encountered: '%s'%s",
+             cursor_p->operand_p,
+             (1 < cursor_p->operand_count) ? " and more." : ".");
+    report_error(message);
+    report_error("Invalid arguments passed.");
+    record_error(options_p, OPTION_ERROR_EXTRA_ARGUMENT, cursor_p->operand_p);
 }
 
 static void print_help_menu()
@@ -319,10 +3143,188 @@ static void print_help_menu()
     printf(
         "  -p PORT   Port to listen on; (MIN: 1025, MAX: 65535) defaults to "
         "31337.\n");
+    printf("            May be repeated to listen on up to 8 ports.\n");
     printf(
         "  -n NUM    Number of threads in the pool; (MIN: 2) defaults to 4.\n");
+    printf("            'auto' sizes the pool to the available CPUs, and\n");
+    printf("            'auto:N%%' to N%% of them.\n");
+    printf("  -c FILE   Read options from FILE, one 'name value' per line "
+           "(e.g.\n");
+    printf("            'queue-depth 4096'); '#' starts a comment.\n");
+    printf("  -q        Quiet (machine) mode: on error, print the single "
+           "line\n");
+    printf("            'netcalc: error=KIND code=N option=OPT "
+           "message=\"...\"'\n");
+    printf("            instead of this menu. Also accepted as "
+           "'--quiet'.\n");
     printf("  -h        Print this help menu and exit.\n");
     printf("\n");
+    printf("Tuning options:\n");
+    printf(
+        "  --reuseport K         Open K SO_REUSEPORT listeners per port, each "
+        "with\n"
+        "                        its own acceptor thread; (MIN: 1, MAX: "
+        "64).\n");
+    printf(
+        "  --tcp-nodelay         Set TCP_NODELAY so small replies are sent "
+        "at once.\n");
+    printf(
+        "  --busy-poll-us T      Busy-poll the NIC for up to T us before "
+        "sleeping on\n"
+        "                        a read (SO_BUSY_POLL); (MIN: 1, MAX: "
+        "1000000).\n");
+    printf(
+        "  --rcvbuf B            Socket receive buffer in bytes; (MIN: 4096, "
+        "MAX:\n"
+        "                        67108864).\n");
+    printf(
+        "  --sndbuf B            Socket send buffer in bytes; (MIN: 4096, "
+        "MAX:\n"
+        "                        67108864).\n");
+    printf(
+        "  --defer-accept S      Accept a connection only once its first "
+        "request\n"
+        "                        arrives, waiting up to S seconds; (MAX: "
+        "3600).\n");
+    printf(
+        "  --backlog N           Pending connection queue per listener; "
+        "(MIN: 1, MAX:\n"
+        "                        65535). Default: SOMAXCONN.\n");
+    printf(
+        "  --max-threads N       Let the pool grow from '-n' up to N threads "
+        "while\n"
+        "                        queue wait and CPU use are high, and shrink "
+        "back\n"
+        "                        when they stay low; (MAX: 1024).\n");
+    printf(
+        "  --cpu-list LIST       Pin workers to these CPUs, e.g. '0-3,8'; "
+        "worker i\n"
+        "                        runs on the (i mod count)th CPU of the "
+        "list.\n");
+    printf(
+        "  --numa-policy MODE    Worker memory placement: none (default), "
+        "local,\n"
+        "                        or interleave.\n");
+    printf(
+        "  --io-backend NAME     I/O engine: epoll (default) or io_uring; "
+        "io_uring\n"
+        "                        requires --shared-nothing.\n");
+    printf(
+        "  --queue TYPE          Work queue: locked (default) or lockfree.\n");
+    printf(
+        "  --queue-depth N       Work queue capacity; (MIN: 2, MAX: "
+        "16777216).\n"
+        "                        Default: 4096.\n");
+    printf(
+        "  --scheduler MODE      shared (default) or work-stealing; the latter "
+        "gives\n"
+        "                        each worker a local deque and steals when "
+        "idle.\n");
+    printf(
+        "  --batch-size N        Work items drained per dequeue; (MIN: 1, MAX: "
+        "1024).\n");
+    printf(
+        "  --batch-timeout-us T  Wait up to T us to fill a batch; (MAX: "
+        "1000000).\n");
+    printf(
+        "  --simd LEVEL          Calculation kernels: auto (default), off, "
+        "avx2,\n"
+        "                        or avx512.\n");
+    printf(
+        "  --protocol NAME       Request format: text (default) or binary "
+        "(framed,\n"
+        "                        pipelined, out-of-order replies).\n");
+    printf(
+        "  --transport NAME      tcp (default) accepts connections; udp "
+        "answers one\n"
+        "                        request per datagram, with a SO_REUSEPORT "
+        "socket\n"
+        "                        per worker and batched recvmmsg()/"
+        "sendmmsg().\n");
+    printf(
+        "  --pool-slab-count N   Preallocated work items and buffers per pool; "
+        "at\n"
+        "                        least 32 per thread plus 64, and at most 4 "
+        "GiB of\n"
+        "                        buffers; (MIN: 96, MAX: 4194304).\n");
+    printf(
+        "  --buffer-size B       Receive buffer size in bytes; (MIN: 512, MAX: "
+        "1048576).\n");
+    printf(
+        "  --cache-entries N     Cache up to N results of repeated "
+        "calculations; 0\n"
+        "                        (default) disables; (MAX: 16777216).\n");
+    printf(
+        "  --metrics-port PORT   Serve Prometheus metrics (queue depth, "
+        "per-thread\n"
+        "                        busy time, latency) on PORT; (MIN: 1025, "
+        "MAX: 65535).\n");
+    printf(
+        "  --max-queue-depth N   Queue depth at which the overload policy "
+        "fires;\n"
+        "                        (MIN: 1, MAX: --queue-depth). Default: the "
+        "queue\n"
+        "                        capacity.\n");
+    printf(
+        "  --overload-policy P   At the limit: reject (default) replies "
+        "busy;\n"
+        "                        shed-oldest replies busy to the oldest "
+        "queued\n"
+        "                        request; block-accept stops reading "
+        "sockets\n"
+        "                        until the queue drains.\n");
+    printf(
+        "  --exec-mode MODE      sync (default) workers write their own "
+        "replies;\n"
+        "                        async hands replies to an event loop so "
+        "slow\n"
+        "                        clients never block a worker (binary "
+        "protocol).\n");
+    printf(
+        "  --shared-nothing      Give every worker its own listener per port, "
+        "event\n"
+        "                        loop and memory; requests are computed where "
+        "they\n"
+        "                        are read, with no shared queue (binary "
+        "protocol).\n");
+    printf(
+        "  --qos-classes LIST    Split the work queue into classes "
+        "NAME:WEIGHT[:SLO_US],\n"
+        "                        e.g. 'interactive:8:500,bulk:1'; "
+        "connections on the\n"
+        "                        i-th '-p' port use the i-th class (the last "
+        "class\n"
+        "                        for any further ports).\n");
+    printf(
+        "  --qos-policy P        weighted (default) serves classes by weight; "
+        "strict\n"
+        "                        always serves the first non-empty class.\n");
+    printf(
+        "  --takeover PATH       Take the listening sockets over from the "
+        "process\n"
+        "                        offering them on the UNIX socket PATH, "
+        "which then\n"
+        "                        drains and exits; then offer them on PATH "
+        "to the\n"
+        "                        next process. Ports are never closed "
+        "across a\n"
+        "                        restart.\n");
+    printf(
+        "  --trace-sample 1/N    Time the accept, read, queue, compute and "
+        "write\n"
+        "                        stages of one request in N; dumped as "
+        "Chrome trace\n"
+        "                        JSON; (MAX N: 1000000).\n");
+    printf("\n");
+    printf("Environment:\n");
+    printf("  Every option may also be set as NETCALC_NAME, with the name "
+           "upper-cased\n");
+    printf("  and '-' written as '_' (NETCALC_N=8, NETCALC_QUEUE_DEPTH=4096, "
+           "and\n");
+    printf("  NETCALC_P=8080,8081 for several ports). The command line "
+           "overrides the\n");
+    printf("  environment, which overrides the config file.\n");
+    printf("\n");
     printf("Description:\n");
     printf(
         "  Net Calc is a server application that performs a variety of "
@@ -334,6 +3336,32 @@ static void print_help_menu()
     printf("\n");
     printf("Examples:\n");
     printf("  netcalc -p 8080 -n 8\n");
+    printf("  netcalc -p 8080 -n auto:50%%\n");
+    printf("  netcalc -p 8080 -n 8 --cpu-list 0-7 --numa-policy local\n");
+    printf("  netcalc -p 8080 -n 4 --max-threads 32\n");
+    printf("  netcalc -p 8080 -p 8081 --reuseport 4\n");
+    printf("  netcalc -p 8080 --tcp-nodelay --busy-poll-us 50 --defer-accept "
+           "5\n");
+    printf("  netcalc -n 32 --queue lockfree --queue-depth 65536\n");
+    printf("  netcalc -n auto --scheduler work-stealing\n");
+    printf("  netcalc -n 8 --batch-size 64 --batch-timeout-us 50\n");
+    printf("  netcalc -n 8 --batch-size 256 --simd avx2\n");
+    printf("  netcalc -p 8080 --protocol binary\n");
+    printf("  netcalc -p 8080 -n auto --transport udp\n");
+    printf("  netcalc -n 16 --pool-slab-count 65536 --buffer-size 4096\n");
+    printf("  netcalc -n auto --cache-entries 1000000\n");
+    printf("  netcalc -p 8080 --metrics-port 9100\n");
+    printf("  netcalc -n 8 --max-queue-depth 4096 --overload-policy "
+           "shed-oldest\n");
+    printf("  netcalc --quiet -p 8080 -n auto\n");
+    printf("  NETCALC_N=16 netcalc -c /etc/netcalc.conf -p 8080\n");
+    printf("  netcalc -n 4 --protocol binary --exec-mode async\n");
+    printf("  netcalc -n auto --cpu-list 0-15 --protocol binary "
+           "--shared-nothing\n");
+    printf("  netcalc -p 8080 -p 8081 --qos-classes "
+           "interactive:8:500,bulk:1\n");
+    printf("  netcalc -p 8080 -n 16 --takeover /run/netcalc.sock\n");
+    printf("  netcalc -p 8080 --trace-sample 1/1000\n");
     printf("  netcalc -h\n");
     printf("\n");
     printf("For more information, see the documentation.\n");
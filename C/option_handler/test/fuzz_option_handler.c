@@ -0,0 +1,128 @@
+/**
+ * @file fuzz_option_handler.c
+ * @brief libFuzzer Harness for process_options()
+ *
+ * The input is split at NUL bytes into command-line arguments, which follow
+ * a fixed program name and '-q' (so a rejected command line prints one line
+ * rather than the help menu). The options are parsed into zeroed storage and
+ * any successful result is cloned and destroyed, as the server does with its
+ * snapshot.
+ *
+ * Only the command line is fuzzed. The NETCALC_* variables are removed once
+ * at start-up, and inputs that may give '-c' are skipped, since a config
+ * file such as /dev/stdin would block the fuzzer and any other would make
+ * runs depend on the machine.
+ *
+ * Build with: make fuzz-option-handler (clang -fsanitize=fuzzer,address)
+ * Usage: fuzz-option-handler [libFuzzer options] [corpus directory]
+ */
+#define _GNU_SOURCE // for environ
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "option_handler.h"
+#include "utilities.h"
+
+#define MAX_FUZZ_ARGS  64   // Most arguments taken from one input
+#define MAX_FUZZ_INPUT 4096 // Longest input parsed; the rest is ignored
+#define MAX_ENV_NAME   256  // Longest NETCALC_* variable name removed
+
+#define ENV_PREFIX     "NETCALC_" // Variables process_options() reads
+#define ENV_PREFIX_LEN 8          // Length of ENV_PREFIX
+
+int LLVMFuzzerInitialize(int * argc_p, char *** argv_p);
+int LLVMFuzzerTestOneInput(const uint8_t * data_p, size_t size);
+
+/**
+ * @brief Checks whether an argument may be a '-c' option.
+ *
+ * '-c' has no long name, so only short option groups can hold it. Any
+ * group with a 'c' counts, even where the 'c' is another option's value,
+ * which skips a few inputs that would not have opened a file.
+ *
+ * @param arg_p The argument.
+ * @return bool - true if the input must be skipped.
+ */
+static bool may_name_config(const char * arg_p);
+
+int LLVMFuzzerInitialize(int * argc_p, char *** argv_p)
+{
+    char   name[MAX_ENV_NAME] = { 0 };
+    size_t length             = 0;
+    size_t idx                = 0;
+
+    (void)argc_p;
+    (void)argv_p;
+
+    // unsetenv() shifts the entries after the one it removes
+    while (NULL != environ[idx])
+    {
+        length = strcspn(environ[idx], "=");
+        if ((0 != strncmp(environ[idx], ENV_PREFIX, ENV_PREFIX_LEN)) ||
+            (sizeof(name) <= length))
+        {
+            idx++;
+            continue;
+        }
+
+        memcpy(name, environ[idx], length);
+        name[length] = '\0';
+        unsetenv(name);
+    }
+
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t * data_p, size_t size)
+{
+    static char program[] = "netcalc";
+    static char quiet[]   = "-q";
+
+    char        input[MAX_FUZZ_INPUT + 1] = { 0 };
+    char *      argv[MAX_FUZZ_ARGS + 3]   = { NULL };
+    int         argc                      = 0;
+    size_t      length                    = size;
+    options_t   options                   = { 0 };
+    options_t * clone_p                   = NULL;
+
+    if (MAX_FUZZ_INPUT < length)
+    {
+        length = MAX_FUZZ_INPUT;
+    }
+    memcpy(input, data_p, length);
+
+    argv[argc++] = program;
+    argv[argc++] = quiet;
+
+    // Every NUL ends an argument; the copy is terminated after the last
+    for (size_t start = 0; (start < length) && (MAX_FUZZ_ARGS + 2 > argc);
+         start += strlen(&input[start]) + 1)
+    {
+        if (true == may_name_config(&input[start]))
+        {
+            return 0;
+        }
+        argv[argc++] = &input[start];
+    }
+
+    if (E_SUCCESS == process_options(argc, argv, &options))
+    {
+        clone_p = options_clone(&options);
+    }
+    options_destroy(&clone_p);
+
+    return 0;
+}
+
+static bool may_name_config(const char * arg_p)
+{
+    return (('-' == arg_p[0]) && ('-' != arg_p[1]) &&
+            (NULL != strchr(arg_p, 'c')));
+}
+
+/*** end of file ***/
@@ -0,0 +1,701 @@
+/**
+ * @file test_option_handler.c
+ * @brief Tests for the Option Handler
+ *
+ * Drives process_options() with command lines, NETCALC_* variables and
+ * config files: the '-n' and '-p' checks, the errors recorded for unknown
+ * options, missing values and stray arguments, the command line > environment
+ * > file precedence, and the checks between options. The option table is
+ * checked by loading every sample both from the command line and from a
+ * config file and requiring the two results to match. A last test parses a
+ * subset of the options, plus extra ones, with options_parse_command_line().
+ *
+ * Any NETCALC_* variables in the environment are removed first. Failures are
+ * parsed with '-q', so each prints one line rather than the help menu.
+ *
+ * Usage: test-option-handler
+ */
+#define _GNU_SOURCE // for mkstemp(), environ
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "option_handler.h"
+#include "utilities.h"
+
+#define MAX_TEST_ARGS      32  // Most arguments in one test command line
+#define MAX_TEST_LINE      256 // Longest test command line
+#define TEST_PATH_TEMPLATE "/tmp/test-option-handler-XXXXXX"
+#define TEST_PATH_SIZE     sizeof(TEST_PATH_TEMPLATE)
+#define TEST_ENV_PREFIX    "NETCALC_" // Variables process_options() reads
+#define TEST_ENV_PREFIX_LEN 8         // Length of TEST_ENV_PREFIX
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr,                                                    \
+                    "%s:%d: CHECK(%s) failed\n",                               \
+                    __FILE__,                                                  \
+                    __LINE__,                                                  \
+                    #condition);                                               \
+            goto END;                                                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @struct test_case
+ * @brief One named test.
+ */
+typedef struct test_case
+{
+    const char * name_p; // Printed with the result
+    int (*run)(void);    // Returns E_SUCCESS if the test passed
+} test_case_t;
+
+/**
+ * @struct table_sample
+ * @brief The same settings written as a command line and as a config file.
+ */
+typedef struct table_sample
+{
+    const char * command_line_p; // Arguments after the program name
+    const char * file_p;         // Config file contents
+} table_sample_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Splits a command line into arguments, after a program name.
+ *
+ * @param line_p The arguments after the program name, separated by single
+ * spaces.
+ * @param buffer_p Buffer of MAX_TEST_LINE receiving the arguments.
+ * @param argv Array of MAX_TEST_ARGS + 1 receiving pointers to them.
+ * @return int - The number of arguments, the program name included.
+ */
+static int split_line(const char * line_p, char * buffer_p, char ** argv);
+
+/**
+ * @brief Parses a command line into zeroed options.
+ *
+ * @param line_p The arguments after the program name, separated by single
+ * spaces.
+ * @param options_p The options to fill.
+ * @return int - What process_options() returned.
+ */
+static int parse_line(const char * line_p, options_t * options_p);
+
+/**
+ * @brief Writes a config file under /tmp.
+ *
+ * @param contents_p The file contents.
+ * @param path_p Buffer of TEST_PATH_SIZE receiving the file's path.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int write_config(const char * contents_p, char * path_p);
+
+/**
+ * @brief Parses a command line with the options test_subset() accepts.
+ *
+ * @param line_p The arguments after the program name.
+ * @param options_p The options to fill.
+ * @param rate_p Pointer to where '--rate' is stored.
+ * @return int - What options_parse_command_line() returned.
+ */
+static int parse_subset(const char * line_p,
+                        options_t *  options_p,
+                        int32_t *    rate_p);
+
+/**
+ * @brief The option_extra_parse_t of test_subset()'s '--rate'.
+ *
+ * @param value_p The value, which must be a positive number.
+ * @param context_p Pointer to the int32_t receiving it.
+ * @param reason_pp Pointer to where the reason for a rejection is stored.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int parse_test_rate(const char *  value_p,
+                           void *        context_p,
+                           const char ** reason_pp);
+
+/**
+ * @brief Removes every NETCALC_* variable from the environment.
+ */
+static void clear_environment(void);
+
+static int test_defaults(void);
+static int test_threads(void);
+static int test_ports(void);
+static int test_errors(void);
+static int test_conflicts(void);
+static int test_precedence(void);
+static int test_table(void);
+static int test_clone(void);
+static int test_subset(void);
+
+// +---------------------------------------------------------------------------+
+// |                                   MAIN                                    |
+// +---------------------------------------------------------------------------+
+
+int main(void)
+{
+    static const test_case_t tests[] = {
+        { "defaults", test_defaults },     { "threads", test_threads },
+        { "ports", test_ports },           { "errors", test_errors },
+        { "conflicts", test_conflicts },   { "precedence", test_precedence },
+        { "table", test_table },           { "clone", test_clone },
+        { "subset", test_subset },
+    };
+    int exit_code = E_SUCCESS;
+
+    clear_environment();
+
+    for (size_t idx = 0; idx < sizeof(tests) / sizeof(tests[0]); idx++)
+    {
+        if (E_SUCCESS == tests[idx].run())
+        {
+            printf("PASS %s\n", tests[idx].name_p);
+        }
+        else
+        {
+            printf("FAIL %s\n", tests[idx].name_p);
+            exit_code = E_FAILURE;
+        }
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int test_defaults(void)
+{
+    int       exit_code = E_FAILURE;
+    options_t options   = { 0 };
+
+    CHECK(E_SUCCESS == parse_line("", &options));
+    CHECK(OPTION_ERROR_NONE == options.error.code);
+    CHECK(false == options.n_flag);
+    CHECK(false == options.p_flag);
+    CHECK(0 == options.p_count);
+    CHECK(false == options.quiet_flag);
+    CHECK(0 == options.pinned_set);
+
+    CHECK(E_SUCCESS == parse_line("--quiet", &options));
+    CHECK(true == options.quiet_flag);
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int test_threads(void)
+{
+    int       exit_code = E_FAILURE;
+    options_t options   = { 0 };
+
+    CHECK(E_SUCCESS == parse_line("-n 8", &options));
+    CHECK(true == options.n_flag);
+    CHECK(8 == options.n_value);
+
+    CHECK(E_SUCCESS == parse_line("-n auto", &options));
+    CHECK(2 <= options.n_value);
+
+    CHECK(E_SUCCESS == parse_line("-n auto:1%", &options));
+    CHECK(2 <= options.n_value);
+
+    // Below the minimum, not a number, and a bad "auto" percentage
+    CHECK(E_FAILURE == parse_line("-q -n 1", &options));
+    CHECK(OPTION_ERROR_INVALID_VALUE == options.error.code);
+    CHECK(0 == strcmp("-n", options.error.option));
+    CHECK(E_FAILURE == parse_line("-q -n eight", &options));
+    CHECK(OPTION_ERROR_INVALID_VALUE == options.error.code);
+    CHECK(E_FAILURE == parse_line("-q -n auto:0%", &options));
+    CHECK(E_FAILURE == parse_line("-q -n auto:101%", &options));
+
+    // '--max-threads' must not be below '-n'
+    CHECK(E_SUCCESS == parse_line("-n 4 --max-threads 8", &options));
+    CHECK(E_FAILURE == parse_line("-q -n 8 --max-threads 4", &options));
+    CHECK(OPTION_ERROR_CONFLICT == options.error.code);
+    CHECK(0 == strcmp("--max-threads", options.error.option));
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int test_ports(void)
+{
+    int       exit_code = E_FAILURE;
+    options_t options   = { 0 };
+
+    CHECK(E_SUCCESS == parse_line("-p 8080 -p 08081", &options));
+    CHECK(true == options.p_flag);
+    CHECK(2 == options.p_count);
+    CHECK(0 == strcmp("8080", options.p_value));
+    CHECK(0 == strcmp("8080", options.p_values[0]));
+    CHECK(0 == strcmp("08081", options.p_values[1]));
+
+    CHECK(E_FAILURE == parse_line("-q -p 0", &options));
+    CHECK(OPTION_ERROR_INVALID_VALUE == options.error.code);
+    CHECK(0 == strcmp("-p", options.error.option));
+    CHECK(E_FAILURE == parse_line("-q -p 65536", &options));
+    CHECK(E_FAILURE == parse_line("-q -p 80x", &options));
+
+    // The same port twice, however it is written
+    CHECK(E_FAILURE == parse_line("-q -p 8080 -p 08080", &options));
+    CHECK(OPTION_ERROR_INVALID_VALUE == options.error.code);
+
+    CHECK(E_SUCCESS == parse_line("-p 8081 -p 8082 -p 8083 -p 8084 -p 8085 "
+                                  "-p 8086 -p 8087 -p 8088",
+                                  &options));
+    CHECK(MAX_LISTEN_PORTS == options.p_count);
+    CHECK(E_FAILURE == parse_line("-q -p 8081 -p 8082 -p 8083 -p 8084 "
+                                  "-p 8085 -p 8086 -p 8087 -p 8088 -p 8089",
+                                  &options));
+
+    // Ports up to 1024 are reserved
+    CHECK(E_FAILURE == parse_line("-q -p 1024", &options));
+
+    // The metrics endpoint needs a port of its own
+    CHECK(E_SUCCESS == parse_line("-p 8080 --metrics-port 9100", &options));
+    CHECK(E_FAILURE ==
+          parse_line("-q -p 8080 --metrics-port 8080", &options));
+    CHECK(OPTION_ERROR_CONFLICT == options.error.code);
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int test_errors(void)
+{
+    int       exit_code = E_FAILURE;
+    options_t options   = { 0 };
+
+    CHECK(E_FAILURE == parse_line("-q -n 4 stray", &options));
+    CHECK(OPTION_ERROR_EXTRA_ARGUMENT == options.error.code);
+    CHECK(0 == strcmp("stray", options.error.option));
+
+    CHECK(E_FAILURE == parse_line("-q --bogus", &options));
+    CHECK(OPTION_ERROR_UNKNOWN_OPTION == options.error.code);
+    CHECK(0 == strcmp("--bogus", options.error.option));
+
+    CHECK(E_FAILURE == parse_line("-q -x", &options));
+    CHECK(OPTION_ERROR_UNKNOWN_OPTION == options.error.code);
+
+    CHECK(E_FAILURE == parse_line("-q -n", &options));
+    CHECK(OPTION_ERROR_MISSING_ARGUMENT == options.error.code);
+    CHECK(0 == strcmp("-n", options.error.option));
+
+    CHECK(E_FAILURE == parse_line("-q --protocol bogus", &options));
+    CHECK(OPTION_ERROR_INVALID_VALUE == options.error.code);
+    CHECK(0 == strcmp("--protocol", options.error.option));
+    CHECK('\0' != options.error.message[0]);
+
+    CHECK(E_FAILURE == parse_line("-q -c /nonexistent/netcalc.conf", &options));
+    CHECK(OPTION_ERROR_SOURCE == options.error.code);
+
+    CHECK(E_FAILURE == process_options(1, NULL, &options));
+    CHECK(0 == strcmp("invalid-value",
+                      options_error_string(OPTION_ERROR_INVALID_VALUE)));
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int test_conflicts(void)
+{
+    int       exit_code = E_FAILURE;
+    options_t options   = { 0 };
+
+    // Without '--queue-depth' the limit must fit the default depth
+    CHECK(E_SUCCESS == parse_line("--max-queue-depth 4096", &options));
+    CHECK(E_FAILURE == parse_line("-q --max-queue-depth 5000", &options));
+    CHECK(OPTION_ERROR_CONFLICT == options.error.code);
+    CHECK(0 == strcmp("--max-queue-depth", options.error.option));
+    CHECK(E_SUCCESS ==
+          parse_line("--queue-depth 8192 --max-queue-depth 5000", &options));
+
+    CHECK(E_FAILURE == parse_line("-q --qos-policy strict", &options));
+    CHECK(0 == strcmp("--qos-policy", options.error.option));
+
+    CHECK(E_FAILURE == parse_line("-q --exec-mode async", &options));
+    CHECK(0 == strcmp("--exec-mode", options.error.option));
+
+    CHECK(E_FAILURE ==
+          parse_line("-q --shared-nothing --protocol binary --queue-depth 64",
+                     &options));
+    CHECK(0 == strcmp("--shared-nothing", options.error.option));
+
+    // Only the shards have an io_uring engine
+    CHECK(E_FAILURE == parse_line("-q --io-backend io_uring", &options));
+    CHECK(0 == strcmp("--io-backend", options.error.option));
+    CHECK(E_SUCCESS ==
+          parse_line("--io-backend io_uring --shared-nothing --protocol binary",
+                     &options));
+    CHECK(IO_BACKEND_IO_URING == options.io_backend);
+
+    CHECK(E_FAILURE ==
+          parse_line("-q --transport udp --reuseport 2", &options));
+    CHECK(0 == strcmp("--transport", options.error.option));
+
+    // One magazine per thread plus two, checked against '--max-threads'
+    CHECK(E_SUCCESS == parse_line("-n 4 --pool-slab-count 192", &options));
+    CHECK(E_FAILURE == parse_line("-q -n 4 --pool-slab-count 191", &options));
+    CHECK(0 == strcmp("--pool-slab-count", options.error.option));
+    CHECK(E_FAILURE ==
+          parse_line("-q -n 4 --max-threads 64 --pool-slab-count 1000",
+                     &options));
+
+    // options_check() runs the same checks on assembled options
+    CHECK(E_SUCCESS == parse_line("-n 4 --max-threads 8", &options));
+    options.n_value = 16;
+    CHECK(E_FAILURE == options_check(&options));
+    CHECK(OPTION_ERROR_CONFLICT == options.error.code);
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int test_precedence(void)
+{
+    int       exit_code            = E_FAILURE;
+    options_t options              = { 0 };
+    uint64_t  pinned               = 0;
+    char      path[TEST_PATH_SIZE] = { 0 };
+    char      line[MAX_TEST_LINE]  = { 0 };
+
+    CHECK(E_SUCCESS == write_config("n 5\nbatch-size 3\n# comment\n", path));
+
+    // File alone
+    snprintf(line, sizeof(line), "-c %s", path);
+    CHECK(E_SUCCESS == parse_line(line, &options));
+    CHECK(5 == options.n_value);
+    CHECK(3 == options.batch_size);
+    CHECK(0 == strcmp(path, options.c_value));
+
+    // The environment outranks the file
+    CHECK(0 == setenv("NETCALC_N", "6", 1));
+    CHECK(E_SUCCESS == parse_line(line, &options));
+    CHECK(6 == options.n_value);
+    CHECK(3 == options.batch_size);
+
+    // The command line outranks both
+    snprintf(line, sizeof(line), "-c %s -n 7", path);
+    CHECK(E_SUCCESS == parse_line(line, &options));
+    CHECK(7 == options.n_value);
+    CHECK(3 == options.batch_size);
+    CHECK(0 != options.pinned_set);
+
+    // A reload loads into fresh options that carry the pinned set, so the
+    // file's '-n' is skipped
+    pinned = options.pinned_set;
+    memset(&options, 0, sizeof(options));
+    options.pinned_set = pinned;
+    CHECK(E_SUCCESS == options_load_file(path, &options));
+    CHECK(false == options.n_flag);
+    CHECK(3 == options.batch_size);
+
+    // The file may also be named in the environment
+    CHECK(0 == unsetenv("NETCALC_N"));
+    CHECK(0 == setenv("NETCALC_C", path, 1));
+    CHECK(E_SUCCESS == parse_line("", &options));
+    CHECK(5 == options.n_value);
+
+    // A bad NETCALC_* value is reported like a bad source
+    CHECK(0 == unsetenv("NETCALC_C"));
+    CHECK(0 == setenv("NETCALC_N", "eight", 1));
+    CHECK(E_FAILURE == parse_line("-q", &options));
+
+    exit_code = E_SUCCESS;
+END:
+    clear_environment();
+    if ('\0' != path[0])
+    {
+        unlink(path);
+    }
+    return exit_code;
+}
+
+static int test_table(void)
+{
+    static const table_sample_t samples[] = {
+        { "-n 8", "n 8\n" },
+        { "--max-threads 16", "max-threads=16\n" },
+        { "-p 8080 -p 8081", "p 8080\np 8081\n" },
+        { "--queue-depth 8192", "queue-depth = 8192\n" },
+        { "--batch-size 8 --batch-timeout-us 50",
+          "batch-size 8\nbatch-timeout-us 50\n" },
+        { "--protocol binary --exec-mode async",
+          "protocol binary\nexec-mode async\n" },
+        { "--cpu-list 0 --numa-policy local",
+          "cpu-list 0\nnuma-policy local\n" },
+        { "--qos-classes a:2:100,b:1 --qos-policy strict",
+          "qos-classes a:2:100,b:1\nqos-policy strict\n" },
+        { "--tcp-nodelay --backlog 128", "tcp-nodelay\nbacklog 128\n" },
+        { "--simd off --trace-sample 1/64", "simd off\ntrace-sample 1/64\n" },
+    };
+    int       exit_code             = E_FAILURE;
+    options_t from_line             = { 0 };
+    options_t from_file             = { 0 };
+    char      path[TEST_PATH_SIZE]  = { 0 };
+    char      name[MAX_OPTION_NAME] = { 0 };
+    bool      matched               = false;
+
+    for (size_t idx = 0; idx < sizeof(samples) / sizeof(samples[0]); idx++)
+    {
+        CHECK(E_SUCCESS == parse_line(samples[idx].command_line_p, &from_line));
+
+        memset(&from_file, 0, sizeof(from_file));
+        CHECK(E_SUCCESS == write_config(samples[idx].file_p, path));
+        CHECK(E_SUCCESS == options_load_file(path, &from_file));
+        CHECK(E_SUCCESS == options_check(&from_file));
+        unlink(path);
+        path[0] = '\0';
+
+        matched = (!options_find_difference(
+                       &from_line, &from_file, name, sizeof(name)) &&
+                   !options_find_difference(
+                       &from_file, &from_line, name, sizeof(name)));
+        if (false == matched)
+        {
+            fprintf(stderr,
+                    "'%s' differs in '%s'\n",
+                    samples[idx].command_line_p,
+                    name);
+        }
+        CHECK(true == matched);
+    }
+
+    // A changed value is found and named
+    CHECK(E_SUCCESS == parse_line("--queue-depth 8192", &from_line));
+    CHECK(E_SUCCESS == parse_line("--queue-depth 4096", &from_file));
+    CHECK(true == options_find_difference(
+                      &from_line, &from_file, name, sizeof(name)));
+    CHECK(0 == strcmp("--queue-depth", name));
+
+    // A config file may not name another one
+    CHECK(E_SUCCESS == write_config("c /etc/netcalc.conf\n", path));
+    memset(&from_file, 0, sizeof(from_file));
+    CHECK(E_FAILURE == options_load_file(path, &from_file));
+
+    exit_code = E_SUCCESS;
+END:
+    if ('\0' != path[0])
+    {
+        unlink(path);
+    }
+    return exit_code;
+}
+
+static int test_clone(void)
+{
+    int         exit_code = E_FAILURE;
+    options_t   options   = { 0 };
+    options_t * clone_p   = NULL;
+
+    CHECK(E_SUCCESS == parse_line("-n 4 -p 8080", &options));
+
+    clone_p = options_clone(&options);
+    CHECK(NULL != clone_p);
+    CHECK(0 == memcmp(&options, clone_p, sizeof(options)));
+
+    options_destroy(&clone_p);
+    CHECK(NULL == clone_p);
+    options_destroy(&clone_p);
+
+    exit_code = E_SUCCESS;
+END:
+    options_destroy(&clone_p);
+    return exit_code;
+}
+
+static int test_subset(void)
+{
+    int       exit_code = E_FAILURE;
+    options_t options   = { 0 };
+    int32_t   rate      = 0;
+
+    // Shared options are checked as process_options() checks them
+    CHECK(E_SUCCESS == parse_subset("-p 8080 -p 8081 -n 3", &options, &rate));
+    CHECK(2 == options.p_count);
+    CHECK(3 == options.n_value);
+    CHECK(E_SUCCESS == parse_subset("-n auto", &options, &rate));
+    CHECK(2 <= options.n_value);
+    CHECK(E_FAILURE == parse_subset("-q -n 1", &options, &rate));
+    CHECK(OPTION_ERROR_INVALID_VALUE == options.error.code);
+    CHECK(0 == strcmp("-n", options.error.option));
+    CHECK(E_FAILURE == parse_subset("-q -p 80", &options, &rate));
+
+    // Extra options, abbreviated or not
+    CHECK(E_SUCCESS == parse_subset("--rate 50", &options, &rate));
+    CHECK(50 == rate);
+    CHECK(E_SUCCESS == parse_subset("--ra=60 -n 2", &options, &rate));
+    CHECK(60 == rate);
+    CHECK(E_FAILURE == parse_subset("-q --rate 0", &options, &rate));
+    CHECK(OPTION_ERROR_INVALID_VALUE == options.error.code);
+    CHECK(0 == strcmp("--rate", options.error.option));
+    CHECK(E_FAILURE == parse_subset("-q --rate", &options, &rate));
+    CHECK(OPTION_ERROR_MISSING_ARGUMENT == options.error.code);
+
+    // Options not named are unknown, '-c' included
+    CHECK(E_FAILURE == parse_subset("-q -c /dev/null", &options, &rate));
+    CHECK(OPTION_ERROR_UNKNOWN_OPTION == options.error.code);
+    CHECK(E_FAILURE == parse_subset("-q --queue-depth 8", &options, &rate));
+    CHECK(OPTION_ERROR_UNKNOWN_OPTION == options.error.code);
+    CHECK(E_FAILURE == parse_subset("-q stray", &options, &rate));
+    CHECK(OPTION_ERROR_EXTRA_ARGUMENT == options.error.code);
+
+    // Help is left to the caller
+    CHECK(E_FAILURE == parse_subset("-h", &options, &rate));
+    CHECK(OPTION_ERROR_NONE == options.error.code);
+
+    // Neither the environment nor a config file is read
+    CHECK(0 == setenv("NETCALC_N", "eight", 1));
+    CHECK(0 == setenv("NETCALC_C", "/nonexistent", 1));
+    CHECK(E_SUCCESS == parse_subset("-p 8080", &options, &rate));
+    CHECK(false == options.n_flag);
+    CHECK(false == options.c_flag);
+
+    exit_code = E_SUCCESS;
+END:
+    clear_environment();
+    return exit_code;
+}
+
+static int split_line(const char * line_p, char * buffer_p, char ** argv)
+{
+    char * save_p = NULL;
+    int    argc   = 0;
+
+    snprintf(buffer_p, MAX_TEST_LINE, "%s", line_p);
+
+    argv[argc++] = "netcalc";
+    for (char * arg_p = strtok_r(buffer_p, " ", &save_p);
+         (NULL != arg_p) && (MAX_TEST_ARGS > argc);
+         arg_p = strtok_r(NULL, " ", &save_p))
+    {
+        argv[argc++] = arg_p;
+    }
+    argv[argc] = NULL;
+
+    return argc;
+}
+
+static int parse_line(const char * line_p, options_t * options_p)
+{
+    char   buffer[MAX_TEST_LINE]   = { 0 };
+    char * argv[MAX_TEST_ARGS + 1] = { NULL };
+    int    argc                    = split_line(line_p, buffer, argv);
+
+    memset(options_p, 0, sizeof(*options_p));
+    return process_options(argc, argv, options_p);
+}
+
+static int parse_subset(const char * line_p,
+                        options_t *  options_p,
+                        int32_t *    rate_p)
+{
+    static const char * const names[] = { "p", "n", "q", "h", NULL };
+    static const option_extra_t extras[] = {
+        { "rate", true, parse_test_rate },
+        { NULL, false, NULL },
+    };
+
+    char   buffer[MAX_TEST_LINE]   = { 0 };
+    char * argv[MAX_TEST_ARGS + 1] = { NULL };
+    int    argc                    = split_line(line_p, buffer, argv);
+
+    memset(options_p, 0, sizeof(*options_p));
+    return options_parse_command_line(
+        argc, argv, names, extras, rate_p, options_p);
+}
+
+static int parse_test_rate(const char *  value_p,
+                           void *        context_p,
+                           const char ** reason_pp)
+{
+    char * end_p = NULL;
+    long   rate  = strtol(value_p, &end_p, 10);
+
+    if (('\0' == value_p[0]) || ('\0' != *end_p) || (1 > rate) ||
+        (INT32_MAX < rate))
+    {
+        *reason_pp = "must be a positive number";
+        return E_FAILURE;
+    }
+
+    *(int32_t *)context_p = (int32_t)rate;
+    return E_SUCCESS;
+}
+
+static int write_config(const char * contents_p, char * path_p)
+{
+    int    exit_code = E_FAILURE;
+    int    fd        = -1;
+    size_t length    = strlen(contents_p);
+
+    memcpy(path_p, TEST_PATH_TEMPLATE, TEST_PATH_SIZE);
+
+    fd = mkstemp(path_p);
+    if (-1 == fd)
+    {
+        path_p[0] = '\0';
+        goto END;
+    }
+
+    if (length != (size_t)write(fd, contents_p, length))
+    {
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    if (-1 != fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+static void clear_environment(void)
+{
+    char   name[MAX_TEST_LINE] = { 0 };
+    size_t length              = 0;
+    size_t idx                 = 0;
+
+    // unsetenv() shifts the entries after the one it removes
+    while (NULL != environ[idx])
+    {
+        if (0 != strncmp(environ[idx], TEST_ENV_PREFIX, TEST_ENV_PREFIX_LEN))
+        {
+            idx++;
+            continue;
+        }
+
+        length = strcspn(environ[idx], "=");
+        if (sizeof(name) <= length)
+        {
+            idx++;
+            continue;
+        }
+        memcpy(name, environ[idx], length);
+        name[length] = '\0';
+        unsetenv(name);
+    }
+}
+
+/*** end of file ***/
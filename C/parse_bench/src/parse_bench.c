@@ -0,0 +1,254 @@
+/**
+ * @file parse_bench.c
+ * @brief Integer Parsing Microbenchmark
+ *
+ * parse-bench times number_parse_int32_str() against strtol() (with the
+ * checks str_to_int32() needs to reject partial and out of range input) and
+ * against str_to_int32() itself, over the same corpus of decimal strings.
+ * The corpus mixes every length from one to ten digits, signs and a share of
+ * invalid strings, so neither branch prediction nor an early exit flatters
+ * any of the parsers. Each result is the best of several rounds.
+ *
+ * Usage: parse-bench [COUNT [ROUNDS]]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "number_converter.h"
+#include "number_parser.h"
+#include "utilities.h"
+
+#define DEFAULT_COUNT  65536    // Strings in the corpus
+#define DEFAULT_ROUNDS 50       // Passes over the corpus per parser
+#define MAX_COUNT      16777216 // Largest corpus accepted
+#define MAX_ROUNDS     10000    // Most rounds accepted
+#define TEXT_SIZE      16       // Bytes per corpus string, with NUL
+#define INVALID_SHARE  8        // One string in this many is invalid
+#define NSEC_PER_SEC   1000000000ULL
+
+/**
+ * @brief Parses one string; E_SUCCESS or E_FAILURE like the parsers timed.
+ */
+typedef int (*bench_parser_t)(const char * text_p, int32_t * value_p);
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Fills the corpus with random decimal strings.
+ *
+ * @param corpus_p COUNT strings of TEXT_SIZE bytes each.
+ * @param count The number of strings.
+ */
+static void build_corpus(char * corpus_p, size_t count);
+
+/**
+ * @brief Times one parser over the corpus.
+ *
+ * @param name_p The parser's name, for the report.
+ * @param parse The parser.
+ * @param corpus_p The corpus.
+ * @param count The number of strings in it.
+ * @param rounds The number of passes; the fastest one is reported.
+ */
+static void time_parser(const char *   name_p,
+                        bench_parser_t parse,
+                        const char *   corpus_p,
+                        size_t         count,
+                        int32_t        rounds);
+
+/**
+ * @brief strtol() with the checks a strict int32 parser needs.
+ */
+static int parse_with_strtol(const char * text_p, int32_t * value_p);
+
+/**
+ * @brief str_to_int32(), adapted to bench_parser_t.
+ */
+static int parse_with_converter(const char * text_p, int32_t * value_p);
+
+/**
+ * @brief Returns CLOCK_MONOTONIC in nanoseconds.
+ */
+static uint64_t now_ns(void);
+
+int main(int argc, char ** argv)
+{
+    int     exit_code = E_FAILURE;
+    int32_t count     = DEFAULT_COUNT;
+    int32_t rounds    = DEFAULT_ROUNDS;
+    char *  corpus_p  = NULL;
+
+    if ((2 <= argc) &&
+        ((E_SUCCESS != number_parse_int32_str(argv[1], &count)) ||
+         (1 > count) || (MAX_COUNT < count)))
+    {
+        fprintf(stderr, "Usage: %s [COUNT [ROUNDS]]\n", argv[0]);
+        goto END;
+    }
+
+    if ((3 <= argc) &&
+        ((E_SUCCESS != number_parse_int32_str(argv[2], &rounds)) ||
+         (1 > rounds) || (MAX_ROUNDS < rounds)))
+    {
+        fprintf(stderr, "Usage: %s [COUNT [ROUNDS]]\n", argv[0]);
+        goto END;
+    }
+
+    corpus_p = calloc((size_t)count, TEXT_SIZE);
+    if (NULL == corpus_p)
+    {
+        print_error("main(): calloc() failed.");
+        goto END;
+    }
+
+    build_corpus(corpus_p, (size_t)count);
+
+    printf("%d strings, best of %d rounds\n", count, rounds);
+    time_parser("number_parse_int32_str",
+                number_parse_int32_str,
+                corpus_p,
+                (size_t)count,
+                rounds);
+    time_parser("strtol", parse_with_strtol, corpus_p, (size_t)count, rounds);
+    time_parser("str_to_int32",
+                parse_with_converter,
+                corpus_p,
+                (size_t)count,
+                rounds);
+
+    exit_code = E_SUCCESS;
+END:
+    free(corpus_p);
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static void build_corpus(char * corpus_p, size_t count)
+{
+    char * text_p = NULL;
+    size_t pos    = 0;
+    int    digits = 0;
+
+    srand(1);
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        text_p = corpus_p + (idx * TEXT_SIZE);
+        pos    = 0;
+        digits = 1 + (rand() % 10);
+
+        if (0 == (rand() % 4))
+        {
+            text_p[pos++] = '-';
+        }
+
+        // Leading zeros would make ten digit strings out of range less often
+        text_p[pos++] = (char)('1' + (rand() % 9));
+        for (int digit = 1; digit < digits; digit++)
+        {
+            text_p[pos++] = (char)('0' + (rand() % 10));
+        }
+
+        if (0 == (rand() % INVALID_SHARE))
+        {
+            text_p[rand() % pos] = 'x';
+        }
+        text_p[pos] = '\0';
+    }
+}
+
+static void time_parser(const char *   name_p,
+                        bench_parser_t parse,
+                        const char *   corpus_p,
+                        size_t         count,
+                        int32_t        rounds)
+{
+    uint64_t best     = UINT64_MAX;
+    uint64_t start    = 0;
+    uint64_t elapsed  = 0;
+    uint64_t checksum = 0;
+    size_t   failures = 0;
+    int32_t  value    = 0;
+
+    for (int32_t round = 0; round < rounds; round++)
+    {
+        checksum = 0;
+        failures = 0;
+        start    = now_ns();
+
+        for (size_t idx = 0; idx < count; idx++)
+        {
+            if (E_SUCCESS == parse(corpus_p + (idx * TEXT_SIZE), &value))
+            {
+                checksum += (uint32_t)value;
+            }
+            else
+            {
+                failures++;
+            }
+        }
+
+        elapsed = now_ns() - start;
+        if (elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+
+    // The checksum keeps the compiler from dropping the parses, and lets the
+    // parsers be compared for agreement
+    printf("  %-24s %7.2f ns/string  (rejected %zu, checksum %016llx)\n",
+           name_p,
+           (double)best / (double)count,
+           failures,
+           (unsigned long long)checksum);
+}
+
+static int parse_with_strtol(const char * text_p, int32_t * value_p)
+{
+    char * end_p = NULL;
+    long   value = 0;
+
+    errno = 0;
+    value = strtol(text_p, &end_p, 10);
+    if ((0 != errno) || (end_p == text_p) || ('\0' != *end_p) ||
+        (INT32_MIN > value) || (INT32_MAX < value))
+    {
+        return E_FAILURE;
+    }
+
+    *value_p = (int32_t)value;
+    return E_SUCCESS;
+}
+
+static int parse_with_converter(const char * text_p, int32_t * value_p)
+{
+    number_t number = { 0 };
+
+    if (E_SUCCESS != str_to_int32((char *)text_p, &number))
+    {
+        return E_FAILURE;
+    }
+
+    *value_p = number.signed_num;
+    return E_SUCCESS;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec now = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * NSEC_PER_SEC) + (uint64_t)now.tv_nsec;
+}
+
+/*** end of file ***/
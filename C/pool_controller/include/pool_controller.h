@@ -0,0 +1,123 @@
+/**
+ * @file pool_controller.h
+ * @brief Header for the Adaptive Thread Pool Controller
+ *
+ * This header file provides the interface for '--max-threads', which lets
+ * the pool run anywhere between '-n' and '--max-threads' workers. Every
+ * worker up to the maximum is started once; the controller decides how
+ * many of them are active and the rest are parked on a condition variable,
+ * so growing the pool costs a wakeup rather than a thread creation.
+ *
+ * A controller thread calls pool_controller_update() every
+ * POOL_CONTROLLER_INTERVAL_MS with the cumulative load from
+ * metrics_load(). The pool grows when the mean queue wait is high while the
+ * active workers are busy, and shrinks when the wait is low and the load
+ * spread over one worker fewer would stay a clear margin below the growth
+ * threshold. Hysteresis keeps it from thrashing: the grow and shrink
+ * thresholds are far apart, a decision needs several samples in a row
+ * (shrinking needs many more than growing), and no decision is made for a
+ * while after each change.
+ *
+ */
+#ifndef _POOL_CONTROLLER_H
+#define _POOL_CONTROLLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define POOL_CONTROLLER_INTERVAL_MS 100 // Expected time between updates
+
+/**
+ * @struct pool_load
+ * @brief Cumulative counters of the whole pool, as read by metrics_load().
+ */
+typedef struct pool_load
+{
+    uint64_t now_ns;   // When the counters were read (metrics_now_ns())
+    uint64_t dequeued; // Requests taken off the work queue
+    uint64_t wait_ns;  // Total time those requests spent queued
+    uint64_t busy_ns;  // Total time workers spent computing
+} pool_load_t;
+
+/**
+ * @struct pool_controller
+ * @brief Opaque controller handle.
+ */
+typedef struct pool_controller pool_controller_t;
+
+/**
+ * @brief Creates a controller with 'min_workers' of them active.
+ *
+ * @param min_workers Workers that are never parked ('-n', at least 1).
+ * @param max_workers Workers started ('--max-threads', >= min_workers).
+ * @return pool_controller_t * - The controller, or NULL on failure.
+ */
+pool_controller_t * pool_controller_create(size_t min_workers,
+                                           size_t max_workers);
+
+/**
+ * @brief Destroys a controller and sets the caller's pointer to NULL.
+ *
+ * No worker may still be parked; call pool_controller_stop() and join them
+ * first.
+ *
+ * @param controller_pp The address of the controller pointer.
+ */
+void pool_controller_destroy(pool_controller_t ** controller_pp);
+
+/**
+ * @brief Feeds one load sample to the controller and applies its decision.
+ *
+ * Called by a single controller thread. Parked workers are woken when the
+ * pool grows; when it shrinks, the worker with the highest index parks
+ * after its current work item.
+ *
+ * @param controller_p The controller.
+ * @param load_p The pool's cumulative counters.
+ * @return size_t - The number of active workers after the update.
+ */
+size_t pool_controller_update(pool_controller_t * controller_p,
+                              const pool_load_t * load_p);
+
+/**
+ * @brief Returns the number of active workers.
+ *
+ * @param controller_p The controller.
+ * @return size_t - The count.
+ */
+size_t pool_controller_active(const pool_controller_t * controller_p);
+
+/**
+ * @brief Reports whether a worker should park. Cheap enough for every item.
+ *
+ * @param controller_p The controller.
+ * @param worker The worker's index, from 0 to max_workers - 1.
+ * @return bool - true if the worker is beyond the active count or the pool
+ * is stopping; pool_controller_park() then tells the two apart.
+ */
+bool pool_controller_should_park(const pool_controller_t * controller_p,
+                                 size_t                    worker);
+
+/**
+ * @brief Parks a worker until the pool grows to include it again.
+ *
+ * A worker parks with no work item in hand; under '--scheduler
+ * work-stealing' its deque is left for the active workers to steal.
+ *
+ * @param controller_p The controller.
+ * @param worker The worker's index.
+ * @return int - Returns E_SUCCESS when the worker should run again, or
+ * E_FAILURE once pool_controller_stop() has been called.
+ */
+int pool_controller_park(pool_controller_t * controller_p, size_t worker);
+
+/**
+ * @brief Wakes every parked worker for shutdown and keeps them from parking.
+ *
+ * @param controller_p The controller.
+ */
+void pool_controller_stop(pool_controller_t * controller_p);
+
+#endif /* _POOL_CONTROLLER_H */
+/*** end of file ***/
@@ -0,0 +1,295 @@
+/**
+ * @file pool_controller.c
+ * @brief Adaptive Thread Pool Controller
+ *
+ * This file implements the grow and shrink decision and the parking of
+ * workers. The decision state is only touched by the controller thread; the
+ * active count is an atomic that workers read with a relaxed load between
+ * work items, and the mutex and condition variable are only used by workers
+ * that actually park or are woken.
+ *
+ * Growth is multiplicative (a quarter of the active workers, at least one)
+ * so a sudden peak is absorbed within a few samples; shrinking removes one
+ * worker at a time, since an idle worker costs little while a missing one
+ * costs queueing delay.
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "pool_controller.h"
+#include "utilities.h"
+
+#define GROW_WAIT_NS       200000 // Mean queue wait that calls for growth
+#define SHRINK_WAIT_NS     20000  // Mean queue wait below which to shrink
+#define GROW_UTILIZATION   0.80   // Busy fraction that calls for growth
+#define SHRINK_UTILIZATION 0.40   // Busy fraction below which to shrink
+#define SHRINK_MARGIN      0.20   // Headroom a shrink keeps below growth
+#define SHRINK_PROJECTED   (GROW_UTILIZATION - SHRINK_MARGIN) // Busy limit
+#define GROW_SAMPLES       3      // Samples in a row before growing
+#define SHRINK_SAMPLES     50     // Samples in a row before shrinking
+#define COOLDOWN_SAMPLES   10     // Samples ignored after any change
+#define GROW_DIVISOR       4      // Growth step is active / GROW_DIVISOR
+
+struct pool_controller
+{
+    pthread_mutex_t lock;        // Guards 'stop' for parked workers
+    pthread_cond_t  wake;        // Signalled when workers may run
+    atomic_size_t   active;      // Workers that should run
+    atomic_bool     stop;        // pool_controller_stop() was called
+    size_t          min_workers; // Never parked
+    size_t          max_workers; // Started
+
+    // Controller thread only
+    pool_load_t last;          // Previous sample
+    bool        have_last;     // Whether 'last' is set
+    size_t      grow_streak;   // Samples in a row calling for growth
+    size_t      shrink_streak; // Samples in a row calling for shrinking
+    size_t      cooldown;      // Samples left to ignore
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Changes the active count, waking parked workers if it grew.
+ *
+ * @param controller_p The controller.
+ * @param active The new count.
+ */
+static void set_active(pool_controller_t * controller_p, size_t active);
+
+// +---------------------------------------------------------------------------+
+// |                           POOL CONTROLLER API                             |
+// +---------------------------------------------------------------------------+
+
+pool_controller_t * pool_controller_create(size_t min_workers,
+                                           size_t max_workers)
+{
+    pool_controller_t * controller_p = NULL;
+
+    if ((0 == min_workers) || (min_workers > max_workers))
+    {
+        print_error("pool_controller_create(): Invalid worker limits.");
+        goto END;
+    }
+
+    controller_p = calloc(1, sizeof(pool_controller_t));
+    if (NULL == controller_p)
+    {
+        print_error("pool_controller_create(): calloc() failed.");
+        goto END;
+    }
+
+    if (0 != pthread_mutex_init(&controller_p->lock, NULL))
+    {
+        print_error("pool_controller_create(): pthread_mutex_init() failed.");
+        free(controller_p);
+        controller_p = NULL;
+        goto END;
+    }
+
+    if (0 != pthread_cond_init(&controller_p->wake, NULL))
+    {
+        print_error("pool_controller_create(): pthread_cond_init() failed.");
+        pthread_mutex_destroy(&controller_p->lock);
+        free(controller_p);
+        controller_p = NULL;
+        goto END;
+    }
+
+    atomic_init(&controller_p->active, min_workers);
+    atomic_init(&controller_p->stop, false);
+    controller_p->min_workers = min_workers;
+    controller_p->max_workers = max_workers;
+
+END:
+    return controller_p;
+}
+
+void pool_controller_destroy(pool_controller_t ** controller_pp)
+{
+    if ((NULL == controller_pp) || (NULL == *controller_pp))
+    {
+        return;
+    }
+
+    pthread_cond_destroy(&(*controller_pp)->wake);
+    pthread_mutex_destroy(&(*controller_pp)->lock);
+    free(*controller_pp);
+    *controller_pp = NULL;
+}
+
+size_t pool_controller_update(pool_controller_t * controller_p,
+                              const pool_load_t * load_p)
+{
+    size_t   active      = 0;
+    uint64_t elapsed_ns  = 0;
+    uint64_t dequeued    = 0;
+    double   mean_wait   = 0.0;
+    double   utilization = 0.0;
+    double   projected   = 0.0;
+    size_t   step        = 0;
+
+    if ((NULL == controller_p) || (NULL == load_p))
+    {
+        print_error("pool_controller_update(): NULL argument passed.");
+        return 0;
+    }
+
+    active = atomic_load_explicit(&controller_p->active, memory_order_relaxed);
+
+    if ((false == controller_p->have_last) ||
+        (load_p->now_ns <= controller_p->last.now_ns))
+    {
+        controller_p->last      = *load_p;
+        controller_p->have_last = true;
+        return active;
+    }
+
+    elapsed_ns  = load_p->now_ns - controller_p->last.now_ns;
+    dequeued    = load_p->dequeued - controller_p->last.dequeued;
+    utilization = (double)(load_p->busy_ns - controller_p->last.busy_ns) /
+                  ((double)elapsed_ns * (double)active);
+    if (0 < dequeued)
+    {
+        mean_wait = (double)(load_p->wait_ns - controller_p->last.wait_ns) /
+                    (double)dequeued;
+    }
+    controller_p->last = *load_p;
+
+    if (0 < controller_p->cooldown)
+    {
+        controller_p->cooldown--;
+        return active;
+    }
+
+    // The load the remaining workers would carry with one worker fewer. It
+    // must stay SHRINK_MARGIN below the growth threshold, not merely below
+    // it, so that normal variation after a shrink does not grow the pool
+    // straight back; this binds for small pools, where one worker is a large
+    // share of the capacity (with 2 active, shrinking needs under 30% busy)
+    projected = (1 < active)
+                    ? (utilization * (double)active / (double)(active - 1))
+                    : 1.0;
+
+    if ((GROW_WAIT_NS <= mean_wait) && (GROW_UTILIZATION <= utilization) &&
+        (active < controller_p->max_workers))
+    {
+        controller_p->grow_streak++;
+        controller_p->shrink_streak = 0;
+    }
+    else if ((SHRINK_WAIT_NS >= mean_wait) &&
+             (SHRINK_UTILIZATION > utilization) &&
+             (SHRINK_PROJECTED > projected) &&
+             (active > controller_p->min_workers))
+    {
+        controller_p->shrink_streak++;
+        controller_p->grow_streak = 0;
+    }
+    else
+    {
+        controller_p->grow_streak   = 0;
+        controller_p->shrink_streak = 0;
+    }
+
+    if (GROW_SAMPLES <= controller_p->grow_streak)
+    {
+        step   = (GROW_DIVISOR <= active) ? (active / GROW_DIVISOR) : 1;
+        active = (controller_p->max_workers - active < step)
+                     ? controller_p->max_workers
+                     : active + step;
+    }
+    else if (SHRINK_SAMPLES <= controller_p->shrink_streak)
+    {
+        active--;
+    }
+    else
+    {
+        return active;
+    }
+
+    controller_p->grow_streak   = 0;
+    controller_p->shrink_streak = 0;
+    controller_p->cooldown      = COOLDOWN_SAMPLES;
+    set_active(controller_p, active);
+
+    return active;
+}
+
+size_t pool_controller_active(const pool_controller_t * controller_p)
+{
+    if (NULL == controller_p)
+    {
+        return 0;
+    }
+
+    return atomic_load_explicit(&controller_p->active, memory_order_relaxed);
+}
+
+bool pool_controller_should_park(const pool_controller_t * controller_p,
+                                 size_t                    worker)
+{
+    return (worker >= atomic_load_explicit(&controller_p->active,
+                                           memory_order_relaxed)) ||
+           (true ==
+            atomic_load_explicit(&controller_p->stop, memory_order_relaxed));
+}
+
+int pool_controller_park(pool_controller_t * controller_p, size_t worker)
+{
+    int exit_code = E_FAILURE;
+
+    if (NULL == controller_p)
+    {
+        print_error("pool_controller_park(): NULL argument passed.");
+        return E_FAILURE;
+    }
+
+    pthread_mutex_lock(&controller_p->lock);
+    while ((false == atomic_load(&controller_p->stop)) &&
+           (worker >= atomic_load(&controller_p->active)))
+    {
+        pthread_cond_wait(&controller_p->wake, &controller_p->lock);
+    }
+    exit_code =
+        (true == atomic_load(&controller_p->stop)) ? E_FAILURE : E_SUCCESS;
+    pthread_mutex_unlock(&controller_p->lock);
+
+    return exit_code;
+}
+
+void pool_controller_stop(pool_controller_t * controller_p)
+{
+    if (NULL == controller_p)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&controller_p->lock);
+    atomic_store(&controller_p->stop, true);
+    pthread_cond_broadcast(&controller_p->wake);
+    pthread_mutex_unlock(&controller_p->lock);
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static void set_active(pool_controller_t * controller_p, size_t active)
+{
+    size_t previous = atomic_load(&controller_p->active);
+
+    // Under the lock, so that a worker between its check and its wait
+    // cannot miss the broadcast
+    pthread_mutex_lock(&controller_p->lock);
+    atomic_store(&controller_p->active, active);
+    if (active > previous)
+    {
+        pthread_cond_broadcast(&controller_p->wake);
+    }
+    pthread_mutex_unlock(&controller_p->lock);
+}
+
+/*** end of file ***/
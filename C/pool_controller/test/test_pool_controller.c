@@ -0,0 +1,446 @@
+/**
+ * @file test_pool_controller.c
+ * @brief Tests for the Adaptive Thread Pool Controller
+ *
+ * Feeds the controller synthetic load samples, one per
+ * POOL_CONTROLLER_INTERVAL_MS, and checks its decisions: a busy pool with
+ * long queue waits grows after GROW_SAMPLES samples by a quarter of its
+ * workers (at least one) up to the maximum, nothing is decided for
+ * COOLDOWN_SAMPLES samples after a change, and an idle pool shrinks one
+ * worker at a time after SHRINK_SAMPLES samples, down to the minimum but
+ * never while the remaining workers would be left too close to growing
+ * again. Last, worker threads park beyond the active count, are woken when
+ * the pool grows, park again when it shrinks, and leave once the pool is
+ * stopped.
+ *
+ * Usage: test-pool-controller
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "pool_controller.h"
+#include "utilities.h"
+
+// As in pool_controller.c
+#define GROW_SAMPLES     3  // Samples in a row before growing
+#define SHRINK_SAMPLES   50 // Samples in a row before shrinking
+#define COOLDOWN_SAMPLES 10 // Samples ignored after any change
+
+#define SAMPLE_NS      ((uint64_t)POOL_CONTROLLER_INTERVAL_MS * 1000000)
+#define SAMPLE_ITEMS   100    // Requests dequeued in each sample
+#define BUSY_LOAD      0.90   // Busy fraction of a pool that should grow
+#define BUSY_WAIT_NS   300000 // Mean queue wait of a pool that should grow
+#define IDLE_LOAD      0.25   // Busy fraction of a pool that should shrink
+#define IDLE_WAIT_NS   1000   // Mean queue wait of a pool that should shrink
+#define CLOSE_LOAD     0.35   // Idle, but too busy for one worker fewer
+#define TEST_WORKERS   3      // Workers of test_park()
+#define TEST_TIMEOUT_S 5      // Longest wait for a worker to park or wake
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr,                                                    \
+                    "%s:%d: CHECK(%s) failed\n",                               \
+                    __FILE__,                                                  \
+                    __LINE__,                                                  \
+                    #condition);                                               \
+            goto END;                                                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @struct worker
+ * @brief One worker thread of test_park().
+ */
+typedef struct worker
+{
+    pool_controller_t * controller_p; // Shared controller
+    size_t              index;        // The worker's index
+    atomic_size_t       parks;        // Calls to pool_controller_park()
+    atomic_size_t       wakes;        // Of those, returns with E_SUCCESS
+} worker_t;
+
+/**
+ * @struct test_case
+ * @brief One named test.
+ */
+typedef struct test_case
+{
+    const char * name_p; // Printed with the result
+    int (*run)(void);    // Returns E_SUCCESS if the test passed
+} test_case_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Checks invalid limits and that a fixed size pool never changes.
+ */
+static int test_limits(void);
+
+/**
+ * @brief Checks the growth streak, the growth step, the cooldown and the cap.
+ */
+static int test_grow(void);
+
+/**
+ * @brief Checks the shrink streak, the projected load guard and the floor.
+ */
+static int test_shrink(void);
+
+/**
+ * @brief Checks that workers park, wake on growth and leave on stop.
+ */
+static int test_park(void);
+
+/**
+ * @brief Feeds the controller samples of a constant load.
+ *
+ * @param controller_p The controller.
+ * @param load_p The cumulative counters, advanced by each sample.
+ * @param utilization Busy fraction of the active workers.
+ * @param wait_ns Mean queue wait of the requests.
+ * @param samples How many samples to feed.
+ * @return size_t - The number of active workers after the last sample.
+ */
+static size_t feed(pool_controller_t * controller_p,
+                   pool_load_t *       load_p,
+                   double              utilization,
+                   uint64_t            wait_ns,
+                   size_t              samples);
+
+/**
+ * @brief Waits for a worker counter to reach a value.
+ *
+ * @param counter_p The counter.
+ * @param target The value.
+ * @return int - Returns E_SUCCESS once reached, or E_FAILURE after
+ * TEST_TIMEOUT_S seconds.
+ */
+static int wait_for(atomic_size_t * counter_p, size_t target);
+
+/**
+ * @brief Runs like a pool worker, yielding in place of work items.
+ *
+ * @param arg_p The worker_t.
+ * @return NULL.
+ */
+static void * worker_run(void * arg_p);
+
+int main(void)
+{
+    static const test_case_t tests[] = {
+        { "limits", test_limits }, { "grow", test_grow },
+        { "shrink", test_shrink }, { "park", test_park },
+    };
+    int exit_code = E_SUCCESS;
+
+    for (size_t idx = 0; idx < sizeof(tests) / sizeof(tests[0]); idx++)
+    {
+        if (E_SUCCESS == tests[idx].run())
+        {
+            printf("PASS %s\n", tests[idx].name_p);
+        }
+        else
+        {
+            printf("FAIL %s\n", tests[idx].name_p);
+            exit_code = E_FAILURE;
+        }
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int test_limits(void)
+{
+    int                 exit_code    = E_FAILURE;
+    pool_controller_t * controller_p = NULL;
+    pool_load_t         load         = { 0 };
+
+    CHECK(NULL == pool_controller_create(0, 4));
+    CHECK(NULL == pool_controller_create(3, 2));
+    CHECK(0 == pool_controller_update(NULL, &load));
+    CHECK(0 == pool_controller_active(NULL));
+
+    controller_p = pool_controller_create(2, 2);
+    CHECK(NULL != controller_p);
+    CHECK(2 == pool_controller_active(controller_p));
+    CHECK(0 == pool_controller_update(controller_p, NULL));
+
+    // Neither a busy nor an idle pool can leave the limits
+    CHECK(2 == feed(controller_p, &load, BUSY_LOAD, BUSY_WAIT_NS, 100));
+    CHECK(2 == feed(controller_p, &load, IDLE_LOAD, IDLE_WAIT_NS, 100));
+
+    pool_controller_destroy(&controller_p);
+    CHECK(NULL == controller_p);
+    pool_controller_destroy(&controller_p);
+
+    exit_code = E_SUCCESS;
+END:
+    pool_controller_destroy(&controller_p);
+    return exit_code;
+}
+
+static int test_grow(void)
+{
+    int                 exit_code    = E_FAILURE;
+    pool_controller_t * controller_p = NULL;
+    pool_load_t         load         = { 0 };
+    size_t              active       = 0;
+
+    controller_p = pool_controller_create(2, 8);
+    CHECK(NULL != controller_p);
+
+    // The first sample only sets the baseline
+    CHECK(2 == feed(controller_p, &load, BUSY_LOAD, BUSY_WAIT_NS, 1));
+    CHECK(2 ==
+          feed(controller_p, &load, BUSY_LOAD, BUSY_WAIT_NS, GROW_SAMPLES - 1));
+    CHECK(3 == feed(controller_p, &load, BUSY_LOAD, BUSY_WAIT_NS, 1));
+
+    // Busy as the pool still is, it waits out the cooldown, then a streak
+    CHECK(3 == feed(controller_p,
+                    &load,
+                    BUSY_LOAD,
+                    BUSY_WAIT_NS,
+                    COOLDOWN_SAMPLES + GROW_SAMPLES - 1));
+    CHECK(4 == feed(controller_p, &load, BUSY_LOAD, BUSY_WAIT_NS, 1));
+
+    // A busy sample with short waits breaks the streak
+    CHECK(4 == feed(controller_p,
+                    &load,
+                    BUSY_LOAD,
+                    BUSY_WAIT_NS,
+                    COOLDOWN_SAMPLES + GROW_SAMPLES - 1));
+    CHECK(4 == feed(controller_p, &load, BUSY_LOAD, IDLE_WAIT_NS, 1));
+    CHECK(4 ==
+          feed(controller_p, &load, BUSY_LOAD, BUSY_WAIT_NS, GROW_SAMPLES - 1));
+    CHECK(5 == feed(controller_p, &load, BUSY_LOAD, BUSY_WAIT_NS, 1));
+
+    // Up to the maximum, and no further
+    for (size_t sample = 0; sample < 100; sample++)
+    {
+        active = feed(controller_p, &load, BUSY_LOAD, BUSY_WAIT_NS, 1);
+        CHECK(8 >= active);
+    }
+    CHECK(8 == active);
+    pool_controller_destroy(&controller_p);
+
+    // Larger pools grow by a quarter of their workers
+    controller_p = pool_controller_create(8, 32);
+    CHECK(NULL != controller_p);
+    CHECK(10 == feed(controller_p,
+                     &load,
+                     BUSY_LOAD,
+                     BUSY_WAIT_NS,
+                     1 + GROW_SAMPLES));
+    CHECK(12 == feed(controller_p,
+                     &load,
+                     BUSY_LOAD,
+                     BUSY_WAIT_NS,
+                     COOLDOWN_SAMPLES + GROW_SAMPLES));
+
+    exit_code = E_SUCCESS;
+END:
+    pool_controller_destroy(&controller_p);
+    return exit_code;
+}
+
+static int test_shrink(void)
+{
+    int                 exit_code    = E_FAILURE;
+    pool_controller_t * controller_p = NULL;
+    pool_load_t         load         = { 0 };
+
+    controller_p = pool_controller_create(1, 4);
+    CHECK(NULL != controller_p);
+    CHECK(2 == feed(controller_p,
+                    &load,
+                    BUSY_LOAD,
+                    BUSY_WAIT_NS,
+                    1 + GROW_SAMPLES));
+
+    // At 35% busy, one worker would carry 70%: too close to growing
+    CHECK(2 == feed(controller_p,
+                    &load,
+                    CLOSE_LOAD,
+                    IDLE_WAIT_NS,
+                    COOLDOWN_SAMPLES + (2 * SHRINK_SAMPLES)));
+
+    // At 25% busy it would carry 50%, so the pool shrinks after a streak
+    CHECK(2 == feed(controller_p,
+                    &load,
+                    IDLE_LOAD,
+                    IDLE_WAIT_NS,
+                    SHRINK_SAMPLES - 1));
+    CHECK(1 == feed(controller_p, &load, IDLE_LOAD, IDLE_WAIT_NS, 1));
+
+    // Never below the minimum
+    CHECK(1 == feed(controller_p,
+                    &load,
+                    IDLE_LOAD,
+                    IDLE_WAIT_NS,
+                    COOLDOWN_SAMPLES + (2 * SHRINK_SAMPLES)));
+
+    exit_code = E_SUCCESS;
+END:
+    pool_controller_destroy(&controller_p);
+    return exit_code;
+}
+
+static int test_park(void)
+{
+    int                 exit_code    = E_FAILURE;
+    pool_controller_t * controller_p = NULL;
+    pool_load_t         load         = { 0 };
+    size_t              started      = 1;
+    pthread_t           threads[TEST_WORKERS];
+    worker_t            workers[TEST_WORKERS];
+
+    controller_p = pool_controller_create(1, TEST_WORKERS);
+    CHECK(NULL != controller_p);
+
+    // Worker 0 is never parked; the main thread stands in for it
+    CHECK(false == pool_controller_should_park(controller_p, 0));
+    for (size_t idx = 1; idx < TEST_WORKERS; idx++)
+    {
+        workers[idx].controller_p = controller_p;
+        workers[idx].index        = idx;
+        atomic_init(&workers[idx].parks, 0);
+        atomic_init(&workers[idx].wakes, 0);
+        CHECK(0 == pthread_create(
+                       &threads[idx], NULL, worker_run, &workers[idx]));
+        started++;
+    }
+    CHECK(E_SUCCESS == wait_for(&workers[1].parks, 1));
+    CHECK(E_SUCCESS == wait_for(&workers[2].parks, 1));
+
+    // Growing to 2 wakes worker 1 only
+    CHECK(2 == feed(controller_p,
+                    &load,
+                    BUSY_LOAD,
+                    BUSY_WAIT_NS,
+                    1 + GROW_SAMPLES));
+    CHECK(E_SUCCESS == wait_for(&workers[1].wakes, 1));
+    CHECK(0 == atomic_load(&workers[2].wakes));
+
+    // Shrinking back to 1 parks it again after its current item
+    CHECK(1 == feed(controller_p,
+                    &load,
+                    IDLE_LOAD,
+                    IDLE_WAIT_NS,
+                    COOLDOWN_SAMPLES + SHRINK_SAMPLES));
+    CHECK(E_SUCCESS == wait_for(&workers[1].parks, 2));
+
+    // Growing to 3 wakes both
+    CHECK(2 == feed(controller_p,
+                    &load,
+                    BUSY_LOAD,
+                    BUSY_WAIT_NS,
+                    COOLDOWN_SAMPLES + GROW_SAMPLES));
+    CHECK(3 == feed(controller_p,
+                    &load,
+                    BUSY_LOAD,
+                    BUSY_WAIT_NS,
+                    COOLDOWN_SAMPLES + GROW_SAMPLES));
+    CHECK(E_SUCCESS == wait_for(&workers[1].wakes, 2));
+    CHECK(E_SUCCESS == wait_for(&workers[2].wakes, 1));
+
+    // Stopping sends every worker through a park that fails, and a park
+    // after the stop does not wait
+    pool_controller_stop(controller_p);
+    for (; 1 < started; started--)
+    {
+        pthread_join(threads[started - 1], NULL);
+    }
+    CHECK(true == pool_controller_should_park(controller_p, 0));
+    CHECK(E_FAILURE == pool_controller_park(controller_p, 0));
+    CHECK(2 == atomic_load(&workers[1].wakes));
+    CHECK(1 == atomic_load(&workers[2].wakes));
+
+    exit_code = E_SUCCESS;
+END:
+    pool_controller_stop(controller_p);
+    for (; 1 < started; started--)
+    {
+        pthread_join(threads[started - 1], NULL);
+    }
+    pool_controller_destroy(&controller_p);
+    return exit_code;
+}
+
+static size_t feed(pool_controller_t * controller_p,
+                   pool_load_t *       load_p,
+                   double              utilization,
+                   uint64_t            wait_ns,
+                   size_t              samples)
+{
+    size_t active = pool_controller_active(controller_p);
+
+    for (size_t sample = 0; sample < samples; sample++)
+    {
+        load_p->now_ns += SAMPLE_NS;
+        load_p->dequeued += SAMPLE_ITEMS;
+        load_p->wait_ns += SAMPLE_ITEMS * wait_ns;
+        load_p->busy_ns +=
+            (uint64_t)((double)SAMPLE_NS * (double)active * utilization);
+        active = pool_controller_update(controller_p, load_p);
+    }
+
+    return active;
+}
+
+static int wait_for(atomic_size_t * counter_p, size_t target)
+{
+    time_t deadline = time(NULL) + TEST_TIMEOUT_S;
+
+    while (target > atomic_load(counter_p))
+    {
+        if (time(NULL) > deadline)
+        {
+            fprintf(stderr, "Timed out waiting for a worker.\n");
+            return E_FAILURE;
+        }
+        sched_yield();
+    }
+
+    return E_SUCCESS;
+}
+
+static void * worker_run(void * arg_p)
+{
+    worker_t * worker_p = arg_p;
+
+    for (;;)
+    {
+        if (false == pool_controller_should_park(worker_p->controller_p,
+                                                 worker_p->index))
+        {
+            sched_yield();
+            continue;
+        }
+
+        atomic_fetch_add(&worker_p->parks, 1);
+        if (E_SUCCESS !=
+            pool_controller_park(worker_p->controller_p, worker_p->index))
+        {
+            break;
+        }
+        atomic_fetch_add(&worker_p->wakes, 1);
+    }
+
+    return NULL;
+}
+
+/*** end of file ***/
@@ -0,0 +1,177 @@
+/**
+ * @file qos_queue.h
+ * @brief Header for the Quality of Service Work Queue
+ *
+ * This header file provides the interface for splitting the work queue into
+ * named classes ('--qos-classes'), so that a flood of bulk requests cannot
+ * queue in front of interactive ones. Every class has its own lock-free
+ * queue and its own latency SLO counters; workers choose which class to
+ * serve next by strict priority or by weight ('--qos-policy').
+ *
+ */
+#ifndef _QOS_QUEUE_H
+#define _QOS_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define QOS_MAX_CLASSES 8        // Maximum number of classes
+#define QOS_MAX_NAME    16       // Size of a class name, with NUL
+#define QOS_MAX_WEIGHT  100      // Largest class weight
+#define QOS_MAX_SLO_US  60000000 // Largest latency objective (60 seconds)
+
+/**
+ * @enum qos_policy
+ * @brief How workers choose the class to dequeue from.
+ */
+typedef enum qos_policy
+{
+    QOS_POLICY_WEIGHTED = 0, // Serve classes in proportion to their weight
+    QOS_POLICY_STRICT,       // Always serve the first non-empty class
+} qos_policy_t;
+
+/**
+ * @struct qos_class
+ * @brief One class as given on the command line.
+ *
+ * Self-contained so that it can be stored in options_t.
+ */
+typedef struct qos_class
+{
+    char     name[QOS_MAX_NAME]; // e.g. "interactive"
+    uint32_t weight;             // Relative share of dequeues when weighted
+    uint32_t slo_us;             // Latency objective, 0 if none
+} qos_class_t;
+
+/**
+ * @struct qos_class_stats
+ * @brief A snapshot of one class's counters.
+ */
+typedef struct qos_class_stats
+{
+    uint64_t enqueued;   // Requests queued in the class
+    uint64_t completed;  // Requests whose latency was recorded
+    uint64_t slo_misses; // Completed requests slower than the objective
+    size_t   depth;      // Requests waiting now
+} qos_class_stats_t;
+
+/**
+ * @struct qos_queue
+ * @brief Opaque QoS queue handle.
+ */
+typedef struct qos_queue qos_queue_t;
+
+/**
+ * @brief Parses a class list such as "interactive:8:500,bulk:1".
+ *
+ * Each class is NAME:WEIGHT[:SLO_US]. Names are 1 to QOS_MAX_NAME - 1
+ * characters from [a-z0-9_-] and must be unique; weights are 1 to
+ * QOS_MAX_WEIGHT; the optional SLO is 1 to QOS_MAX_SLO_US microseconds.
+ * Under QOS_POLICY_STRICT classes are served in the order they are listed.
+ *
+ * @param spec_p The class list.
+ * @param classes_p Array where the parsed classes are stored.
+ * @param max_classes The capacity of classes_p.
+ * @param count_p Pointer to where the number of parsed classes is stored.
+ * @param reason_pp Optional pointer to where a static description of what
+ * is wrong with the list (e.g. "invalid weight") is stored on failure.
+ * Nothing is printed for a malformed list.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int qos_parse_classes(const char *  spec_p,
+                      qos_class_t * classes_p,
+                      size_t        max_classes,
+                      size_t *      count_p,
+                      const char ** reason_pp);
+
+/**
+ * @brief Creates a queue with one lock-free queue per class.
+ *
+ * @param classes_p The classes, in priority order.
+ * @param count The number of classes.
+ * @param depth The capacity of each class's queue.
+ * @param policy How dequeue chooses between classes.
+ * @return qos_queue_t * - The new queue, or NULL on failure.
+ */
+qos_queue_t * qos_queue_create(const qos_class_t * classes_p,
+                               size_t              count,
+                               size_t              depth,
+                               qos_policy_t        policy);
+
+/**
+ * @brief Destroys a queue and sets the caller's pointer to NULL.
+ *
+ * Items still queued are not freed.
+ *
+ * @param queue_pp The address of the queue pointer.
+ */
+void qos_queue_destroy(qos_queue_t ** queue_pp);
+
+/**
+ * @brief Looks up a class by name.
+ *
+ * @param queue_p The queue.
+ * @param name_p The class name.
+ * @param class_p Pointer to where the class index is stored.
+ * @return int - Returns E_SUCCESS if found, otherwise E_FAILURE.
+ */
+int qos_queue_find_class(const qos_queue_t * queue_p,
+                         const char *        name_p,
+                         size_t *            class_p);
+
+/**
+ * @brief Queues an item in a class.
+ *
+ * @param queue_p The queue.
+ * @param class_index The class.
+ * @param item_p The item.
+ * @return int - Returns E_SUCCESS on success, E_FAILURE if the class is full.
+ */
+int qos_queue_enqueue(qos_queue_t * queue_p, size_t class_index, void * item_p);
+
+/**
+ * @brief Takes the next item according to the policy.
+ *
+ * Under QOS_POLICY_WEIGHTED each worker walks its own copy of a smooth
+ * weighted round-robin schedule, held in 'cursor_p', so choosing a class
+ * adds no shared write. An empty class passes its turn to the next class in
+ * the schedule, so no worker idles while any class has work.
+ *
+ * @param queue_p The queue.
+ * @param cursor_p The calling worker's position in the schedule; start it
+ * at 0 and pass the same one on every call from that worker.
+ * @param item_pp Pointer to where the item is stored.
+ * @param class_p Pointer to where the item's class is stored; may be NULL.
+ * @return int - Returns E_SUCCESS on success, E_FAILURE if every class is
+ * empty.
+ */
+int qos_queue_dequeue(qos_queue_t * queue_p,
+                      uint32_t *    cursor_p,
+                      void **       item_pp,
+                      size_t *      class_p);
+
+/**
+ * @brief Records the end-to-end latency of one request of a class.
+ *
+ * @param queue_p The queue.
+ * @param class_index The request's class.
+ * @param latency_ns The time from arrival to reply, in nanoseconds.
+ */
+void qos_queue_record_latency(qos_queue_t * queue_p,
+                              size_t        class_index,
+                              uint64_t      latency_ns);
+
+/**
+ * @brief Reads a class's counters.
+ *
+ * @param queue_p The queue.
+ * @param class_index The class.
+ * @param stats_p Pointer to where the snapshot is stored.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int qos_queue_stats(const qos_queue_t * queue_p,
+                    size_t              class_index,
+                    qos_class_stats_t * stats_p);
+
+#endif /* _QOS_QUEUE_H */
+/*** end of file ***/
@@ -0,0 +1,446 @@
+/**
+ * @file qos_queue.c
+ * @brief Quality of Service Work Queue
+ *
+ * This file implements the per-class queues and the two dequeue policies.
+ * The weighted policy precomputes one smooth weighted round-robin schedule
+ * at creation (weights 3:1 give A A B A rather than A A A B), and each
+ * worker walks it with a private cursor, so the only shared writes on the
+ * dequeue path are those of the class queue itself. Each class's counters
+ * live on their own cache line, apart from the read-only class description
+ * every worker reads.
+ */
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpmc_queue.h"
+#include "number_parser.h"
+#include "qos_queue.h"
+#include "utilities.h"
+
+#define CACHE_LINE_SIZE   64 // Assumed size of a CPU cache line
+#define MAX_SCHEDULE_SIZE (QOS_MAX_CLASSES * QOS_MAX_WEIGHT)
+#define NSEC_PER_USEC     1000
+#define CLASS_NAME_CHARS  "abcdefghijklmnopqrstuvwxyz0123456789_-"
+#define DIGIT_CHARS       "0123456789"
+
+/**
+ * @struct qos_lane
+ * @brief One class: its description, its queue and its counters.
+ */
+typedef struct qos_lane
+{
+    alignas(CACHE_LINE_SIZE) qos_class_t config; // As configured
+    uint64_t       slo_ns;                       // Objective, 0 if none
+    mpmc_queue_t * queue_p;                      // Waiting requests
+    alignas(CACHE_LINE_SIZE) atomic_uint_least64_t enqueued; // Queued
+    atomic_uint_least64_t completed;                         // Recorded
+    atomic_uint_least64_t slo_misses;                        // Too slow
+} qos_lane_t;
+
+struct qos_queue
+{
+    qos_policy_t policy;                      // How classes are chosen
+    size_t       count;                       // Classes in use
+    uint32_t     schedule_size;               // Entries in 'schedule'
+    uint8_t      schedule[MAX_SCHEDULE_SIZE]; // Class of each turn
+    qos_lane_t   lanes[QOS_MAX_CLASSES];      // One per class
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Parses a decimal number within a range.
+ *
+ * @param str_p The digits; signs and whitespace are rejected.
+ * @param end_pp Pointer to where the first unparsed character is stored.
+ * @param max The largest value accepted; the smallest is 1.
+ * @param value_p Pointer to where the value is stored.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int parse_bounded(const char *  str_p,
+                         const char ** end_pp,
+                         int32_t       max,
+                         uint32_t *    value_p);
+
+/**
+ * @brief Fills in the smooth weighted round-robin schedule.
+ *
+ * Every turn, each class's credit grows by its weight and the class with
+ * the most credit is served and pays back the total weight. Over a full
+ * schedule each class is served exactly 'weight' times, spread as evenly
+ * as the weights allow.
+ *
+ * @param queue_p The queue, with its lanes configured.
+ */
+static void build_schedule(qos_queue_t * queue_p);
+
+// +---------------------------------------------------------------------------+
+// |                               QOS QUEUE API                               |
+// +---------------------------------------------------------------------------+
+
+int qos_parse_classes(const char *  spec_p,
+                      qos_class_t * classes_p,
+                      size_t        max_classes,
+                      size_t *      count_p,
+                      const char ** reason_pp)
+{
+    int          exit_code = E_FAILURE;
+    const char * reason_p  = NULL;
+    const char * cursor_p  = spec_p;
+    const char * end_p     = NULL;
+    size_t       name_len  = 0;
+    size_t       count     = 0;
+    qos_class_t  parsed    = { { 0 }, 0, 0 };
+
+    if ((NULL == spec_p) || (NULL == classes_p) || (NULL == count_p))
+    {
+        print_error("qos_parse_classes(): NULL argument passed.");
+        goto END;
+    }
+
+    while ('\0' != *cursor_p)
+    {
+        memset(&parsed, 0, sizeof(parsed));
+
+        name_len = strspn(cursor_p, CLASS_NAME_CHARS);
+        if ((0 == name_len) || (QOS_MAX_NAME <= name_len) ||
+            (':' != cursor_p[name_len]))
+        {
+            reason_p = "invalid class name";
+            goto END;
+        }
+        memcpy(parsed.name, cursor_p, name_len);
+
+        for (size_t idx = 0; idx < count; idx++)
+        {
+            if (0 == strcmp(classes_p[idx].name, parsed.name))
+            {
+                reason_p = "duplicate class name";
+                goto END;
+            }
+        }
+
+        if (E_SUCCESS != parse_bounded(cursor_p + name_len + 1,
+                                       &end_p,
+                                       QOS_MAX_WEIGHT,
+                                       &parsed.weight))
+        {
+            reason_p = "invalid weight";
+            goto END;
+        }
+
+        if ((':' == *end_p) &&
+            (E_SUCCESS !=
+             parse_bounded(end_p + 1, &end_p, QOS_MAX_SLO_US, &parsed.slo_us)))
+        {
+            reason_p = "invalid SLO";
+            goto END;
+        }
+
+        if ((',' != *end_p) && ('\0' != *end_p))
+        {
+            reason_p = "unexpected character";
+            goto END;
+        }
+
+        if (max_classes <= count)
+        {
+            reason_p = "too many classes";
+            goto END;
+        }
+        classes_p[count++] = parsed;
+
+        cursor_p = (',' == *end_p) ? (end_p + 1) : end_p;
+        if ((',' == *end_p) && ('\0' == *cursor_p))
+        {
+            reason_p = "trailing ','";
+            goto END;
+        }
+    }
+
+    if (0 == count)
+    {
+        reason_p = "empty class list";
+        goto END;
+    }
+
+    *count_p = count;
+
+    exit_code = E_SUCCESS;
+END:
+    if ((NULL != reason_p) && (NULL != reason_pp))
+    {
+        *reason_pp = reason_p;
+    }
+    return exit_code;
+}
+
+qos_queue_t * qos_queue_create(const qos_class_t * classes_p,
+                               size_t              count,
+                               size_t              depth,
+                               qos_policy_t        policy)
+{
+    qos_queue_t * queue_p = NULL;
+
+    if ((NULL == classes_p) || (0 == count) || (QOS_MAX_CLASSES < count) ||
+        (QOS_POLICY_STRICT < policy))
+    {
+        print_error("qos_queue_create(): Invalid argument passed.");
+        goto END;
+    }
+
+    queue_p = aligned_alloc(CACHE_LINE_SIZE, sizeof(qos_queue_t));
+    if (NULL == queue_p)
+    {
+        print_error("qos_queue_create(): aligned_alloc() failed.");
+        goto END;
+    }
+    memset(queue_p, 0, sizeof(qos_queue_t));
+
+    queue_p->policy = policy;
+    queue_p->count  = count;
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        if ((0 == classes_p[idx].weight) ||
+            (QOS_MAX_WEIGHT < classes_p[idx].weight))
+        {
+            print_error("qos_queue_create(): Invalid class weight.");
+            qos_queue_destroy(&queue_p);
+            goto END;
+        }
+
+        queue_p->lanes[idx].config  = classes_p[idx];
+        queue_p->lanes[idx].slo_ns  = (uint64_t)classes_p[idx].slo_us *
+                                     NSEC_PER_USEC;
+        queue_p->lanes[idx].queue_p = mpmc_queue_create(depth);
+        if (NULL == queue_p->lanes[idx].queue_p)
+        {
+            print_error("qos_queue_create(): Unable to create class queue.");
+            qos_queue_destroy(&queue_p);
+            goto END;
+        }
+
+        atomic_init(&queue_p->lanes[idx].enqueued, 0);
+        atomic_init(&queue_p->lanes[idx].completed, 0);
+        atomic_init(&queue_p->lanes[idx].slo_misses, 0);
+    }
+
+    build_schedule(queue_p);
+
+END:
+    return queue_p;
+}
+
+void qos_queue_destroy(qos_queue_t ** queue_pp)
+{
+    if ((NULL == queue_pp) || (NULL == *queue_pp))
+    {
+        return;
+    }
+
+    for (size_t idx = 0; idx < (*queue_pp)->count; idx++)
+    {
+        mpmc_queue_destroy(&(*queue_pp)->lanes[idx].queue_p);
+    }
+
+    free(*queue_pp);
+    *queue_pp = NULL;
+}
+
+int qos_queue_find_class(const qos_queue_t * queue_p,
+                         const char *        name_p,
+                         size_t *            class_p)
+{
+    if ((NULL == queue_p) || (NULL == name_p) || (NULL == class_p))
+    {
+        print_error("qos_queue_find_class(): NULL argument passed.");
+        return E_FAILURE;
+    }
+
+    for (size_t idx = 0; idx < queue_p->count; idx++)
+    {
+        if (0 == strcmp(queue_p->lanes[idx].config.name, name_p))
+        {
+            *class_p = idx;
+            return E_SUCCESS;
+        }
+    }
+
+    return E_FAILURE;
+}
+
+int qos_queue_enqueue(qos_queue_t * queue_p, size_t class_index, void * item_p)
+{
+    qos_lane_t * lane_p = NULL;
+
+    if ((NULL == queue_p) || (queue_p->count <= class_index))
+    {
+        print_error("qos_queue_enqueue(): Invalid argument passed.");
+        return E_FAILURE;
+    }
+
+    lane_p = &queue_p->lanes[class_index];
+    if (E_SUCCESS != mpmc_queue_enqueue(lane_p->queue_p, item_p))
+    {
+        return E_FAILURE;
+    }
+
+    atomic_fetch_add_explicit(&lane_p->enqueued, 1, memory_order_relaxed);
+    return E_SUCCESS;
+}
+
+int qos_queue_dequeue(qos_queue_t * queue_p,
+                      uint32_t *    cursor_p,
+                      void **       item_pp,
+                      size_t *      class_p)
+{
+    size_t first = 0;
+    size_t lane  = 0;
+
+    if ((NULL == queue_p) || (NULL == cursor_p) || (NULL == item_pp))
+    {
+        print_error("qos_queue_dequeue(): NULL argument passed.");
+        return E_FAILURE;
+    }
+
+    if (QOS_POLICY_WEIGHTED == queue_p->policy)
+    {
+        *cursor_p %= queue_p->schedule_size;
+        first = queue_p->schedule[*cursor_p];
+        (*cursor_p)++;
+    }
+
+    // Strict priority always starts from the first class; weighted starts
+    // from the scheduled one and, if it is empty, offers its turn to the
+    // others in order
+    for (size_t offset = 0; offset < queue_p->count; offset++)
+    {
+        lane = (first + offset) % queue_p->count;
+        if (E_SUCCESS ==
+            mpmc_queue_dequeue(queue_p->lanes[lane].queue_p, item_pp))
+        {
+            if (NULL != class_p)
+            {
+                *class_p = lane;
+            }
+            return E_SUCCESS;
+        }
+    }
+
+    return E_FAILURE;
+}
+
+void qos_queue_record_latency(qos_queue_t * queue_p,
+                              size_t        class_index,
+                              uint64_t      latency_ns)
+{
+    qos_lane_t * lane_p = NULL;
+
+    if ((NULL == queue_p) || (queue_p->count <= class_index))
+    {
+        return;
+    }
+
+    // Any worker may complete a request of any class, so these are shared
+    // counters; keeping them per class, on their own line, is what stops
+    // bulk traffic from contending with interactive traffic here
+    lane_p = &queue_p->lanes[class_index];
+    atomic_fetch_add_explicit(&lane_p->completed, 1, memory_order_relaxed);
+    if ((0 != lane_p->slo_ns) && (latency_ns > lane_p->slo_ns))
+    {
+        atomic_fetch_add_explicit(&lane_p->slo_misses, 1, memory_order_relaxed);
+    }
+}
+
+int qos_queue_stats(const qos_queue_t * queue_p,
+                    size_t              class_index,
+                    qos_class_stats_t * stats_p)
+{
+    const qos_lane_t * lane_p = NULL;
+
+    if ((NULL == queue_p) || (NULL == stats_p) ||
+        (queue_p->count <= class_index))
+    {
+        print_error("qos_queue_stats(): Invalid argument passed.");
+        return E_FAILURE;
+    }
+
+    lane_p = &queue_p->lanes[class_index];
+
+    stats_p->enqueued =
+        atomic_load_explicit(&lane_p->enqueued, memory_order_relaxed);
+    stats_p->completed =
+        atomic_load_explicit(&lane_p->completed, memory_order_relaxed);
+    stats_p->slo_misses =
+        atomic_load_explicit(&lane_p->slo_misses, memory_order_relaxed);
+    stats_p->depth = mpmc_queue_size(lane_p->queue_p);
+
+    return E_SUCCESS;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int parse_bounded(const char *  str_p,
+                         const char ** end_pp,
+                         int32_t       max,
+                         uint32_t *    value_p)
+{
+    int     exit_code = E_FAILURE;
+    size_t  length    = strspn(str_p, DIGIT_CHARS);
+    int32_t value     = 0;
+
+    // Only the digits are handed over, so signs and whitespace never parse
+    if ((0 == length) ||
+        (E_SUCCESS != number_parse_int32(str_p, length, &value)) ||
+        (1 > value) || (max < value))
+    {
+        goto END;
+    }
+
+    *end_pp   = str_p + length;
+    *value_p  = (uint32_t)value;
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static void build_schedule(qos_queue_t * queue_p)
+{
+    int32_t credit[QOS_MAX_CLASSES] = { 0 };
+    int32_t total                   = 0;
+    size_t  best                    = 0;
+
+    for (size_t idx = 0; idx < queue_p->count; idx++)
+    {
+        total += (int32_t)queue_p->lanes[idx].config.weight;
+    }
+
+    for (int32_t turn = 0; turn < total; turn++)
+    {
+        best = 0;
+        for (size_t idx = 0; idx < queue_p->count; idx++)
+        {
+            credit[idx] += (int32_t)queue_p->lanes[idx].config.weight;
+            if (credit[idx] > credit[best])
+            {
+                best = idx;
+            }
+        }
+
+        credit[best] -= total;
+        queue_p->schedule[turn] = (uint8_t)best;
+    }
+
+    queue_p->schedule_size = (uint32_t)total;
+}
+
+/*** end of file ***/
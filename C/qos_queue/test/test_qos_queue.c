@@ -0,0 +1,332 @@
+/**
+ * @file test_qos_queue.c
+ * @brief Tests for the Quality of Service Work Queue
+ *
+ * Single-threaded checks of the two dequeue policies: weights 3:1 must be
+ * served as the smooth schedule A A B A, an empty class must pass its turn
+ * on rather than stall a worker, and the strict policy must drain classes
+ * in the order they were listed. The class list parser is checked with
+ * well formed lists and with one list per rejection reason.
+ *
+ * Usage: test-qos-queue
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "qos_queue.h"
+#include "utilities.h"
+
+#define TEST_DEPTH 16 // Capacity of each class's queue
+#define TEST_ITEMS 8  // Items enqueued per class
+
+// Items are encoded as pointers; +1 keeps item 0 of class 0 non-NULL
+#define ITEM_ENCODE(class, seq)                                                \
+    ((void *)(uintptr_t)((((uint64_t)(class) << 32) | (seq)) + 1))
+#define ITEM_VALUE(item_p) (((uint64_t)(uintptr_t)(item_p)) - 1)
+#define ITEM_CLASS(item_p) (ITEM_VALUE(item_p) >> 32)
+#define ITEM_SEQ(item_p)   (ITEM_VALUE(item_p) & 0xFFFFFFFF)
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr,                                                    \
+                    "%s:%d: CHECK(%s) failed\n",                               \
+                    __FILE__,                                                  \
+                    __LINE__,                                                  \
+                    #condition);                                               \
+            goto END;                                                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @struct test_case
+ * @brief One named test.
+ */
+typedef struct test_case
+{
+    const char * name_p; // Printed with the result
+    int (*run)(void);    // Returns E_SUCCESS if the test passed
+} test_case_t;
+
+/**
+ * @struct parse_error
+ * @brief A malformed class list and the reason it must be rejected with.
+ */
+typedef struct parse_error
+{
+    const char * spec_p;   // The class list
+    const char * reason_p; // What qos_parse_classes() must report
+} parse_error_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Checks that weights 3:1 are served as A A B A, twice over.
+ */
+static int test_weighted(void);
+
+/**
+ * @brief Checks that an empty class passes its turn to one with work.
+ */
+static int test_pass_on(void);
+
+/**
+ * @brief Checks that the strict policy drains the first class first.
+ */
+static int test_strict(void);
+
+/**
+ * @brief Checks well formed class lists and every rejection reason.
+ */
+static int test_parse(void);
+
+/**
+ * @brief Creates a queue from a class list.
+ *
+ * @param spec_p The class list.
+ * @param policy How dequeue chooses between classes.
+ * @return qos_queue_t * - The new queue, or NULL on failure.
+ */
+static qos_queue_t * create_queue(const char * spec_p, qos_policy_t policy);
+
+/**
+ * @brief Enqueues TEST_ITEMS items, numbered in order, in one class.
+ *
+ * @param queue_p The queue.
+ * @param class_index The class.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int fill_class(qos_queue_t * queue_p, size_t class_index);
+
+int main(void)
+{
+    static const test_case_t tests[] = {
+        { "weighted", test_weighted }, { "pass-on", test_pass_on },
+        { "strict", test_strict },     { "parse", test_parse },
+    };
+    int exit_code = E_SUCCESS;
+
+    for (size_t idx = 0; idx < sizeof(tests) / sizeof(tests[0]); idx++)
+    {
+        if (E_SUCCESS == tests[idx].run())
+        {
+            printf("PASS %s\n", tests[idx].name_p);
+        }
+        else
+        {
+            printf("FAIL %s\n", tests[idx].name_p);
+            exit_code = E_FAILURE;
+        }
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int test_weighted(void)
+{
+    static const size_t expected[] = { 0, 0, 1, 0, 0, 0, 1, 0 };
+
+    int           exit_code = E_FAILURE;
+    qos_queue_t * queue_p   = NULL;
+    uint32_t      cursor    = 0;
+    void *        item_p    = NULL;
+    size_t        lane      = 0;
+    uint64_t      next[2]   = { 0 };
+
+    queue_p = create_queue("a:3,b:1", QOS_POLICY_WEIGHTED);
+    CHECK(NULL != queue_p);
+    CHECK(E_SUCCESS == fill_class(queue_p, 0));
+    CHECK(E_SUCCESS == fill_class(queue_p, 1));
+
+    for (size_t turn = 0; turn < sizeof(expected) / sizeof(expected[0]);
+         turn++)
+    {
+        CHECK(E_SUCCESS == qos_queue_dequeue(queue_p, &cursor, &item_p, &lane));
+        CHECK(expected[turn] == lane);
+        CHECK(lane == ITEM_CLASS(item_p));
+        CHECK(next[lane] == ITEM_SEQ(item_p));
+        next[lane]++;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    qos_queue_destroy(&queue_p);
+    return exit_code;
+}
+
+static int test_pass_on(void)
+{
+    int           exit_code = E_FAILURE;
+    qos_queue_t * queue_p   = NULL;
+    uint32_t      cursor    = 0;
+    void *        item_p    = NULL;
+    size_t        lane      = 0;
+
+    queue_p = create_queue("a:3,b:1", QOS_POLICY_WEIGHTED);
+    CHECK(NULL != queue_p);
+    CHECK(E_FAILURE == qos_queue_dequeue(queue_p, &cursor, &item_p, &lane));
+
+    // Only 'b' has work: every turn, 'a's included, is served from it
+    CHECK(E_SUCCESS == fill_class(queue_p, 1));
+    for (uint64_t seq = 0; seq < TEST_ITEMS; seq++)
+    {
+        CHECK(E_SUCCESS == qos_queue_dequeue(queue_p, &cursor, &item_p, &lane));
+        CHECK(1 == lane);
+        CHECK(ITEM_ENCODE(1, seq) == item_p);
+    }
+    CHECK(E_FAILURE == qos_queue_dequeue(queue_p, &cursor, &item_p, &lane));
+
+    // Only 'a' has work: 'b's turns go to it
+    CHECK(E_SUCCESS == fill_class(queue_p, 0));
+    for (uint64_t seq = 0; seq < TEST_ITEMS; seq++)
+    {
+        CHECK(E_SUCCESS == qos_queue_dequeue(queue_p, &cursor, &item_p, NULL));
+        CHECK(ITEM_ENCODE(0, seq) == item_p);
+    }
+    CHECK(E_FAILURE == qos_queue_dequeue(queue_p, &cursor, &item_p, &lane));
+
+    exit_code = E_SUCCESS;
+END:
+    qos_queue_destroy(&queue_p);
+    return exit_code;
+}
+
+static int test_strict(void)
+{
+    int           exit_code = E_FAILURE;
+    qos_queue_t * queue_p   = NULL;
+    uint32_t      cursor    = 0;
+    void *        item_p    = NULL;
+    size_t        lane      = 0;
+
+    // Weights do not matter under the strict policy
+    queue_p = create_queue("high:1,low:5", QOS_POLICY_STRICT);
+    CHECK(NULL != queue_p);
+
+    // Queued after 'low', yet served before it
+    CHECK(E_SUCCESS == fill_class(queue_p, 1));
+    CHECK(E_SUCCESS == fill_class(queue_p, 0));
+
+    for (size_t class_index = 0; class_index < 2; class_index++)
+    {
+        for (uint64_t seq = 0; seq < TEST_ITEMS; seq++)
+        {
+            CHECK(E_SUCCESS ==
+                  qos_queue_dequeue(queue_p, &cursor, &item_p, &lane));
+            CHECK(class_index == lane);
+            CHECK(ITEM_ENCODE(class_index, seq) == item_p);
+        }
+    }
+    CHECK(E_FAILURE == qos_queue_dequeue(queue_p, &cursor, &item_p, &lane));
+
+    exit_code = E_SUCCESS;
+END:
+    qos_queue_destroy(&queue_p);
+    return exit_code;
+}
+
+static int test_parse(void)
+{
+    static const parse_error_t errors[] = {
+        { "", "empty class list" },
+        { ":1", "invalid class name" },
+        { "Bulk:1", "invalid class name" },
+        { "abcdefghijklmnop:1", "invalid class name" },
+        { "bulk", "invalid class name" },
+        { "a:1,a:2", "duplicate class name" },
+        { "a:0", "invalid weight" },
+        { "a:101", "invalid weight" },
+        { "a:+1", "invalid weight" },
+        { "a:1:0", "invalid SLO" },
+        { "a:1:60000001", "invalid SLO" },
+        { "a:1x", "unexpected character" },
+        { "a:1,", "trailing ','" },
+        { "a:1,b:1,c:1,d:1,e:1,f:1,g:1,h:1,i:1", "too many classes" },
+    };
+
+    int          exit_code                = E_FAILURE;
+    qos_class_t  classes[QOS_MAX_CLASSES] = { { { 0 }, 0, 0 } };
+    size_t       count                    = 0;
+    const char * reason_p                 = NULL;
+
+    CHECK(E_SUCCESS == qos_parse_classes("interactive:8:500,bulk:1",
+                                         classes,
+                                         QOS_MAX_CLASSES,
+                                         &count,
+                                         &reason_p));
+    CHECK(2 == count);
+    CHECK(0 == strcmp("interactive", classes[0].name));
+    CHECK(8 == classes[0].weight);
+    CHECK(500 == classes[0].slo_us);
+    CHECK(0 == strcmp("bulk", classes[1].name));
+    CHECK(1 == classes[1].weight);
+    CHECK(0 == classes[1].slo_us);
+    CHECK(NULL == reason_p);
+
+    for (size_t idx = 0; idx < sizeof(errors) / sizeof(errors[0]); idx++)
+    {
+        reason_p = NULL;
+        count    = 0;
+        CHECK(E_FAILURE == qos_parse_classes(errors[idx].spec_p,
+                                             classes,
+                                             QOS_MAX_CLASSES,
+                                             &count,
+                                             &reason_p));
+        CHECK(NULL != reason_p);
+        if (0 != strcmp(errors[idx].reason_p, reason_p))
+        {
+            fprintf(stderr,
+                    "'%s': expected \"%s\", got \"%s\"\n",
+                    errors[idx].spec_p,
+                    errors[idx].reason_p,
+                    reason_p);
+            goto END;
+        }
+        CHECK(0 == count);
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static qos_queue_t * create_queue(const char * spec_p, qos_policy_t policy)
+{
+    qos_class_t classes[QOS_MAX_CLASSES] = { { { 0 }, 0, 0 } };
+    size_t      count                    = 0;
+
+    if (E_SUCCESS !=
+        qos_parse_classes(spec_p, classes, QOS_MAX_CLASSES, &count, NULL))
+    {
+        return NULL;
+    }
+
+    return qos_queue_create(classes, count, TEST_DEPTH, policy);
+}
+
+static int fill_class(qos_queue_t * queue_p, size_t class_index)
+{
+    for (uint64_t seq = 0; seq < TEST_ITEMS; seq++)
+    {
+        if (E_SUCCESS != qos_queue_enqueue(queue_p,
+                                           class_index,
+                                           ITEM_ENCODE(class_index, seq)))
+        {
+            return E_FAILURE;
+        }
+    }
+
+    return E_SUCCESS;
+}
+
+/*** end of file ***/
@@ -0,0 +1,72 @@
+/**
+ * @file result_cache.h
+ * @brief Header for the Calculation Result Cache
+ *
+ * This header file provides the interface for a bounded cache of calculation
+ * results keyed by operator and operands, so repeated expressions are
+ * answered without recomputation. The cache is sharded, with a reader-writer
+ * lock per shard, so concurrent lookups from many workers do not serialize.
+ *
+ */
+#ifndef _RESULT_CACHE_H
+#define _RESULT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @struct result_cache
+ * @brief Opaque result cache handle.
+ */
+typedef struct result_cache result_cache_t;
+
+/**
+ * @brief Creates a cache holding up to about 'entries' results.
+ *
+ * The capacity is rounded up to fill whole shards and buckets.
+ *
+ * @param entries The requested number of entries.
+ * @return result_cache_t * - The new cache, or NULL on failure.
+ */
+result_cache_t * result_cache_create(size_t entries);
+
+/**
+ * @brief Destroys a cache and sets the caller's pointer to NULL.
+ *
+ * @param cache_pp The address of the cache pointer.
+ */
+void result_cache_destroy(result_cache_t ** cache_pp);
+
+/**
+ * @brief Looks up a cached result.
+ *
+ * @param cache_p The cache.
+ * @param op The operator.
+ * @param lhs The left operand.
+ * @param rhs The right operand.
+ * @param result_p Pointer to where the result is stored on a hit.
+ * @return int - Returns E_SUCCESS on a hit, E_FAILURE on a miss.
+ */
+int result_cache_lookup(result_cache_t * cache_p,
+                        uint8_t          op,
+                        int32_t          lhs,
+                        int32_t          rhs,
+                        int32_t *        result_p);
+
+/**
+ * @brief Stores a result, evicting a not recently used entry if needed.
+ *
+ * @param cache_p The cache.
+ * @param op The operator.
+ * @param lhs The left operand.
+ * @param rhs The right operand.
+ * @param result The result to store.
+ */
+void result_cache_insert(result_cache_t * cache_p,
+                         uint8_t          op,
+                         int32_t          lhs,
+                         int32_t          rhs,
+                         int32_t          result);
+
+#endif /* _RESULT_CACHE_H */
+/*** end of file ***/
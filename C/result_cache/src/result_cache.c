@@ -0,0 +1,300 @@
+/**
+ * @file result_cache.c
+ * @brief Sharded CLOCK Result Cache
+ *
+ * This file implements the result cache as a set-associative table. A key
+ * hashes to one shard and to one bucket of BUCKET_WAYS entries within it.
+ * Each entry has a reference bit that lookups set; on insert into a full
+ * bucket the CLOCK hand skips referenced entries (clearing their bit) and
+ * evicts the first unreferenced one. This approximates LRU without moving
+ * entries, so a lookup only needs the shard's read lock: the reference bit
+ * is an atomic written with relaxed ordering.
+ */
+#define _GNU_SOURCE // for pthread_rwlock_t
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "result_cache.h"
+#include "utilities.h"
+
+#define CACHE_LINE_SIZE 64 // Assumed size of a CPU cache line
+#define CACHE_SHARDS    64 // Number of independently locked shards
+#define BUCKET_WAYS     4  // Entries per bucket
+
+/**
+ * @struct cache_entry
+ * @brief One cached result.
+ */
+typedef struct cache_entry
+{
+    uint64_t     key;        // Packed operands
+    uint8_t      op;         // Operator
+    bool         valid;      // Whether the entry holds a result
+    atomic_uchar referenced; // CLOCK reference bit
+    int32_t      result;     // Cached result
+} cache_entry_t;
+
+/**
+ * @struct cache_bucket
+ * @brief A set of entries sharing one hash value, and its CLOCK hand.
+ */
+typedef struct cache_bucket
+{
+    cache_entry_t entries[BUCKET_WAYS]; // The entries of the set
+    uint8_t       hand;                 // Next entry to consider evicting
+} cache_bucket_t;
+
+/**
+ * @struct cache_shard
+ * @brief A lock and the buckets it protects, padded to a cache line.
+ */
+typedef struct cache_shard
+{
+    alignas(CACHE_LINE_SIZE) pthread_rwlock_t lock; // Protects the buckets
+    cache_bucket_t * buckets_p;                     // Buckets of this shard
+} cache_shard_t;
+
+struct result_cache
+{
+    cache_shard_t shards[CACHE_SHARDS]; // The shards
+    size_t        bucket_mask;          // Buckets per shard - 1
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Hashes an operator and its operands.
+ *
+ * @param op The operator.
+ * @param key The packed operands.
+ * @return A well mixed 64-bit hash.
+ */
+static uint64_t hash_key(uint8_t op, uint64_t key);
+
+/**
+ * @brief Packs two operands into one 64-bit key.
+ *
+ * @param lhs The left operand.
+ * @param rhs The right operand.
+ * @return The packed key.
+ */
+static uint64_t pack_operands(int32_t lhs, int32_t rhs);
+
+/**
+ * @brief Finds the shard and bucket a key belongs to.
+ *
+ * @param cache_p The cache.
+ * @param hash The key's hash.
+ * @param shard_pp Pointer to where the shard is stored.
+ * @return The bucket.
+ */
+static cache_bucket_t * locate(result_cache_t * cache_p,
+                               uint64_t         hash,
+                               cache_shard_t ** shard_pp);
+
+// +---------------------------------------------------------------------------+
+// |                            RESULT CACHE API                               |
+// +---------------------------------------------------------------------------+
+
+result_cache_t * result_cache_create(size_t entries)
+{
+    result_cache_t * cache_p = NULL;
+    size_t           buckets = 1;
+    size_t           shard   = 0;
+
+    if (0 == entries)
+    {
+        print_error("result_cache_create(): Cache size must be positive.");
+        goto END;
+    }
+
+    while ((buckets * CACHE_SHARDS * BUCKET_WAYS) < entries)
+    {
+        buckets <<= 1;
+    }
+
+    cache_p = aligned_alloc(CACHE_LINE_SIZE, sizeof(*cache_p));
+    if (NULL == cache_p)
+    {
+        print_error("result_cache_create(): aligned_alloc() failed.");
+        goto END;
+    }
+    cache_p->bucket_mask = buckets - 1;
+
+    for (shard = 0; shard < CACHE_SHARDS; shard++)
+    {
+        cache_p->shards[shard].buckets_p =
+            calloc(buckets, sizeof(*cache_p->shards[shard].buckets_p));
+        if ((NULL == cache_p->shards[shard].buckets_p) ||
+            (0 != pthread_rwlock_init(&cache_p->shards[shard].lock, NULL)))
+        {
+            print_error("result_cache_create(): Unable to create shard.");
+            free(cache_p->shards[shard].buckets_p);
+            goto ERROR;
+        }
+    }
+
+    goto END;
+
+ERROR:
+    while (0 < shard)
+    {
+        shard--;
+        pthread_rwlock_destroy(&cache_p->shards[shard].lock);
+        free(cache_p->shards[shard].buckets_p);
+    }
+    free(cache_p);
+    cache_p = NULL;
+END:
+    return cache_p;
+}
+
+void result_cache_destroy(result_cache_t ** cache_pp)
+{
+    if ((NULL == cache_pp) || (NULL == *cache_pp))
+    {
+        return;
+    }
+
+    for (size_t shard = 0; shard < CACHE_SHARDS; shard++)
+    {
+        pthread_rwlock_destroy(&(*cache_pp)->shards[shard].lock);
+        free((*cache_pp)->shards[shard].buckets_p);
+    }
+    free(*cache_pp);
+    *cache_pp = NULL;
+}
+
+int result_cache_lookup(result_cache_t * cache_p,
+                        uint8_t          op,
+                        int32_t          lhs,
+                        int32_t          rhs,
+                        int32_t *        result_p)
+{
+    int              exit_code = E_FAILURE;
+    uint64_t         key       = pack_operands(lhs, rhs);
+    cache_shard_t *  shard_p   = NULL;
+    cache_bucket_t * bucket_p  = NULL;
+    cache_entry_t *  entry_p   = NULL;
+
+    if ((NULL == cache_p) || (NULL == result_p))
+    {
+        goto END;
+    }
+
+    bucket_p = locate(cache_p, hash_key(op, key), &shard_p);
+
+    pthread_rwlock_rdlock(&shard_p->lock);
+    for (size_t way = 0; way < BUCKET_WAYS; way++)
+    {
+        entry_p = &bucket_p->entries[way];
+        if ((true == entry_p->valid) && (key == entry_p->key) &&
+            (op == entry_p->op))
+        {
+            *result_p = entry_p->result;
+            atomic_store_explicit(
+                &entry_p->referenced, 1, memory_order_relaxed);
+            exit_code = E_SUCCESS;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&shard_p->lock);
+
+END:
+    return exit_code;
+}
+
+void result_cache_insert(result_cache_t * cache_p,
+                         uint8_t          op,
+                         int32_t          lhs,
+                         int32_t          rhs,
+                         int32_t          result)
+{
+    uint64_t         key      = pack_operands(lhs, rhs);
+    cache_shard_t *  shard_p  = NULL;
+    cache_bucket_t * bucket_p = NULL;
+    cache_entry_t *  entry_p  = NULL;
+
+    if (NULL == cache_p)
+    {
+        return;
+    }
+
+    bucket_p = locate(cache_p, hash_key(op, key), &shard_p);
+
+    pthread_rwlock_wrlock(&shard_p->lock);
+
+    // Update in place if present, otherwise take a free way
+    for (size_t way = 0; way < BUCKET_WAYS; way++)
+    {
+        if ((false == bucket_p->entries[way].valid) ||
+            ((key == bucket_p->entries[way].key) &&
+             (op == bucket_p->entries[way].op)))
+        {
+            entry_p = &bucket_p->entries[way];
+            break;
+        }
+    }
+
+    // Bucket full: run the CLOCK hand until an unreferenced entry is found.
+    // This terminates within two sweeps as each pass clears the bits.
+    while (NULL == entry_p)
+    {
+        cache_entry_t * candidate_p = &bucket_p->entries[bucket_p->hand];
+
+        bucket_p->hand = (uint8_t)((bucket_p->hand + 1) % BUCKET_WAYS);
+        if (0 == atomic_exchange_explicit(
+                     &candidate_p->referenced, 0, memory_order_relaxed))
+        {
+            entry_p = candidate_p;
+        }
+    }
+
+    entry_p->key    = key;
+    entry_p->op     = op;
+    entry_p->result = result;
+    entry_p->valid  = true;
+    atomic_store_explicit(&entry_p->referenced, 0, memory_order_relaxed);
+
+    pthread_rwlock_unlock(&shard_p->lock);
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static uint64_t hash_key(uint8_t op, uint64_t key)
+{
+    // SplitMix64 finalizer
+    uint64_t hash = key ^ ((uint64_t)op * 0x9E3779B97F4A7C15ULL);
+
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+static uint64_t pack_operands(int32_t lhs, int32_t rhs)
+{
+    return ((uint64_t)(uint32_t)lhs << 32) | (uint64_t)(uint32_t)rhs;
+}
+
+static cache_bucket_t * locate(result_cache_t * cache_p,
+                               uint64_t         hash,
+                               cache_shard_t ** shard_pp)
+{
+    // Low bits pick the shard, the next bits pick the bucket within it
+    *shard_pp = &cache_p->shards[hash % CACHE_SHARDS];
+    return &(*shard_pp)
+                ->buckets_p[(hash / CACHE_SHARDS) & cache_p->bucket_mask];
+}
+
+/*** end of file ***/
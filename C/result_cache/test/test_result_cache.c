@@ -0,0 +1,316 @@
+/**
+ * @file test_result_cache.c
+ * @brief Tests for the Calculation Result Cache
+ *
+ * Single-threaded checks of hits and misses (the operator and the order of
+ * the operands are part of the key) and of updates in place, then of
+ * eviction: a cache filled many times over holds no more than its capacity,
+ * while an entry looked up between inserts keeps its reference bit and
+ * survives every sweep of the CLOCK hand. Last, several threads look up and
+ * insert overlapping keys at once, and every hit must return the result
+ * stored for its key. Build with -fsanitize=thread to check the locking as
+ * well.
+ *
+ * Usage: test-result-cache
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "result_cache.h"
+#include "utilities.h"
+
+#define SMALL_ENTRIES  1      // Rounded up to one bucket per shard
+#define SMALL_CAPACITY 256    // Entries that rounding gives
+#define EVICT_INSERTS  5000   // Keys inserted into the small cache
+#define STRESS_THREADS 4      // Threads sharing one cache
+#define STRESS_ROUNDS  200000 // Lookups made by each thread
+#define STRESS_KEYS    2048   // Distinct operand pairs, per operator
+#define STRESS_OPS     3      // Distinct operators
+#define STRESS_ENTRIES 1024   // Fewer than the keys, so entries are evicted
+
+// What every key is cached as, so a hit can be checked by any thread
+#define EXPECTED_RESULT(op, lhs, rhs)                                          \
+    ((int32_t)(((lhs) * 31) ^ ((rhs) * 7) ^ ((int32_t)(op) << 24)))
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr,                                                    \
+                    "%s:%d: CHECK(%s) failed\n",                               \
+                    __FILE__,                                                  \
+                    __LINE__,                                                  \
+                    #condition);                                               \
+            goto END;                                                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @struct stress
+ * @brief State shared by the threads of test_concurrent().
+ */
+typedef struct stress
+{
+    result_cache_t * cache_p; // The cache under test
+    atomic_bool      failed;  // A hit returned the wrong result
+    atomic_size_t    hits;    // Lookups that hit, by every thread
+} stress_t;
+
+/**
+ * @struct stress_thread
+ * @brief One thread of test_concurrent().
+ */
+typedef struct stress_thread
+{
+    stress_t * stress_p; // Shared state
+    uint64_t   seed;     // Start of the thread's key sequence
+} stress_thread_t;
+
+/**
+ * @struct test_case
+ * @brief One named test.
+ */
+typedef struct test_case
+{
+    const char * name_p; // Printed with the result
+    int (*run)(void);    // Returns E_SUCCESS if the test passed
+} test_case_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Checks hits, misses, updates and invalid arguments.
+ */
+static int test_hit_miss(void);
+
+/**
+ * @brief Checks the capacity bound and that referenced entries survive.
+ */
+static int test_eviction(void);
+
+/**
+ * @brief Runs STRESS_THREADS threads looking up and inserting at once.
+ */
+static int test_concurrent(void);
+
+/**
+ * @brief Looks up pseudo random keys, checking hits and inserting misses.
+ *
+ * @param arg_p The stress_thread_t.
+ * @return NULL.
+ */
+static void * stress_worker(void * arg_p);
+
+int main(void)
+{
+    static const test_case_t tests[] = {
+        { "hit-miss", test_hit_miss },
+        { "eviction", test_eviction },
+        { "concurrent", test_concurrent },
+    };
+    int exit_code = E_SUCCESS;
+
+    for (size_t idx = 0; idx < sizeof(tests) / sizeof(tests[0]); idx++)
+    {
+        if (E_SUCCESS == tests[idx].run())
+        {
+            printf("PASS %s\n", tests[idx].name_p);
+        }
+        else
+        {
+            printf("FAIL %s\n", tests[idx].name_p);
+            exit_code = E_FAILURE;
+        }
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int test_hit_miss(void)
+{
+    int              exit_code = E_FAILURE;
+    result_cache_t * cache_p   = NULL;
+    int32_t          result    = 0;
+
+    CHECK(NULL == result_cache_create(0));
+
+    cache_p = result_cache_create(1000);
+    CHECK(NULL != cache_p);
+    CHECK(E_FAILURE == result_cache_lookup(cache_p, 0, 6, 7, &result));
+
+    result_cache_insert(cache_p, 0, 6, 7, 13);
+    CHECK(E_SUCCESS == result_cache_lookup(cache_p, 0, 6, 7, &result));
+    CHECK(13 == result);
+
+    // Another operator, or the operands swapped, is another key
+    CHECK(E_FAILURE == result_cache_lookup(cache_p, 2, 6, 7, &result));
+    CHECK(E_FAILURE == result_cache_lookup(cache_p, 0, 7, 6, &result));
+
+    // Negative operands must not alias positive ones
+    result_cache_insert(cache_p, 1, -1, INT32_MIN, 42);
+    CHECK(E_SUCCESS == result_cache_lookup(cache_p, 1, -1, INT32_MIN, &result));
+    CHECK(42 == result);
+    CHECK(E_FAILURE == result_cache_lookup(cache_p, 1, 1, INT32_MIN, &result));
+
+    // A second insert of a key replaces its result
+    result_cache_insert(cache_p, 0, 6, 7, 14);
+    CHECK(E_SUCCESS == result_cache_lookup(cache_p, 0, 6, 7, &result));
+    CHECK(14 == result);
+
+    CHECK(E_FAILURE == result_cache_lookup(NULL, 0, 6, 7, &result));
+    CHECK(E_FAILURE == result_cache_lookup(cache_p, 0, 6, 7, NULL));
+    result_cache_insert(NULL, 0, 6, 7, 13);
+
+    result_cache_destroy(&cache_p);
+    CHECK(NULL == cache_p);
+    result_cache_destroy(&cache_p);
+
+    exit_code = E_SUCCESS;
+END:
+    result_cache_destroy(&cache_p);
+    return exit_code;
+}
+
+static int test_eviction(void)
+{
+    int              exit_code = E_FAILURE;
+    result_cache_t * cache_p   = NULL;
+    int32_t          result    = 0;
+    int32_t          last      = 0;
+    size_t           hits      = 0;
+
+    cache_p = result_cache_create(SMALL_ENTRIES);
+    CHECK(NULL != cache_p);
+
+    // The kept entry is looked up after every insert, so the CLOCK hand
+    // always finds its reference bit set and passes it over. The others are
+    // never looked up, so one of them is always there to evict.
+    result_cache_insert(cache_p, 2, -5, -5, 25);
+    for (int32_t key = 0; key < EVICT_INSERTS; key++)
+    {
+        result_cache_insert(cache_p, 0, key, key, key);
+        CHECK(E_SUCCESS == result_cache_lookup(cache_p, 2, -5, -5, &result));
+        CHECK(25 == result);
+    }
+
+    // The last insert is the newest entry of its bucket
+    last = EVICT_INSERTS - 1;
+    CHECK(E_SUCCESS == result_cache_lookup(cache_p, 0, last, last, &result));
+    CHECK(last == result);
+
+    for (int32_t key = 0; key < EVICT_INSERTS; key++)
+    {
+        if (E_SUCCESS == result_cache_lookup(cache_p, 0, key, key, &result))
+        {
+            CHECK(key == result);
+            hits++;
+        }
+    }
+
+    // The kept entry takes one of the slots
+    CHECK(0 < hits);
+    CHECK((SMALL_CAPACITY - 1) >= hits);
+
+    exit_code = E_SUCCESS;
+END:
+    result_cache_destroy(&cache_p);
+    return exit_code;
+}
+
+static int test_concurrent(void)
+{
+    int             exit_code = E_FAILURE;
+    stress_t        stress    = { 0 };
+    size_t          started   = 0;
+    pthread_t       threads[STRESS_THREADS];
+    stress_thread_t args[STRESS_THREADS];
+
+    stress.cache_p = result_cache_create(STRESS_ENTRIES);
+    CHECK(NULL != stress.cache_p);
+    atomic_init(&stress.failed, false);
+    atomic_init(&stress.hits, 0);
+
+    for (size_t idx = 0; idx < STRESS_THREADS; idx++)
+    {
+        args[idx].stress_p = &stress;
+        args[idx].seed     = 0x9E3779B97F4A7C15ULL * (idx + 1);
+        CHECK(0 == pthread_create(
+                       &threads[idx], NULL, stress_worker, &args[idx]));
+        started++;
+    }
+
+    for (; 0 < started; started--)
+    {
+        pthread_join(threads[started - 1], NULL);
+    }
+    CHECK(false == atomic_load(&stress.failed));
+    CHECK(0 < atomic_load(&stress.hits));
+
+    exit_code = E_SUCCESS;
+END:
+    for (; 0 < started; started--)
+    {
+        pthread_join(threads[started - 1], NULL);
+    }
+    result_cache_destroy(&stress.cache_p);
+    return exit_code;
+}
+
+static void * stress_worker(void * arg_p)
+{
+    stress_thread_t * thread_p = arg_p;
+    stress_t *        stress_p = thread_p->stress_p;
+    uint64_t          state    = thread_p->seed;
+    size_t            hits     = 0;
+    uint8_t           op       = 0;
+    int32_t           lhs      = 0;
+    int32_t           rhs      = 0;
+    int32_t           result   = 0;
+
+    for (size_t round = 0; round < STRESS_ROUNDS; round++)
+    {
+        // xorshift64
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        op  = (uint8_t)((state >> 40) % STRESS_OPS);
+        lhs = (int32_t)(state % STRESS_KEYS) - (STRESS_KEYS / 2);
+        rhs = -lhs;
+
+        if (E_SUCCESS ==
+            result_cache_lookup(stress_p->cache_p, op, lhs, rhs, &result))
+        {
+            if (EXPECTED_RESULT(op, lhs, rhs) != result)
+            {
+                atomic_store(&stress_p->failed, true);
+                break;
+            }
+            hits++;
+        }
+        else
+        {
+            result_cache_insert(stress_p->cache_p,
+                                op,
+                                lhs,
+                                rhs,
+                                EXPECTED_RESULT(op, lhs, rhs));
+        }
+    }
+
+    atomic_fetch_add(&stress_p->hits, hits);
+    return NULL;
+}
+
+/*** end of file ***/
@@ -0,0 +1,115 @@
+/**
+ * @file shard.h
+ * @brief Header for Shared-Nothing Worker Shards
+ *
+ * This header file provides the interface for '--shared-nothing'. A shard is
+ * everything one worker needs to serve its clients on its own: a
+ * SO_REUSEPORT listening socket of its own on each port, an epoll loop, its
+ * connections and the memory they use. Requests are read, computed and
+ * replied to on the shard's thread, so no request, reply or cache line is
+ * ever handed to another thread; the kernel's SO_REUSEPORT hash is the only
+ * thing spreading load between shards.
+ *
+ * Requests and replies are '--protocol binary' frames (wire_protocol.h).
+ *
+ * The loop runs on epoll or, with '--io-backend io_uring', on completions:
+ * multishot accepts and receives into a ring of provided buffers, and
+ * zero-copy sends from registered output buffers.
+ *
+ */
+#ifndef _SHARD_H
+#define _SHARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "io_backend.h"
+#include "wire_protocol.h"
+
+#define SHARD_MAX_LISTENERS 8   // Listening sockets per shard, one per port
+#define SHARD_MAX_PAYLOAD   256 // Largest reply payload, in bytes
+#define SHARD_RECV_BUFFERS  256 // Provided receive buffers under io_uring
+
+/**
+ * @struct shard
+ * @brief Opaque shard handle.
+ */
+typedef struct shard shard_t;
+
+/**
+ * @brief Computes the reply to one request.
+ *
+ * Called on the shard's thread. The frame, including its payload, is only
+ * valid for the duration of the call.
+ *
+ * @param context_p The context given to shard_create().
+ * @param frame_p The request.
+ * @param payload_p Where the reply payload is written.
+ * @param length_p Pointer to where the payload size, at most
+ * SHARD_MAX_PAYLOAD, is stored.
+ * @return uint8_t - The reply status (see wire_reply_status_t).
+ */
+typedef uint8_t (*shard_handler_t)(void *               context_p,
+                                   const wire_frame_t * frame_p,
+                                   uint8_t *            payload_p,
+                                   uint32_t *           length_p);
+
+/**
+ * @brief Creates a shard serving the given listening sockets.
+ *
+ * All of the shard's memory is one allocation made here. Call it on the
+ * shard's own thread, after cpu_topology_bind_worker(), so that the memory
+ * is first touched, and therefore placed, on that worker's NUMA node.
+ *
+ * @param listen_fds_p The shard's listening sockets, typically entry 'i' of
+ * each port's listener_open_group(). The shard does not take ownership.
+ * @param listen_count The number of sockets, at most SHARD_MAX_LISTENERS.
+ * @param max_connections The most connections the shard keeps open; more
+ * are closed as soon as they are accepted.
+ * @param buffer_size The size of each connection's input and output
+ * buffer; a request frame larger than this closes its connection.
+ * @param backend The I/O engine ('--io-backend'). For io_uring the kernel
+ * is probed (io_backend_probe()), SHARD_RECV_BUFFERS more buffers of
+ * 'buffer_size' are allocated to receive into, and the connection buffers
+ * are registered with the ring, which counts against RLIMIT_MEMLOCK.
+ * @param handler The function computing each reply.
+ * @param context_p Passed to 'handler'.
+ * @return shard_t * - The new shard, or NULL on failure.
+ */
+shard_t * shard_create(const int *     listen_fds_p,
+                       size_t          listen_count,
+                       size_t          max_connections,
+                       size_t          buffer_size,
+                       io_backend_t    backend,
+                       shard_handler_t handler,
+                       void *          context_p);
+
+/**
+ * @brief Closes every connection, destroys a shard and sets the caller's
+ * pointer to NULL.
+ *
+ * The shard must not be running. Its listening sockets are left open.
+ *
+ * @param shard_pp The address of the shard pointer.
+ */
+void shard_destroy(shard_t ** shard_pp);
+
+/**
+ * @brief Serves clients on the calling thread until shard_stop().
+ *
+ * @param shard_p The shard.
+ * @return int - Returns E_SUCCESS once stopped, otherwise E_FAILURE.
+ */
+int shard_run(shard_t * shard_p);
+
+/**
+ * @brief Asks a running shard to return from shard_run().
+ *
+ * This is the one call that may be made from another thread.
+ *
+ * @param shard_p The shard.
+ */
+void shard_stop(shard_t * shard_p);
+
+#endif /* _SHARD_H */
+/*** end of file ***/
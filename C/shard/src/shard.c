@@ -0,0 +1,1501 @@
+/**
+ * @file shard.c
+ * @brief Shared-Nothing Worker Shards
+ *
+ * This file implements a shard's epoll loop. Each wakeup accepts new
+ * connections on the shard's own listening sockets, reads every readable
+ * connection and computes its requests in place, then writes the replies of
+ * every connection that produced any, so replies to pipelined requests
+ * leave in a single send(). Connections are only closed after the events
+ * of a wakeup are handled, so no event ever refers to a reused slot.
+ *
+ * Under '--io-backend io_uring' the same connections are driven by
+ * completions instead. Each listener has one multishot accept and each
+ * connection one multishot receive, which the kernel fills from a ring of
+ * provided buffers; a request is answered straight from the buffer it
+ * arrived in and only a frame split across buffers is copied to the
+ * connection's input buffer. Replies are sent with zero-copy sends from
+ * the output buffers, which are registered with the ring once. A buffer
+ * still referenced by a send is never moved, and a connection is only
+ * closed once nothing in flight refers to its slot.
+ *
+ * The shard's structure, connections and buffers are one allocation; they
+ * are only touched by the shard's thread, so nothing here is atomic except
+ * the stop request.
+ */
+#define _GNU_SOURCE // for accept4()
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "io_ring.h"
+#include "shard.h"
+#include "utilities.h"
+
+#define CACHE_LINE_SIZE 64         // Assumed size of a CPU cache line
+#define MAX_EVENTS      256        // epoll events handled per wakeup
+#define WAKE_EVENT      UINT64_MAX // epoll data of the stop eventfd
+#define LISTEN_EVENT    (WAKE_EVENT - SHARD_MAX_LISTENERS) // + listener index
+#define NO_SLOT         UINT32_MAX // End of a connection list
+#define REPLY_SIZE      (WIRE_HEADER_SIZE + SHARD_MAX_PAYLOAD)
+#define URING_ENTRIES   256 // io_uring submission queue entries
+
+// io_uring user_data: what completed, and the listener or slot it was for
+#define URING_DATA(tag, index) (((uint64_t)(tag) << 32) | (uint32_t)(index))
+#define URING_TAG(data)        ((uint32_t)((data) >> 32))
+#define URING_INDEX(data)      ((uint32_t)(data))
+
+// Rounds 'size' up to a multiple of the power of two 'align'
+#define ROUND_UP(size, align) (((size) + (align)-1) & ~(size_t)((align)-1))
+
+/**
+ * @enum uring_tag
+ * @brief The kinds of io_uring requests a shard makes.
+ */
+typedef enum uring_tag
+{
+    URING_TAG_WAKE = 1, // Poll of the stop eventfd
+    URING_TAG_ACCEPT,   // Multishot accept; index is the listener
+    URING_TAG_RECV,     // Multishot receive; index is the slot
+    URING_TAG_SEND,     // Zero-copy send; index is the slot
+    URING_TAG_CANCEL,   // Cancellation of a receive; nothing to do
+} uring_tag_t;
+
+/**
+ * @struct shard_buffer
+ * @brief A provided receive buffer held by a connection (io_uring only).
+ */
+typedef struct shard_buffer
+{
+    uint32_t length; // Bytes the kernel received into it
+    uint32_t next;   // Next buffer held by the same connection
+} shard_buffer_t;
+
+/**
+ * @struct shard_conn
+ * @brief One connection of a shard.
+ */
+typedef struct shard_conn
+{
+    int       fd;       // Connected socket, -1 if the slot is free
+    uint32_t  events;   // epoll events registered
+    uint32_t  next;     // Next free slot, or next dirty connection
+    bool      dirty;    // On the dirty list this wakeup
+    bool      paused;   // Output full; not reading until it drains
+    bool      closing;  // No more requests; close once replies are sent
+    bool      failed;   // Socket error; close without sending
+    size_t    in_len;   // Received bytes not yet decoded
+    size_t    out_head; // Offset of the first unsent byte
+    size_t    out_len;  // Bytes waiting to be sent
+    uint8_t * in_p;     // Input buffer
+    uint8_t * out_p;    // Output buffer
+
+    // io_uring only
+    bool     eof;         // The peer is done sending
+    bool     receiving;   // A multishot receive is armed
+    bool     cancelling;  // Its cancellation was submitted
+    bool     starved;     // It ended for want of provided buffers
+    bool     sending;     // A send of the output is in flight
+    uint32_t notifs;      // Zero-copy notifications still to come
+    uint32_t held_head;   // First provided buffer not yet consumed
+    uint32_t held_tail;   // Last one
+    uint32_t held_offset; // Bytes of the first one consumed
+} shard_conn_t;
+
+/**
+ * @struct shard
+ * @brief A shard's sockets, connections and buffers.
+ */
+struct shard
+{
+    int             epoll_fd;                        // Readiness of all fds
+    int             wake_fd;                         // eventfd for shard_stop()
+    atomic_bool     stop;                            // shard_stop() was called
+    shard_handler_t handler;                         // Computes replies
+    void *          context_p;                       // Passed to 'handler'
+    size_t          listen_count;                    // Entries of listen_fds
+    int             listen_fds[SHARD_MAX_LISTENERS]; // Not owned
+    size_t          max_connections;                 // Size of 'conns_p'
+    size_t          buffer_size;                     // Per direction
+    uint32_t        free_head;                       // First free slot
+    uint32_t        dirty_head;                      // First dirty slot
+    shard_conn_t *  conns_p;                         // Every slot
+
+    // io_uring only
+    io_backend_t     backend;       // Engine shard_run() drives
+    io_ring_t *      ring_p;        // The shard's ring
+    shard_buffer_t * buffers_p;     // State of each provided buffer
+    uint8_t *        recv_p;        // The provided buffers
+    size_t           starved;       // Connections whose receive starved
+    bool             wake_starved;  // A buffer came back since
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Runs the epoll engine until shard_stop().
+ *
+ * @param shard_p The shard.
+ * @return int - Returns E_SUCCESS once stopped, otherwise E_FAILURE.
+ */
+static int run_epoll(shard_t * shard_p);
+
+/**
+ * @brief Sets up the shard's ring, its provided and registered buffers.
+ *
+ * @param shard_p The shard.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int uring_setup(shard_t * shard_p);
+
+/**
+ * @brief Runs the io_uring engine until shard_stop().
+ *
+ * @param shard_p The shard.
+ * @return int - Returns E_SUCCESS once stopped, otherwise E_FAILURE.
+ */
+static int run_uring(shard_t * shard_p);
+
+/**
+ * @brief Accepts every pending connection on one listening socket.
+ *
+ * @param shard_p The shard.
+ * @param listen_fd The listening socket.
+ */
+static void accept_all(shard_t * shard_p, int listen_fd);
+
+/**
+ * @brief Gives an accepted socket a free slot.
+ *
+ * @param shard_p The shard.
+ * @param fd The accepted socket, closed if every slot is taken.
+ * @return shard_conn_t * - The connection, or NULL if the shard is full.
+ */
+static shard_conn_t * conn_open(shard_t * shard_p, int fd);
+
+/**
+ * @brief Reads from a connection and answers the requests received.
+ *
+ * @param shard_p The shard.
+ * @param conn_p The connection.
+ */
+static void conn_read(shard_t * shard_p, shard_conn_t * conn_p);
+
+/**
+ * @brief Answers every complete request in a connection's input buffer for
+ * which there is room in its output buffer.
+ *
+ * @param shard_p The shard.
+ * @param conn_p The connection.
+ */
+static void conn_decode(shard_t * shard_p, shard_conn_t * conn_p);
+
+/**
+ * @brief Answers the complete requests at the start of some received bytes
+ * for which there is room in the connection's output buffer.
+ *
+ * @param shard_p The shard.
+ * @param conn_p The connection.
+ * @param data_p The received bytes.
+ * @param length The number of bytes.
+ * @return size_t - The bytes answered, which the caller drops.
+ */
+static size_t conn_answer(shard_t *       shard_p,
+                          shard_conn_t *  conn_p,
+                          const uint8_t * data_p,
+                          size_t          length);
+
+/**
+ * @brief Moves a connection's unsent output to the front of its buffer,
+ * unless a send in flight still reads it where it is.
+ *
+ * @param conn_p The connection.
+ */
+static void conn_compact(shard_conn_t * conn_p);
+
+/**
+ * @brief Adds a connection to the list written at the end of the wakeup.
+ *
+ * @param shard_p The shard.
+ * @param conn_p The connection.
+ */
+static void conn_mark_dirty(shard_t * shard_p, shard_conn_t * conn_p);
+
+/**
+ * @brief Writes every dirty connection, resumes those that drained and
+ * closes those that are done.
+ *
+ * @param shard_p The shard.
+ */
+static void flush_dirty(shard_t * shard_p);
+
+/**
+ * @brief Sends as much of a connection's output as the socket takes.
+ *
+ * @param conn_p The connection.
+ */
+static void conn_flush(shard_conn_t * conn_p);
+
+/**
+ * @brief Registers the epoll events a connection's state calls for.
+ *
+ * @param shard_p The shard.
+ * @param conn_p The connection.
+ */
+static void conn_watch(shard_t * shard_p, shard_conn_t * conn_p);
+
+/**
+ * @brief Closes a connection and returns its slot to the free list.
+ *
+ * @param shard_p The shard.
+ * @param conn_p The connection.
+ */
+static void conn_close(shard_t * shard_p, shard_conn_t * conn_p);
+
+/**
+ * @brief Polls the stop eventfd, so that shard_stop() wakes the ring.
+ *
+ * @param shard_p The shard.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int uring_arm_wake(shard_t * shard_p);
+
+/**
+ * @brief Arms a multishot accept on one listening socket.
+ *
+ * @param shard_p The shard.
+ * @param index The listener's index.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+static int uring_arm_accept(shard_t * shard_p, size_t index);
+
+/**
+ * @brief Arms a multishot receive into the provided buffers.
+ *
+ * @param shard_p The shard.
+ * @param conn_p The connection.
+ */
+static void uring_arm_recv(shard_t * shard_p, shard_conn_t * conn_p);
+
+/**
+ * @brief Cancels a connection's multishot receive.
+ *
+ * @param shard_p The shard.
+ * @param conn_p The connection.
+ */
+static void uring_cancel_recv(shard_t * shard_p, shard_conn_t * conn_p);
+
+/**
+ * @brief Sends a connection's output from the registered buffers.
+ *
+ * @param shard_p The shard.
+ * @param conn_p The connection.
+ */
+static void uring_send(shard_t * shard_p, shard_conn_t * conn_p);
+
+/**
+ * @brief Handles one completion.
+ *
+ * @param shard_p The shard.
+ * @param cqe_p The completion.
+ */
+static void uring_complete(shard_t *                   shard_p,
+                           const struct io_uring_cqe * cqe_p);
+
+/**
+ * @brief Handles a completion of a listener's multishot accept.
+ *
+ * @param shard_p The shard.
+ * @param index The listener's index.
+ * @param cqe_p The completion.
+ */
+static void uring_accepted(shard_t *                   shard_p,
+                           size_t                      index,
+                           const struct io_uring_cqe * cqe_p);
+
+/**
+ * @brief Handles a completion of a connection's multishot receive.
+ *
+ * @param shard_p The shard.
+ * @param conn_p The connection.
+ * @param cqe_p The completion.
+ */
+static void uring_received(shard_t *                   shard_p,
+                           shard_conn_t *              conn_p,
+                           const struct io_uring_cqe * cqe_p);
+
+/**
+ * @brief Handles a send's completion or its zero-copy notification.
+ *
+ * @param conn_p The connection.
+ * @param cqe_p The completion.
+ */
+static void uring_sent(shard_conn_t *              conn_p,
+                       const struct io_uring_cqe * cqe_p);
+
+/**
+ * @brief Answers the requests in a connection's held buffers.
+ *
+ * Stops when the output is full or the connection is closing; whatever is
+ * left stays held until then.
+ *
+ * @param shard_p The shard.
+ * @param conn_p The connection.
+ */
+static void uring_consume(shard_t * shard_p, shard_conn_t * conn_p);
+
+/**
+ * @brief Brings every dirty connection up to date: answers, sends, re-arms
+ * or cancels its receive, and closes those that are done.
+ *
+ * @param shard_p The shard.
+ */
+static void uring_flush_dirty(shard_t * shard_p);
+
+/**
+ * @brief Closes a connection once nothing in flight refers to its slot.
+ *
+ * @param shard_p The shard.
+ * @param conn_p The connection.
+ */
+static void uring_close(shard_t * shard_p, shard_conn_t * conn_p);
+
+/**
+ * @brief Gives a provided buffer back to the kernel.
+ *
+ * @param shard_p The shard.
+ * @param buffer_id The buffer.
+ */
+static void uring_recycle(shard_t * shard_p, uint32_t buffer_id);
+
+/**
+ * @brief Marks the connections whose receive starved dirty, to re-arm it.
+ *
+ * @param shard_p The shard.
+ */
+static void uring_wake_starved(shard_t * shard_p);
+
+// +---------------------------------------------------------------------------+
+// |                                 SHARD API                                 |
+// +---------------------------------------------------------------------------+
+
+shard_t * shard_create(const int *     listen_fds_p,
+                       size_t          listen_count,
+                       size_t          max_connections,
+                       size_t          buffer_size,
+                       io_backend_t    backend,
+                       shard_handler_t handler,
+                       void *          context_p)
+{
+    shard_t *          shard_p   = NULL;
+    size_t             head_size = 0;
+    size_t             size      = 0;
+    size_t             buffers   = 0;
+    uint8_t *          buffer_p  = NULL;
+    struct epoll_event event     = { 0 };
+
+    if ((NULL == listen_fds_p) || (0 == listen_count) ||
+        (SHARD_MAX_LISTENERS < listen_count) || (0 == max_connections) ||
+        (NO_SLOT <= max_connections) || (REPLY_SIZE > buffer_size) ||
+        (UINT32_MAX < buffer_size) || (NULL == handler) ||
+        ((IO_BACKEND_EPOLL != backend) && (IO_BACKEND_IO_URING != backend)))
+    {
+        print_error("shard_create(): Invalid argument passed.");
+        goto END;
+    }
+
+    if (E_SUCCESS != io_backend_probe(backend))
+    {
+        goto END;
+    }
+
+    if (IO_BACKEND_IO_URING == backend)
+    {
+        buffers = SHARD_RECV_BUFFERS;
+    }
+
+    // One allocation: the shard, then its slots and buffer states, then the
+    // connection buffers, then the provided receive buffers
+    head_size = sizeof(shard_t) + (max_connections * sizeof(shard_conn_t)) +
+                (buffers * sizeof(shard_buffer_t));
+    head_size = ROUND_UP(head_size, CACHE_LINE_SIZE);
+    size      = ROUND_UP(head_size + (max_connections * 2 * buffer_size) +
+                        (buffers * buffer_size),
+                    CACHE_LINE_SIZE);
+
+    shard_p = aligned_alloc(CACHE_LINE_SIZE, size);
+    if (NULL == shard_p)
+    {
+        print_error("shard_create(): aligned_alloc() failed.");
+        goto END;
+    }
+    memset(shard_p, 0, head_size);
+
+    shard_p->epoll_fd        = -1;
+    shard_p->wake_fd         = -1;
+    shard_p->handler         = handler;
+    shard_p->context_p       = context_p;
+    shard_p->listen_count    = listen_count;
+    shard_p->max_connections = max_connections;
+    shard_p->buffer_size     = buffer_size;
+    shard_p->dirty_head      = NO_SLOT;
+    shard_p->conns_p         = (shard_conn_t *)(shard_p + 1);
+    shard_p->backend         = backend;
+    shard_p->buffers_p = (shard_buffer_t *)(shard_p->conns_p + max_connections);
+    atomic_init(&shard_p->stop, false);
+
+    buffer_p = (uint8_t *)shard_p + head_size;
+    for (size_t slot = 0; slot < max_connections; slot++)
+    {
+        shard_p->conns_p[slot].fd    = -1;
+        shard_p->conns_p[slot].in_p  = buffer_p + (slot * 2 * buffer_size);
+        shard_p->conns_p[slot].out_p = shard_p->conns_p[slot].in_p +
+                                       buffer_size;
+        shard_p->conns_p[slot].next  = (uint32_t)(slot + 1);
+    }
+    shard_p->conns_p[max_connections - 1].next = NO_SLOT;
+    shard_p->free_head                         = 0;
+    shard_p->recv_p = buffer_p + (max_connections * 2 * buffer_size);
+
+    shard_p->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == shard_p->wake_fd)
+    {
+        perror("shard_create(): eventfd()");
+        goto FAIL;
+    }
+
+    for (size_t idx = 0; idx < listen_count; idx++)
+    {
+        shard_p->listen_fds[idx] = listen_fds_p[idx];
+    }
+
+    if (IO_BACKEND_IO_URING == backend)
+    {
+        if (E_SUCCESS != uring_setup(shard_p))
+        {
+            goto FAIL;
+        }
+        goto END;
+    }
+
+    shard_p->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (-1 == shard_p->epoll_fd)
+    {
+        perror("shard_create(): epoll_create1()");
+        goto FAIL;
+    }
+
+    event.events   = EPOLLIN;
+    event.data.u64 = WAKE_EVENT;
+    if (-1 == epoll_ctl(shard_p->epoll_fd, EPOLL_CTL_ADD, shard_p->wake_fd,
+                        &event))
+    {
+        perror("shard_create(): epoll_ctl()");
+        goto FAIL;
+    }
+
+    // The shard is the only reader of its listeners, so accepting until
+    // EAGAIN never competes with another thread.
+    for (size_t idx = 0; idx < listen_count; idx++)
+    {
+        event.events   = EPOLLIN;
+        event.data.u64 = LISTEN_EVENT + idx;
+        if ((-1 == fcntl(listen_fds_p[idx],
+                         F_SETFL,
+                         fcntl(listen_fds_p[idx], F_GETFL) | O_NONBLOCK)) ||
+            (-1 == epoll_ctl(shard_p->epoll_fd,
+                             EPOLL_CTL_ADD,
+                             listen_fds_p[idx],
+                             &event)))
+        {
+            perror("shard_create(): Unable to watch listener");
+            goto FAIL;
+        }
+    }
+
+    goto END;
+
+FAIL:
+    shard_destroy(&shard_p);
+END:
+    return shard_p;
+}
+
+void shard_destroy(shard_t ** shard_pp)
+{
+    shard_t * shard_p = NULL;
+
+    if ((NULL == shard_pp) || (NULL == *shard_pp))
+    {
+        return;
+    }
+
+    shard_p = *shard_pp;
+
+    // Before anything the ring may still write to is closed or freed
+    io_ring_destroy(&shard_p->ring_p);
+
+    for (size_t slot = 0; slot < shard_p->max_connections; slot++)
+    {
+        if (-1 != shard_p->conns_p[slot].fd)
+        {
+            close(shard_p->conns_p[slot].fd);
+        }
+    }
+
+    if (-1 != shard_p->wake_fd)
+    {
+        close(shard_p->wake_fd);
+    }
+    if (-1 != shard_p->epoll_fd)
+    {
+        close(shard_p->epoll_fd);
+    }
+
+    free(shard_p);
+    *shard_pp = NULL;
+}
+
+int shard_run(shard_t * shard_p)
+{
+    if (NULL == shard_p)
+    {
+        print_error("shard_run(): NULL argument passed.");
+        return E_FAILURE;
+    }
+
+    if (IO_BACKEND_IO_URING == shard_p->backend)
+    {
+        return run_uring(shard_p);
+    }
+
+    return run_epoll(shard_p);
+}
+
+void shard_stop(shard_t * shard_p)
+{
+    uint64_t one = 1;
+
+    if (NULL == shard_p)
+    {
+        return;
+    }
+
+    atomic_store_explicit(&shard_p->stop, true, memory_order_release);
+    if (-1 == write(shard_p->wake_fd, &one, sizeof(one)))
+    {
+        perror("shard_stop(): write()");
+    }
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int run_epoll(shard_t * shard_p)
+{
+    int                exit_code          = E_FAILURE;
+    int                count              = 0;
+    uint64_t           data               = 0;
+    uint64_t           value              = 0;
+    shard_conn_t *     conn_p             = NULL;
+    struct epoll_event events[MAX_EVENTS] = { { 0 } };
+
+    while (false == atomic_load_explicit(&shard_p->stop, memory_order_acquire))
+    {
+        count = epoll_wait(shard_p->epoll_fd, events, MAX_EVENTS, -1);
+        if (-1 == count)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            perror("shard_run(): epoll_wait()");
+            goto END;
+        }
+
+        for (int idx = 0; idx < count; idx++)
+        {
+            data = events[idx].data.u64;
+            if (WAKE_EVENT == data)
+            {
+                if (-1 == read(shard_p->wake_fd, &value, sizeof(value)))
+                {
+                    perror("shard_run(): read()");
+                }
+                continue;
+            }
+
+            if (LISTEN_EVENT <= data)
+            {
+                accept_all(shard_p,
+                           shard_p->listen_fds[data - LISTEN_EVENT]);
+                continue;
+            }
+
+            conn_p = &shard_p->conns_p[data];
+            if (0 != (events[idx].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+            {
+                conn_read(shard_p, conn_p);
+            }
+            // A hang-up must be looked at even while the connection is
+            // not reading, or level-triggered epoll reports it forever
+            if (0 != (events[idx].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)))
+            {
+                conn_mark_dirty(shard_p, conn_p);
+            }
+        }
+
+        flush_dirty(shard_p);
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int uring_setup(shard_t * shard_p)
+{
+    shard_p->ring_p = io_ring_create(URING_ENTRIES);
+    if (NULL == shard_p->ring_p)
+    {
+        return E_FAILURE;
+    }
+
+    // Sends only ever come from the output buffers, but registering the
+    // slots' buffers whole is one region instead of one per connection
+    if ((E_SUCCESS !=
+         io_ring_register_buffers(shard_p->ring_p,
+                                  shard_p->conns_p[0].in_p,
+                                  shard_p->max_connections * 2 *
+                                      shard_p->buffer_size)) ||
+        (E_SUCCESS != io_ring_provide_buffers(shard_p->ring_p,
+                                              shard_p->recv_p,
+                                              (uint32_t)shard_p->buffer_size,
+                                              SHARD_RECV_BUFFERS)))
+    {
+        return E_FAILURE;
+    }
+
+    return E_SUCCESS;
+}
+
+static int run_uring(shard_t * shard_p)
+{
+    int                   exit_code = E_FAILURE;
+    struct io_uring_cqe * cqe_p     = NULL;
+
+    if (E_SUCCESS != uring_arm_wake(shard_p))
+    {
+        goto END;
+    }
+
+    for (size_t idx = 0; idx < shard_p->listen_count; idx++)
+    {
+        if (E_SUCCESS != uring_arm_accept(shard_p, idx))
+        {
+            goto END;
+        }
+    }
+
+    while (false == atomic_load_explicit(&shard_p->stop, memory_order_acquire))
+    {
+        if (E_SUCCESS != io_ring_submit_and_wait(shard_p->ring_p))
+        {
+            goto END;
+        }
+
+        for (cqe_p = io_ring_peek_cqe(shard_p->ring_p); NULL != cqe_p;
+             cqe_p = io_ring_peek_cqe(shard_p->ring_p))
+        {
+            uring_complete(shard_p, cqe_p);
+            io_ring_cqe_seen(shard_p->ring_p);
+        }
+
+        // Buffers recycled while flushing re-arm starved receives now, not
+        // on some later completion
+        uring_flush_dirty(shard_p);
+        while (true == shard_p->wake_starved)
+        {
+            uring_wake_starved(shard_p);
+            uring_flush_dirty(shard_p);
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static void accept_all(shard_t * shard_p, int listen_fd)
+{
+    int                fd     = -1;
+    shard_conn_t *     conn_p = NULL;
+    struct epoll_event event  = { 0 };
+
+    while (true)
+    {
+        fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (-1 == fd)
+        {
+            if ((EAGAIN != errno) && (EWOULDBLOCK != errno) &&
+                (EINTR != errno) && (ECONNABORTED != errno))
+            {
+                perror("shard: accept4()");
+            }
+            if (ECONNABORTED == errno)
+            {
+                continue;
+            }
+            return;
+        }
+
+        conn_p = conn_open(shard_p, fd);
+        if (NULL == conn_p)
+        {
+            continue;
+        }
+
+        conn_p->events = EPOLLIN;
+        event.events   = EPOLLIN;
+        event.data.u64 = (uint64_t)(conn_p - shard_p->conns_p);
+        if (-1 == epoll_ctl(shard_p->epoll_fd, EPOLL_CTL_ADD, fd, &event))
+        {
+            perror("shard: epoll_ctl()");
+            conn_p->events = 0;
+            conn_close(shard_p, conn_p);
+        }
+    }
+}
+
+static shard_conn_t * conn_open(shard_t * shard_p, int fd)
+{
+    shard_conn_t * conn_p = NULL;
+
+    if (NO_SLOT == shard_p->free_head)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    conn_p             = &shard_p->conns_p[shard_p->free_head];
+    shard_p->free_head = conn_p->next;
+
+    conn_p->fd          = fd;
+    conn_p->events      = 0;
+    conn_p->next        = NO_SLOT;
+    conn_p->dirty       = false;
+    conn_p->paused      = false;
+    conn_p->closing     = false;
+    conn_p->failed      = false;
+    conn_p->in_len      = 0;
+    conn_p->out_head    = 0;
+    conn_p->out_len     = 0;
+    conn_p->eof         = false;
+    conn_p->receiving   = false;
+    conn_p->cancelling  = false;
+    conn_p->starved     = false;
+    conn_p->sending     = false;
+    conn_p->notifs      = 0;
+    conn_p->held_head   = NO_SLOT;
+    conn_p->held_tail   = NO_SLOT;
+    conn_p->held_offset = 0;
+
+    return conn_p;
+}
+
+static void conn_read(shard_t * shard_p, shard_conn_t * conn_p)
+{
+    ssize_t received = 0;
+
+    if ((-1 == conn_p->fd) || (true == conn_p->paused) ||
+        (true == conn_p->closing))
+    {
+        return;
+    }
+
+    received = recv(conn_p->fd,
+                    conn_p->in_p + conn_p->in_len,
+                    shard_p->buffer_size - conn_p->in_len,
+                    0);
+    if (0 < received)
+    {
+        conn_p->in_len += (size_t)received;
+        conn_decode(shard_p, conn_p);
+    }
+    else if (0 == received)
+    {
+        // The client is done sending; answer what it already sent
+        conn_p->closing = true;
+    }
+    else if ((EAGAIN == errno) || (EWOULDBLOCK == errno) || (EINTR == errno))
+    {
+        return;
+    }
+    else
+    {
+        conn_p->closing = true;
+        conn_p->failed  = true;
+    }
+
+    conn_mark_dirty(shard_p, conn_p);
+}
+
+static void conn_decode(shard_t * shard_p, shard_conn_t * conn_p)
+{
+    size_t offset = 0;
+
+    conn_compact(conn_p);
+
+    offset = conn_answer(shard_p, conn_p, conn_p->in_p, conn_p->in_len);
+    if (0 < offset)
+    {
+        memmove(conn_p->in_p, conn_p->in_p + offset, conn_p->in_len - offset);
+        conn_p->in_len -= offset;
+    }
+}
+
+static size_t conn_answer(shard_t *       shard_p,
+                          shard_conn_t *  conn_p,
+                          const uint8_t * data_p,
+                          size_t          length)
+{
+    size_t        offset    = 0;
+    size_t        consumed  = 0;
+    size_t        used      = 0;
+    uint32_t      reply_len = 0;
+    uint8_t       status    = 0;
+    uint8_t *     reply_p   = NULL;
+    wire_frame_t  frame     = { 0 };
+    wire_status_t decoded   = WIRE_FRAME_OK;
+
+    while (false == conn_p->closing)
+    {
+        // A request is only taken once its reply is sure to fit
+        used = conn_p->out_head + conn_p->out_len;
+        if ((shard_p->buffer_size - used) < REPLY_SIZE)
+        {
+            conn_p->paused = true;
+            break;
+        }
+
+        decoded = wire_decode_frame(
+            data_p + offset, length - offset, &frame, &consumed);
+        if (WIRE_FRAME_INCOMPLETE == decoded)
+        {
+            // A frame that fills the whole buffer and is still incomplete
+            // can never be read
+            if ((0 == offset) && (shard_p->buffer_size <= length))
+            {
+                conn_p->closing = true;
+            }
+            break;
+        }
+
+        if (WIRE_FRAME_INVALID == decoded)
+        {
+            conn_p->closing = true;
+            break;
+        }
+
+        offset += consumed;
+
+        reply_p   = conn_p->out_p + used;
+        reply_len = 0;
+        status    = shard_p->handler(shard_p->context_p,
+                                  &frame,
+                                  reply_p + WIRE_HEADER_SIZE,
+                                  &reply_len);
+        if (SHARD_MAX_PAYLOAD < reply_len)
+        {
+            reply_len = 0;
+        }
+
+        wire_encode_header(reply_p, status, frame.request_id, reply_len);
+        conn_p->out_len += WIRE_HEADER_SIZE + reply_len;
+    }
+
+    return offset;
+}
+
+static void conn_compact(shard_conn_t * conn_p)
+{
+    // Replies are appended after the unsent ones; move those to the front
+    if ((0 < conn_p->out_head) && (false == conn_p->sending) &&
+        (0 == conn_p->notifs))
+    {
+        memmove(conn_p->out_p,
+                conn_p->out_p + conn_p->out_head,
+                conn_p->out_len);
+        conn_p->out_head = 0;
+    }
+}
+
+static void conn_mark_dirty(shard_t * shard_p, shard_conn_t * conn_p)
+{
+    if (true == conn_p->dirty)
+    {
+        return;
+    }
+
+    conn_p->dirty       = true;
+    conn_p->next        = shard_p->dirty_head;
+    shard_p->dirty_head = (uint32_t)(conn_p - shard_p->conns_p);
+}
+
+static void flush_dirty(shard_t * shard_p)
+{
+    shard_conn_t * conn_p = NULL;
+
+    while (NO_SLOT != shard_p->dirty_head)
+    {
+        conn_p              = &shard_p->conns_p[shard_p->dirty_head];
+        shard_p->dirty_head = conn_p->next;
+        conn_p->next        = NO_SLOT;
+        conn_p->dirty       = false;
+
+        if (false == conn_p->failed)
+        {
+            conn_flush(conn_p);
+        }
+
+        // Room freed up: answer what was left waiting in the input buffer
+        while ((false == conn_p->failed) && (true == conn_p->paused) &&
+               ((shard_p->buffer_size - conn_p->out_len) >= REPLY_SIZE))
+        {
+            conn_p->paused = false;
+            conn_decode(shard_p, conn_p);
+            conn_flush(conn_p);
+        }
+
+        if ((true == conn_p->failed) ||
+            ((true == conn_p->closing) && (0 == conn_p->out_len)))
+        {
+            conn_close(shard_p, conn_p);
+            continue;
+        }
+
+        conn_watch(shard_p, conn_p);
+    }
+}
+
+static void conn_flush(shard_conn_t * conn_p)
+{
+    ssize_t sent = 0;
+
+    while (0 < conn_p->out_len)
+    {
+        sent = send(conn_p->fd,
+                    conn_p->out_p + conn_p->out_head,
+                    conn_p->out_len,
+                    MSG_NOSIGNAL);
+        if (0 < sent)
+        {
+            conn_p->out_head += (size_t)sent;
+            conn_p->out_len -= (size_t)sent;
+            continue;
+        }
+
+        if ((-1 == sent) && (EINTR == errno))
+        {
+            continue;
+        }
+
+        if ((-1 == sent) && ((EAGAIN == errno) || (EWOULDBLOCK == errno)))
+        {
+            break;
+        }
+
+        conn_p->closing = true;
+        conn_p->failed  = true;
+        break;
+    }
+
+    if (0 == conn_p->out_len)
+    {
+        conn_p->out_head = 0;
+    }
+}
+
+static void conn_watch(shard_t * shard_p, shard_conn_t * conn_p)
+{
+    uint32_t           wanted = 0;
+    struct epoll_event event  = { 0 };
+
+    if ((false == conn_p->paused) && (false == conn_p->closing))
+    {
+        wanted |= EPOLLIN;
+    }
+    if (0 < conn_p->out_len)
+    {
+        wanted |= EPOLLOUT;
+    }
+
+    if (wanted == conn_p->events)
+    {
+        return;
+    }
+
+    event.events   = wanted;
+    event.data.u64 = (uint64_t)(conn_p - shard_p->conns_p);
+    if (-1 == epoll_ctl(shard_p->epoll_fd, EPOLL_CTL_MOD, conn_p->fd, &event))
+    {
+        perror("shard: epoll_ctl()");
+        conn_close(shard_p, conn_p);
+        return;
+    }
+    conn_p->events = wanted;
+}
+
+static void conn_close(shard_t * shard_p, shard_conn_t * conn_p)
+{
+    close(conn_p->fd);
+    conn_p->fd         = -1;
+    conn_p->next       = shard_p->free_head;
+    shard_p->free_head = (uint32_t)(conn_p - shard_p->conns_p);
+}
+
+static int uring_arm_wake(shard_t * shard_p)
+{
+    struct io_uring_sqe * sqe_p = io_ring_get_sqe(shard_p->ring_p);
+
+    if (NULL == sqe_p)
+    {
+        return E_FAILURE;
+    }
+
+    // Polled, not read: only shard_stop() writes it, so it is never drained
+    sqe_p->opcode        = IORING_OP_POLL_ADD;
+    sqe_p->fd            = shard_p->wake_fd;
+    sqe_p->poll32_events = POLLIN;
+    sqe_p->user_data     = URING_DATA(URING_TAG_WAKE, 0);
+
+    return E_SUCCESS;
+}
+
+static int uring_arm_accept(shard_t * shard_p, size_t index)
+{
+    struct io_uring_sqe * sqe_p = io_ring_get_sqe(shard_p->ring_p);
+
+    if (NULL == sqe_p)
+    {
+        return E_FAILURE;
+    }
+
+    sqe_p->opcode       = IORING_OP_ACCEPT;
+    sqe_p->fd           = shard_p->listen_fds[index];
+    sqe_p->ioprio       = IORING_ACCEPT_MULTISHOT;
+    sqe_p->accept_flags = SOCK_CLOEXEC;
+    sqe_p->user_data    = URING_DATA(URING_TAG_ACCEPT, index);
+
+    return E_SUCCESS;
+}
+
+static void uring_arm_recv(shard_t * shard_p, shard_conn_t * conn_p)
+{
+    struct io_uring_sqe * sqe_p = io_ring_get_sqe(shard_p->ring_p);
+
+    if (NULL == sqe_p)
+    {
+        conn_p->closing = true;
+        conn_p->failed  = true;
+        return;
+    }
+
+    sqe_p->opcode    = IORING_OP_RECV;
+    sqe_p->fd        = conn_p->fd;
+    sqe_p->ioprio    = IORING_RECV_MULTISHOT;
+    sqe_p->flags     = IOSQE_BUFFER_SELECT;
+    sqe_p->buf_group = IO_RING_BUFFER_GROUP;
+    sqe_p->user_data =
+        URING_DATA(URING_TAG_RECV, conn_p - shard_p->conns_p);
+    conn_p->receiving = true;
+}
+
+static void uring_cancel_recv(shard_t * shard_p, shard_conn_t * conn_p)
+{
+    struct io_uring_sqe * sqe_p = io_ring_get_sqe(shard_p->ring_p);
+
+    // Without a cancellation the next change of state tries again
+    if (NULL == sqe_p)
+    {
+        return;
+    }
+
+    sqe_p->opcode    = IORING_OP_ASYNC_CANCEL;
+    sqe_p->fd        = -1;
+    sqe_p->addr      = URING_DATA(URING_TAG_RECV, conn_p - shard_p->conns_p);
+    sqe_p->user_data = URING_DATA(URING_TAG_CANCEL, 0);
+    conn_p->cancelling = true;
+}
+
+static void uring_send(shard_t * shard_p, shard_conn_t * conn_p)
+{
+    struct io_uring_sqe * sqe_p = io_ring_get_sqe(shard_p->ring_p);
+
+    if (NULL == sqe_p)
+    {
+        conn_p->closing = true;
+        conn_p->failed  = true;
+        return;
+    }
+
+    sqe_p->opcode    = IORING_OP_SEND_ZC;
+    sqe_p->fd        = conn_p->fd;
+    sqe_p->addr      = (uint64_t)(uintptr_t)(conn_p->out_p + conn_p->out_head);
+    sqe_p->len       = (uint32_t)conn_p->out_len;
+    sqe_p->msg_flags = MSG_NOSIGNAL;
+    sqe_p->ioprio    = IORING_RECVSEND_FIXED_BUF;
+    sqe_p->buf_index = 0;
+    sqe_p->user_data =
+        URING_DATA(URING_TAG_SEND, conn_p - shard_p->conns_p);
+    conn_p->sending = true;
+}
+
+static void uring_complete(shard_t *                   shard_p,
+                           const struct io_uring_cqe * cqe_p)
+{
+    uint32_t index = URING_INDEX(cqe_p->user_data);
+
+    switch (URING_TAG(cqe_p->user_data))
+    {
+        case URING_TAG_WAKE:
+            // shard_run() checks the stop request next
+            if ((false == atomic_load(&shard_p->stop)) &&
+                (E_SUCCESS != uring_arm_wake(shard_p)))
+            {
+                print_error("shard: Unable to re-arm the stop eventfd.");
+            }
+            break;
+
+        case URING_TAG_ACCEPT:
+            uring_accepted(shard_p, index, cqe_p);
+            break;
+
+        case URING_TAG_RECV:
+            uring_received(shard_p, &shard_p->conns_p[index], cqe_p);
+            break;
+
+        case URING_TAG_SEND:
+            uring_sent(&shard_p->conns_p[index], cqe_p);
+            conn_mark_dirty(shard_p, &shard_p->conns_p[index]);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void uring_accepted(shard_t *                   shard_p,
+                           size_t                      index,
+                           const struct io_uring_cqe * cqe_p)
+{
+    shard_conn_t * conn_p = NULL;
+
+    if (0 <= cqe_p->res)
+    {
+        conn_p = conn_open(shard_p, cqe_p->res);
+        if (NULL != conn_p)
+        {
+            conn_mark_dirty(shard_p, conn_p);
+        }
+    }
+    else if ((-EAGAIN != cqe_p->res) && (-EINTR != cqe_p->res) &&
+             (-ECONNABORTED != cqe_p->res))
+    {
+        errno = -cqe_p->res;
+        perror("shard: accept");
+    }
+
+    if (0 != (cqe_p->flags & IORING_CQE_F_MORE))
+    {
+        return;
+    }
+
+    // A listener that cannot accept any more is left alone, as epoll would
+    // stop reporting it
+    if ((-EBADF == cqe_p->res) || (-EINVAL == cqe_p->res) ||
+        (-ENOTSOCK == cqe_p->res) || (-ECANCELED == cqe_p->res))
+    {
+        return;
+    }
+
+    if (E_SUCCESS != uring_arm_accept(shard_p, index))
+    {
+        print_error("shard: Unable to re-arm accept.");
+    }
+}
+
+static void uring_received(shard_t *                   shard_p,
+                           shard_conn_t *              conn_p,
+                           const struct io_uring_cqe * cqe_p)
+{
+    uint32_t buffer_id = 0;
+
+    if (0 != (cqe_p->flags & IORING_CQE_F_BUFFER))
+    {
+        buffer_id = cqe_p->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (0 < cqe_p->res)
+        {
+            shard_p->buffers_p[buffer_id].length = (uint32_t)cqe_p->res;
+            shard_p->buffers_p[buffer_id].next   = NO_SLOT;
+            if (NO_SLOT == conn_p->held_tail)
+            {
+                conn_p->held_head = buffer_id;
+            }
+            else
+            {
+                shard_p->buffers_p[conn_p->held_tail].next = buffer_id;
+            }
+            conn_p->held_tail = buffer_id;
+        }
+        else
+        {
+            uring_recycle(shard_p, buffer_id);
+        }
+    }
+
+    if (0 == cqe_p->res)
+    {
+        // The client is done sending; what it sent is still answered
+        conn_p->eof = true;
+    }
+    else if (-ENOBUFS == cqe_p->res)
+    {
+        // Every buffer is held; re-armed once one comes back
+        conn_p->starved = true;
+        shard_p->starved++;
+    }
+    else if ((0 > cqe_p->res) && (-ECANCELED != cqe_p->res))
+    {
+        conn_p->closing = true;
+        conn_p->failed  = true;
+    }
+
+    if (0 == (cqe_p->flags & IORING_CQE_F_MORE))
+    {
+        conn_p->receiving  = false;
+        conn_p->cancelling = false;
+    }
+
+    conn_mark_dirty(shard_p, conn_p);
+}
+
+static void uring_sent(shard_conn_t *              conn_p,
+                       const struct io_uring_cqe * cqe_p)
+{
+    // The kernel is done with the bytes of an earlier send
+    if (0 != (cqe_p->flags & IORING_CQE_F_NOTIF))
+    {
+        conn_p->notifs--;
+        return;
+    }
+
+    conn_p->sending = false;
+    if (0 != (cqe_p->flags & IORING_CQE_F_MORE))
+    {
+        conn_p->notifs++;
+    }
+
+    if (0 < cqe_p->res)
+    {
+        conn_p->out_head += (size_t)cqe_p->res;
+        conn_p->out_len -= (size_t)cqe_p->res;
+        return;
+    }
+
+    conn_p->closing = true;
+    conn_p->failed  = true;
+}
+
+static void uring_consume(shard_t * shard_p, shard_conn_t * conn_p)
+{
+    uint32_t        buffer_id = 0;
+    size_t          available = 0;
+    size_t          consumed  = 0;
+    size_t          copied    = 0;
+    const uint8_t * data_p    = NULL;
+
+    // A frame left over from an earlier buffer is completed first
+    if (0 < conn_p->in_len)
+    {
+        conn_decode(shard_p, conn_p);
+    }
+
+    while ((false == conn_p->paused) && (false == conn_p->closing) &&
+           (NO_SLOT != conn_p->held_head))
+    {
+        buffer_id = conn_p->held_head;
+        data_p    = shard_p->recv_p +
+                 ((size_t)buffer_id * shard_p->buffer_size) +
+                 conn_p->held_offset;
+        available = shard_p->buffers_p[buffer_id].length - conn_p->held_offset;
+
+        // Answered in place when nothing is waiting in the input buffer
+        consumed = 0;
+        if (0 == conn_p->in_len)
+        {
+            consumed = conn_answer(shard_p, conn_p, data_p, available);
+        }
+
+        // A frame cut short by the end of the buffer waits for the rest
+        copied = 0;
+        if ((false == conn_p->paused) && (false == conn_p->closing))
+        {
+            copied = available - consumed;
+            if (copied > (shard_p->buffer_size - conn_p->in_len))
+            {
+                copied = shard_p->buffer_size - conn_p->in_len;
+            }
+            memcpy(conn_p->in_p + conn_p->in_len, data_p + consumed, copied);
+            conn_p->in_len += copied;
+        }
+
+        conn_p->held_offset += (uint32_t)(consumed + copied);
+        if (conn_p->held_offset == shard_p->buffers_p[buffer_id].length)
+        {
+            conn_p->held_head = shard_p->buffers_p[buffer_id].next;
+            if (NO_SLOT == conn_p->held_head)
+            {
+                conn_p->held_tail = NO_SLOT;
+            }
+            conn_p->held_offset = 0;
+            uring_recycle(shard_p, buffer_id);
+        }
+
+        if (0 < copied)
+        {
+            conn_decode(shard_p, conn_p);
+        }
+    }
+}
+
+static void uring_flush_dirty(shard_t * shard_p)
+{
+    shard_conn_t * conn_p = NULL;
+    bool           wanted = false;
+
+    while (NO_SLOT != shard_p->dirty_head)
+    {
+        conn_p              = &shard_p->conns_p[shard_p->dirty_head];
+        shard_p->dirty_head = conn_p->next;
+        conn_p->next        = NO_SLOT;
+        conn_p->dirty       = false;
+
+        if (false == conn_p->failed)
+        {
+            // Room freed up: answer what was left waiting
+            conn_compact(conn_p);
+            if ((true == conn_p->paused) &&
+                ((shard_p->buffer_size - conn_p->out_head - conn_p->out_len) >=
+                 REPLY_SIZE))
+            {
+                conn_p->paused = false;
+            }
+
+            uring_consume(shard_p, conn_p);
+            if ((true == conn_p->eof) && (false == conn_p->paused) &&
+                (NO_SLOT == conn_p->held_head))
+            {
+                conn_p->closing = true;
+            }
+
+            if ((0 < conn_p->out_len) && (false == conn_p->sending))
+            {
+                uring_send(shard_p, conn_p);
+            }
+        }
+
+        if ((true == conn_p->failed) ||
+            ((true == conn_p->closing) && (0 == conn_p->out_len)))
+        {
+            uring_close(shard_p, conn_p);
+            continue;
+        }
+
+        // A paused connection stops receiving, so it holds few buffers
+        wanted = (false == conn_p->paused) && (false == conn_p->closing) &&
+                 (false == conn_p->eof) && (false == conn_p->starved);
+        if ((true == wanted) && (false == conn_p->receiving))
+        {
+            uring_arm_recv(shard_p, conn_p);
+        }
+        else if ((false == wanted) && (true == conn_p->receiving) &&
+                 (false == conn_p->cancelling))
+        {
+            uring_cancel_recv(shard_p, conn_p);
+        }
+    }
+}
+
+static void uring_close(shard_t * shard_p, shard_conn_t * conn_p)
+{
+    if (true == conn_p->receiving)
+    {
+        if (false == conn_p->cancelling)
+        {
+            uring_cancel_recv(shard_p, conn_p);
+        }
+        return;
+    }
+
+    // Completions still to come would name the slot; wait for them
+    if ((true == conn_p->sending) || (0 < conn_p->notifs))
+    {
+        return;
+    }
+
+    while (NO_SLOT != conn_p->held_head)
+    {
+        uring_recycle(shard_p, conn_p->held_head);
+        conn_p->held_head = shard_p->buffers_p[conn_p->held_head].next;
+    }
+    conn_p->held_tail = NO_SLOT;
+
+    if (true == conn_p->starved)
+    {
+        conn_p->starved = false;
+        shard_p->starved--;
+    }
+
+    conn_close(shard_p, conn_p);
+}
+
+static void uring_recycle(shard_t * shard_p, uint32_t buffer_id)
+{
+    io_ring_recycle_buffer(shard_p->ring_p, (uint16_t)buffer_id);
+    if (0 < shard_p->starved)
+    {
+        shard_p->wake_starved = true;
+    }
+}
+
+static void uring_wake_starved(shard_t * shard_p)
+{
+    shard_p->wake_starved = false;
+
+    for (size_t slot = 0;
+         (0 < shard_p->starved) && (slot < shard_p->max_connections);
+         slot++)
+    {
+        if (true == shard_p->conns_p[slot].starved)
+        {
+            shard_p->conns_p[slot].starved = false;
+            shard_p->starved--;
+            conn_mark_dirty(shard_p, &shard_p->conns_p[slot]);
+        }
+    }
+}
+
+/*** end of file ***/
@@ -0,0 +1,731 @@
+/**
+ * @file test_shard.c
+ * @brief Tests for the Shared-Nothing Worker Shards
+ *
+ * Runs shards on their own threads behind SO_REUSEPORT listeners bound to
+ * one loopback port, the way the server gives each shard its own listener,
+ * and talks to them over TCP. The tests check that pipelined requests are
+ * answered in order with their payload echoed, including when the client
+ * sends far more than a connection buffer holds before reading any reply and
+ * when several connections are spread over two shards; that a reply longer
+ * than SHARD_MAX_PAYLOAD is sent empty; that a bad frame or a frame larger
+ * than the connection buffer closes the connection; and that connections
+ * beyond max_connections are closed while the open ones keep working. Every
+ * test runs on both I/O backends; io_uring is skipped where the kernel does
+ * not support it. Build with -fsanitize=thread to check shard_stop() from
+ * another thread as well.
+ *
+ * Usage: test-shard
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h> // htonl, ntohl
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "shard.h"
+#include "utilities.h"
+#include "wire_protocol.h"
+
+#define TEST_SHARDS      2    // Shards sharing the port
+#define TEST_CONNECTIONS 8    // Connections each shard keeps open
+#define TEST_BUFFER_SIZE 1024 // Bytes per connection buffer
+#define TEST_PAYLOAD     4    // Request payload: the request id again
+#define TEST_REQUESTS    2000 // Requests pipelined by the slow reader
+#define TEST_TIMEOUT_S   5    // Longest wait for a reply
+#define TYPE_ECHO        1    // Request the handler echoes
+#define TYPE_TOO_LONG    2    // Request answered with an oversized reply
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr,                                                    \
+                    "%s:%d: CHECK(%s) failed\n",                               \
+                    __FILE__,                                                  \
+                    __LINE__,                                                  \
+                    #condition);                                               \
+            goto END;                                                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @struct harness
+ * @brief Running shards, their threads and the port they share.
+ */
+typedef struct harness
+{
+    io_backend_t backend;                 // Engine the shards run on
+    size_t       count;                   // Shards started
+    in_port_t    port;                    // Shared port, network byte order
+    int          listen_fds[TEST_SHARDS]; // One listener per shard
+    shard_t *    shards[TEST_SHARDS];     // The shards under test
+    pthread_t    threads[TEST_SHARDS];    // Run shard_run()
+} harness_t;
+
+/**
+ * @struct test_case
+ * @brief One named test.
+ */
+typedef struct test_case
+{
+    const char * name_p;               // Printed with the result
+    size_t       shards;               // Shards the test runs against
+    int (*run)(harness_t * harness_p); // Returns E_SUCCESS if it passed
+} test_case_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Pipelines a few requests and checks their replies.
+ */
+static int test_pipeline(harness_t * harness_p);
+
+/**
+ * @brief Sends TEST_REQUESTS requests before reading a single reply.
+ */
+static int test_slow_reader(harness_t * harness_p);
+
+/**
+ * @brief Interleaves requests on connections spread over every shard.
+ */
+static int test_many_connections(harness_t * harness_p);
+
+/**
+ * @brief Checks that a reply beyond SHARD_MAX_PAYLOAD is sent empty.
+ */
+static int test_long_reply(harness_t * harness_p);
+
+/**
+ * @brief Checks that a frame with a bad magic closes its connection.
+ */
+static int test_bad_frame(harness_t * harness_p);
+
+/**
+ * @brief Checks that a frame larger than the buffer closes its connection.
+ */
+static int test_huge_frame(harness_t * harness_p);
+
+/**
+ * @brief Checks that connections beyond max_connections are closed.
+ */
+static int test_connection_limit(harness_t * harness_p);
+
+/**
+ * @brief Opens the listeners, creates the shards and starts their threads.
+ *
+ * @param harness_p The harness to start.
+ * @param count The number of shards, at most TEST_SHARDS.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int harness_start(harness_t * harness_p, size_t count);
+
+/**
+ * @brief Stops and joins the shard threads, destroys the shards and closes
+ * the listeners.
+ *
+ * @param harness_p The harness to stop.
+ */
+static void harness_stop(harness_t * harness_p);
+
+/**
+ * @brief Opens a connection to the shared port.
+ *
+ * @param harness_p The harness.
+ * @return The connected socket, or -1 on failure.
+ */
+static int harness_connect(harness_t * harness_p);
+
+/**
+ * @brief Opens one SO_REUSEPORT listener on the loopback address.
+ *
+ * @param port_p The port to bind, network byte order; 0 picks one and
+ * stores it.
+ * @return The listening socket, or -1 on failure.
+ */
+static int open_listener(in_port_t * port_p);
+
+/**
+ * @brief Handler: echoes TYPE_ECHO payloads, overfills TYPE_TOO_LONG.
+ */
+static uint8_t handle_request(void *               context_p,
+                              const wire_frame_t * frame_p,
+                              uint8_t *            payload_p,
+                              uint32_t *           length_p);
+
+/**
+ * @brief Runs one shard.
+ *
+ * @param arg_p The shard.
+ * @return NULL.
+ */
+static void * run_shard(void * arg_p);
+
+/**
+ * @brief Sends requests 'first' to 'first + count - 1' on a connection.
+ *
+ * @param fd The connected socket.
+ * @param type The request type.
+ * @param first The first request id.
+ * @param count The number of requests.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int send_requests(int fd, uint8_t type, uint32_t first, size_t count);
+
+/**
+ * @brief Reads 'count' replies and checks each of them.
+ *
+ * A shard answers a connection's requests in order, so reply 'idx' must
+ * carry request id 'first + idx' and, for TYPE_ECHO, that id as payload.
+ *
+ * @param fd The connected socket.
+ * @param type The type the requests were sent with.
+ * @param first The first request id.
+ * @param count The number of replies.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int read_replies(int fd, uint8_t type, uint32_t first, size_t count);
+
+/**
+ * @brief Reads exactly 'length' bytes.
+ *
+ * @return E_SUCCESS on success, E_FAILURE on end of file or error.
+ */
+static int read_full(int fd, void * buffer_p, size_t length);
+
+/**
+ * @brief Waits for the peer to close a connection.
+ *
+ * @return E_SUCCESS if the connection reached end of file, otherwise
+ * E_FAILURE.
+ */
+static int wait_closed(int fd);
+
+int main(void)
+{
+    static const test_case_t tests[] = {
+        { "pipeline", TEST_SHARDS, test_pipeline },
+        { "slow-reader", TEST_SHARDS, test_slow_reader },
+        { "many-connections", TEST_SHARDS, test_many_connections },
+        { "long-reply", TEST_SHARDS, test_long_reply },
+        { "bad-frame", TEST_SHARDS, test_bad_frame },
+        { "huge-frame", TEST_SHARDS, test_huge_frame },
+        { "connection-limit", 1, test_connection_limit },
+    };
+    static const io_backend_t backends[] = { IO_BACKEND_EPOLL,
+                                             IO_BACKEND_IO_URING };
+    int                       exit_code  = E_SUCCESS;
+    const char *              name_p     = NULL;
+    harness_t *               harness_p  = NULL;
+
+    for (size_t backend = 0; backend < sizeof(backends) / sizeof(backends[0]);
+         backend++)
+    {
+        name_p = io_backend_to_string(backends[backend]);
+        if (E_SUCCESS != io_backend_probe(backends[backend]))
+        {
+            printf("SKIP %s: not supported by this kernel\n", name_p);
+            continue;
+        }
+
+        for (size_t idx = 0; idx < sizeof(tests) / sizeof(tests[0]); idx++)
+        {
+            // Fresh shards per test, so a failure cannot leak into the next
+            harness_p = calloc(1, sizeof(*harness_p));
+            if (NULL != harness_p)
+            {
+                harness_p->backend = backends[backend];
+            }
+
+            if ((NULL != harness_p) &&
+                (E_SUCCESS == harness_start(harness_p, tests[idx].shards)) &&
+                (E_SUCCESS == tests[idx].run(harness_p)))
+            {
+                printf("PASS %s %s\n", name_p, tests[idx].name_p);
+            }
+            else
+            {
+                printf("FAIL %s %s\n", name_p, tests[idx].name_p);
+                exit_code = E_FAILURE;
+            }
+
+            if (NULL != harness_p)
+            {
+                harness_stop(harness_p);
+                free(harness_p);
+            }
+        }
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int test_pipeline(harness_t * harness_p)
+{
+    int exit_code = E_FAILURE;
+    int fd        = -1;
+
+    fd = harness_connect(harness_p);
+    CHECK(0 <= fd);
+
+    for (uint32_t round = 0; round < 10; round++)
+    {
+        CHECK(E_SUCCESS == send_requests(fd, TYPE_ECHO, round * 12, 12));
+        CHECK(E_SUCCESS == read_replies(fd, TYPE_ECHO, round * 12, 12));
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    if (0 <= fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+static int test_slow_reader(harness_t * harness_p)
+{
+    int exit_code = E_FAILURE;
+    int fd        = -1;
+
+    fd = harness_connect(harness_p);
+    CHECK(0 <= fd);
+
+    // Far beyond one buffer: the shard must pause reading, not drop
+    CHECK(E_SUCCESS == send_requests(fd, TYPE_ECHO, 0, TEST_REQUESTS));
+    CHECK(E_SUCCESS == read_replies(fd, TYPE_ECHO, 0, TEST_REQUESTS));
+
+    exit_code = E_SUCCESS;
+END:
+    if (0 <= fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+static int test_many_connections(harness_t * harness_p)
+{
+    int    exit_code = E_FAILURE;
+    size_t opened    = 0;
+    int    fds[TEST_CONNECTIONS];
+
+    // The kernel spreads these over the shards' listeners
+    for (; opened < TEST_CONNECTIONS; opened++)
+    {
+        fds[opened] = harness_connect(harness_p);
+        CHECK(0 <= fds[opened]);
+    }
+
+    for (uint32_t round = 0; round < 20; round++)
+    {
+        for (size_t idx = 0; idx < TEST_CONNECTIONS; idx++)
+        {
+            CHECK(E_SUCCESS ==
+                  send_requests(fds[idx], TYPE_ECHO, round * 100, 40));
+        }
+
+        for (size_t idx = 0; idx < TEST_CONNECTIONS; idx++)
+        {
+            CHECK(E_SUCCESS ==
+                  read_replies(fds[idx], TYPE_ECHO, round * 100, 40));
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    for (size_t idx = 0; idx < opened; idx++)
+    {
+        close(fds[idx]);
+    }
+    return exit_code;
+}
+
+static int test_long_reply(harness_t * harness_p)
+{
+    int exit_code = E_FAILURE;
+    int fd        = -1;
+
+    fd = harness_connect(harness_p);
+    CHECK(0 <= fd);
+
+    CHECK(E_SUCCESS == send_requests(fd, TYPE_TOO_LONG, 0, 3));
+    CHECK(E_SUCCESS == read_replies(fd, TYPE_TOO_LONG, 0, 3));
+
+    // The connection stays usable afterwards
+    CHECK(E_SUCCESS == send_requests(fd, TYPE_ECHO, 3, 3));
+    CHECK(E_SUCCESS == read_replies(fd, TYPE_ECHO, 3, 3));
+
+    exit_code = E_SUCCESS;
+END:
+    if (0 <= fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+static int test_bad_frame(harness_t * harness_p)
+{
+    int     exit_code               = E_FAILURE;
+    int     fd                      = -1;
+    uint8_t frame[WIRE_HEADER_SIZE] = { 0 };
+
+    fd = harness_connect(harness_p);
+    CHECK(0 <= fd);
+
+    CHECK(E_SUCCESS == send_requests(fd, TYPE_ECHO, 0, 3));
+    CHECK(E_SUCCESS == read_replies(fd, TYPE_ECHO, 0, 3));
+
+    // Not "NC": the shard closes the connection
+    memset(frame, 0xFF, sizeof(frame));
+    CHECK((ssize_t)sizeof(frame) == write(fd, frame, sizeof(frame)));
+    CHECK(E_SUCCESS == wait_closed(fd));
+
+    exit_code = E_SUCCESS;
+END:
+    if (0 <= fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+static int test_huge_frame(harness_t * harness_p)
+{
+    int     exit_code               = E_FAILURE;
+    int     fd                      = -1;
+    uint8_t frame[TEST_BUFFER_SIZE] = { 0 };
+
+    fd = harness_connect(harness_p);
+    CHECK(0 <= fd);
+
+    // A valid header for a payload the connection buffer cannot hold
+    wire_encode_header(frame, TYPE_ECHO, 0, 2 * TEST_BUFFER_SIZE);
+    CHECK((ssize_t)sizeof(frame) == write(fd, frame, sizeof(frame)));
+    CHECK(E_SUCCESS == wait_closed(fd));
+
+    exit_code = E_SUCCESS;
+END:
+    if (0 <= fd)
+    {
+        close(fd);
+    }
+    return exit_code;
+}
+
+static int test_connection_limit(harness_t * harness_p)
+{
+    int    exit_code = E_FAILURE;
+    int    extra_fd  = -1;
+    size_t opened    = 0;
+    int    fds[TEST_CONNECTIONS];
+
+    // A round trip on each makes sure the shard holds all of them
+    for (; opened < TEST_CONNECTIONS; opened++)
+    {
+        fds[opened] = harness_connect(harness_p);
+        CHECK(0 <= fds[opened]);
+        CHECK(E_SUCCESS == send_requests(fds[opened], TYPE_ECHO, 0, 1));
+        CHECK(E_SUCCESS == read_replies(fds[opened], TYPE_ECHO, 0, 1));
+    }
+
+    extra_fd = harness_connect(harness_p);
+    CHECK(0 <= extra_fd);
+    CHECK(E_SUCCESS == wait_closed(extra_fd));
+
+    for (size_t idx = 0; idx < TEST_CONNECTIONS; idx++)
+    {
+        CHECK(E_SUCCESS == send_requests(fds[idx], TYPE_ECHO, 1, 5));
+        CHECK(E_SUCCESS == read_replies(fds[idx], TYPE_ECHO, 1, 5));
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    if (0 <= extra_fd)
+    {
+        close(extra_fd);
+    }
+    for (size_t idx = 0; idx < opened; idx++)
+    {
+        close(fds[idx]);
+    }
+    return exit_code;
+}
+
+static int harness_start(harness_t * harness_p, size_t count)
+{
+    int exit_code = E_FAILURE;
+
+    for (size_t idx = 0; idx < TEST_SHARDS; idx++)
+    {
+        harness_p->listen_fds[idx] = -1;
+    }
+
+    // Every listener is open before any shard starts, as at server start
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        harness_p->listen_fds[idx] = open_listener(&harness_p->port);
+        CHECK(0 <= harness_p->listen_fds[idx]);
+    }
+
+    for (; harness_p->count < count; harness_p->count++)
+    {
+        harness_p->shards[harness_p->count] =
+            shard_create(&harness_p->listen_fds[harness_p->count],
+                         1,
+                         TEST_CONNECTIONS,
+                         TEST_BUFFER_SIZE,
+                         harness_p->backend,
+                         handle_request,
+                         NULL);
+        CHECK(NULL != harness_p->shards[harness_p->count]);
+
+        if (0 != pthread_create(&harness_p->threads[harness_p->count],
+                                NULL,
+                                run_shard,
+                                harness_p->shards[harness_p->count]))
+        {
+            shard_destroy(&harness_p->shards[harness_p->count]);
+            goto END;
+        }
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static void harness_stop(harness_t * harness_p)
+{
+    for (size_t idx = 0; idx < harness_p->count; idx++)
+    {
+        shard_stop(harness_p->shards[idx]);
+        pthread_join(harness_p->threads[idx], NULL);
+        shard_destroy(&harness_p->shards[idx]);
+    }
+    harness_p->count = 0;
+
+    // Shards do not own their listeners
+    for (size_t idx = 0; idx < TEST_SHARDS; idx++)
+    {
+        if (0 <= harness_p->listen_fds[idx])
+        {
+            close(harness_p->listen_fds[idx]);
+            harness_p->listen_fds[idx] = -1;
+        }
+    }
+}
+
+static int harness_connect(harness_t * harness_p)
+{
+    int                fd      = -1;
+    struct timeval     timeout = { .tv_sec = TEST_TIMEOUT_S };
+    struct sockaddr_in address = { 0 };
+
+    address.sin_family      = AF_INET;
+    address.sin_port        = harness_p->port;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (-1 == fd)
+    {
+        perror("harness_connect(): socket()");
+        return -1;
+    }
+
+    // A reply that never comes fails the test instead of hanging it
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (-1 == connect(fd, (struct sockaddr *)&address, sizeof(address)))
+    {
+        perror("harness_connect(): connect()");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int open_listener(in_port_t * port_p)
+{
+    int                fd      = -1;
+    int                one     = 1;
+    socklen_t          length  = sizeof(struct sockaddr_in);
+    struct sockaddr_in address = { 0 };
+
+    address.sin_family      = AF_INET;
+    address.sin_port        = *port_p;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (-1 == fd)
+    {
+        perror("open_listener(): socket()");
+        return -1;
+    }
+
+    if ((-1 == setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))) ||
+        (-1 == bind(fd, (struct sockaddr *)&address, sizeof(address))) ||
+        (-1 == listen(fd, TEST_CONNECTIONS)) ||
+        (-1 == getsockname(fd, (struct sockaddr *)&address, &length)))
+    {
+        perror("open_listener()");
+        close(fd);
+        return -1;
+    }
+
+    *port_p = address.sin_port;
+    return fd;
+}
+
+static uint8_t handle_request(void *               context_p,
+                              const wire_frame_t * frame_p,
+                              uint8_t *            payload_p,
+                              uint32_t *           length_p)
+{
+    (void)context_p;
+
+    if (TYPE_TOO_LONG == frame_p->type)
+    {
+        // The shard must drop this payload rather than overrun its buffer
+        *length_p = SHARD_MAX_PAYLOAD + 1;
+        return WIRE_REPLY_OK;
+    }
+
+    if ((TYPE_ECHO != frame_p->type) || (TEST_PAYLOAD != frame_p->length))
+    {
+        return WIRE_REPLY_BUSY;
+    }
+
+    memcpy(payload_p, frame_p->payload_p, frame_p->length);
+    *length_p = frame_p->length;
+    return WIRE_REPLY_OK;
+}
+
+static void * run_shard(void * arg_p)
+{
+    shard_run(arg_p);
+    return NULL;
+}
+
+static int send_requests(int fd, uint8_t type, uint32_t first, size_t count)
+{
+    uint32_t id                                     = 0;
+    uint8_t  frame[WIRE_HEADER_SIZE + TEST_PAYLOAD] = { 0 };
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        id = first + (uint32_t)idx;
+        wire_encode_header(frame, type, id, TEST_PAYLOAD);
+        memcpy(frame + WIRE_HEADER_SIZE, &id, sizeof(id));
+
+        if ((ssize_t)sizeof(frame) != write(fd, frame, sizeof(frame)))
+        {
+            perror("send_requests(): write()");
+            return E_FAILURE;
+        }
+    }
+
+    return E_SUCCESS;
+}
+
+static int read_replies(int fd, uint8_t type, uint32_t first, size_t count)
+{
+    int          exit_code                               = E_FAILURE;
+    size_t       consumed                                = 0;
+    uint32_t     echoed                                  = 0;
+    uint32_t     length                                  = 0;
+    wire_frame_t frame                                   = { 0 };
+    uint8_t      buffer[WIRE_HEADER_SIZE + TEST_PAYLOAD] = { 0 };
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        // The length is the last header field, in network byte order
+        CHECK(E_SUCCESS == read_full(fd, buffer, WIRE_HEADER_SIZE));
+        memcpy(&length,
+               buffer + WIRE_HEADER_SIZE - sizeof(length),
+               sizeof(length));
+        length = ntohl(length);
+        CHECK(TEST_PAYLOAD >= length);
+        CHECK(E_SUCCESS == read_full(fd, buffer + WIRE_HEADER_SIZE, length));
+        CHECK(WIRE_FRAME_OK ==
+              wire_decode_frame(
+                  buffer, WIRE_HEADER_SIZE + length, &frame, &consumed));
+
+        CHECK(WIRE_REPLY_OK == frame.type);
+        CHECK(first + (uint32_t)idx == frame.request_id);
+
+        if (TYPE_TOO_LONG == type)
+        {
+            CHECK(0 == frame.length);
+            continue;
+        }
+
+        CHECK(TEST_PAYLOAD == frame.length);
+        memcpy(&echoed, frame.payload_p, sizeof(echoed));
+        CHECK(frame.request_id == echoed);
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+static int read_full(int fd, void * buffer_p, size_t length)
+{
+    size_t  done   = 0;
+    ssize_t result = 0;
+
+    while (done < length)
+    {
+        result = read(fd, (uint8_t *)buffer_p + done, length - done);
+        if ((-1 == result) && (EINTR == errno))
+        {
+            continue;
+        }
+        if (0 >= result)
+        {
+            return E_FAILURE;
+        }
+        done += (size_t)result;
+    }
+
+    return E_SUCCESS;
+}
+
+static int wait_closed(int fd)
+{
+    ssize_t result = 0;
+    uint8_t byte   = 0;
+
+    do
+    {
+        result = read(fd, &byte, sizeof(byte));
+    } while ((-1 == result) && (EINTR == errno));
+
+    // A reset counts as closed too: unread input makes close() send RST
+    if ((0 == result) || ((-1 == result) && (ECONNRESET == errno)))
+    {
+        return E_SUCCESS;
+    }
+
+    return E_FAILURE;
+}
+
+/*** end of file ***/
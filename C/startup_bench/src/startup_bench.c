@@ -0,0 +1,295 @@
+/**
+ * @file startup_bench.c
+ * @brief Cold Start Latency Benchmark
+ *
+ * startup-bench times what NetCalc does between exec() and accepting its
+ * first connection: process_options() over a command line using most of the
+ * tuning options, then installing the calculation kernels it asks for and
+ * opening every listener it asks for with its socket tuning applied. Each
+ * round starts from a zeroed options_t and closes its sockets again, so
+ * every round is a cold parse and bind.
+ *
+ * Given a budget, the benchmark exits with a failure status when the median
+ * parse-to-listening time exceeds it, so a build script can gate on it.
+ *
+ * Usage: startup-bench [ROUNDS [BUDGET_US [PORT]]]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "calc_kernels.h"
+#include "listener.h"
+#include "number_parser.h"
+#include "option_handler.h"
+#include "utilities.h"
+
+#define DEFAULT_ROUNDS 200             // Cold starts timed
+#define MAX_ROUNDS     100000          // Most rounds accepted
+#define DEFAULT_PORT   "18080"         // First port listened on
+#define PORT_COUNT     2               // Ports in the command line
+#define ARG_SIZE       32              // Bytes per command-line argument
+#define MAX_ARGS       32              // Most command-line arguments
+#define MAX_LISTENERS  (PORT_COUNT * 4) // Sockets a round opens
+#define NSEC_PER_USEC  1000ULL
+#define NSEC_PER_SEC   1000000000ULL
+
+/**
+ * @struct bench_sample
+ * @brief The phases of one cold start, in nanoseconds.
+ */
+typedef struct bench_sample
+{
+    uint64_t parse_ns;  // process_options()
+    uint64_t listen_ns; // calc_kernels_select(), every listener_open_group()
+    uint64_t total_ns;  // Both
+} bench_sample_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Builds the command line every round parses.
+ *
+ * @param port The first port; the next port is the second.
+ * @param args_p MAX_ARGS arguments of ARG_SIZE bytes receiving the text.
+ * @return The number of arguments.
+ */
+static int build_arguments(int32_t port, char (*args_p)[ARG_SIZE]);
+
+/**
+ * @brief Runs one cold start.
+ *
+ * @param argc The number of arguments.
+ * @param args_p The arguments.
+ * @param sample_p Pointer to where the timings are stored.
+ * @return E_SUCCESS on success, E_FAILURE otherwise.
+ */
+static int run_round(int              argc,
+                     char (*args_p)[ARG_SIZE],
+                     bench_sample_t * sample_p);
+
+/**
+ * @brief Prints the minimum, median and maximum of one phase.
+ *
+ * @param name_p The phase's name.
+ * @param values_p The phase's timings; sorted in place.
+ * @param count The number of timings.
+ * @return The median.
+ */
+static uint64_t report(const char * name_p, uint64_t * values_p, size_t count);
+
+/**
+ * @brief qsort() comparison of two uint64_t.
+ */
+static int compare_u64(const void * left_p, const void * right_p);
+
+/**
+ * @brief Returns CLOCK_MONOTONIC in nanoseconds.
+ */
+static uint64_t now_ns(void);
+
+int main(int argc, char ** argv)
+{
+    int            exit_code = E_FAILURE;
+    int32_t        rounds    = DEFAULT_ROUNDS;
+    int32_t        budget_us = 0;
+    int32_t        port      = 0;
+    int            arg_count = 0;
+    uint64_t       median    = 0;
+    bench_sample_t sample    = { 0 };
+    uint64_t *     parse_p   = NULL;
+    uint64_t *     listen_p  = NULL;
+    uint64_t *     total_p   = NULL;
+    char           args[MAX_ARGS][ARG_SIZE];
+
+    number_parse_int32_str(DEFAULT_PORT, &port);
+
+    if (((2 <= argc) &&
+         ((E_SUCCESS != number_parse_int32_str(argv[1], &rounds)) ||
+          (1 > rounds) || (MAX_ROUNDS < rounds))) ||
+        ((3 <= argc) &&
+         ((E_SUCCESS != number_parse_int32_str(argv[2], &budget_us)) ||
+          (0 > budget_us))) ||
+        ((4 <= argc) &&
+         ((E_SUCCESS != number_parse_int32_str(argv[3], &port)) ||
+          (1025 > port) || (65534 < port))))
+    {
+        fprintf(stderr, "Usage: %s [ROUNDS [BUDGET_US [PORT]]]\n", argv[0]);
+        goto END;
+    }
+
+    parse_p  = calloc((size_t)rounds, sizeof(uint64_t));
+    listen_p = calloc((size_t)rounds, sizeof(uint64_t));
+    total_p  = calloc((size_t)rounds, sizeof(uint64_t));
+    if ((NULL == parse_p) || (NULL == listen_p) || (NULL == total_p))
+    {
+        print_error("main(): calloc() failed.");
+        goto END;
+    }
+
+    arg_count = build_arguments(port, args);
+
+    printf("%d cold starts of:", rounds);
+    for (int idx = 0; idx < arg_count; idx++)
+    {
+        printf(" %s", args[idx]);
+    }
+    printf("\n");
+
+    for (int32_t round = 0; round < rounds; round++)
+    {
+        if (E_SUCCESS != run_round(arg_count, args, &sample))
+        {
+            goto END;
+        }
+        parse_p[round]  = sample.parse_ns;
+        listen_p[round] = sample.listen_ns;
+        total_p[round]  = sample.total_ns;
+    }
+
+    report("process_options", parse_p, (size_t)rounds);
+    report("listeners", listen_p, (size_t)rounds);
+    median = report("parse-to-listening", total_p, (size_t)rounds);
+
+    if ((0 < budget_us) && (median > (uint64_t)budget_us * NSEC_PER_USEC))
+    {
+        printf("FAIL: median %.1f us exceeds the %d us budget\n",
+               (double)median / (double)NSEC_PER_USEC,
+               budget_us);
+        goto END;
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    free(parse_p);
+    free(listen_p);
+    free(total_p);
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int build_arguments(int32_t port, char (*args_p)[ARG_SIZE])
+{
+    static const char * const tuning[] = {
+        "-n", "8", "--reuseport", "4", "--tcp-nodelay", "--backlog", "1024",
+        "--rcvbuf", "262144", "--queue", "lockfree", "--queue-depth", "65536",
+        "--max-threads", "32", "--trace-sample", "1/1000", "--quiet",
+    };
+    int count = 0;
+
+    snprintf(args_p[count++], ARG_SIZE, "netcalc");
+    for (int32_t idx = 0; idx < PORT_COUNT; idx++)
+    {
+        snprintf(args_p[count++], ARG_SIZE, "-p");
+        snprintf(args_p[count++], ARG_SIZE, "%d", port + idx);
+    }
+
+    for (size_t idx = 0; idx < sizeof(tuning) / sizeof(tuning[0]); idx++)
+    {
+        snprintf(args_p[count++], ARG_SIZE, "%s", tuning[idx]);
+    }
+
+    return count;
+}
+
+static int run_round(int              argc,
+                     char (*args_p)[ARG_SIZE],
+                     bench_sample_t * sample_p)
+{
+    int       exit_code = E_FAILURE;
+    uint64_t  start     = 0;
+    uint64_t  parsed    = 0;
+    size_t    opened    = 0;
+    size_t    per_port  = 1;
+    options_t options   = { 0 };
+    char *    argv[MAX_ARGS + 1];
+    int       fds[MAX_LISTENERS];
+
+    // Fresh pointers every round, in case the parser reorders them
+    for (int idx = 0; idx < argc; idx++)
+    {
+        argv[idx] = args_p[idx];
+    }
+    argv[argc] = NULL;
+
+    start = now_ns();
+    if (E_SUCCESS != process_options(argc, argv, &options))
+    {
+        print_error("run_round(): process_options() failed.");
+        goto END;
+    }
+    parsed = now_ns();
+
+    // Once per start, whether or not '--simd' was given
+    if (E_SUCCESS != calc_kernels_select(options.simd_level, NULL))
+    {
+        print_error("run_round(): Unable to install the kernels.");
+        goto END;
+    }
+
+    if (true == options.reuseport_flag)
+    {
+        per_port = (size_t)options.reuseport_value;
+    }
+
+    for (size_t port = 0; port < options.p_count; port++)
+    {
+        if ((MAX_LISTENERS - opened < per_port) ||
+            (E_SUCCESS != listener_open_group(options.p_values[port],
+                                              per_port,
+                                              &options.listen_tuning,
+                                              &fds[opened])))
+        {
+            print_error("run_round(): Unable to open the listeners.");
+            goto END;
+        }
+        opened += per_port;
+    }
+
+    sample_p->parse_ns  = parsed - start;
+    sample_p->listen_ns = now_ns() - parsed;
+    sample_p->total_ns  = sample_p->parse_ns + sample_p->listen_ns;
+
+    exit_code = E_SUCCESS;
+END:
+    listener_close_all(fds, opened);
+    return exit_code;
+}
+
+static uint64_t report(const char * name_p, uint64_t * values_p, size_t count)
+{
+    qsort(values_p, count, sizeof(uint64_t), compare_u64);
+
+    printf("  %-20s min %8.1f us  median %8.1f us  max %8.1f us\n",
+           name_p,
+           (double)values_p[0] / (double)NSEC_PER_USEC,
+           (double)values_p[count / 2] / (double)NSEC_PER_USEC,
+           (double)values_p[count - 1] / (double)NSEC_PER_USEC);
+
+    return values_p[count / 2];
+}
+
+static int compare_u64(const void * left_p, const void * right_p)
+{
+    uint64_t left  = *(const uint64_t *)left_p;
+    uint64_t right = *(const uint64_t *)right_p;
+
+    return (left > right) - (left < right);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec now = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * NSEC_PER_SEC) + (uint64_t)now.tv_nsec;
+}
+
+/*** end of file ***/
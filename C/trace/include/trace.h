@@ -0,0 +1,148 @@
+/**
+ * @file trace.h
+ * @brief Header for Sampled Per-Stage Request Tracing
+ *
+ * This header file provides the interface for '--trace-sample=1/N', which
+ * records where one request in N spends its time: accept, read and parse,
+ * queue wait, compute and write. A request carries a trace_span_t from the
+ * moment it is read; each stage stamps its start with the CPU's cycle
+ * counter (rdtsc on x86-64, cntvct_el0 on AArch64), and the thread that
+ * finishes the request copies the span into its own ring buffer. The rings
+ * are dumped on demand as Chrome trace JSON, which chrome://tracing,
+ * Perfetto and speedscope open as a timeline or flame graph.
+ *
+ * An unsampled request costs one call and one branch per stage and touches
+ * no shared memory; with tracing off there is no trace_t at all and every
+ * thread's handle is NULL.
+ *
+ */
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_RING_SIZE 1024 // Sampled requests kept per thread (2^10)
+
+/**
+ * @enum trace_stage
+ * @brief The stages of a request, in the order they happen.
+ */
+typedef enum trace_stage
+{
+    TRACE_STAGE_ACCEPT = 0, // Connection accepted (first request only)
+    TRACE_STAGE_READ,       // Reading and parsing the request
+    TRACE_STAGE_QUEUE,      // Waiting on the work queue
+    TRACE_STAGE_COMPUTE,    // Computing the result
+    TRACE_STAGE_WRITE,      // Writing the reply
+    TRACE_STAGE_COUNT,      // Number of stages
+} trace_stage_t;
+
+/**
+ * @struct trace_span
+ * @brief The stage timestamps of one request.
+ *
+ * Travels with the request, so stages may be stamped on different threads.
+ * A stamp of 0 means the stage was skipped (e.g. accept on a kept-alive
+ * connection).
+ */
+typedef struct trace_span
+{
+    bool     sampled;                       // Whether the request is traced
+    uint64_t stamps[TRACE_STAGE_COUNT + 1]; // Stage starts, then the end
+} trace_span_t;
+
+typedef struct trace        trace_t;
+typedef struct trace_thread trace_thread_t;
+
+/**
+ * @brief Creates a tracer sampling one request in 'sample_every'.
+ *
+ * @param max_threads The largest number of threads that may register.
+ * @param sample_every N of '--trace-sample=1/N'; 1 traces every request.
+ * @return trace_t * - The tracer, or NULL on failure.
+ */
+trace_t * trace_create(size_t max_threads, uint32_t sample_every);
+
+/**
+ * @brief Frees a tracer and sets the caller's pointer to NULL.
+ *
+ * @param trace_pp The address of the tracer pointer.
+ */
+void trace_destroy(trace_t ** trace_pp);
+
+/**
+ * @brief Claims a ring for the calling thread.
+ *
+ * Called once per thread at start-up, not on the request path.
+ *
+ * @param trace_p The tracer, or NULL when tracing is off.
+ * @return trace_thread_t * - The thread's handle, or NULL if tracing is off
+ * or every ring has been claimed.
+ */
+trace_thread_t * trace_register_thread(trace_t * trace_p);
+
+/**
+ * @brief Reads the cycle counter the stamps are taken with.
+ *
+ * @return uint64_t - The counter, or monotonic nanoseconds where the CPU
+ * has no usable counter.
+ */
+uint64_t trace_now(void);
+
+/**
+ * @brief Starts the span of a new request, deciding whether to sample it.
+ *
+ * @param thread_p The calling thread's handle; NULL never samples.
+ * @param span_p The request's span.
+ */
+void trace_begin(trace_thread_t * thread_p, trace_span_t * span_p);
+
+/**
+ * @brief Stamps the start of a stage of a sampled request, now.
+ *
+ * @param span_p The request's span.
+ * @param stage The stage starting.
+ */
+void trace_mark(trace_span_t * span_p, trace_stage_t stage);
+
+/**
+ * @brief Stamps the start of a stage with an earlier trace_now() reading.
+ *
+ * Used for the accept stage, whose start is known before the request is.
+ *
+ * @param span_p The request's span.
+ * @param stage The stage.
+ * @param stamp The trace_now() reading.
+ */
+void trace_mark_at(trace_span_t * span_p, trace_stage_t stage, uint64_t stamp);
+
+/**
+ * @brief Ends a sampled request and records it in the calling thread's ring.
+ *
+ * The oldest request in the ring is overwritten once it is full.
+ *
+ * @param thread_p The calling thread's handle.
+ * @param span_p The request's span.
+ */
+void trace_end(trace_thread_t * thread_p, const trace_span_t * span_p);
+
+/**
+ * @brief Writes every recorded request as Chrome trace JSON.
+ *
+ * Each stage becomes a complete ("X") event in microseconds, on the track
+ * of the thread that finished the request. May be called from any thread
+ * while requests are being recorded (e.g. one woken by SIGUSR2, but not
+ * from the signal handler itself); a request being overwritten during the
+ * dump is left out rather than printed torn.
+ *
+ * @param trace_p The tracer.
+ * @param stream_p The stream to write to.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int trace_dump(trace_t * trace_p, FILE * stream_p);
+
+#endif /* _TRACE_H */
+/*** end of file ***/
@@ -0,0 +1,446 @@
+/**
+ * @file trace.c
+ * @brief Sampled Per-Stage Request Tracing
+ *
+ * This file implements the sampling decision, the per-thread rings and the
+ * Chrome trace dump. A ring is written only by its owner: the stamps of a
+ * request are stored with relaxed atomics and the ring's head is published
+ * with a release store. The dump copies a ring and then re-reads its head;
+ * any request the owner may have started overwriting in the meantime is
+ * dropped, so nothing is ever locked on the recording side.
+ *
+ * Stamps are raw cycle counts. They are converted to microseconds at dump
+ * time from the counts and monotonic clock readings taken when the tracer
+ * was created and when it is dumped, which needs no calibration delay at
+ * start-up.
+ */
+#define _GNU_SOURCE // for clock_gettime()
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h> // __rdtsc
+#endif
+
+#include "trace.h"
+#include "utilities.h"
+
+#define CACHE_LINE_SIZE  64 // Assumed size of a CPU cache line
+#define TRACE_RING_MASK  (TRACE_RING_SIZE - 1)
+#define MAX_SAMPLE_EVERY 1000000 // Largest N of '--trace-sample=1/N'
+#define TRACE_PID        1       // Process id shown in the dump
+
+/**
+ * @struct trace_record
+ * @brief One sampled request in a ring.
+ */
+typedef struct trace_record
+{
+    atomic_uint_least64_t stamps[TRACE_STAGE_COUNT + 1]; // As in the span
+} trace_record_t;
+
+/**
+ * @struct trace_thread
+ * @brief One thread's sampling state and ring, written only by that thread.
+ *
+ * Aligned so that no two threads' heads share a cache line.
+ */
+struct trace_thread
+{
+    alignas(CACHE_LINE_SIZE) atomic_uint_least64_t head; // Records written
+    uint32_t         countdown;    // Requests until the next sample
+    uint32_t         sample_every; // N of '--trace-sample=1/N'
+    trace_record_t * ring_p;       // TRACE_RING_SIZE records
+};
+
+/**
+ * @struct trace
+ * @brief Every thread's ring plus the clock readings for the dump.
+ */
+struct trace
+{
+    trace_thread_t * threads_p;   // 'max_threads' slots
+    trace_record_t * records_p;   // Every ring, one allocation
+    size_t           max_threads; // Number of slots
+    atomic_size_t    registered;  // Slots claimed so far
+    uint64_t         start_stamp; // trace_now() at creation
+    uint64_t         start_ns;    // Monotonic clock at creation
+};
+
+// Event names of the stages, as shown in the dump
+static const char * const g_stage_names[TRACE_STAGE_COUNT] = {
+    "accept", "read", "queue", "compute", "write",
+};
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Returns the monotonic clock in nanoseconds.
+ *
+ * @return The current time.
+ */
+static uint64_t monotonic_ns(void);
+
+/**
+ * @brief Copies the ring of one thread, keeping only untorn requests.
+ *
+ * @param thread_p The thread.
+ * @param copy_p Array of TRACE_RING_SIZE records receiving the copies.
+ * @param first_p Pointer to where the sequence number of the first request
+ * copied is stored.
+ * @return The number of requests copied.
+ */
+static size_t copy_ring(trace_thread_t * thread_p,
+                        uint64_t (*copy_p)[TRACE_STAGE_COUNT + 1],
+                        uint64_t *       first_p);
+
+/**
+ * @brief Writes the stage events of one request.
+ *
+ * @param stream_p The stream to write to.
+ * @param stamps_p The request's stamps.
+ * @param thread The track the request is shown on.
+ * @param request The request's sequence number on that track.
+ * @param start_stamp The stamp shown as time zero.
+ * @param ticks_per_us Stamps per microsecond.
+ * @param first_p Whether no event has been written yet; cleared once one is.
+ */
+static void print_request(FILE *           stream_p,
+                          const uint64_t * stamps_p,
+                          size_t           thread,
+                          uint64_t         request,
+                          uint64_t         start_stamp,
+                          double           ticks_per_us,
+                          bool *           first_p);
+
+// +---------------------------------------------------------------------------+
+// |                                TRACE API                                  |
+// +---------------------------------------------------------------------------+
+
+trace_t * trace_create(size_t max_threads, uint32_t sample_every)
+{
+    trace_t * trace_p = NULL;
+
+    if ((0 == max_threads) || (0 == sample_every) ||
+        (MAX_SAMPLE_EVERY < sample_every))
+    {
+        print_error("trace_create(): Invalid argument passed.");
+        goto END;
+    }
+
+    trace_p = calloc(1, sizeof(trace_t));
+    if (NULL == trace_p)
+    {
+        print_error("trace_create(): calloc() failed.");
+        goto END;
+    }
+
+    trace_p->threads_p =
+        aligned_alloc(CACHE_LINE_SIZE, max_threads * sizeof(trace_thread_t));
+    trace_p->records_p =
+        calloc(max_threads * TRACE_RING_SIZE, sizeof(trace_record_t));
+    if ((NULL == trace_p->threads_p) || (NULL == trace_p->records_p))
+    {
+        print_error("trace_create(): Unable to allocate the rings.");
+        trace_destroy(&trace_p);
+        goto END;
+    }
+
+    for (size_t idx = 0; idx < max_threads; idx++)
+    {
+        trace_thread_t * thread_p = &trace_p->threads_p[idx];
+
+        atomic_init(&thread_p->head, 0);
+        thread_p->sample_every = sample_every;
+        // Stagger the threads so that they do not all sample in step
+        thread_p->countdown = (uint32_t)(idx % sample_every) + 1;
+        thread_p->ring_p    = &trace_p->records_p[idx * TRACE_RING_SIZE];
+    }
+
+    trace_p->max_threads = max_threads;
+    trace_p->start_stamp = trace_now();
+    trace_p->start_ns    = monotonic_ns();
+    atomic_init(&trace_p->registered, 0);
+
+END:
+    return trace_p;
+}
+
+void trace_destroy(trace_t ** trace_pp)
+{
+    if ((NULL == trace_pp) || (NULL == *trace_pp))
+    {
+        return;
+    }
+
+    free((*trace_pp)->threads_p);
+    free((*trace_pp)->records_p);
+    free(*trace_pp);
+    *trace_pp = NULL;
+}
+
+trace_thread_t * trace_register_thread(trace_t * trace_p)
+{
+    size_t slot = 0;
+
+    if (NULL == trace_p)
+    {
+        return NULL;
+    }
+
+    slot = atomic_fetch_add(&trace_p->registered, 1);
+    if (slot >= trace_p->max_threads)
+    {
+        print_error("trace_register_thread(): Every ring is claimed.");
+        return NULL;
+    }
+
+    return &trace_p->threads_p[slot];
+}
+
+uint64_t trace_now(void)
+{
+#if defined(__x86_64__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value = 0;
+
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return monotonic_ns();
+#endif
+}
+
+void trace_begin(trace_thread_t * thread_p, trace_span_t * span_p)
+{
+    span_p->sampled = false;
+
+    if ((NULL == thread_p) || (0 != --thread_p->countdown))
+    {
+        return;
+    }
+
+    thread_p->countdown = thread_p->sample_every;
+    memset(span_p->stamps, 0, sizeof(span_p->stamps));
+    span_p->sampled = true;
+}
+
+void trace_mark(trace_span_t * span_p, trace_stage_t stage)
+{
+    if (true == span_p->sampled)
+    {
+        span_p->stamps[stage] = trace_now();
+    }
+}
+
+void trace_mark_at(trace_span_t * span_p, trace_stage_t stage, uint64_t stamp)
+{
+    if (true == span_p->sampled)
+    {
+        span_p->stamps[stage] = stamp;
+    }
+}
+
+void trace_end(trace_thread_t * thread_p, const trace_span_t * span_p)
+{
+    uint64_t         head     = 0;
+    trace_record_t * record_p = NULL;
+
+    if ((NULL == thread_p) || (false == span_p->sampled))
+    {
+        return;
+    }
+
+    head     = atomic_load_explicit(&thread_p->head, memory_order_relaxed);
+    record_p = &thread_p->ring_p[head & TRACE_RING_MASK];
+
+    for (size_t idx = 0; idx < TRACE_STAGE_COUNT; idx++)
+    {
+        atomic_store_explicit(
+            &record_p->stamps[idx], span_p->stamps[idx], memory_order_relaxed);
+    }
+    atomic_store_explicit(&record_p->stamps[TRACE_STAGE_COUNT],
+                          trace_now(),
+                          memory_order_relaxed);
+
+    atomic_store_explicit(&thread_p->head, head + 1, memory_order_release);
+}
+
+int trace_dump(trace_t * trace_p, FILE * stream_p)
+{
+    int      exit_code    = E_FAILURE;
+    bool     first        = true;
+    size_t   threads      = 0;
+    size_t   copied       = 0;
+    uint64_t first_seq    = 0;
+    uint64_t elapsed_ns   = 0;
+    double   ticks_per_us = 1000.0;
+    uint64_t (*copy_p)[TRACE_STAGE_COUNT + 1] = NULL;
+
+    if ((NULL == trace_p) || (NULL == stream_p))
+    {
+        print_error("trace_dump(): NULL argument passed.");
+        goto END;
+    }
+
+    copy_p = malloc(TRACE_RING_SIZE * sizeof(*copy_p));
+    if (NULL == copy_p)
+    {
+        print_error("trace_dump(): malloc() failed.");
+        goto END;
+    }
+
+    elapsed_ns = monotonic_ns() - trace_p->start_ns;
+    if (0 < elapsed_ns)
+    {
+        ticks_per_us = (double)(trace_now() - trace_p->start_stamp) * 1000.0 /
+                       (double)elapsed_ns;
+    }
+
+    threads = atomic_load(&trace_p->registered);
+    if (threads > trace_p->max_threads)
+    {
+        threads = trace_p->max_threads;
+    }
+
+    fprintf(stream_p, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    for (size_t thread = 0; thread < threads; thread++)
+    {
+        fprintf(stream_p,
+                "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"tid\":%zu,\"args\":{\"name\":\"thread %zu\"}}",
+                (true == first) ? "" : ",",
+                TRACE_PID,
+                thread,
+                thread);
+        first = false;
+
+        copied = copy_ring(&trace_p->threads_p[thread], copy_p, &first_seq);
+        for (size_t idx = 0; idx < copied; idx++)
+        {
+            print_request(stream_p,
+                          copy_p[idx],
+                          thread,
+                          first_seq + idx,
+                          trace_p->start_stamp,
+                          ticks_per_us,
+                          &first);
+        }
+    }
+
+    fprintf(stream_p, "\n]}\n");
+
+    exit_code = (0 == ferror(stream_p)) ? E_SUCCESS : E_FAILURE;
+END:
+    free(copy_p);
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+static size_t copy_ring(trace_thread_t * thread_p,
+                        uint64_t (*copy_p)[TRACE_STAGE_COUNT + 1],
+                        uint64_t *       first_p)
+{
+    uint64_t head  = 0;
+    uint64_t first = 0;
+    uint64_t after = 0;
+
+    head  = atomic_load_explicit(&thread_p->head, memory_order_acquire);
+    first = (head > TRACE_RING_SIZE) ? (head - TRACE_RING_SIZE) : 0;
+
+    for (uint64_t seq = first; seq < head; seq++)
+    {
+        trace_record_t * record_p = &thread_p->ring_p[seq & TRACE_RING_MASK];
+
+        for (size_t idx = 0; idx <= TRACE_STAGE_COUNT; idx++)
+        {
+            copy_p[seq - first][idx] = atomic_load_explicit(
+                &record_p->stamps[idx], memory_order_relaxed);
+        }
+    }
+
+    // Requests the owner may have begun overwriting since the copy started
+    // are the oldest ones: drop them
+    atomic_thread_fence(memory_order_acquire);
+    after = atomic_load_explicit(&thread_p->head, memory_order_relaxed);
+    if (after >= first + TRACE_RING_SIZE)
+    {
+        size_t torn = (size_t)(after + 1 - TRACE_RING_SIZE - first);
+
+        if (torn >= head - first)
+        {
+            *first_p = head;
+            return 0;
+        }
+
+        memmove(copy_p, copy_p + torn, (head - first - torn) * sizeof(*copy_p));
+        first += torn;
+    }
+
+    *first_p = first;
+    return (size_t)(head - first);
+}
+
+static void print_request(FILE *           stream_p,
+                          const uint64_t * stamps_p,
+                          size_t           thread,
+                          uint64_t         request,
+                          uint64_t         start_stamp,
+                          double           ticks_per_us,
+                          bool *           first_p)
+{
+    size_t next = 0;
+    double ts   = 0.0;
+    double dur  = 0.0;
+
+    for (size_t stage = 0; stage < TRACE_STAGE_COUNT; stage++)
+    {
+        if (0 == stamps_p[stage])
+        {
+            continue;
+        }
+
+        // A stage lasts until the next one that was stamped
+        for (next = stage + 1; 0 == stamps_p[next]; next++)
+        {
+        }
+
+        ts  = (double)(int64_t)(stamps_p[stage] - start_stamp) / ticks_per_us;
+        dur = (stamps_p[next] > stamps_p[stage])
+                  ? (double)(stamps_p[next] - stamps_p[stage]) / ticks_per_us
+                  : 0.0;
+
+        fprintf(stream_p,
+                "%s\n{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"X\","
+                "\"pid\":%d,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f,"
+                "\"args\":{\"request\":%llu}}",
+                (true == *first_p) ? "" : ",",
+                g_stage_names[stage],
+                TRACE_PID,
+                thread,
+                ts,
+                dur,
+                (unsigned long long)request);
+        *first_p = false;
+    }
+}
+
+/*** end of file ***/
@@ -0,0 +1,99 @@
+/**
+ * @file wire_protocol.h
+ * @brief Header for the NetCalc Binary Wire Protocol
+ *
+ * This header file provides the frame format and codec used when NetCalc runs
+ * with '--protocol binary'. Every frame is a fixed 12 byte header followed by
+ * 'length' bytes of payload. All header fields are in network byte order:
+ *
+ *   0       2       3       4               8              12
+ *   +-------+-------+-------+---------------+---------------+----------
+ *   | magic |version| type  |  request id   |    length     | payload...
+ *   +-------+-------+-------+---------------+---------------+----------
+ *
+ * Clients may pipeline any number of frames on a connection. Each reply
+ * carries the request id of the frame it answers, so replies may be sent in
+ * any order.
+ *
+ */
+#ifndef _WIRE_PROTOCOL_H
+#define _WIRE_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WIRE_MAGIC            0x4E43 // "NC"
+#define WIRE_VERSION          1      // Current protocol version
+#define WIRE_HEADER_SIZE      12     // Size of the fixed frame header
+#define WIRE_MAX_PAYLOAD_SIZE 65536  // Largest payload accepted
+
+/**
+ * @struct wire_frame
+ * @brief A decoded frame.
+ *
+ * 'payload_p' points into the buffer the frame was decoded from; nothing is
+ * copied, so it is only valid while that buffer is.
+ */
+typedef struct wire_frame
+{
+    uint8_t         type;       // Operation (requests) or status (replies)
+    uint32_t        request_id; // Client chosen id, echoed in the reply
+    uint32_t        length;     // Number of payload bytes
+    const uint8_t * payload_p;  // Payload, inside the receive buffer
+} wire_frame_t;
+
+/**
+ * @enum wire_reply_status
+ * @brief Values of 'type' in reply frames.
+ */
+typedef enum wire_reply_status
+{
+    WIRE_REPLY_OK = 0, // The payload holds the result
+    WIRE_REPLY_BUSY,   // Not computed: the server is overloaded, retry later
+} wire_reply_status_t;
+
+/**
+ * @enum wire_status
+ * @brief Result of decoding a frame from a receive buffer.
+ */
+typedef enum wire_status
+{
+    WIRE_FRAME_OK = 0,     // A complete frame was decoded
+    WIRE_FRAME_INCOMPLETE, // More bytes are needed; keep reading
+    WIRE_FRAME_INVALID,    // Bad magic, version or length; drop connection
+} wire_status_t;
+
+/**
+ * @brief Decodes the frame at the start of a receive buffer.
+ *
+ * @param buffer_p The received bytes.
+ * @param buffer_len The number of received bytes.
+ * @param frame_p Pointer to where the decoded frame is stored.
+ * @param consumed_p Pointer to where the frame's total size (header plus
+ * payload) is stored, so the caller can advance to the next pipelined frame.
+ * @return wire_status_t - The decoding result.
+ */
+wire_status_t wire_decode_frame(const uint8_t * buffer_p,
+                                size_t          buffer_len,
+                                wire_frame_t *  frame_p,
+                                size_t *        consumed_p);
+
+/**
+ * @brief Writes a frame header into a buffer.
+ *
+ * The payload is written separately (typically as the next iovec of a
+ * vectored write), so large replies are never copied to prepend the header.
+ *
+ * @param buffer_p Buffer of at least WIRE_HEADER_SIZE bytes.
+ * @param type The operation or status.
+ * @param request_id The request id the frame answers.
+ * @param length The number of payload bytes that will follow.
+ * @return int - Returns E_SUCCESS on success, otherwise E_FAILURE.
+ */
+int wire_encode_header(uint8_t * buffer_p,
+                       uint8_t   type,
+                       uint32_t  request_id,
+                       uint32_t  length);
+
+#endif /* _WIRE_PROTOCOL_H */
+/*** end of file ***/
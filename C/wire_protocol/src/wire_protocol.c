@@ -0,0 +1,105 @@
+/**
+ * @file wire_protocol.c
+ * @brief NetCalc Binary Wire Protocol Codec
+ *
+ * This file contains the frame encoder and decoder for the binary protocol.
+ * Decoding works directly on the receive buffer: the header is read with
+ * memcpy() (the buffer need not be aligned) and the payload is returned as a
+ * pointer into the buffer.
+ */
+#include <arpa/inet.h> // htonl, ntohl, htons, ntohs
+#include <string.h>
+
+#include "utilities.h"
+#include "wire_protocol.h"
+
+#define OFFSET_MAGIC      0 // Offset of the magic number
+#define OFFSET_VERSION    2 // Offset of the version
+#define OFFSET_TYPE       3 // Offset of the type
+#define OFFSET_REQUEST_ID 4 // Offset of the request id
+#define OFFSET_LENGTH     8 // Offset of the payload length
+
+// +---------------------------------------------------------------------------+
+// |                            WIRE PROTOCOL API                              |
+// +---------------------------------------------------------------------------+
+
+wire_status_t wire_decode_frame(const uint8_t * buffer_p,
+                                size_t          buffer_len,
+                                wire_frame_t *  frame_p,
+                                size_t *        consumed_p)
+{
+    uint16_t magic      = 0;
+    uint32_t request_id = 0;
+    uint32_t length     = 0;
+
+    if ((NULL == buffer_p) || (NULL == frame_p) || (NULL == consumed_p))
+    {
+        return WIRE_FRAME_INVALID;
+    }
+
+    if (WIRE_HEADER_SIZE > buffer_len)
+    {
+        return WIRE_FRAME_INCOMPLETE;
+    }
+
+    memcpy(&magic, buffer_p + OFFSET_MAGIC, sizeof(magic));
+    memcpy(&request_id, buffer_p + OFFSET_REQUEST_ID, sizeof(request_id));
+    memcpy(&length, buffer_p + OFFSET_LENGTH, sizeof(length));
+    length = ntohl(length);
+
+    if ((WIRE_MAGIC != ntohs(magic)) ||
+        (WIRE_VERSION != buffer_p[OFFSET_VERSION]) ||
+        (WIRE_MAX_PAYLOAD_SIZE < length))
+    {
+        return WIRE_FRAME_INVALID;
+    }
+
+    if ((buffer_len - WIRE_HEADER_SIZE) < length)
+    {
+        return WIRE_FRAME_INCOMPLETE;
+    }
+
+    frame_p->type       = buffer_p[OFFSET_TYPE];
+    frame_p->request_id = ntohl(request_id);
+    frame_p->length     = length;
+    frame_p->payload_p  = buffer_p + WIRE_HEADER_SIZE;
+
+    *consumed_p = WIRE_HEADER_SIZE + (size_t)length;
+    return WIRE_FRAME_OK;
+}
+
+int wire_encode_header(uint8_t * buffer_p,
+                       uint8_t   type,
+                       uint32_t  request_id,
+                       uint32_t  length)
+{
+    int      exit_code = E_FAILURE;
+    uint16_t magic     = htons(WIRE_MAGIC);
+
+    if (NULL == buffer_p)
+    {
+        print_error("wire_encode_header(): NULL argument passed.");
+        goto END;
+    }
+
+    if (WIRE_MAX_PAYLOAD_SIZE < length)
+    {
+        print_error("wire_encode_header(): Payload too large.");
+        goto END;
+    }
+
+    request_id = htonl(request_id);
+    length     = htonl(length);
+
+    memcpy(buffer_p + OFFSET_MAGIC, &magic, sizeof(magic));
+    buffer_p[OFFSET_VERSION] = WIRE_VERSION;
+    buffer_p[OFFSET_TYPE]    = type;
+    memcpy(buffer_p + OFFSET_REQUEST_ID, &request_id, sizeof(request_id));
+    memcpy(buffer_p + OFFSET_LENGTH, &length, sizeof(length));
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+/*** end of file ***/
@@ -0,0 +1,78 @@
+/**
+ * @file ws_deque.h
+ * @brief Header for the Work-Stealing Deque
+ *
+ * This header file provides the interface for the per-worker deque used by
+ * the '--scheduler work-stealing' mode. The owning worker pushes and pops at
+ * the bottom; idle workers steal from the top.
+ *
+ */
+#ifndef _WS_DEQUE_H
+#define _WS_DEQUE_H
+
+#include <stddef.h>
+
+/**
+ * @struct ws_deque
+ * @brief Opaque work-stealing deque handle.
+ */
+typedef struct ws_deque ws_deque_t;
+
+/**
+ * @brief Result of a steal attempt.
+ */
+typedef enum ws_steal_result
+{
+    WS_STEAL_SUCCESS = 0, // An item was stolen
+    WS_STEAL_EMPTY,       // The deque was empty
+    WS_STEAL_ABORT,       // Lost a race with another thread; may retry
+} ws_steal_result_t;
+
+/**
+ * @brief Creates a deque holding at least 'capacity' items.
+ *
+ * The capacity is rounded up to the next power of two.
+ *
+ * @param capacity The minimum number of items the deque can hold (>= 2).
+ * @return ws_deque_t * - The new deque, or NULL on failure.
+ */
+ws_deque_t * ws_deque_create(size_t capacity);
+
+/**
+ * @brief Destroys a deque and sets the caller's pointer to NULL.
+ *
+ * @param deque_pp The address of the deque pointer.
+ */
+void ws_deque_destroy(ws_deque_t ** deque_pp);
+
+/**
+ * @brief Pushes an item onto the bottom of the deque. Owner thread only.
+ *
+ * @param deque_p The deque.
+ * @param item_p The item to push. May not be NULL.
+ * @return int - Returns E_SUCCESS on success, E_FAILURE if the deque is full;
+ * the caller should then fall back to the shared queue.
+ */
+int ws_deque_push(ws_deque_t * deque_p, void * item_p);
+
+/**
+ * @brief Pops the most recently pushed item. Owner thread only.
+ *
+ * @param deque_p The deque.
+ * @param item_pp Pointer to where the popped item is stored; left unchanged
+ * on failure.
+ * @return int - Returns E_SUCCESS on success, E_FAILURE if the deque is empty.
+ */
+int ws_deque_pop(ws_deque_t * deque_p, void ** item_pp);
+
+/**
+ * @brief Steals the oldest item from the deque. Callable from any thread.
+ *
+ * @param deque_p The deque to steal from.
+ * @param item_pp Pointer to where the stolen item is stored.
+ * @return ws_steal_result_t - The outcome of the attempt.
+ */
+ws_steal_result_t ws_deque_steal(ws_deque_t * deque_p, void ** item_pp);
+
+#endif /* _WS_DEQUE_H */
+/*** end of file ***/
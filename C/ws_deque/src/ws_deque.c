@@ -0,0 +1,203 @@
+/**
+ * @file ws_deque.c
+ * @brief Bounded Chase-Lev Work-Stealing Deque
+ *
+ * This file implements the Chase-Lev deque using the C11 memory orderings
+ * from Le, Pop, Cohen and Zappa Nardelli, "Correct and Efficient
+ * Work-Stealing for Weak Memory Models" (PPoPP 2013). The buffer has a fixed
+ * size; a full deque is reported to the owner instead of being grown, which
+ * keeps the hot path free of allocation.
+ */
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "utilities.h"
+#include "ws_deque.h"
+
+#define CACHE_LINE_SIZE 64 // Assumed size of a CPU cache line
+#define MIN_DEQUE_SLOTS 2  // Smallest capacity supported
+
+struct ws_deque
+{
+    alignas(CACHE_LINE_SIZE) atomic_llong top;    // Next index thieves take
+    alignas(CACHE_LINE_SIZE) atomic_llong bottom; // Next index owner fills
+    alignas(CACHE_LINE_SIZE) long long mask;      // capacity - 1
+    _Atomic(void *) * buffer_p;                   // The ring buffer
+};
+
+// +---------------------------------------------------------------------------+
+// |                               WS DEQUE API                                |
+// +---------------------------------------------------------------------------+
+
+ws_deque_t * ws_deque_create(size_t capacity)
+{
+    ws_deque_t * deque_p = NULL;
+    size_t       slots   = 1;
+
+    if ((MIN_DEQUE_SLOTS > capacity) || ((SIZE_MAX / 2) < capacity))
+    {
+        print_error("ws_deque_create(): Invalid capacity.");
+        goto END;
+    }
+
+    while (slots < capacity)
+    {
+        slots <<= 1;
+    }
+
+    deque_p = aligned_alloc(CACHE_LINE_SIZE, sizeof(*deque_p));
+    if (NULL == deque_p)
+    {
+        print_error("ws_deque_create(): aligned_alloc() failed.");
+        goto END;
+    }
+
+    deque_p->buffer_p = calloc(slots, sizeof(*deque_p->buffer_p));
+    if (NULL == deque_p->buffer_p)
+    {
+        print_error("ws_deque_create(): calloc() failed.");
+        free(deque_p);
+        deque_p = NULL;
+        goto END;
+    }
+
+    atomic_init(&deque_p->top, 0);
+    atomic_init(&deque_p->bottom, 0);
+    deque_p->mask = (long long)slots - 1;
+
+END:
+    return deque_p;
+}
+
+void ws_deque_destroy(ws_deque_t ** deque_pp)
+{
+    if ((NULL == deque_pp) || (NULL == *deque_pp))
+    {
+        return;
+    }
+
+    free((void *)(*deque_pp)->buffer_p);
+    free(*deque_pp);
+    *deque_pp = NULL;
+}
+
+int ws_deque_push(ws_deque_t * deque_p, void * item_p)
+{
+    int       exit_code = E_FAILURE;
+    long long bottom    = 0;
+    long long top       = 0;
+
+    if ((NULL == deque_p) || (NULL == item_p))
+    {
+        goto END;
+    }
+
+    bottom = atomic_load_explicit(&deque_p->bottom, memory_order_relaxed);
+    top    = atomic_load_explicit(&deque_p->top, memory_order_acquire);
+    if (deque_p->mask < (bottom - top))
+    {
+        goto END;
+    }
+
+    atomic_store_explicit(&deque_p->buffer_p[bottom & deque_p->mask],
+                          item_p,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque_p->bottom, bottom + 1, memory_order_relaxed);
+
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+int ws_deque_pop(ws_deque_t * deque_p, void ** item_pp)
+{
+    int       exit_code = E_FAILURE;
+    long long bottom    = 0;
+    long long top       = 0;
+    long long expected  = 0;
+    void *    item_p    = NULL;
+
+    if ((NULL == deque_p) || (NULL == item_pp))
+    {
+        goto END;
+    }
+
+    bottom = atomic_load_explicit(&deque_p->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque_p->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    top = atomic_load_explicit(&deque_p->top, memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        // Empty: undo the reservation
+        atomic_store_explicit(
+            &deque_p->bottom, bottom + 1, memory_order_relaxed);
+        goto END;
+    }
+
+    item_p = atomic_load_explicit(&deque_p->buffer_p[bottom & deque_p->mask],
+                                  memory_order_relaxed);
+
+    if (top == bottom)
+    {
+        // Last item: race any thief for it through 'top'
+        expected = top;
+        if (!atomic_compare_exchange_strong_explicit(&deque_p->top,
+                                                     &expected,
+                                                     top + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed))
+        {
+            atomic_store_explicit(
+                &deque_p->bottom, bottom + 1, memory_order_relaxed);
+            goto END;
+        }
+        atomic_store_explicit(
+            &deque_p->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    *item_pp  = item_p;
+    exit_code = E_SUCCESS;
+END:
+    return exit_code;
+}
+
+ws_steal_result_t ws_deque_steal(ws_deque_t * deque_p, void ** item_pp)
+{
+    long long top    = 0;
+    long long bottom = 0;
+    void *    item_p = NULL;
+
+    if ((NULL == deque_p) || (NULL == item_pp))
+    {
+        return WS_STEAL_EMPTY;
+    }
+
+    top = atomic_load_explicit(&deque_p->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    bottom = atomic_load_explicit(&deque_p->bottom, memory_order_acquire);
+
+    if (top >= bottom)
+    {
+        return WS_STEAL_EMPTY;
+    }
+
+    item_p = atomic_load_explicit(&deque_p->buffer_p[top & deque_p->mask],
+                                  memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque_p->top,
+                                                 &top,
+                                                 top + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed))
+    {
+        return WS_STEAL_ABORT;
+    }
+
+    *item_pp = item_p;
+    return WS_STEAL_SUCCESS;
+}
+
+/*** end of file ***/
@@ -0,0 +1,379 @@
+/**
+ * @file test_ws_deque.c
+ * @brief Tests for the Work-Stealing Deque
+ *
+ * Single-threaded checks of the owner's LIFO end, the thieves' FIFO end and
+ * the full and empty cases, followed by two races: thieves stealing while
+ * the owner pushes and pops in bursts, and thieves racing the owner for the
+ * last item of the deque over and over. In both, every item must be taken
+ * exactly once, and each thief must steal items in the order they were
+ * pushed. Build with -fsanitize=thread to check the memory ordering as well.
+ *
+ * Usage: test-ws-deque
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "utilities.h"
+#include "ws_deque.h"
+
+#define RACE_THIEVES 3       // Stealing threads
+#define RACE_ITEMS   1000000 // Items pushed by the owner in each race
+#define RACE_DEPTH   256     // Deque capacity
+#define RACE_BURST   32      // Largest run of pushes between pops
+
+// Items are encoded as pointers; +1 keeps item 0 non-NULL
+#define ITEM_ENCODE(seq) ((void *)(uintptr_t)((uint64_t)(seq) + 1))
+#define ITEM_SEQ(item_p) (((uint64_t)(uintptr_t)(item_p)) - 1)
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr,                                                    \
+                    "%s:%d: CHECK(%s) failed\n",                               \
+                    __FILE__,                                                  \
+                    __LINE__,                                                  \
+                    #condition);                                               \
+            goto END;                                                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * @struct race
+ * @brief State shared by the owner and thieves of one race.
+ */
+typedef struct race
+{
+    ws_deque_t *  deque_p; // The deque under test
+    atomic_bool   done;    // The owner has taken or seen taken every item
+    atomic_bool   failed;  // A thief stole out of order
+    atomic_size_t taken;   // Items popped or stolen so far
+    // How often each item was taken
+    atomic_uchar  seen[RACE_ITEMS];
+} race_t;
+
+/**
+ * @struct test_case
+ * @brief One named test.
+ */
+typedef struct test_case
+{
+    const char * name_p; // Printed with the result
+    int (*run)(void);    // Returns E_SUCCESS if the test passed
+} test_case_t;
+
+//
+// -----------------------------UTILITY FUNCTIONS-----------------------------
+//
+
+/**
+ * @brief Checks that the owner pops newest first and thieves steal oldest.
+ */
+static int test_order(void);
+
+/**
+ * @brief Checks the full and empty cases and invalid arguments.
+ */
+static int test_limits(void);
+
+/**
+ * @brief Thieves steal while the owner pushes and pops in bursts.
+ */
+static int test_steal_race(void);
+
+/**
+ * @brief Thieves and the owner race for a single item, RACE_ITEMS times.
+ */
+static int test_last_item_race(void);
+
+/**
+ * @brief Runs one race with RACE_THIEVES thieves.
+ *
+ * @param burst The largest run of pushes between pops; 1 leaves at most one
+ * item in the deque, so every pop races the thieves for the last item.
+ * @return E_SUCCESS if every item was taken exactly once, in order by each
+ * thief.
+ */
+static int run_race(size_t burst);
+
+/**
+ * @brief Steals until the owner is done.
+ *
+ * @param arg_p The race_t.
+ * @return NULL.
+ */
+static void * race_thief(void * arg_p);
+
+/**
+ * @brief Records one item taken by the owner or a thief.
+ *
+ * @param race_p Shared state.
+ * @param item_p The item.
+ */
+static void race_record(race_t * race_p, void * item_p);
+
+int main(void)
+{
+    static const test_case_t tests[] = {
+        { "order", test_order },
+        { "limits", test_limits },
+        { "steal-race", test_steal_race },
+        { "last-item-race", test_last_item_race },
+    };
+    int exit_code = E_SUCCESS;
+
+    for (size_t idx = 0; idx < sizeof(tests) / sizeof(tests[0]); idx++)
+    {
+        if (E_SUCCESS == tests[idx].run())
+        {
+            printf("PASS %s\n", tests[idx].name_p);
+        }
+        else
+        {
+            printf("FAIL %s\n", tests[idx].name_p);
+            exit_code = E_FAILURE;
+        }
+    }
+
+    return exit_code;
+}
+
+// *****************************************************************************
+//                          STATIC FUNCTION DEFINITIONS
+// *****************************************************************************
+
+static int test_order(void)
+{
+    int          exit_code = E_FAILURE;
+    ws_deque_t * deque_p   = NULL;
+    void *       item_p    = NULL;
+
+    deque_p = ws_deque_create(8);
+    CHECK(NULL != deque_p);
+
+    for (uint64_t seq = 0; seq < 4; seq++)
+    {
+        CHECK(E_SUCCESS == ws_deque_push(deque_p, ITEM_ENCODE(seq)));
+    }
+
+    CHECK(E_SUCCESS == ws_deque_pop(deque_p, &item_p));
+    CHECK(ITEM_ENCODE(3) == item_p);
+    CHECK(WS_STEAL_SUCCESS == ws_deque_steal(deque_p, &item_p));
+    CHECK(ITEM_ENCODE(0) == item_p);
+    CHECK(WS_STEAL_SUCCESS == ws_deque_steal(deque_p, &item_p));
+    CHECK(ITEM_ENCODE(1) == item_p);
+    CHECK(E_SUCCESS == ws_deque_pop(deque_p, &item_p));
+    CHECK(ITEM_ENCODE(2) == item_p);
+
+    item_p = NULL;
+    CHECK(E_FAILURE == ws_deque_pop(deque_p, &item_p));
+    CHECK(NULL == item_p);
+    CHECK(WS_STEAL_EMPTY == ws_deque_steal(deque_p, &item_p));
+
+    // Empty pops must leave the deque usable
+    CHECK(E_SUCCESS == ws_deque_push(deque_p, ITEM_ENCODE(4)));
+    CHECK(WS_STEAL_SUCCESS == ws_deque_steal(deque_p, &item_p));
+    CHECK(ITEM_ENCODE(4) == item_p);
+
+    exit_code = E_SUCCESS;
+END:
+    ws_deque_destroy(&deque_p);
+    return exit_code;
+}
+
+static int test_limits(void)
+{
+    int          exit_code = E_FAILURE;
+    ws_deque_t * deque_p   = NULL;
+    void *       item_p    = NULL;
+
+    CHECK(NULL == ws_deque_create(1));
+
+    deque_p = ws_deque_create(3);
+    CHECK(NULL != deque_p);
+
+    for (uint64_t seq = 0; seq < 4; seq++)
+    {
+        CHECK(E_SUCCESS == ws_deque_push(deque_p, ITEM_ENCODE(seq)));
+    }
+    CHECK(E_FAILURE == ws_deque_push(deque_p, ITEM_ENCODE(4)));
+
+    CHECK(WS_STEAL_SUCCESS == ws_deque_steal(deque_p, &item_p));
+    CHECK(E_SUCCESS == ws_deque_push(deque_p, ITEM_ENCODE(4)));
+
+    CHECK(E_FAILURE == ws_deque_push(deque_p, NULL));
+    CHECK(E_FAILURE == ws_deque_pop(NULL, &item_p));
+    CHECK(WS_STEAL_EMPTY == ws_deque_steal(NULL, &item_p));
+
+    ws_deque_destroy(&deque_p);
+    CHECK(NULL == deque_p);
+
+    exit_code = E_SUCCESS;
+END:
+    ws_deque_destroy(&deque_p);
+    return exit_code;
+}
+
+static int test_steal_race(void)
+{
+    return run_race(RACE_BURST);
+}
+
+static int test_last_item_race(void)
+{
+    return run_race(1);
+}
+
+static int run_race(size_t burst)
+{
+    int       exit_code = E_FAILURE;
+    race_t *  race_p    = NULL;
+    size_t    started   = 0;
+    uint64_t  next      = 0;
+    size_t    pushes    = 0;
+    void *    item_p    = NULL;
+    pthread_t thieves[RACE_THIEVES];
+
+    // Too large for the stack
+    race_p = calloc(1, sizeof(*race_p));
+    CHECK(NULL != race_p);
+    race_p->deque_p = ws_deque_create(RACE_DEPTH);
+    CHECK(NULL != race_p->deque_p);
+
+    for (; started < RACE_THIEVES; started++)
+    {
+        CHECK(0 ==
+              pthread_create(&thieves[started], NULL, race_thief, race_p));
+    }
+
+    while (next < RACE_ITEMS)
+    {
+        // A varying run of pushes, then pop about half of them back
+        pushes = (size_t)(next % burst) + 1;
+        for (size_t idx = 0; (idx < pushes) && (next < RACE_ITEMS); idx++)
+        {
+            if (E_SUCCESS != ws_deque_push(race_p->deque_p, ITEM_ENCODE(next)))
+            {
+                break;
+            }
+            next++;
+        }
+
+        for (size_t idx = 0; idx < (pushes + 1) / 2; idx++)
+        {
+            // A pop that loses the last item must leave 'item_p' alone
+            item_p = NULL;
+            if (E_SUCCESS == ws_deque_pop(race_p->deque_p, &item_p))
+            {
+                race_record(race_p, item_p);
+            }
+            else if (NULL != item_p)
+            {
+                atomic_store(&race_p->failed, true);
+            }
+        }
+    }
+
+    while (E_SUCCESS == ws_deque_pop(race_p->deque_p, &item_p))
+    {
+        race_record(race_p, item_p);
+    }
+
+    // A thief may still hold an item it is about to record
+    while (RACE_ITEMS > atomic_load(&race_p->taken))
+    {
+        sched_yield();
+    }
+
+    exit_code = E_SUCCESS;
+END:
+    if (NULL != race_p)
+    {
+        atomic_store(&race_p->done, true);
+    }
+    for (size_t idx = 0; idx < started; idx++)
+    {
+        pthread_join(thieves[idx], NULL);
+    }
+
+    if ((E_SUCCESS == exit_code) &&
+        ((true == atomic_load(&race_p->failed)) ||
+         (RACE_ITEMS != atomic_load(&race_p->taken))))
+    {
+        exit_code = E_FAILURE;
+    }
+
+    for (size_t seq = 0; (E_SUCCESS == exit_code) && (seq < RACE_ITEMS); seq++)
+    {
+        if (1 != atomic_load(&race_p->seen[seq]))
+        {
+            fprintf(stderr,
+                    "run_race(): item %zu taken %u times\n",
+                    seq,
+                    (unsigned)atomic_load(&race_p->seen[seq]));
+            exit_code = E_FAILURE;
+        }
+    }
+
+    if (NULL != race_p)
+    {
+        ws_deque_destroy(&race_p->deque_p);
+        free(race_p);
+    }
+    return exit_code;
+}
+
+static void * race_thief(void * arg_p)
+{
+    race_t *          race_p = arg_p;
+    void *            item_p = NULL;
+    uint64_t          next   = 0;
+    ws_steal_result_t result = WS_STEAL_EMPTY;
+
+    while (false == atomic_load(&race_p->done))
+    {
+        result = ws_deque_steal(race_p->deque_p, &item_p);
+        if (WS_STEAL_SUCCESS != result)
+        {
+            if (WS_STEAL_EMPTY == result)
+            {
+                sched_yield();
+            }
+            continue;
+        }
+
+        // The top only moves forward, so one thief sees rising items
+        if (ITEM_SEQ(item_p) < next)
+        {
+            atomic_store(&race_p->failed, true);
+        }
+        next = ITEM_SEQ(item_p) + 1;
+        race_record(race_p, item_p);
+    }
+
+    return NULL;
+}
+
+static void race_record(race_t * race_p, void * item_p)
+{
+    uint64_t seq = ITEM_SEQ(item_p);
+
+    // Counted even when invalid, so run_race() never waits for it
+    atomic_fetch_add(&race_p->taken, 1);
+    if (RACE_ITEMS <= seq)
+    {
+        atomic_store(&race_p->failed, true);
+        return;
+    }
+
+    atomic_fetch_add(&race_p->seen[seq], 1);
+}
+
+/*** end of file ***/